@@ -38,9 +38,9 @@
 (define-module rfc.sha
   (use gauche.uvector)
   (extend util.digest)
-  (export <sha1> sha1-digest sha1-digest-string
+  (export <sha1> sha1-digest sha1-digest-string sha1-digest-list
           <sha224> sha224-digest sha224-digest-string
-          <sha256> sha256-digest sha256-digest-string
+          <sha256> sha256-digest sha256-digest-string sha256-digest-list
           <sha384> sha384-digest sha384-digest-string
           <sha512> sha512-digest sha512-digest-string))
 (select-module rfc.sha)
@@ -70,11 +70,17 @@
 (define sha384-digest (gen-digest %sha384-init %sha384-update %sha384-final))
 (define sha512-digest (gen-digest %sha512-init %sha512-update %sha512-final))
 
-(define (sha1-digest-string s)   (with-input-from-string s sha1-digest))
-(define (sha224-digest-string s) (with-input-from-string s sha224-digest))
-(define (sha256-digest-string s) (with-input-from-string s sha256-digest))
-(define (sha384-digest-string s) (with-input-from-string s sha384-digest))
-(define (sha512-digest-string s) (with-input-from-string s sha512-digest))
+;; These digest the string body (or the u8vector) directly.
+(define (sha1-digest-string s)   (%sha1-digest-data s))
+(define (sha224-digest-string s) (%sha224-digest-data s))
+(define (sha256-digest-string s) (%sha256-digest-data s))
+(define (sha384-digest-string s) (%sha384-digest-data s))
+(define (sha512-digest-string s) (%sha512-digest-data s))
+
+;; Digests each of a list of strings or u8vectors.  Independent messages
+;; can be hashed side by side with SIMD instructions (see shasimd.c).
+(define (sha1-digest-list datas)   (%sha1-digest-list datas))
+(define (sha256-digest-list datas) (%sha256-digest-list datas))
 
 ;;;
 ;;; Digest framework
@@ -86,7 +92,8 @@
         [init   (string->symbol #"%sha~|n|-init")]
         [update (string->symbol #"%sha~|n|-update")]
         [final  (string->symbol #"%sha~|n|-final")]
-        [digest (string->symbol #"sha~|n|-digest")])
+        [digest (string->symbol #"sha~|n|-digest")]
+        [digest-string (string->symbol #"sha~|n|-digest-string")])
     `(begin
        (define-class ,meta (<message-digest-algorithm-meta>) ())
        (define-class ,cls (<message-digest-algorithm>)
@@ -103,7 +110,9 @@
        (define-method digest-final! ((self ,cls))
          (,final (slot-ref self'context)))
        (define-method digest ((class ,meta))
-         (,digest)))))
+         (,digest))
+       (define-method digest-string ((class ,meta) string)
+         (,digest-string string)))))
 
 (define-framework 1    64)
 (define-framework 224  64)
@@ -193,6 +202,70 @@
    (common-final SHA384_Final ctx SHA384_DIGEST_LENGTH))
  (define-cproc %sha512-final (ctx::<sha-context>)
    (common-final SHA512_Final ctx SHA512_DIGEST_LENGTH))
+
+ ;; init, update and final at once, without allocating a context
+ (define-cise-stmt common-digest
+   [(_ init update final data size)
+    `(let* ([c::ScmShaContext] [ctx::ScmShaContext* (& c)])
+       (,init (& (-> ctx ctx)))
+       (common-update ,update ctx ,data)
+       (common-final ,final ctx ,size))])
+
+ (define-cproc %sha1-digest-data (data)
+   (common-digest SHA1_Init SHA1_Update SHA1_Final data SHA1_DIGEST_LENGTH))
+ (define-cproc %sha224-digest-data (data)
+   (common-digest SHA224_Init SHA224_Update SHA224_Final data
+                  SHA224_DIGEST_LENGTH))
+ (define-cproc %sha256-digest-data (data)
+   (common-digest SHA256_Init SHA256_Update SHA256_Final data
+                  SHA256_DIGEST_LENGTH))
+ (define-cproc %sha384-digest-data (data)
+   (common-digest SHA384_Init SHA384_Update SHA384_Final data
+                  SHA384_DIGEST_LENGTH))
+ (define-cproc %sha512-digest-data (data)
+   (common-digest SHA512_Init SHA512_Update SHA512_Final data
+                  SHA512_DIGEST_LENGTH))
+
+ ;; Returns a list of digests of DATAS.  If SHA256 is true, uses SHA-256;
+ ;; otherwise SHA-1.
+ (define-cfn digest-list (datas sha256::int) :static
+   (let* ([n::ScmSize (Scm_Length datas)]
+          [size::int (?: sha256 SHA256_DIGEST_LENGTH SHA1_DIGEST_LENGTH)]
+          [data::(const uint8_t**) NULL]
+          [len::size_t* NULL]
+          [digests::uint8_t* NULL]
+          [h SCM_NIL] [t SCM_NIL]
+          [i::ScmSize 0])
+     (when (< n 0) (SCM_TYPE_ERROR datas "list"))
+     (set! data (SCM_NEW_ATOMIC_ARRAY (.type (const uint8_t*)) (+ n 1))
+           len (SCM_NEW_ATOMIC_ARRAY (.type size_t) (+ n 1))
+           digests (SCM_NEW_ATOMIC_ARRAY (.type uint8_t) (+ (* n size) 1)))
+     (dolist [d datas]
+       (cond
+        [(SCM_U8VECTORP d)
+         (set! (aref data i)
+               (cast (const uint8_t*) (SCM_UVECTOR_ELEMENTS (SCM_U8VECTOR d)))
+               (aref len i) (SCM_U8VECTOR_SIZE (SCM_U8VECTOR d)))]
+        [(SCM_STRINGP d)
+         (let* ([b::(const ScmStringBody*) (SCM_STRING_BODY d)])
+           (set! (aref data i) (cast (const uint8_t*) (SCM_STRING_BODY_START b))
+                 (aref len i) (SCM_STRING_BODY_SIZE b)))]
+        [else (SCM_TYPE_ERROR d "u8vector or string")])
+       (post++ i))
+     (if sha256
+       (SHA256_Multi n data len digests)
+       (SHA1_Multi n data len digests))
+     (dotimes [k n]
+       (SCM_APPEND1 h t (Scm_MakeString (cast (const char*) (+ digests (* k size)))
+                                        size size
+                                        (logior SCM_STRING_INCOMPLETE
+                                                SCM_STRING_COPYING))))
+     (return h)))
+
+ (define-cproc %sha1-digest-list (datas)
+   (result (digest-list datas FALSE)))
+ (define-cproc %sha256-digest-list (datas)
+   (result (digest-list datas TRUE)))
  )
 
 
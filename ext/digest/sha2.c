@@ -436,6 +436,12 @@ void SHA1_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 	sha_word32	T1, *W1;
 	int		j;
 
+	/*[SK] Use SHA extensions if available */
+	if (SHA1_Transform_Accel(context->s1.state, (const sha_byte*)data, 1)) {
+		return;
+	}
+	/*[/SK]*/
+
 	W1 = (sha_word32*)context->s1.buffer;
 
 	/* Initialize registers with the prev. intermediate value */
@@ -555,6 +561,12 @@ void SHA1_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 	sha_word32	T1, *W1;
 	int		j;
 
+	/*[SK] Use SHA extensions if available */
+	if (SHA1_Transform_Accel(context->s1.state, (const sha_byte*)data, 1)) {
+		return;
+	}
+	/*[/SK]*/
+
 	W1 = (sha_word32*)context->s1.buffer;
 
 	/* Initialize registers with the prev. intermediate value */
@@ -670,6 +682,14 @@ void SHA1_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 			return;
 		}
 	}
+	/*[SK] Process all complete blocks at once if we can */
+	if (len >= 64
+	    && SHA1_Transform_Accel(context->s1.state, data, len / 64)) {
+		context->s1.bitcount += (sha_word64)(len / 64) << 9;
+		data += len - len % 64;
+		len %= 64;
+	}
+	/*[/SK]*/
 	while (len >= 64) {
 		/* Process as many complete blocks as we can */
 		SHA1_Internal_Transform(context, (sha_word32*)data);
@@ -845,6 +865,12 @@ void SHA256_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 	sha_word32	T1, *W256;
 	int		j;
 
+	/*[SK] Use SHA extensions if available */
+	if (SHA256_Transform_Accel(context->s256.state, (const sha_byte*)data, 1)) {
+		return;
+	}
+	/*[/SK]*/
+
 	W256 = (sha_word32*)context->s256.buffer;
 
 	/* Initialize registers with the prev. intermediate value */
@@ -903,6 +929,12 @@ void SHA256_Internal_Transform(SHA_CTX* context, const sha_word32* data) {
 	sha_word32	T1, T2, *W256;
 	int		j;
 
+	/*[SK] Use SHA extensions if available */
+	if (SHA256_Transform_Accel(context->s256.state, (const sha_byte*)data, 1)) {
+		return;
+	}
+	/*[/SK]*/
+
 	W256 = (sha_word32*)context->s256.buffer;
 
 	/* Initialize registers with the prev. intermediate value */
@@ -1010,6 +1042,14 @@ void SHA256_Update(SHA_CTX* context, const sha_byte *data, size_t len) {
 			return;
 		}
 	}
+	/*[SK] Process all complete blocks at once if we can */
+	if (len >= 64
+	    && SHA256_Transform_Accel(context->s256.state, data, len / 64)) {
+		context->s256.bitcount += (sha_word64)(len / 64) << 9;
+		data += len - len % 64;
+		len %= 64;
+	}
+	/*[/SK]*/
 	while (len >= 64) {
 		/* Process as many complete blocks as we can */
 		SHA256_Internal_Transform(context, (sha_word32*)data);
@@ -211,6 +211,13 @@ void SHA512_Final(uint8_t[SHA512_DIGEST_LENGTH], SHA_CTX*);
 char* SHA512_End(SHA_CTX*, char[SHA512_DIGEST_STRING_LENGTH]);
 char* SHA512_Data(const uint8_t*, size_t, char[SHA512_DIGEST_STRING_LENGTH]);
 
+/*[SK] Accelerated block transforms and multi-message digests (shasimd.c) */
+int SHA1_Transform_Accel(uint32_t*, const uint8_t*, size_t);
+int SHA256_Transform_Accel(uint32_t*, const uint8_t*, size_t);
+void SHA1_Multi(size_t, const uint8_t* const[], const size_t[], uint8_t*);
+void SHA256_Multi(size_t, const uint8_t* const[], const size_t[], uint8_t*);
+/*[/SK]*/
+
 #else /* SHA2_USE_INTTYPES_H */
 
 void SHA1_Init(SHA_CTX*);
@@ -243,6 +250,13 @@ void SHA512_Final(u_int8_t[SHA512_DIGEST_LENGTH], SHA_CTX*);
 char* SHA512_End(SHA_CTX*, char[SHA512_DIGEST_STRING_LENGTH]);
 char* SHA512_Data(const u_int8_t*, size_t, char[SHA512_DIGEST_STRING_LENGTH]);
 
+/*[SK] Accelerated block transforms and multi-message digests (shasimd.c) */
+int SHA1_Transform_Accel(u_int32_t*, const u_int8_t*, size_t);
+int SHA256_Transform_Accel(u_int32_t*, const u_int8_t*, size_t);
+void SHA1_Multi(size_t, const u_int8_t* const[], const size_t[], u_int8_t*);
+void SHA256_Multi(size_t, const u_int8_t* const[], const size_t[], u_int8_t*);
+/*[/SK]*/
+
 #endif /* SHA2_USE_INTTYPES_H */
 
 #else /* NOPROTO */
@@ -277,6 +291,13 @@ void SHA512_Final();
 char* SHA512_End();
 char* SHA512_Data();
 
+/*[SK]*/
+int SHA1_Transform_Accel();
+int SHA256_Transform_Accel();
+void SHA1_Multi();
+void SHA256_Multi();
+/*[/SK]*/
+
 #endif /* NOPROTO */
 
 #ifdef    __cplusplus
@@ -0,0 +1,513 @@
+/*
+ * shasimd.c - accelerated SHA-1 and SHA-256
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Faster block transforms for SHA-1 and SHA-256, used by sha2.c, and
+ * digesting many independent messages at once.
+ *
+ * On x86 CPUs with SHA extensions (SHA-NI), the block transforms use
+ * the dedicated instructions; sha2.c calls SHA1_Transform_Accel and
+ * SHA256_Transform_Accel first, and falls back to its portable code if
+ * they return 0.
+ *
+ * Without SHA-NI, hashing one message can't be made much faster, for
+ * each round depends on the previous one.  Many independent messages,
+ * however, can be processed side by side in the lanes of vector
+ * registers.  SHA1_Multi and SHA256_Multi do so with 8 lanes of AVX2
+ * if available.  Whenever a lane finishes its message, the next pending
+ * message is fed to it, so the messages can have different lengths.
+ *
+ * The availability of the instructions is checked at runtime.
+ */
+
+#include <string.h>
+#include <gauche.h>
+#include <gauche/priv/simdP.h>
+#include "sha2.h"
+
+#if defined(SCM_X86_TARGET)
+#define SHASIMD_X86 1
+#endif
+
+#ifdef SHA2_USE_INTTYPES_H
+typedef uint8_t  sha_byte;
+typedef uint32_t sha_word32;
+typedef uint64_t sha_word64;
+#else
+typedef u_int8_t  sha_byte;
+typedef u_int32_t sha_word32;
+typedef u_int64_t sha_word64;
+#endif
+
+static const sha_word32 sha1_iv[5] = {
+    0x67452301UL, 0xefcdab89UL, 0x98badcfeUL, 0x10325476UL, 0xc3d2e1f0UL
+};
+
+static const sha_word32 sha256_iv[8] = {
+    0x6a09e667UL, 0xbb67ae85UL, 0x3c6ef372UL, 0xa54ff53aUL,
+    0x510e527fUL, 0x9b05688cUL, 0x1f83d9abUL, 0x5be0cd19UL
+};
+
+static const sha_word32 K256[64] = {
+    0x428a2f98UL, 0x71374491UL, 0xb5c0fbcfUL, 0xe9b5dba5UL,
+    0x3956c25bUL, 0x59f111f1UL, 0x923f82a4UL, 0xab1c5ed5UL,
+    0xd807aa98UL, 0x12835b01UL, 0x243185beUL, 0x550c7dc3UL,
+    0x72be5d74UL, 0x80deb1feUL, 0x9bdc06a7UL, 0xc19bf174UL,
+    0xe49b69c1UL, 0xefbe4786UL, 0x0fc19dc6UL, 0x240ca1ccUL,
+    0x2de92c6fUL, 0x4a7484aaUL, 0x5cb0a9dcUL, 0x76f988daUL,
+    0x983e5152UL, 0xa831c66dUL, 0xb00327c8UL, 0xbf597fc7UL,
+    0xc6e00bf3UL, 0xd5a79147UL, 0x06ca6351UL, 0x14292967UL,
+    0x27b70a85UL, 0x2e1b2138UL, 0x4d2c6dfcUL, 0x53380d13UL,
+    0x650a7354UL, 0x766a0abbUL, 0x81c2c92eUL, 0x92722c85UL,
+    0xa2bfe8a1UL, 0xa81a664bUL, 0xc24b8b70UL, 0xc76c51a3UL,
+    0xd192e819UL, 0xd6990624UL, 0xf40e3585UL, 0x106aa070UL,
+    0x19a4c116UL, 0x1e376c08UL, 0x2748774cUL, 0x34b0bcb5UL,
+    0x391c0cb3UL, 0x4ed8aa4aUL, 0x5b9cca4fUL, 0x682e6ff3UL,
+    0x748f82eeUL, 0x78a5636fUL, 0x84c87814UL, 0x8cc70208UL,
+    0x90befffaUL, 0xa4506cebUL, 0xbef9a3f7UL, 0xc67178f2UL
+};
+
+static inline sha_word32 load_be32(const sha_byte *p)
+{
+    return ((sha_word32)p[0] << 24) | ((sha_word32)p[1] << 16)
+        | ((sha_word32)p[2] << 8) | (sha_word32)p[3];
+}
+
+static inline void store_be32(sha_byte *p, sha_word32 w)
+{
+    p[0] = (sha_byte)(w >> 24);
+    p[1] = (sha_byte)(w >> 16);
+    p[2] = (sha_byte)(w >> 8);
+    p[3] = (sha_byte)w;
+}
+
+/*=================================================================
+ * SHA-NI block transforms
+ */
+
+#if defined(SHASIMD_X86)
+
+#define SHANI_TARGET SCM_X86_TARGET("sha,sse4.1")
+
+static SHANI_TARGET void sha1_shani(sha_word32 state[5],
+                                    const sha_byte *data, size_t nblocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0001020304050607ULL,
+                                        0x08090a0b0c0d0e0fULL);
+    __m128i abcd, e0, e1, abcd_save, e0_save, m[4];
+
+    abcd = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)state), 0x1b);
+    e0 = _mm_set_epi32(state[4], 0, 0, 0);
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        abcd_save = abcd;
+        e0_save = e0;
+
+        /* Each step does 4 rounds.  The message schedule for the later
+           steps is computed in m[] along the way. */
+#define SHA1_STEP(i, f, ecur, enext)                                    \
+        do {                                                            \
+            __m128i w_ = m[(i)&3];                                      \
+            if ((i) == 0) ecur = _mm_add_epi32(ecur, w_);               \
+            else          ecur = _mm_sha1nexte_epu32(ecur, w_);         \
+            enext = abcd;                                               \
+            if ((i) >= 3 && (i) <= 18)                                  \
+                m[((i)+1)&3] = _mm_sha1msg2_epu32(m[((i)+1)&3], w_);    \
+            abcd = _mm_sha1rnds4_epu32(abcd, ecur, f);                  \
+            if ((i) >= 1 && (i) <= 16)                                  \
+                m[((i)-1)&3] = _mm_sha1msg1_epu32(m[((i)-1)&3], w_);    \
+            if ((i) >= 2 && (i) <= 17)                                  \
+                m[((i)-2)&3] = _mm_xor_si128(m[((i)-2)&3], w_);         \
+        } while (0)
+
+        for (int k = 0; k < 4; k++) {
+            m[k] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*)(data + k*16)), mask);
+        }
+        SHA1_STEP(0, 0, e0, e1);  SHA1_STEP(1, 0, e1, e0);
+        SHA1_STEP(2, 0, e0, e1);  SHA1_STEP(3, 0, e1, e0);
+        SHA1_STEP(4, 0, e0, e1);  SHA1_STEP(5, 1, e1, e0);
+        SHA1_STEP(6, 1, e0, e1);  SHA1_STEP(7, 1, e1, e0);
+        SHA1_STEP(8, 1, e0, e1);  SHA1_STEP(9, 1, e1, e0);
+        SHA1_STEP(10, 2, e0, e1); SHA1_STEP(11, 2, e1, e0);
+        SHA1_STEP(12, 2, e0, e1); SHA1_STEP(13, 2, e1, e0);
+        SHA1_STEP(14, 2, e0, e1); SHA1_STEP(15, 3, e1, e0);
+        SHA1_STEP(16, 3, e0, e1); SHA1_STEP(17, 3, e1, e0);
+        SHA1_STEP(18, 3, e0, e1); SHA1_STEP(19, 3, e1, e0);
+#undef SHA1_STEP
+
+        e0 = _mm_sha1nexte_epu32(e0, e0_save);
+        abcd = _mm_add_epi32(abcd, abcd_save);
+    }
+
+    _mm_storeu_si128((__m128i*)state, _mm_shuffle_epi32(abcd, 0x1b));
+    state[4] = (sha_word32)_mm_extract_epi32(e0, 3);
+}
+
+static SHANI_TARGET void sha256_shani(sha_word32 state[8],
+                                      const sha_byte *data, size_t nblocks)
+{
+    const __m128i mask = _mm_set_epi64x(0x0c0d0e0f08090a0bULL,
+                                        0x0405060700010203ULL);
+    __m128i s0, s1, tmp, msg, abef_save, cdgh_save, m[4];
+
+    /* The instructions want the state as ABEF and CDGH. */
+    tmp = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[0]), 0xb1);
+    s1  = _mm_shuffle_epi32(_mm_loadu_si128((const __m128i*)&state[4]), 0x1b);
+    s0  = _mm_alignr_epi8(tmp, s1, 8);
+    s1  = _mm_blend_epi16(s1, tmp, 0xf0);
+
+    for (; nblocks > 0; nblocks--, data += 64) {
+        abef_save = s0;
+        cdgh_save = s1;
+
+#define SHA256_STEP(i)                                                  \
+        do {                                                            \
+            __m128i w_ = m[(i)&3];                                      \
+            msg = _mm_add_epi32(w_,                                     \
+                     _mm_loadu_si128((const __m128i*)&K256[(i)*4]));    \
+            s1 = _mm_sha256rnds2_epu32(s1, s0, msg);                    \
+            if ((i) >= 3 && (i) <= 14) {                                \
+                tmp = _mm_alignr_epi8(w_, m[((i)-1)&3], 4);             \
+                m[((i)+1)&3] = _mm_add_epi32(m[((i)+1)&3], tmp);        \
+                m[((i)+1)&3] = _mm_sha256msg2_epu32(m[((i)+1)&3], w_);  \
+            }                                                           \
+            msg = _mm_shuffle_epi32(msg, 0x0e);                         \
+            s0 = _mm_sha256rnds2_epu32(s0, s1, msg);                    \
+            if ((i) >= 1 && (i) <= 12)                                  \
+                m[((i)-1)&3] = _mm_sha256msg1_epu32(m[((i)-1)&3], w_);  \
+        } while (0)
+
+        for (int k = 0; k < 4; k++) {
+            m[k] = _mm_shuffle_epi8(
+                _mm_loadu_si128((const __m128i*)(data + k*16)), mask);
+        }
+        SHA256_STEP(0);  SHA256_STEP(1);  SHA256_STEP(2);  SHA256_STEP(3);
+        SHA256_STEP(4);  SHA256_STEP(5);  SHA256_STEP(6);  SHA256_STEP(7);
+        SHA256_STEP(8);  SHA256_STEP(9);  SHA256_STEP(10); SHA256_STEP(11);
+        SHA256_STEP(12); SHA256_STEP(13); SHA256_STEP(14); SHA256_STEP(15);
+#undef SHA256_STEP
+
+        s0 = _mm_add_epi32(s0, abef_save);
+        s1 = _mm_add_epi32(s1, cdgh_save);
+    }
+
+    tmp = _mm_shuffle_epi32(s0, 0x1b);
+    s1  = _mm_shuffle_epi32(s1, 0xb1);
+    s0  = _mm_blend_epi16(tmp, s1, 0xf0);
+    s1  = _mm_alignr_epi8(s1, tmp, 8);
+    _mm_storeu_si128((__m128i*)&state[0], s0);
+    _mm_storeu_si128((__m128i*)&state[4], s1);
+}
+
+#undef SHANI_TARGET
+
+#endif /*SHASIMD_X86*/
+
+int SHA1_Transform_Accel(sha_word32 *state, const sha_byte *data,
+                         size_t nblocks)
+{
+#if defined(SHASIMD_X86)
+    if (Scm__CPUFeatures() & SCM_CPU_SHA) {
+        sha1_shani(state, data, nblocks);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+int SHA256_Transform_Accel(sha_word32 *state, const sha_byte *data,
+                           size_t nblocks)
+{
+#if defined(SHASIMD_X86)
+    if (Scm__CPUFeatures() & SCM_CPU_SHA) {
+        sha256_shani(state, data, nblocks);
+        return 1;
+    }
+#endif
+    return 0;
+}
+
+/*=================================================================
+ * Multi-buffer
+ */
+
+#if defined(SHASIMD_X86)
+
+#define LANES 8
+
+/* Each lane holds its state transposed: st[j][l] is the j-th word of
+   the state of lane l. */
+
+#define AVX2_TARGET SCM_X86_TARGET("avx2")
+
+#define ROTL(x, n) \
+    _mm256_or_si256(_mm256_slli_epi32(x, n), _mm256_srli_epi32(x, 32-(n)))
+#define ROTR(x, n) \
+    _mm256_or_si256(_mm256_srli_epi32(x, n), _mm256_slli_epi32(x, 32-(n)))
+#define ADD(a, b)   _mm256_add_epi32(a, b)
+#define XOR(a, b)   _mm256_xor_si256(a, b)
+#define AND(a, b)   _mm256_and_si256(a, b)
+#define ANDNOT(a, b) _mm256_andnot_si256(a, b)   /* ~a & b */
+#define SET1(x)     _mm256_set1_epi32((int)(x))
+
+/* Loads the T-th message word of each lane's block */
+static inline AVX2_TARGET __m256i load_words(const sha_byte *blk[LANES],
+                                             int t)
+{
+    return _mm256_set_epi32((int)load_be32(blk[7] + 4*t),
+                            (int)load_be32(blk[6] + 4*t),
+                            (int)load_be32(blk[5] + 4*t),
+                            (int)load_be32(blk[4] + 4*t),
+                            (int)load_be32(blk[3] + 4*t),
+                            (int)load_be32(blk[2] + 4*t),
+                            (int)load_be32(blk[1] + 4*t),
+                            (int)load_be32(blk[0] + 4*t));
+}
+
+static AVX2_TARGET void sha1_x8(sha_word32 st[5][LANES],
+                                const sha_byte *blk[LANES])
+{
+    __m256i w[16], a, b, c, d, e, f, k, t;
+
+    a = _mm256_loadu_si256((const __m256i*)st[0]);
+    b = _mm256_loadu_si256((const __m256i*)st[1]);
+    c = _mm256_loadu_si256((const __m256i*)st[2]);
+    d = _mm256_loadu_si256((const __m256i*)st[3]);
+    e = _mm256_loadu_si256((const __m256i*)st[4]);
+
+    for (int j = 0; j < 80; j++) {
+        if (j < 16) {
+            w[j] = load_words(blk, j);
+        } else {
+            t = XOR(XOR(w[(j+13)&15], w[(j+8)&15]),
+                    XOR(w[(j+2)&15], w[j&15]));
+            w[j&15] = ROTL(t, 1);
+        }
+        if (j < 20) {
+            f = XOR(AND(b, c), ANDNOT(b, d));
+            k = SET1(0x5a827999UL);
+        } else if (j < 40) {
+            f = XOR(XOR(b, c), d);
+            k = SET1(0x6ed9eba1UL);
+        } else if (j < 60) {
+            f = XOR(XOR(AND(b, c), AND(b, d)), AND(c, d));
+            k = SET1(0x8f1bbcdcUL);
+        } else {
+            f = XOR(XOR(b, c), d);
+            k = SET1(0xca62c1d6UL);
+        }
+        t = ADD(ADD(ROTL(a, 5), f), ADD(ADD(e, k), w[j&15]));
+        e = d;
+        d = c;
+        c = ROTL(b, 30);
+        b = a;
+        a = t;
+    }
+
+#define STORE_ADD(j, v) \
+    _mm256_storeu_si256((__m256i*)st[j], \
+                        ADD(_mm256_loadu_si256((const __m256i*)st[j]), v))
+    STORE_ADD(0, a); STORE_ADD(1, b); STORE_ADD(2, c);
+    STORE_ADD(3, d); STORE_ADD(4, e);
+}
+
+static AVX2_TARGET void sha256_x8(sha_word32 st[8][LANES],
+                                  const sha_byte *blk[LANES])
+{
+    __m256i w[16], s[8], t1, t2, s0, s1;
+
+    for (int j = 0; j < 8; j++) {
+        s[j] = _mm256_loadu_si256((const __m256i*)st[j]);
+    }
+
+    for (int j = 0; j < 64; j++) {
+        if (j < 16) {
+            w[j] = load_words(blk, j);
+        } else {
+            __m256i x = w[(j+1)&15], y = w[(j+14)&15];
+            s0 = XOR(XOR(ROTR(x, 7), ROTR(x, 18)), _mm256_srli_epi32(x, 3));
+            s1 = XOR(XOR(ROTR(y, 17), ROTR(y, 19)), _mm256_srli_epi32(y, 10));
+            w[j&15] = ADD(ADD(w[j&15], s0), ADD(s1, w[(j+9)&15]));
+        }
+        /* s[0..7] = a..h */
+        t1 = ADD(ADD(s[7], XOR(XOR(ROTR(s[4], 6), ROTR(s[4], 11)),
+                               ROTR(s[4], 25))),
+                 ADD(ADD(XOR(AND(s[4], s[5]), ANDNOT(s[4], s[6])),
+                         SET1(K256[j])),
+                     w[j&15]));
+        t2 = ADD(XOR(XOR(ROTR(s[0], 2), ROTR(s[0], 13)), ROTR(s[0], 22)),
+                 XOR(XOR(AND(s[0], s[1]), AND(s[0], s[2])),
+                     AND(s[1], s[2])));
+        s[7] = s[6];
+        s[6] = s[5];
+        s[5] = s[4];
+        s[4] = ADD(s[3], t1);
+        s[3] = s[2];
+        s[2] = s[1];
+        s[1] = s[0];
+        s[0] = ADD(t1, t2);
+    }
+
+    for (int j = 0; j < 8; j++) STORE_ADD(j, s[j]);
+#undef STORE_ADD
+}
+
+#undef ROTL
+#undef ROTR
+#undef ADD
+#undef XOR
+#undef AND
+#undef ANDNOT
+#undef SET1
+#undef AVX2_TARGET
+
+/* A message being digested in a lane.  The full blocks are read
+   directly from the message; the rest and the padding are copied
+   into tail. */
+typedef struct mb_laneRec {
+    long msg;                   /* index of the message, or -1 if idle */
+    const sha_byte *data;       /* next full block */
+    size_t nfull;               /* # of remaining full blocks */
+    int ntail;                  /* # of remaining tail blocks */
+    int tailpos;
+    sha_byte tail[128];
+} mb_lane;
+
+static void mb_prepare_tail(mb_lane *lane, const sha_byte *data, size_t len)
+{
+    size_t rest = len % 64;
+    sha_word64 bits = (sha_word64)len << 3;
+
+    memset(lane->tail, 0, sizeof(lane->tail));
+    memcpy(lane->tail, data + len - rest, rest);
+    lane->tail[rest] = 0x80;
+    lane->ntail = (rest < 56)? 1 : 2;
+    lane->tailpos = 0;
+    store_be32(lane->tail + lane->ntail*64 - 8, (sha_word32)(bits >> 32));
+    store_be32(lane->tail + lane->ntail*64 - 4, (sha_word32)bits);
+    lane->data = data;
+    lane->nfull = len / 64;
+}
+
+/* Digests messages with LANES lanes.  NWORDS is 5 for SHA-1 and 8 for
+   SHA-256. */
+static void multi_x8(size_t n, const sha_byte *const data[],
+                     const size_t len[], sha_byte *digests,
+                     int nwords, const sha_word32 *iv,
+                     void (*kernel)(sha_word32 (*)[LANES], const sha_byte **))
+{
+    static const sha_byte idle_block[64] = { 0 };
+    sha_word32 st[8][LANES];
+    mb_lane lanes[LANES];
+    const sha_byte *blk[LANES];
+    size_t next = 0, active = 0;
+
+    for (int l = 0; l < LANES; l++) {
+        lanes[l].msg = -1;
+        for (int j = 0; j < nwords; j++) st[j][l] = 0;
+    }
+
+    for (;;) {
+        /* Feed pending messages to idle lanes */
+        for (int l = 0; l < LANES && next < n; l++) {
+            if (lanes[l].msg >= 0) continue;
+            lanes[l].msg = (long)next;
+            mb_prepare_tail(&lanes[l], data[next], len[next]);
+            for (int j = 0; j < nwords; j++) st[j][l] = iv[j];
+            next++;
+            active++;
+        }
+        if (active == 0) break;
+
+        for (int l = 0; l < LANES; l++) {
+            mb_lane *lane = &lanes[l];
+            if (lane->msg < 0)       blk[l] = idle_block;
+            else if (lane->nfull > 0) blk[l] = lane->data;
+            else                      blk[l] = lane->tail + lane->tailpos*64;
+        }
+        kernel(st, blk);
+
+        for (int l = 0; l < LANES; l++) {
+            mb_lane *lane = &lanes[l];
+            if (lane->msg < 0) continue;
+            if (lane->nfull > 0) {
+                lane->nfull--;
+                lane->data += 64;
+            } else if (++lane->tailpos == lane->ntail) {
+                sha_byte *d = digests + lane->msg * nwords * 4;
+                for (int j = 0; j < nwords; j++) store_be32(d + j*4, st[j][l]);
+                lane->msg = -1;
+                active--;
+            }
+        }
+    }
+}
+
+#endif /*SHASIMD_X86*/
+
+void SHA1_Multi(size_t n, const sha_byte *const data[], const size_t len[],
+                sha_byte *digests)
+{
+#if defined(SHASIMD_X86)
+    if ((Scm__CPUFeatures() & (SCM_CPU_SHA|SCM_CPU_AVX2)) == SCM_CPU_AVX2
+        && n > 1) {
+        multi_x8(n, data, len, digests, 5, sha1_iv, sha1_x8);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        SHA_CTX ctx;
+        SHA1_Init(&ctx);
+        SHA1_Update(&ctx, data[i], len[i]);
+        SHA1_Final(digests + i*SHA1_DIGEST_LENGTH, &ctx);
+    }
+}
+
+void SHA256_Multi(size_t n, const sha_byte *const data[], const size_t len[],
+                  sha_byte *digests)
+{
+#if defined(SHASIMD_X86)
+    if ((Scm__CPUFeatures() & (SCM_CPU_SHA|SCM_CPU_AVX2)) == SCM_CPU_AVX2
+        && n > 1) {
+        multi_x8(n, data, len, digests, 8, sha256_iv, sha256_x8);
+        return;
+    }
+#endif
+    for (size_t i = 0; i < n; i++) {
+        SHA_CTX ctx;
+        SHA256_Init(&ctx);
+        SHA256_Update(&ctx, data[i], len[i]);
+        SHA256_Final(digests + i*SHA256_DIGEST_LENGTH, &ctx);
+    }
+}
@@ -97,5 +97,43 @@
       (test* #"~file sha512" r (digest-hexify (sha512-digest-string input))))
     ))
 
-(for-each test-from-file (glob "data/*.info"))
+(define (sha-tests)
+  (for-each test-from-file (glob "data/*.info"))
 
+  (let* ([msgs (list-ec (: n 0 300 7)
+                        (string-tabulate
+                         (^i (integer->char (+ 32 (modulo (* i n) 95))))
+                         n))]
+         [vecs (map string->u8vector msgs)])
+    (define (via-port digest s) (with-input-from-string s digest))
+    (test* "sha1-digest-string (u8vector)"
+           (via-port sha1-digest "abc")
+           (sha1-digest-string (string->u8vector "abc")))
+    (test* "sha256-digest-string (u8vector)"
+           (via-port sha256-digest "abc")
+           (sha256-digest-string (string->u8vector "abc")))
+    (test* "sha512-digest-string" (map (cut via-port sha512-digest <>) msgs)
+           (map sha512-digest-string msgs))
+    (test* "sha1-digest-list" (map (cut via-port sha1-digest <>) msgs)
+           (sha1-digest-list msgs))
+    (test* "sha1-digest-list (u8vector)" (map sha1-digest-string msgs)
+           (sha1-digest-list vecs))
+    (test* "sha256-digest-list" (map (cut via-port sha256-digest <>) msgs)
+           (sha256-digest-list msgs))
+    (test* "sha256-digest-list (u8vector)" (map sha256-digest-string msgs)
+           (sha256-digest-list vecs))
+    (test* "sha256-digest-list (empty)" '() (sha256-digest-list '()))
+    (test* "sha256-digest-list (error)" (test-error)
+           (sha256-digest-list '("abc" 1)))
+    ))
+
+;; Run the tests with the portable code, the AVX2 multi-buffer lanes
+;; (which are used only without SHA extensions), and SHA-NI, as far
+;; as this machine supports them.
+(let1 available (%cpu-features)
+  (dolist [fs '(() (sse2 avx2) (sse2 sha))]
+    (when (every (cut memq <> available) fs)
+      (test-section (format #f "sha2 with kernels ~s" fs))
+      (%cpu-features fs)
+      (sha-tests)))
+  (%cpu-features #t))
@@ -68,6 +68,51 @@
     (print name " lookup:    " (calc-time ref-timer))
     ))
 
+;; Set operations, e.g. intersecting posting lists of an inverted index.
+;; A sparse u8vector whose values are all 1 serves as an integer set.
+(define *setop-size* 100000)
+(define *setop-range* (expt 2 22))
+(define *setop-repeat* 20)
+
+(define (random-keys)
+  (map (^_ (random-integer *setop-range*)) (iota *setop-size*)))
+
+(define *setop-keys-a* (random-keys))
+(define *setop-keys-b* (random-keys))
+
+(define (bm-make keys) (list->sparse-bitmap keys))
+
+(define (sv-make keys)
+  (rlet1 sv (make-sparse-vector 'u8)
+    (dolist [k keys] (sparse-vector-set! sv k 1))))
+
+(define (sv-intersection a b)
+  (rlet1 r (make-sparse-vector 'u8)
+    (sparse-vector-for-each a (^[k _] (when (sparse-vector-exists? b k)
+                                        (sparse-vector-set! r k 1))))))
+
+(define (sv-union a b)
+  (rlet1 r (sparse-vector-copy a)
+    (sparse-vector-for-each b (^[k _] (sparse-vector-set! r k 1)))))
+
+(define (bench-setop name %make %and %or)
+  (let ([a (%make *setop-keys-a*)]
+        [b (%make *setop-keys-b*)]
+        [and-timer (make <user-time-counter>)]
+        [or-timer  (make <user-time-counter>)])
+
+    (define (calc-time timer)
+      (* (/. (time-counter-value timer) *setop-repeat*) 1e3)) ;millisec
+
+    (dotimes [i *setop-repeat*]
+      (with-time-counter and-timer (%and a b))
+      (with-time-counter or-timer (%or a b)))
+
+    (print name " intersection: " (calc-time and-timer))
+    (print name " union:        " (calc-time or-timer))
+    (print "set size: " *setop-size* ", key range: " *setop-range*)
+    ))
+
 (define (active-memory-size)
   (gc) (gc)
   (let1 s (gc-stat)
@@ -97,6 +142,12 @@
                         (bench-mem (cut sv-set (make-sparse-vector 'u32))))]
     [("st" "mem") (print "Sparse table mem: "
                          (bench-mem (cut st-set (make-sparse-table 'eqv?))))]
-    [_ (exit 1 "Usage: bench ht|sv|st speed|mem")])
+
+    [("bm" "setop") (bench-setop "Sparse bitmap" bm-make
+                                 sparse-bitmap-intersection
+                                 sparse-bitmap-union)]
+    [("sv" "setop") (bench-setop "Sparse u8vector" sv-make
+                                 sv-intersection sv-union)]
+    [_ (exit 1 "Usage: bench ht|sv|st speed|mem, or bench bm|sv setop")])
   (print "size: "  *problem-size*)
   0)
@@ -0,0 +1,962 @@
+/*
+ * pmap.c - Persistent maps
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LIBGAUCHE_EXT_BODY
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <gauche/bits_inline.h>
+#include "pmap.h"
+
+/* Transient token.  We only need its identity. */
+static void *new_edit_token(void)
+{
+    return SCM_NEW_ATOMIC2(void*, sizeof(ScmWord));
+}
+
+/*===================================================================
+ * Persistent hash map
+ */
+
+static void phmap_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<%s-hash-map %lu entries>",
+               SCM_XTYPEP(obj, SCM_CLASS_TRANSIENT_HASH_MAP)
+               ? "transient" : "persistent",
+               PHASH_MAP(obj)->numEntries);
+}
+
+static int phmap_compare(ScmObj x, ScmObj y, int equalp);
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_PersistentHashMapClass,
+                         phmap_print, phmap_compare, NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+SCM_DEFINE_BUILTIN_CLASS(Scm_TransientHashMapClass,
+                         phmap_print, phmap_compare, NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+
+#define HASH_BITS   32
+#define HASH_MASK   0xffffffffUL
+#define PH_SHIFT    5
+#define PH_MASK     0x1f
+
+static u_long string_hash(ScmObj key)
+{
+    if (!SCM_STRINGP(key)) {
+        Scm_Error("string persistent hash map got non-string key: %S", key);
+    }
+    return Scm_HashString(SCM_STRING(key), 0);
+}
+
+static int string_cmp(ScmObj a, ScmObj b)
+{
+    if (!SCM_STRINGP(a)) {
+        Scm_Error("string persistent hash map got non-string key: %S", a);
+    }
+    if (!SCM_STRINGP(b)) {
+        Scm_Error("string persistent hash map got non-string key: %S", b);
+    }
+    return Scm_StringEqual(SCM_STRING(a), SCM_STRING(b));
+}
+
+static PHashMap *phmap_new(ScmClass *klass, const PHashMap *proto,
+                           PHNode *root, u_long numEntries, void *edit)
+{
+    PHashMap *m = SCM_NEW(PHashMap);
+    SCM_SET_CLASS(m, klass);
+    m->root = root;
+    m->numEntries = numEntries;
+    m->type = proto->type;
+    m->hashfn = proto->hashfn;
+    m->cmpfn = proto->cmpfn;
+    m->edit = edit;
+    return m;
+}
+
+ScmObj PHashMapMake(ScmHashType type)
+{
+    PHashMap proto;
+    proto.type = type;
+    switch (type) {
+    case SCM_HASH_EQ:
+        proto.hashfn = Scm_EqHash;
+        proto.cmpfn = Scm_EqP;
+        break;
+    case SCM_HASH_EQV:
+        proto.hashfn = Scm_EqvHash;
+        proto.cmpfn = Scm_EqvP;
+        break;
+    case SCM_HASH_EQUAL:
+        proto.hashfn = Scm_Hash;
+        proto.cmpfn = Scm_EqualP;
+        break;
+    case SCM_HASH_STRING:
+        proto.hashfn = string_hash;
+        proto.cmpfn = string_cmp;
+        break;
+    default:
+        Scm_Error("invalid hash type (%d) for a persistent hash map", type);
+    }
+    return SCM_OBJ(phmap_new(SCM_CLASS_PERSISTENT_HASH_MAP, &proto,
+                             NULL, 0, NULL));
+}
+
+/*
+ * Nodes and leaves
+ */
+
+static inline int node_size(PHNode *n)
+{
+    return (int)Scm__CountBitsInWord(n->emap);
+}
+
+static PHNode *node_alloc(int size, void *edit)
+{
+    PHNode *n = SCM_NEW2(PHNode*, sizeof(PHNode)+sizeof(void*)*(size-1));
+    n->edit = edit;
+    return n;
+}
+
+static PHNode *node_copy(PHNode *n, void *edit)
+{
+    int size = node_size(n);
+    PHNode *z = node_alloc(size, edit);
+    z->emap = n->emap;
+    z->lmap = n->lmap;
+    memcpy(z->entries, n->entries, sizeof(void*)*size);
+    return z;
+}
+
+static inline int node_editable(PHNode *n, void *edit)
+{
+    return (edit != NULL && n->edit == edit);
+}
+
+/* Replace I-th (physical) entry, whose logical index is BIT */
+static PHNode *node_set(PHNode *n, void *edit, u_long bit, int i,
+                        void *entry, int leafp)
+{
+    PHNode *z = node_editable(n, edit)? n : node_copy(n, edit);
+    z->entries[i] = entry;
+    if (leafp) z->lmap |= bit;
+    else       z->lmap &= ~bit;
+    return z;
+}
+
+/* Insert a new entry at the logical index BIT */
+static PHNode *node_insert(PHNode *n, void *edit, u_long bit, int i,
+                           void *entry, int leafp)
+{
+    int size = n? node_size(n) : 0;
+    PHNode *z = node_alloc(size+1, edit);
+    z->emap = (n? n->emap : 0) | bit;
+    z->lmap = (n? n->lmap : 0) | (leafp? bit : 0);
+    if (n) {
+        memcpy(z->entries, n->entries, sizeof(void*)*i);
+        memcpy(z->entries+i+1, n->entries+i, sizeof(void*)*(size-i));
+    }
+    z->entries[i] = entry;
+    return z;
+}
+
+/* Remove the entry at the logical index BIT.  Returns NULL if the node
+   becomes empty. */
+static PHNode *node_remove(PHNode *n, void *edit, u_long bit, int i)
+{
+    int size = node_size(n);
+    if (size == 1) return NULL;
+    PHNode *z = node_alloc(size-1, edit);
+    z->emap = n->emap & ~bit;
+    z->lmap = n->lmap & ~bit;
+    memcpy(z->entries, n->entries, sizeof(void*)*i);
+    memcpy(z->entries+i, n->entries+i+1, sizeof(void*)*(size-i-1));
+    return z;
+}
+
+/* If N only has a leaf, returns it. */
+static inline PHLeaf *node_single_leaf(PHNode *n)
+{
+    if (n->lmap == n->emap && node_size(n) == 1) return n->entries[0];
+    return NULL;
+}
+
+static PHLeaf *leaf_new(u_long hash, ScmObj key, ScmObj value, PHLeaf *next)
+{
+    PHLeaf *l = SCM_NEW(PHLeaf);
+    l->hash = hash;
+    l->key = key;
+    l->value = value;
+    l->next = next;
+    return l;
+}
+
+/* Create a node that contains two leaves of different hash values,
+   both of which fall into the same index up to SHIFT. */
+static PHNode *node_pair(void *edit, int shift, PHLeaf *a, PHLeaf *b)
+{
+    u_int ia = (a->hash >> shift) & PH_MASK;
+    u_int ib = (b->hash >> shift) & PH_MASK;
+    if (ia == ib) {
+        PHNode *z = node_alloc(1, edit);
+        z->emap = 1UL << ia;
+        z->lmap = 0;
+        z->entries[0] = node_pair(edit, shift+PH_SHIFT, a, b);
+        return z;
+    } else {
+        PHNode *z = node_alloc(2, edit);
+        z->emap = z->lmap = (1UL << ia) | (1UL << ib);
+        z->entries[ia < ib ? 0 : 1] = a;
+        z->entries[ia < ib ? 1 : 0] = b;
+        return z;
+    }
+}
+
+/*
+ * Lookup
+ */
+static PHLeaf *phmap_search(PHashMap *m, ScmObj key)
+{
+    u_long hv = m->hashfn(key) & HASH_MASK;
+    PHNode *n = m->root;
+
+    for (int shift = 0; n != NULL; shift += PH_SHIFT) {
+        u_int ix = (hv >> shift) & PH_MASK;
+        u_long bit = 1UL << ix;
+        if (!(n->emap & bit)) return NULL;
+        int i = (int)Scm__CountBitsBelow(n->emap, ix);
+        if (n->lmap & bit) {
+            PHLeaf *l = n->entries[i];
+            if (l->hash != hv) return NULL;
+            for (; l; l = l->next) {
+                if (m->cmpfn(key, l->key)) return l;
+            }
+            return NULL;
+        }
+        n = n->entries[i];
+    }
+    return NULL;
+}
+
+ScmObj PHashMapRef(PHashMap *m, ScmObj key, ScmObj fallback)
+{
+    PHLeaf *l = phmap_search(m, key);
+    return l? l->value : fallback;
+}
+
+/*
+ * Insertion
+ */
+
+/* Returns a chain with KEY associated to VALUE.  Returns the same
+   chain if it already has the same association. */
+static PHLeaf *chain_put(PHashMap *m, PHLeaf *chain, ScmObj key,
+                         ScmObj value, int *added)
+{
+    PHLeaf *l = chain;
+    for (; l; l = l->next) {
+        if (m->cmpfn(key, l->key)) break;
+    }
+    if (l == NULL) {
+        *added = TRUE;
+        return leaf_new(chain->hash, key, value, chain);
+    }
+    if (SCM_EQ(l->value, value)) return chain;
+
+    /* Copy the leaves before L, and share the ones after L. */
+    PHLeaf *h = NULL, **t = &h;
+    for (PHLeaf *p = chain; p != l; p = p->next) {
+        *t = leaf_new(p->hash, p->key, p->value, NULL);
+        t = &(*t)->next;
+    }
+    *t = leaf_new(l->hash, l->key, value, l->next);
+    return h;
+}
+
+static PHNode *node_put(PHashMap *m, PHNode *n, int shift, u_long hv,
+                        ScmObj key, ScmObj value, void *edit, int *added)
+{
+    u_int ix = (hv >> shift) & PH_MASK;
+    u_long bit = 1UL << ix;
+
+    if (n == NULL || !(n->emap & bit)) {
+        *added = TRUE;
+        int i = n? (int)Scm__CountBitsBelow(n->emap, ix) : 0;
+        return node_insert(n, edit, bit, i, leaf_new(hv, key, value, NULL),
+                           TRUE);
+    }
+
+    int i = (int)Scm__CountBitsBelow(n->emap, ix);
+    if (n->lmap & bit) {
+        PHLeaf *l = n->entries[i];
+        if (l->hash == hv) {
+            PHLeaf *nl = chain_put(m, l, key, value, added);
+            if (nl == l) return n;
+            return node_set(n, edit, bit, i, nl, TRUE);
+        } else {
+            *added = TRUE;
+            PHNode *sub = node_pair(edit, shift+PH_SHIFT, l,
+                                    leaf_new(hv, key, value, NULL));
+            return node_set(n, edit, bit, i, sub, FALSE);
+        }
+    } else {
+        PHNode *c = n->entries[i];
+        PHNode *nc = node_put(m, c, shift+PH_SHIFT, hv, key, value,
+                              edit, added);
+        if (nc == c) return n;
+        return node_set(n, edit, bit, i, nc, FALSE);
+    }
+}
+
+/*
+ * Deletion
+ */
+
+/* Returns a chain without KEY.  Returns the same chain if KEY isn't
+   in it, or NULL if the chain becomes empty. */
+static PHLeaf *chain_delete(PHashMap *m, PHLeaf *chain, ScmObj key,
+                            int *removed)
+{
+    PHLeaf *l = chain;
+    for (; l; l = l->next) {
+        if (m->cmpfn(key, l->key)) break;
+    }
+    if (l == NULL) return chain;
+    *removed = TRUE;
+
+    PHLeaf *h = l->next, **t = &h;
+    for (PHLeaf *p = chain; p != l; p = p->next) {
+        *t = leaf_new(p->hash, p->key, p->value, NULL);
+        t = &(*t)->next;
+    }
+    if (t != &h) *t = l->next;
+    return h;
+}
+
+static PHNode *node_delete(PHashMap *m, PHNode *n, int shift, u_long hv,
+                           ScmObj key, void *edit, int *removed)
+{
+    u_int ix = (hv >> shift) & PH_MASK;
+    u_long bit = 1UL << ix;
+
+    if (!(n->emap & bit)) return n;
+    int i = (int)Scm__CountBitsBelow(n->emap, ix);
+    if (n->lmap & bit) {
+        PHLeaf *l = n->entries[i];
+        if (l->hash != hv) return n;
+        PHLeaf *nl = chain_delete(m, l, key, removed);
+        if (nl == l) return n;
+        if (nl) return node_set(n, edit, bit, i, nl, TRUE);
+        return node_remove(n, edit, bit, i);
+    } else {
+        PHNode *c = n->entries[i];
+        PHNode *nc = node_delete(m, c, shift+PH_SHIFT, hv, key, edit,
+                                 removed);
+        /* A transient may have removed the key from C in place, in
+           which case NC is C but we still have to check the shape. */
+        if (!*removed) return n;
+        if (nc == NULL) return node_remove(n, edit, bit, i);
+        /* Pull up a lone leaf, to keep the shape canonical. */
+        PHLeaf *sl = node_single_leaf(nc);
+        if (sl) return node_set(n, edit, bit, i, sl, TRUE);
+        return node_set(n, edit, bit, i, nc, FALSE);
+    }
+}
+
+/*
+ * Persistent and transient updates
+ */
+
+static void check_persistent(PHashMap *m)
+{
+    if (m->edit != NULL || !SCM_XTYPEP(m, SCM_CLASS_PERSISTENT_HASH_MAP)) {
+        Scm_Error("persistent hash map required, but got %S", SCM_OBJ(m));
+    }
+}
+
+static void check_transient(PHashMap *m)
+{
+    if (!SCM_XTYPEP(m, SCM_CLASS_TRANSIENT_HASH_MAP)) {
+        Scm_Error("transient hash map required, but got %S", SCM_OBJ(m));
+    }
+    if (m->edit == NULL) {
+        Scm_Error("transient hash map %S has already been made persistent",
+                  SCM_OBJ(m));
+    }
+}
+
+ScmObj PHashMapPut(PHashMap *m, ScmObj key, ScmObj value)
+{
+    check_persistent(m);
+    int added = FALSE;
+    u_long hv = m->hashfn(key) & HASH_MASK;
+    PHNode *r = node_put(m, m->root, 0, hv, key, value, NULL, &added);
+    if (r == m->root) return SCM_OBJ(m);
+    return SCM_OBJ(phmap_new(SCM_CLASS_PERSISTENT_HASH_MAP, m, r,
+                             m->numEntries + (added? 1 : 0), NULL));
+}
+
+ScmObj PHashMapDelete(PHashMap *m, ScmObj key)
+{
+    check_persistent(m);
+    if (m->root == NULL) return SCM_OBJ(m);
+    int removed = FALSE;
+    u_long hv = m->hashfn(key) & HASH_MASK;
+    PHNode *r = node_delete(m, m->root, 0, hv, key, NULL, &removed);
+    if (!removed) return SCM_OBJ(m);
+    return SCM_OBJ(phmap_new(SCM_CLASS_PERSISTENT_HASH_MAP, m, r,
+                             m->numEntries - 1, NULL));
+}
+
+void PHashMapPutX(PHashMap *m, ScmObj key, ScmObj value)
+{
+    check_transient(m);
+    int added = FALSE;
+    u_long hv = m->hashfn(key) & HASH_MASK;
+    m->root = node_put(m, m->root, 0, hv, key, value, m->edit, &added);
+    if (added) m->numEntries++;
+}
+
+int PHashMapDeleteX(PHashMap *m, ScmObj key)
+{
+    check_transient(m);
+    if (m->root == NULL) return FALSE;
+    int removed = FALSE;
+    u_long hv = m->hashfn(key) & HASH_MASK;
+    m->root = node_delete(m, m->root, 0, hv, key, m->edit, &removed);
+    if (removed) m->numEntries--;
+    return removed;
+}
+
+ScmObj PHashMapTransient(PHashMap *m)
+{
+    check_persistent(m);
+    return SCM_OBJ(phmap_new(SCM_CLASS_TRANSIENT_HASH_MAP, m, m->root,
+                             m->numEntries, new_edit_token()));
+}
+
+ScmObj PHashMapPersistent(PHashMap *m)
+{
+    check_transient(m);
+    m->edit = NULL;             /* invalidate the transient */
+    return SCM_OBJ(phmap_new(SCM_CLASS_PERSISTENT_HASH_MAP, m, m->root,
+                             m->numEntries, NULL));
+}
+
+/*
+ * Equality
+ */
+
+/* Two chains have the same hash value.  Their order may differ. */
+static int chain_equal(PHashMap *m, PHLeaf *a, PHLeaf *b)
+{
+    if (a == b) return TRUE;
+    if (a->hash != b->hash) return FALSE;
+    int na = 0, nb = 0;
+    for (PHLeaf *p = a; p; p = p->next) na++;
+    for (PHLeaf *p = b; p; p = p->next) nb++;
+    if (na != nb) return FALSE;
+    for (PHLeaf *p = a; p; p = p->next) {
+        PHLeaf *q = b;
+        for (; q; q = q->next) {
+            if (m->cmpfn(p->key, q->key)) break;
+        }
+        if (q == NULL || !Scm_EqualP(p->value, q->value)) return FALSE;
+    }
+    return TRUE;
+}
+
+static int node_equal(PHashMap *m, PHNode *a, PHNode *b)
+{
+    if (a == b) return TRUE;    /* shared subtrie */
+    if (a == NULL || b == NULL) return FALSE;
+    if (a->emap != b->emap || a->lmap != b->lmap) return FALSE;
+    int size = node_size(a);
+    for (int i=0, ix=0; i<size; ix++) {
+        u_long bit = 1UL << ix;
+        if (!(a->emap & bit)) continue;
+        if (a->lmap & bit) {
+            if (!chain_equal(m, a->entries[i], b->entries[i])) return FALSE;
+        } else {
+            if (!node_equal(m, a->entries[i], b->entries[i])) return FALSE;
+        }
+        i++;
+    }
+    return TRUE;
+}
+
+int PHashMapEqual(PHashMap *a, PHashMap *b)
+{
+    if (a->numEntries != b->numEntries) return FALSE;
+    if (a->type == b->type) return node_equal(a, a->root, b->root);
+
+    /* Different key equality; compare entry by entry. */
+    PHashMapIter it;
+    PHLeaf *l;
+    PHashMapIterInit(&it, a);
+    while ((l = PHashMapIterNext(&it)) != NULL) {
+        PHLeaf *q = phmap_search(b, l->key);
+        if (q == NULL || !Scm_EqualP(l->value, q->value)) return FALSE;
+    }
+    return TRUE;
+}
+
+static int phmap_compare(ScmObj x, ScmObj y, int equalp)
+{
+    if (!equalp) {
+        Scm_Error("can't compare persistent hash maps: %S and %S", x, y);
+    }
+    return PHashMapEqual(PHASH_MAP(x), PHASH_MAP(y))? 0 : -1;
+}
+
+/*
+ * Iterator
+ */
+void PHashMapIterInit(PHashMapIter *it, PHashMap *m)
+{
+    it->depth = 0;
+    it->chain = NULL;
+    if (m->root) {
+        it->nodes[0] = m->root;
+        it->index[0] = 0;
+        it->depth = 1;
+    }
+}
+
+PHLeaf *PHashMapIterNext(PHashMapIter *it)
+{
+    if (it->chain) {
+        PHLeaf *l = it->chain;
+        it->chain = l->next;
+        return l;
+    }
+    while (it->depth > 0) {
+        PHNode *n = it->nodes[it->depth-1];
+        int i = it->index[it->depth-1];
+        if (i >= node_size(n)) {
+            it->depth--;
+            continue;
+        }
+        it->index[it->depth-1]++;
+        /* Find the logical index of the I-th entry to see if it's a leaf */
+        u_long m = n->emap;
+        for (int k = 0; k < i; k++) m &= m - 1; /* drop lower bits */
+        u_long bit = m & (~m + 1);
+        if (n->lmap & bit) {
+            PHLeaf *l = n->entries[i];
+            it->chain = l->next;
+            return l;
+        } else {
+            SCM_ASSERT(it->depth < 8);
+            it->nodes[it->depth] = n->entries[i];
+            it->index[it->depth] = 0;
+            it->depth++;
+        }
+    }
+    return NULL;
+}
+
+/*===================================================================
+ * Persistent tree map
+ */
+
+static void ptmap_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<%s-tree-map %lu entries>",
+               SCM_XTYPEP(obj, SCM_CLASS_TRANSIENT_TREE_MAP)
+               ? "transient" : "persistent",
+               PTREE_MAP_NUM_ENTRIES(PTREE_MAP(obj)));
+}
+
+static int ptmap_compare(ScmObj x, ScmObj y, int equalp);
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_PersistentTreeMapClass,
+                         ptmap_print, ptmap_compare, NULL, NULL,
+                         SCM_CLASS_ORDERED_DICTIONARY_CPL);
+SCM_DEFINE_BUILTIN_CLASS(Scm_TransientTreeMapClass,
+                         ptmap_print, ptmap_compare, NULL, NULL,
+                         SCM_CLASS_ORDERED_DICTIONARY_CPL);
+
+#define PT_DELTA  3
+#define PT_GAMMA  2
+
+static inline u_long pt_size(PTNode *n)
+{
+    return n? n->size : 0;
+}
+
+static inline u_long pt_weight(PTNode *n)
+{
+    return pt_size(n) + 1;
+}
+
+static PTreeMap *ptmap_new(ScmClass *klass, ScmObj cmp, PTNode *root,
+                           void *edit)
+{
+    PTreeMap *m = SCM_NEW(PTreeMap);
+    SCM_SET_CLASS(m, klass);
+    m->root = root;
+    m->cmp = cmp;
+    m->edit = edit;
+    return m;
+}
+
+ScmObj PTreeMapMake(ScmObj cmp)
+{
+    if (!SCM_FALSEP(cmp) && !SCM_PROCEDUREP(cmp)) {
+        Scm_Error("procedure or #f required for a comparison procedure, "
+                  "but got %S", cmp);
+    }
+    return SCM_OBJ(ptmap_new(SCM_CLASS_PERSISTENT_TREE_MAP, cmp, NULL, NULL));
+}
+
+static int ptmap_cmp(PTreeMap *m, ScmObj a, ScmObj b)
+{
+    if (SCM_FALSEP(m->cmp)) return Scm_Compare(a, b);
+    ScmObj r = Scm_ApplyRec2(m->cmp, a, b);
+    if (!SCM_INTP(r)) {
+        Scm_Error("comparison procedure of %S returned non-fixnum: %S",
+                  SCM_OBJ(m), r);
+    }
+    return (int)SCM_INT_VALUE(r);
+}
+
+/* Makes a node.  If REUSE is editable by EDIT, modifies it in place. */
+static PTNode *mk(void *edit, PTNode *reuse, ScmObj key, ScmObj value,
+                  PTNode *left, PTNode *right)
+{
+    PTNode *n;
+    if (reuse && edit && reuse->edit == edit) {
+        n = reuse;
+    } else {
+        n = SCM_NEW(PTNode);
+        n->edit = edit;
+    }
+    n->key = key;
+    n->value = value;
+    n->left = left;
+    n->right = right;
+    n->size = pt_size(left) + pt_size(right) + 1;
+    return n;
+}
+
+/* Rotations.  Note that mk() may overwrite the node passed as REUSE,
+   so we fetch all the fields we need beforehand. */
+static PTNode *rotate_l(void *edit, PTNode *n, ScmObj k, ScmObj v,
+                        PTNode *l, PTNode *r)
+{
+    PTNode *rl = r->left, *rr = r->right;
+    ScmObj rk = r->key, rv = r->value;
+    if (pt_weight(rl) < PT_GAMMA * pt_weight(rr)) {
+        /* single */
+        PTNode *a = mk(edit, n, k, v, l, rl);
+        return mk(edit, r, rk, rv, a, rr);
+    } else {
+        /* double */
+        PTNode *rll = rl->left, *rlr = rl->right;
+        ScmObj rlk = rl->key, rlv = rl->value;
+        PTNode *a = mk(edit, n, k, v, l, rll);
+        PTNode *b = mk(edit, r, rk, rv, rlr, rr);
+        return mk(edit, rl, rlk, rlv, a, b);
+    }
+}
+
+static PTNode *rotate_r(void *edit, PTNode *n, ScmObj k, ScmObj v,
+                        PTNode *l, PTNode *r)
+{
+    PTNode *ll = l->left, *lr = l->right;
+    ScmObj lk = l->key, lv = l->value;
+    if (pt_weight(lr) < PT_GAMMA * pt_weight(ll)) {
+        /* single */
+        PTNode *a = mk(edit, n, k, v, lr, r);
+        return mk(edit, l, lk, lv, ll, a);
+    } else {
+        /* double */
+        PTNode *lrl = lr->left, *lrr = lr->right;
+        ScmObj lrk = lr->key, lrv = lr->value;
+        PTNode *a = mk(edit, l, lk, lv, ll, lrl);
+        PTNode *b = mk(edit, n, k, v, lrr, r);
+        return mk(edit, lr, lrk, lrv, a, b);
+    }
+}
+
+/* Makes a node with K, V, L and R, where the balance between L and R
+   may be off by one insertion or deletion. */
+static PTNode *balance(void *edit, PTNode *n, ScmObj k, ScmObj v,
+                       PTNode *l, PTNode *r)
+{
+    u_long wl = pt_weight(l), wr = pt_weight(r);
+    if (wr > PT_DELTA * wl) return rotate_l(edit, n, k, v, l, r);
+    if (wl > PT_DELTA * wr) return rotate_r(edit, n, k, v, l, r);
+    return mk(edit, n, k, v, l, r);
+}
+
+/* In a transient map, a subtree may be modified in place, so we can't
+   tell whether it's changed only by the pointer.  ADDED and REMOVED
+   tell us that the size has changed. */
+static PTNode *pt_put(PTreeMap *m, PTNode *n, ScmObj key, ScmObj value,
+                      void *edit, int *added)
+{
+    if (n == NULL) {
+        *added = TRUE;
+        return mk(edit, NULL, key, value, NULL, NULL);
+    }
+    int c = ptmap_cmp(m, key, n->key);
+    if (c < 0) {
+        PTNode *nl = pt_put(m, n->left, key, value, edit, added);
+        if (nl == n->left && !*added) return n;
+        return balance(edit, n, n->key, n->value, nl, n->right);
+    } else if (c > 0) {
+        PTNode *nr = pt_put(m, n->right, key, value, edit, added);
+        if (nr == n->right && !*added) return n;
+        return balance(edit, n, n->key, n->value, n->left, nr);
+    } else {
+        if (SCM_EQ(n->value, value)) return n;
+        return mk(edit, n, n->key, value, n->left, n->right);
+    }
+}
+
+static PTNode *pt_delete_min(PTNode *n, void *edit, PTNode **min)
+{
+    if (n->left == NULL) {
+        *min = n;
+        return n->right;
+    }
+    PTNode *nl = pt_delete_min(n->left, edit, min);
+    return balance(edit, n, n->key, n->value, nl, n->right);
+}
+
+static PTNode *pt_delete_max(PTNode *n, void *edit, PTNode **max)
+{
+    if (n->right == NULL) {
+        *max = n;
+        return n->left;
+    }
+    PTNode *nr = pt_delete_max(n->right, edit, max);
+    return balance(edit, n, n->key, n->value, n->left, nr);
+}
+
+/* Joins L and R, where all keys in L are smaller than the ones in R,
+   and they're balanced with each other.  N is the node being removed. */
+static PTNode *pt_glue(PTNode *n, PTNode *l, PTNode *r, void *edit)
+{
+    PTNode *x;
+    if (l == NULL) return r;
+    if (r == NULL) return l;
+    if (pt_size(l) > pt_size(r)) {
+        PTNode *nl = pt_delete_max(l, edit, &x);
+        return balance(edit, n, x->key, x->value, nl, r);
+    } else {
+        PTNode *nr = pt_delete_min(r, edit, &x);
+        return balance(edit, n, x->key, x->value, l, nr);
+    }
+}
+
+static PTNode *pt_delete(PTreeMap *m, PTNode *n, ScmObj key, void *edit,
+                         int *removed)
+{
+    if (n == NULL) return NULL;
+    int c = ptmap_cmp(m, key, n->key);
+    if (c < 0) {
+        PTNode *nl = pt_delete(m, n->left, key, edit, removed);
+        if (nl == n->left && !*removed) return n;
+        return balance(edit, n, n->key, n->value, nl, n->right);
+    } else if (c > 0) {
+        PTNode *nr = pt_delete(m, n->right, key, edit, removed);
+        if (nr == n->right && !*removed) return n;
+        return balance(edit, n, n->key, n->value, n->left, nr);
+    } else {
+        *removed = TRUE;
+        return pt_glue(n, n->left, n->right, edit);
+    }
+}
+
+ScmObj PTreeMapRef(PTreeMap *m, ScmObj key, ScmObj fallback)
+{
+    PTNode *n = m->root;
+    while (n) {
+        int c = ptmap_cmp(m, key, n->key);
+        if (c == 0) return n->value;
+        n = (c < 0)? n->left : n->right;
+    }
+    return fallback;
+}
+
+static void check_persistent_tree(PTreeMap *m)
+{
+    if (m->edit != NULL || !SCM_XTYPEP(m, SCM_CLASS_PERSISTENT_TREE_MAP)) {
+        Scm_Error("persistent tree map required, but got %S", SCM_OBJ(m));
+    }
+}
+
+static void check_transient_tree(PTreeMap *m)
+{
+    if (!SCM_XTYPEP(m, SCM_CLASS_TRANSIENT_TREE_MAP)) {
+        Scm_Error("transient tree map required, but got %S", SCM_OBJ(m));
+    }
+    if (m->edit == NULL) {
+        Scm_Error("transient tree map %S has already been made persistent",
+                  SCM_OBJ(m));
+    }
+}
+
+ScmObj PTreeMapPut(PTreeMap *m, ScmObj key, ScmObj value)
+{
+    check_persistent_tree(m);
+    int added = FALSE;
+    PTNode *r = pt_put(m, m->root, key, value, NULL, &added);
+    if (r == m->root) return SCM_OBJ(m);
+    return SCM_OBJ(ptmap_new(SCM_CLASS_PERSISTENT_TREE_MAP, m->cmp, r, NULL));
+}
+
+ScmObj PTreeMapDelete(PTreeMap *m, ScmObj key)
+{
+    check_persistent_tree(m);
+    int removed = FALSE;
+    PTNode *r = pt_delete(m, m->root, key, NULL, &removed);
+    if (!removed) return SCM_OBJ(m);
+    return SCM_OBJ(ptmap_new(SCM_CLASS_PERSISTENT_TREE_MAP, m->cmp, r, NULL));
+}
+
+void PTreeMapPutX(PTreeMap *m, ScmObj key, ScmObj value)
+{
+    check_transient_tree(m);
+    int added = FALSE;
+    m->root = pt_put(m, m->root, key, value, m->edit, &added);
+}
+
+int PTreeMapDeleteX(PTreeMap *m, ScmObj key)
+{
+    check_transient_tree(m);
+    int removed = FALSE;
+    m->root = pt_delete(m, m->root, key, m->edit, &removed);
+    return removed;
+}
+
+ScmObj PTreeMapTransient(PTreeMap *m)
+{
+    check_persistent_tree(m);
+    return SCM_OBJ(ptmap_new(SCM_CLASS_TRANSIENT_TREE_MAP, m->cmp, m->root,
+                             new_edit_token()));
+}
+
+ScmObj PTreeMapPersistent(PTreeMap *m)
+{
+    check_transient_tree(m);
+    m->edit = NULL;             /* invalidate the transient */
+    return SCM_OBJ(ptmap_new(SCM_CLASS_PERSISTENT_TREE_MAP, m->cmp, m->root,
+                             NULL));
+}
+
+PTNode *PTreeMapMin(PTreeMap *m)
+{
+    PTNode *n = m->root;
+    if (n) while (n->left) n = n->left;
+    return n;
+}
+
+PTNode *PTreeMapMax(PTreeMap *m)
+{
+    PTNode *n = m->root;
+    if (n) while (n->right) n = n->right;
+    return n;
+}
+
+/*
+ * Iterator
+ */
+static void pt_push(PTreeMapIter *it, PTNode *n)
+{
+    while (n) {
+        SCM_ASSERT(it->sp < PTREE_MAX_DEPTH);
+        it->stack[it->sp++] = n;
+        n = it->backward? n->right : n->left;
+    }
+}
+
+void PTreeMapIterInit(PTreeMapIter *it, PTreeMap *m, int backward)
+{
+    it->sp = 0;
+    it->backward = backward;
+    pt_push(it, m->root);
+}
+
+PTNode *PTreeMapIterNext(PTreeMapIter *it)
+{
+    if (it->sp == 0) return NULL;
+    PTNode *n = it->stack[--it->sp];
+    pt_push(it, it->backward? n->left : n->right);
+    return n;
+}
+
+/*
+ * Equality
+ */
+int PTreeMapEqual(PTreeMap *a, PTreeMap *b)
+{
+    if (a->root == b->root) return TRUE;
+    if (PTREE_MAP_NUM_ENTRIES(a) != PTREE_MAP_NUM_ENTRIES(b)) return FALSE;
+
+    PTreeMapIter ia, ib;
+    PTNode *x, *y;
+    PTreeMapIterInit(&ia, a, FALSE);
+    PTreeMapIterInit(&ib, b, FALSE);
+    while ((x = PTreeMapIterNext(&ia)) != NULL) {
+        y = PTreeMapIterNext(&ib);
+        if (x == y) continue;
+        if (ptmap_cmp(a, x->key, y->key) != 0) return FALSE;
+        if (!Scm_EqualP(x->value, y->value)) return FALSE;
+    }
+    return TRUE;
+}
+
+static int ptmap_compare(ScmObj x, ScmObj y, int equalp)
+{
+    if (!equalp) {
+        Scm_Error("can't compare persistent tree maps: %S and %S", x, y);
+    }
+    return PTreeMapEqual(PTREE_MAP(x), PTREE_MAP(y))? 0 : -1;
+}
+
+/*===================================================================
+ * Initialization
+ */
+void Scm_Init_pmap(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_PersistentHashMapClass,
+                        "<persistent-hash-map>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_TransientHashMapClass,
+                        "<transient-hash-map>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_PersistentTreeMapClass,
+                        "<persistent-tree-map>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_TransientTreeMapClass,
+                        "<transient-tree-map>", mod, NULL, 0);
+}
@@ -0,0 +1,190 @@
+/*
+ * pmap.h - Persistent maps
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_PMAP_H
+#define GAUCHE_PMAP_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+#if defined(EXTSPARSE_EXPORTS)
+#define LIBGAUCHE_EXT_BODY
+#endif
+#include <gauche/extern.h>      /* redefine SCM_EXTERN */
+
+/* Persistent maps
+ *
+ * A persistent map is immutable.  An 'update' operation returns a new
+ * map that shares most of its structure with the original one, so it
+ * costs O(log n) instead of O(n) of copying.
+ *
+ * A transient map is a mutable map created from a persistent map in
+ * O(1).  It updates the nodes it has created in place, so a batch of
+ * updates doesn't allocate a new path for every single update.  Once
+ * you're done, you turn it into a persistent map, again in O(1), and
+ * the transient map can no longer be used.  A transient map isn't
+ * thread-safe; it should be used only by the thread that created it.
+ *
+ * Each node records the transient map that created it, by the 'edit'
+ * token.  Only the transient map that has the same token may modify
+ * the node in place.  Nodes of persistent maps have NULL or a token
+ * that is no longer active, so they are never modified.
+ */
+
+/*
+ * Persistent hash map (HAMT)
+ *
+ * The node layout follows CompactTrie (ctrie.h): a node is a 32-way
+ * branch with EMAP and LMAP bitmaps, followed by the entries in compact
+ * form.  Unlike CompactTrie, a leaf is placed at the shallowest level
+ * where its hash value can be distinguished from the others, and a
+ * node that is left with just a leaf after deletion is collapsed.  So
+ * the shape of the trie is determined by the set of hash values, which
+ * allows us to compare two maps by walking their tries side by side,
+ * skipping shared subtries.
+ */
+
+typedef struct PHNodeRec {
+    u_long   emap;              /* bitmap: 1 = has entry */
+    u_long   lmap;              /* bitmap: 1 = entry is leaf */
+    void    *edit;              /* transient token of the creator */
+    void    *entries[1];        /* variable length */
+} PHNode;
+
+typedef struct PHLeafRec {
+    u_long   hash;              /* lower 32 bits of the hash value */
+    ScmObj   key;
+    ScmObj   value;
+    struct PHLeafRec *next;     /* other leaves with the same hash value */
+} PHLeaf;
+
+typedef struct PHashMapRec {
+    SCM_HEADER;
+    PHNode      *root;          /* NULL if empty */
+    u_long       numEntries;
+    ScmHashType  type;
+    u_long       (*hashfn)(ScmObj key);
+    int          (*cmpfn)(ScmObj a, ScmObj b);
+    void        *edit;          /* transient token; NULL if persistent */
+} PHashMap;
+
+SCM_CLASS_DECL(Scm_PersistentHashMapClass);
+SCM_CLASS_DECL(Scm_TransientHashMapClass);
+#define SCM_CLASS_PERSISTENT_HASH_MAP  (&Scm_PersistentHashMapClass)
+#define SCM_CLASS_TRANSIENT_HASH_MAP   (&Scm_TransientHashMapClass)
+#define PHASH_MAP(obj)          ((PHashMap*)(obj))
+#define PHASH_MAP_P(obj)                                        \
+    (SCM_XTYPEP(obj, SCM_CLASS_PERSISTENT_HASH_MAP)             \
+     || SCM_XTYPEP(obj, SCM_CLASS_TRANSIENT_HASH_MAP))
+
+extern ScmObj PHashMapMake(ScmHashType type);
+extern ScmObj PHashMapRef(PHashMap *m, ScmObj key, ScmObj fallback);
+extern ScmObj PHashMapPut(PHashMap *m, ScmObj key, ScmObj value);
+extern ScmObj PHashMapDelete(PHashMap *m, ScmObj key);
+extern void   PHashMapPutX(PHashMap *m, ScmObj key, ScmObj value);
+extern int    PHashMapDeleteX(PHashMap *m, ScmObj key);
+extern ScmObj PHashMapTransient(PHashMap *m);
+extern ScmObj PHashMapPersistent(PHashMap *m);
+extern int    PHashMapEqual(PHashMap *a, PHashMap *b);
+
+typedef struct PHashMapIterRec {
+    PHNode  *nodes[8];          /* 32bit hash / 5bit per level */
+    int      index[8];
+    int      depth;
+    PHLeaf  *chain;
+} PHashMapIter;
+
+extern void    PHashMapIterInit(PHashMapIter *it, PHashMap *m);
+extern PHLeaf *PHashMapIterNext(PHashMapIter *it);
+
+/*
+ * Persistent tree map
+ *
+ * A weight-balanced tree, with the parameters <3,2> (Hirai and
+ * Yamamoto, "Balancing weight-balanced trees", 2011).  Updates copy
+ * the path from the root.
+ */
+
+typedef struct PTNodeRec {
+    struct PTNodeRec *left;
+    struct PTNodeRec *right;
+    ScmObj   key;
+    ScmObj   value;
+    u_long   size;              /* # of nodes in this subtree */
+    void    *edit;              /* transient token of the creator */
+} PTNode;
+
+typedef struct PTreeMapRec {
+    SCM_HEADER;
+    PTNode  *root;              /* NULL if empty */
+    ScmObj   cmp;               /* comparison procedure, or #f to use
+                                   Scm_Compare */
+    void    *edit;              /* transient token; NULL if persistent */
+} PTreeMap;
+
+SCM_CLASS_DECL(Scm_PersistentTreeMapClass);
+SCM_CLASS_DECL(Scm_TransientTreeMapClass);
+#define SCM_CLASS_PERSISTENT_TREE_MAP  (&Scm_PersistentTreeMapClass)
+#define SCM_CLASS_TRANSIENT_TREE_MAP   (&Scm_TransientTreeMapClass)
+#define PTREE_MAP(obj)          ((PTreeMap*)(obj))
+#define PTREE_MAP_P(obj)                                        \
+    (SCM_XTYPEP(obj, SCM_CLASS_PERSISTENT_TREE_MAP)             \
+     || SCM_XTYPEP(obj, SCM_CLASS_TRANSIENT_TREE_MAP))
+#define PTREE_MAP_NUM_ENTRIES(m) ((m)->root? (m)->root->size : 0)
+
+extern ScmObj PTreeMapMake(ScmObj cmp);
+extern ScmObj PTreeMapRef(PTreeMap *m, ScmObj key, ScmObj fallback);
+extern ScmObj PTreeMapPut(PTreeMap *m, ScmObj key, ScmObj value);
+extern ScmObj PTreeMapDelete(PTreeMap *m, ScmObj key);
+extern void   PTreeMapPutX(PTreeMap *m, ScmObj key, ScmObj value);
+extern int    PTreeMapDeleteX(PTreeMap *m, ScmObj key);
+extern ScmObj PTreeMapTransient(PTreeMap *m);
+extern ScmObj PTreeMapPersistent(PTreeMap *m);
+extern int    PTreeMapEqual(PTreeMap *a, PTreeMap *b);
+extern PTNode *PTreeMapMin(PTreeMap *m);
+extern PTNode *PTreeMapMax(PTreeMap *m);
+
+#define PTREE_MAX_DEPTH 128
+
+typedef struct PTreeMapIterRec {
+    PTNode  *stack[PTREE_MAX_DEPTH];
+    int      sp;
+    int      backward;
+} PTreeMapIter;
+
+extern void    PTreeMapIterInit(PTreeMapIter *it, PTreeMap *m, int backward);
+extern PTNode *PTreeMapIterNext(PTreeMapIter *it);
+
+extern void   Scm_Init_pmap(ScmModule *mod);
+
+#endif /*GAUCHE_PMAP_H*/
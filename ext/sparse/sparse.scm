@@ -55,6 +55,48 @@
           sparse-vector-push! sparse-vector-pop!
           sparse-vector-fold sparse-vector-map sparse-vector-for-each
           sparse-vector-keys sparse-vector-values %sparse-vector-dump
+
+          <persistent-hash-map> <transient-hash-map>
+          make-persistent-hash-map alist->persistent-hash-map
+          persistent-hash-map? transient-hash-map?
+          persistent-hash-map-num-entries persistent-hash-map-ref
+          persistent-hash-map-exists? persistent-hash-map-put
+          persistent-hash-map-delete persistent-hash-map-update
+          persistent-hash-map-fold persistent-hash-map-fold-right
+          persistent-hash-map-map
+          persistent-hash-map-for-each persistent-hash-map-keys
+          persistent-hash-map-values persistent-hash-map->alist
+          persistent-hash-map-transient transient-hash-map-put!
+          transient-hash-map-delete! transient-hash-map-update!
+          transient-hash-map-persistent!
+
+          <persistent-tree-map> <transient-tree-map>
+          make-persistent-tree-map alist->persistent-tree-map
+          persistent-tree-map? transient-tree-map?
+          persistent-tree-map-num-entries persistent-tree-map-ref
+          persistent-tree-map-exists? persistent-tree-map-put
+          persistent-tree-map-delete persistent-tree-map-update
+          persistent-tree-map-min persistent-tree-map-max
+          persistent-tree-map-fold persistent-tree-map-fold-right
+          persistent-tree-map-map persistent-tree-map-for-each
+          persistent-tree-map-keys persistent-tree-map-values
+          persistent-tree-map->alist
+          persistent-tree-map-transient transient-tree-map-put!
+          transient-tree-map-delete! transient-tree-map-update!
+          transient-tree-map-persistent!
+
+          <sparse-bitmap> make-sparse-bitmap list->sparse-bitmap
+          sparse-bitmap? sparse-bitmap-cardinality sparse-bitmap-empty?
+          sparse-bitmap-contains? sparse-bitmap-add! sparse-bitmap-remove!
+          sparse-bitmap-add-range! sparse-bitmap-clear! sparse-bitmap-copy
+          sparse-bitmap-min sparse-bitmap-max
+          sparse-bitmap-union sparse-bitmap-intersection
+          sparse-bitmap-difference sparse-bitmap-union!
+          sparse-bitmap-intersection! sparse-bitmap-difference!
+          sparse-bitmap-intersection-size
+          sparse-bitmap-fold sparse-bitmap-for-each sparse-bitmap->list
+          sparse-bitmap-optimize! %sparse-bitmap-containers
+          %sparse-bitmap-dump
           )
   )
 (select-module util.sparse)
@@ -63,6 +105,8 @@
  "#include \"ctrie.h\""
  "#include \"spvec.h\""
  "#include \"sptab.h\""
+ "#include \"pmap.h\""
+ "#include \"spbitmap.h\""
  )
 
 (define-macro (define-stuff type iter ref set)
@@ -271,6 +315,363 @@
 (define-stuff sparse-vector %sparse-vector-iter
   sparse-vector-ref sparse-vector-set!)
 
+;;===============================================================
+;; Persistent maps
+;;
+;;  Both <persistent-*-map> and <transient-*-map> are accepted by the
+;;  read-only procedures.  Functional update procedures require
+;;  a persistent map, and destructive ones require a transient map.
+
+(inline-stub
+ (initcode "Scm_Init_pmap(Scm_CurrentModule());")
+
+ (define-type <persistent-hash-map> "PHashMap*" "persistent hash map"
+   "PHASH_MAP_P" "PHASH_MAP")
+ (define-type <persistent-tree-map> "PTreeMap*" "persistent tree map"
+   "PTREE_MAP_P" "PTREE_MAP")
+
+ (define-cproc make-persistent-hash-map (:optional (type 'eq?))
+   (let* ([t::ScmHashType SCM_HASH_EQ])
+     (cond
+      [(SCM_EQ type 'eq?)      (set! t SCM_HASH_EQ)]
+      [(SCM_EQ type 'eqv?)     (set! t SCM_HASH_EQV)]
+      [(SCM_EQ type 'equal?)   (set! t SCM_HASH_EQUAL)]
+      [(SCM_EQ type 'string=?) (set! t SCM_HASH_STRING)]
+      [else (Scm_Error "unsupported persistent-hash-map hash type: %S" type)])
+     (result (PHashMapMake t))))
+
+ (define-cproc persistent-hash-map? (obj) ::<boolean>
+   (result (SCM_XTYPEP obj SCM_CLASS_PERSISTENT_HASH_MAP)))
+ (define-cproc transient-hash-map? (obj) ::<boolean>
+   (result (SCM_XTYPEP obj SCM_CLASS_TRANSIENT_HASH_MAP)))
+
+ (define-cproc persistent-hash-map-num-entries (m::<persistent-hash-map>)
+   ::<ulong>
+   (result (-> m numEntries)))
+
+ (define-cproc persistent-hash-map-ref (m::<persistent-hash-map> key
+                                        :optional fallback)
+   (let* ([r (PHashMapRef m key fallback)])
+     (when (SCM_UNBOUNDP r)
+       (Scm_Error "%S doesn't have an entry for key %S" (SCM_OBJ m) key))
+     (result r)))
+
+ (define-cproc persistent-hash-map-exists? (m::<persistent-hash-map> key)
+   ::<boolean>
+   (result (not (SCM_UNBOUNDP (PHashMapRef m key SCM_UNBOUND)))))
+
+ (define-cproc persistent-hash-map-put (m::<persistent-hash-map> key value)
+   PHashMapPut)
+ (define-cproc persistent-hash-map-delete (m::<persistent-hash-map> key)
+   PHashMapDelete)
+ (define-cproc persistent-hash-map-transient (m::<persistent-hash-map>)
+   PHashMapTransient)
+
+ (define-cproc transient-hash-map-put! (m::<persistent-hash-map> key value)
+   ::<void>
+   PHashMapPutX)
+ (define-cproc transient-hash-map-delete! (m::<persistent-hash-map> key)
+   ::<boolean>
+   PHashMapDeleteX)
+ (define-cproc transient-hash-map-persistent! (m::<persistent-hash-map>)
+   PHashMapPersistent)
+
+ (define-cfn phash-map-iter (args::ScmObj* nargs::int data::void*) :static
+   (let* ([iter::PHashMapIter* (cast PHashMapIter* data)]
+          [l::PHLeaf* (PHashMapIterNext iter)]
+          [eofval (aref args 0)])
+     (if (== l NULL)
+       (return (values eofval eofval))
+       (return (values (-> l key) (-> l value))))))
+
+ (define-cproc %persistent-hash-map-iter (m::<persistent-hash-map>)
+   (let* ([iter::PHashMapIter* (SCM_NEW PHashMapIter)])
+     (PHashMapIterInit iter m)
+     (result (Scm_MakeSubr phash-map-iter iter 1 0
+                           '"persistent-hash-map-iterator"))))
+
+ (define-cproc make-persistent-tree-map (:optional (cmp #f))
+   PTreeMapMake)
+
+ (define-cproc persistent-tree-map? (obj) ::<boolean>
+   (result (SCM_XTYPEP obj SCM_CLASS_PERSISTENT_TREE_MAP)))
+ (define-cproc transient-tree-map? (obj) ::<boolean>
+   (result (SCM_XTYPEP obj SCM_CLASS_TRANSIENT_TREE_MAP)))
+
+ (define-cproc persistent-tree-map-num-entries (m::<persistent-tree-map>)
+   ::<ulong>
+   (result (PTREE_MAP_NUM_ENTRIES m)))
+
+ (define-cproc persistent-tree-map-ref (m::<persistent-tree-map> key
+                                        :optional fallback)
+   (let* ([r (PTreeMapRef m key fallback)])
+     (when (SCM_UNBOUNDP r)
+       (Scm_Error "%S doesn't have an entry for key %S" (SCM_OBJ m) key))
+     (result r)))
+
+ (define-cproc persistent-tree-map-exists? (m::<persistent-tree-map> key)
+   ::<boolean>
+   (result (not (SCM_UNBOUNDP (PTreeMapRef m key SCM_UNBOUND)))))
+
+ (define-cproc persistent-tree-map-put (m::<persistent-tree-map> key value)
+   PTreeMapPut)
+ (define-cproc persistent-tree-map-delete (m::<persistent-tree-map> key)
+   PTreeMapDelete)
+ (define-cproc persistent-tree-map-transient (m::<persistent-tree-map>)
+   PTreeMapTransient)
+
+ (define-cproc transient-tree-map-put! (m::<persistent-tree-map> key value)
+   ::<void>
+   PTreeMapPutX)
+ (define-cproc transient-tree-map-delete! (m::<persistent-tree-map> key)
+   ::<boolean>
+   PTreeMapDeleteX)
+ (define-cproc transient-tree-map-persistent! (m::<persistent-tree-map>)
+   PTreeMapPersistent)
+
+ (define-cproc persistent-tree-map-min (m::<persistent-tree-map>)
+   (let* ([n::PTNode* (PTreeMapMin m)])
+     (if (== n NULL)
+       (result SCM_FALSE)
+       (result (Scm_Cons (-> n key) (-> n value))))))
+
+ (define-cproc persistent-tree-map-max (m::<persistent-tree-map>)
+   (let* ([n::PTNode* (PTreeMapMax m)])
+     (if (== n NULL)
+       (result SCM_FALSE)
+       (result (Scm_Cons (-> n key) (-> n value))))))
+
+ (define-cfn ptree-map-iter (args::ScmObj* nargs::int data::void*) :static
+   (let* ([iter::PTreeMapIter* (cast PTreeMapIter* data)]
+          [n::PTNode* (PTreeMapIterNext iter)]
+          [eofval (aref args 0)])
+     (if (== n NULL)
+       (return (values eofval eofval))
+       (return (values (-> n key) (-> n value))))))
+
+ (define-cproc %persistent-tree-map-iter (m::<persistent-tree-map>
+                                          :optional (backward::<boolean> #f))
+   (let* ([iter::PTreeMapIter* (SCM_NEW PTreeMapIter)])
+     (PTreeMapIterInit iter m backward)
+     (result (Scm_MakeSubr ptree-map-iter iter 1 0
+                           '"persistent-tree-map-iterator"))))
+ )
+
+(define (%pmap-fold iter proc seed)
+  (let ([end (list #f)])
+    (let loop ([seed seed])
+      (receive (key val) (iter end)
+        (if (eq? key end)
+          seed
+          (loop (proc key val seed)))))))
+
+;; MAKE-ITER is applied to a map and a flag to get an iterator; if the
+;; flag is true, the iterator goes backward.  The list-returning
+;; procedures walk backward, so that the tree map's results come in
+;; the increasing order of keys.
+(define-macro (define-pmap-stuff type make-iter ref put put!)
+  (define (name fmt) (string->symbol (format fmt type)))
+  (let ([x-fold       (name "persistent-~a-fold")]
+        [x-fold-right (name "persistent-~a-fold-right")]
+        [x-map        (name "persistent-~a-map")]
+        [x-for-each   (name "persistent-~a-for-each")]
+        [x-keys       (name "persistent-~a-keys")]
+        [x-values     (name "persistent-~a-values")]
+        [x->alist     (name "persistent-~a->alist")]
+        [x-update     (name "persistent-~a-update")]
+        [x-update!    (name "transient-~a-update!")])
+    `(begin
+       (define (,x-fold m proc seed)
+         (%pmap-fold (,make-iter m #f) proc seed))
+       (define (,x-fold-right m proc seed)
+         (%pmap-fold (,make-iter m #t) proc seed))
+       (define (,x-map m proc)
+         (,x-fold-right m (^[k v s] (cons (proc k v) s)) '()))
+       (define (,x-for-each m proc)
+         (,x-fold m (^[k v _] (proc k v)) #f))
+       (define (,x-keys m)
+         (,x-fold-right m (^[k v s] (cons k s)) '()))
+       (define (,x-values m)
+         (,x-fold-right m (^[k v s] (cons v s)) '()))
+       (define (,x->alist m)
+         (,x-fold-right m acons '()))
+       (define (,x-update m k proc . fallback)
+         (,put m k (proc (apply ,ref m k fallback))))
+       (define (,x-update! m k proc . fallback)
+         (,put! m k (proc (apply ,ref m k fallback))))
+       )))
+
+;; A hash map has no order, so 'backward' is the same as 'forward'.
+(define-pmap-stuff hash-map (^[m _] (%persistent-hash-map-iter m))
+  persistent-hash-map-ref persistent-hash-map-put transient-hash-map-put!)
+(define-pmap-stuff tree-map %persistent-tree-map-iter
+  persistent-tree-map-ref persistent-tree-map-put transient-tree-map-put!)
+
+(define (alist->persistent-hash-map alist :optional (type 'eq?))
+  (let1 t (persistent-hash-map-transient (make-persistent-hash-map type))
+    (dolist [p alist] (transient-hash-map-put! t (car p) (cdr p)))
+    (transient-hash-map-persistent! t)))
+
+(define (alist->persistent-tree-map alist :optional (cmp #f))
+  (let1 t (persistent-tree-map-transient (make-persistent-tree-map cmp))
+    (dolist [p alist] (transient-tree-map-put! t (car p) (cdr p)))
+    (transient-tree-map-persistent! t)))
+
+;;===============================================================
+;; Sparse bitmaps
+;;
+
+(inline-stub
+ (initcode "Scm_Init_spbitmap(Scm_CurrentModule());")
+
+ (define-type <sparse-bitmap> "SparseBitmap*" "sparse bitmap"
+   "SPARSE_BITMAP_P" "SPARSE_BITMAP")
+
+ (define-cproc make-sparse-bitmap () MakeSparseBitmap)
+
+ (define-cproc sparse-bitmap? (obj) ::<boolean>
+   (result (SPARSE_BITMAP_P obj)))
+
+ (define-cproc sparse-bitmap-cardinality (sb::<sparse-bitmap>) ::<ulong>
+   (result (-> sb numEntries)))
+
+ (define-cproc sparse-bitmap-empty? (sb::<sparse-bitmap>) ::<boolean>
+   (result (== (-> sb numEntries) 0)))
+
+ (define-cproc sparse-bitmap-contains? (sb::<sparse-bitmap> key::<ulong>)
+   ::<boolean>
+   SparseBitmapContains)
+
+ (define-cproc sparse-bitmap-add! (sb::<sparse-bitmap> key::<ulong>)
+   ::<boolean>
+   SparseBitmapAdd)
+
+ (define-cproc sparse-bitmap-remove! (sb::<sparse-bitmap> key::<ulong>)
+   ::<boolean>
+   SparseBitmapRemove)
+
+ (define-cproc sparse-bitmap-add-range! (sb::<sparse-bitmap>
+                                         start::<ulong> end::<ulong>)
+   ::<void>
+   SparseBitmapAddRange)
+
+ (define-cproc sparse-bitmap-clear! (sb::<sparse-bitmap>) ::<void>
+   SparseBitmapClear)
+
+ (define-cproc sparse-bitmap-copy (sb::<sparse-bitmap>) SparseBitmapCopy)
+
+ (define-cproc sparse-bitmap-min (sb::<sparse-bitmap>)
+   (let* ([k::u_long 0])
+     (if (SparseBitmapMin sb (& k))
+       (result (Scm_MakeIntegerU k))
+       (result SCM_FALSE))))
+
+ (define-cproc sparse-bitmap-max (sb::<sparse-bitmap>)
+   (let* ([k::u_long 0])
+     (if (SparseBitmapMax sb (& k))
+       (result (Scm_MakeIntegerU k))
+       (result SCM_FALSE))))
+
+ (define-cproc %sparse-bitmap-union (a::<sparse-bitmap> b::<sparse-bitmap>)
+   (result (SparseBitmapOp SPB_OP_OR a b)))
+ (define-cproc %sparse-bitmap-intersection (a::<sparse-bitmap>
+                                            b::<sparse-bitmap>)
+   (result (SparseBitmapOp SPB_OP_AND a b)))
+ (define-cproc %sparse-bitmap-difference (a::<sparse-bitmap>
+                                          b::<sparse-bitmap>)
+   (result (SparseBitmapOp SPB_OP_ANDNOT a b)))
+
+ (define-cproc %sparse-bitmap-union! (a::<sparse-bitmap> b::<sparse-bitmap>)
+   ::<void>
+   (SparseBitmapOpX SPB_OP_OR a b))
+ (define-cproc %sparse-bitmap-intersection! (a::<sparse-bitmap>
+                                             b::<sparse-bitmap>)
+   ::<void>
+   (SparseBitmapOpX SPB_OP_AND a b))
+ (define-cproc %sparse-bitmap-difference! (a::<sparse-bitmap>
+                                           b::<sparse-bitmap>)
+   ::<void>
+   (SparseBitmapOpX SPB_OP_ANDNOT a b))
+
+ (define-cproc sparse-bitmap-intersection-size (a::<sparse-bitmap>
+                                                b::<sparse-bitmap>)
+   ::<ulong>
+   SparseBitmapAndCount)
+
+ (define-cproc sparse-bitmap->list (sb::<sparse-bitmap>) SparseBitmapToList)
+
+ (define-cproc sparse-bitmap-optimize! (sb::<sparse-bitmap>) ::<void>
+   SparseBitmapOptimize)
+
+ (define-cfn sparse-bitmap-iter (args::ScmObj* nargs::int data::void*) :static
+   (let* ([iter::SparseBitmapIter* (cast SparseBitmapIter* data)]
+          [k::u_long 0])
+     (if (SparseBitmapIterNext iter (& k))
+       (return (Scm_MakeIntegerU k))
+       (return (aref args 0)))))
+
+ (define-cproc %sparse-bitmap-iter (sb::<sparse-bitmap>)
+   (let* ([iter::SparseBitmapIter* (SCM_NEW SparseBitmapIter)])
+     (SparseBitmapIterInit iter sb)
+     (result
+      (Scm_MakeSubr sparse-bitmap-iter iter 1 0 '"sparse-bitmap-iterator"))))
+
+ (define-cproc %sparse-bitmap-containers (sb::<sparse-bitmap>)
+   SparseBitmapContainers)
+
+ (define-cproc %sparse-bitmap-dump (sb::<sparse-bitmap>) ::<void>
+   SparseBitmapDump)
+ )
+
+(define (list->sparse-bitmap lis)
+  (rlet1 sb (make-sparse-bitmap)
+    (dolist [k lis] (sparse-bitmap-add! sb k))))
+
+(define (sparse-bitmap-fold sb proc seed)
+  (let ([iter (%sparse-bitmap-iter sb)]
+        [end (list #f)])
+    (let loop ([seed seed])
+      (let1 k (iter end)
+        (if (eq? k end)
+          seed
+          (loop (proc k seed)))))))
+
+(define (sparse-bitmap-for-each sb proc)
+  (sparse-bitmap-fold sb (^[k _] (proc k)) #f))
+
+;; The n-ary versions.  The functional ones create a new bitmap with
+;; the first operation, and update it with the rest.
+(define-macro (define-sparse-bitmap-op name op op!)
+  (let ([name! (string->symbol (format "~a!" name))])
+    `(begin
+       (define (,name sb . sbs)
+         (if (null? sbs)
+           (sparse-bitmap-copy sb)
+           (rlet1 r (,op sb (car sbs))
+             (dolist [b (cdr sbs)] (,op! r b)))))
+       (define (,name! sb . sbs)
+         (dolist [b sbs] (,op! sb b))
+         sb))))
+
+(define-sparse-bitmap-op sparse-bitmap-union
+  %sparse-bitmap-union %sparse-bitmap-union!)
+(define-sparse-bitmap-op sparse-bitmap-difference
+  %sparse-bitmap-difference %sparse-bitmap-difference!)
+
+;; Intersecting the smaller ones first keeps the intermediate results
+;; small.
+(define (sparse-bitmap-intersection sb . sbs)
+  (if (null? sbs)
+    (sparse-bitmap-copy sb)
+    (let1 sorted (sort-by (cons sb sbs) sparse-bitmap-cardinality)
+      (rlet1 r (%sparse-bitmap-intersection (car sorted) (cadr sorted))
+        (dolist [b (cddr sorted)] (%sparse-bitmap-intersection! r b))))))
+
+(define (sparse-bitmap-intersection! sb . sbs)
+  (dolist [b (sort-by sbs sparse-bitmap-cardinality)]
+    (%sparse-bitmap-intersection! sb b))
+  sb)
+
 ;;===============================================================
 ;; dictionary protocol
 ;;
@@ -302,3 +703,51 @@
   :pop!      sparse-vector-pop!
   :push!     sparse-vector-push!
   :update!   sparse-vector-update!)
+
+(define-dict-interface <persistent-hash-map>
+  :get       persistent-hash-map-ref
+  :exists?   persistent-hash-map-exists?
+  :fold      persistent-hash-map-fold
+  :for-each  persistent-hash-map-for-each
+  :map       persistent-hash-map-map
+  :keys      persistent-hash-map-keys
+  :values    persistent-hash-map-values
+  :->alist   persistent-hash-map->alist)
+
+(define-dict-interface <transient-hash-map>
+  :get       persistent-hash-map-ref
+  :put!      transient-hash-map-put!
+  :delete!   transient-hash-map-delete!
+  :exists?   persistent-hash-map-exists?
+  :fold      persistent-hash-map-fold
+  :for-each  persistent-hash-map-for-each
+  :map       persistent-hash-map-map
+  :keys      persistent-hash-map-keys
+  :values    persistent-hash-map-values
+  :->alist   persistent-hash-map->alist
+  :update!   transient-hash-map-update!)
+
+(define-dict-interface <persistent-tree-map>
+  :get        persistent-tree-map-ref
+  :exists?    persistent-tree-map-exists?
+  :fold       persistent-tree-map-fold
+  :fold-right persistent-tree-map-fold-right
+  :for-each   persistent-tree-map-for-each
+  :map        persistent-tree-map-map
+  :keys       persistent-tree-map-keys
+  :values     persistent-tree-map-values
+  :->alist    persistent-tree-map->alist)
+
+(define-dict-interface <transient-tree-map>
+  :get        persistent-tree-map-ref
+  :put!       transient-tree-map-put!
+  :delete!    transient-tree-map-delete!
+  :exists?    persistent-tree-map-exists?
+  :fold       persistent-tree-map-fold
+  :fold-right persistent-tree-map-fold-right
+  :for-each   persistent-tree-map-for-each
+  :map        persistent-tree-map-map
+  :keys       persistent-tree-map-keys
+  :values     persistent-tree-map-values
+  :->alist    persistent-tree-map->alist
+  :update!    transient-tree-map-update!)
@@ -0,0 +1,1338 @@
+/*
+ * spbitmap.c - Sparse bitmaps
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#define LIBGAUCHE_EXT_BODY
+#include <gauche.h>
+#include <gauche/extend.h>
+#include <gauche/bits_inline.h>
+#include <gauche/priv/simdP.h>
+#include <string.h>
+#include "spbitmap.h"
+
+/* The kernels for bitmap containers and the array intersection have
+   SSE2 and AVX2 versions on x86_64, like the uvector kernels.  They're
+   chosen at runtime by Scm__CPUFeatures, so the tests can run the
+   scalar code as well. */
+#if defined(SCM_X86_SSE2)
+#define SPB_SSE2 1
+#if defined(SCM_X86_TARGET)
+#define SPB_AVX2 1
+#endif
+#endif
+
+static void spb_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    Scm_Printf(port, "#<sparse-bitmap %lu entries>",
+               SPARSE_BITMAP(obj)->numEntries);
+}
+
+static int spb_compare(ScmObj x, ScmObj y, int equalp)
+{
+    if (!equalp) {
+        Scm_Error("can't compare sparse bitmaps: %S and %S", x, y);
+    }
+    return SparseBitmapEqual(SPARSE_BITMAP(x), SPARSE_BITMAP(y))? 0 : -1;
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_SparseBitmapClass,
+                         spb_print, spb_compare, NULL, NULL,
+                         SCM_CLASS_DEFAULT_CPL);
+
+#define LOW_BITS      16
+#define LOW_MASK      0xffffUL
+#define BITMAP_BYTES  (SPB_BITMAP_WORDS*sizeof(u_long))
+
+#define BIT_WORD(v)   ((v)/SCM_WORD_BITS)
+#define BIT_MASK(v)   (1UL<<((v)%SCM_WORD_BITS))
+#define BIT_TEST(bits, v)  ((bits)[BIT_WORD(v)] & BIT_MASK(v))
+
+#define RUN_START(c, i)  ((u_int)(c)->data.runs[(i)*2])
+#define RUN_LEN(c, i)    ((u_int)(c)->data.runs[(i)*2+1]) /* length-1 */
+#define RUN_END(c, i)    (RUN_START(c, i) + RUN_LEN(c, i)) /* inclusive */
+
+/* Scanning bits is the inner loop of many operations here, so we use
+   the instruction if available. */
+static inline int lowest_bit(u_long w)
+{
+#if defined(__GNUC__)
+    return __builtin_ctzl(w);
+#else
+    return Scm__LowestBitNumber(w);
+#endif
+}
+
+/*===================================================================
+ * Kernels
+ */
+
+/* Combines two bitmaps of BITMAP_BYTES into D, and returns the number
+   of bits in the result.  D may be NULL if we only need the count. */
+
+static int bits_op_scalar(int op, u_long *d, const u_long *x,
+                          const u_long *y)
+{
+    int cnt = 0;
+    for (int i=0; i<SPB_BITMAP_WORDS; i++) {
+        u_long w = 0;
+        switch (op) {
+        case SPB_OP_AND:    w = x[i] & y[i]; break;
+        case SPB_OP_OR:     w = x[i] | y[i]; break;
+        case SPB_OP_ANDNOT: w = x[i] & ~y[i]; break;
+        }
+        if (d) d[i] = w;
+        cnt += Scm__CountBitsInWord(w);
+    }
+    return cnt;
+}
+
+/* Intersection of sorted arrays A and B.  Stores the result to OUT,
+   if it isn't NULL, and returns the number of common elements. */
+
+static int array_and_merge(u_short *out, const u_short *a, int na,
+                           const u_short *b, int nb)
+{
+    int i = 0, j = 0, k = 0;
+    while (i < na && j < nb) {
+        if (a[i] < b[j]) i++;
+        else if (a[i] > b[j]) j++;
+        else {
+            if (out) out[k] = a[i];
+            k++; i++; j++;
+        }
+    }
+    return k;
+}
+
+/* Used when A is much smaller than B. */
+static int array_and_gallop(u_short *out, const u_short *a, int na,
+                            const u_short *b, int nb)
+{
+    int j = 0, k = 0;
+    for (int i=0; i<na && j<nb; i++) {
+        u_short v = a[i];
+        if (b[j] < v) {
+            /* Find the range (lo, hi] that contains the first b >= v */
+            int lo = j, step = 1, hi = j + 1;
+            while (hi < nb && b[hi] < v) { lo = hi; step *= 2; hi = lo + step; }
+            if (hi >= nb) hi = nb;
+            while (lo + 1 < hi) {
+                int m = (lo + hi)/2;
+                if (b[m] < v) lo = m;
+                else hi = m;
+            }
+            j = hi;
+            if (j == nb) break;
+        }
+        if (b[j] == v) {
+            if (out) out[k] = v;
+            k++; j++;
+        }
+    }
+    return k;
+}
+
+#if defined(SPB_SSE2)
+
+#define POPCNT_BYTES_SSE2(v)                                            \
+    do {                                                                \
+        v = _mm_sub_epi8(v, _mm_and_si128(_mm_srli_epi64(v, 1), m1));   \
+        v = _mm_add_epi8(_mm_and_si128(v, m2),                          \
+                         _mm_and_si128(_mm_srli_epi64(v, 2), m2));      \
+        v = _mm_and_si128(_mm_add_epi8(v, _mm_srli_epi64(v, 4)), m4);   \
+    } while (0)
+
+#define BITS_LOOP_SSE2(vop)                                             \
+    for (int i=0; i<(int)(BITMAP_BYTES/16); i++) {                      \
+        __m128i a = _mm_loadu_si128((const __m128i*)x + i);             \
+        __m128i b = _mm_loadu_si128((const __m128i*)y + i);             \
+        __m128i v = vop;                                                \
+        if (d) _mm_storeu_si128((__m128i*)d + i, v);                    \
+        POPCNT_BYTES_SSE2(v);                                           \
+        total = _mm_add_epi64(total, _mm_sad_epu8(v, zero));            \
+    }
+
+static int bits_op_sse2(int op, u_long *d, const u_long *x, const u_long *y)
+{
+    const __m128i m1 = _mm_set1_epi8(0x55);
+    const __m128i m2 = _mm_set1_epi8(0x33);
+    const __m128i m4 = _mm_set1_epi8(0x0f);
+    const __m128i zero = _mm_setzero_si128();
+    __m128i total = zero;
+    ScmUInt64 sums[2];
+
+    switch (op) {
+    case SPB_OP_AND:    BITS_LOOP_SSE2(_mm_and_si128(a, b)); break;
+    case SPB_OP_OR:     BITS_LOOP_SSE2(_mm_or_si128(a, b)); break;
+    case SPB_OP_ANDNOT: BITS_LOOP_SSE2(_mm_andnot_si128(b, a)); break;
+    }
+    _mm_storeu_si128((__m128i*)sums, total);
+    return (int)(sums[0] + sums[1]);
+}
+
+/* Compares 8 elements of A with 8 elements of B at a time, by
+   comparing A with every rotation of B.  Each block of A is compared
+   with the blocks of B that may overlap, so the elements are
+   emitted in order without duplicates. */
+
+#define ROT16(v, n) \
+    _mm_or_si128(_mm_srli_si128(v, (n)*2), _mm_slli_si128(v, 16-(n)*2))
+
+static int array_and_sse2(u_short *out, const u_short *a, int na,
+                          const u_short *b, int nb)
+{
+    int i = 0, j = 0, k = 0;
+
+    while (i + 8 <= na && j + 8 <= nb) {
+        __m128i va = _mm_loadu_si128((const __m128i*)(a + i));
+        __m128i vb = _mm_loadu_si128((const __m128i*)(b + j));
+        __m128i eq = _mm_cmpeq_epi16(va, vb);
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, ROT16(vb, 1)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, ROT16(vb, 2)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, ROT16(vb, 3)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, ROT16(vb, 4)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, ROT16(vb, 5)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, ROT16(vb, 6)));
+        eq = _mm_or_si128(eq, _mm_cmpeq_epi16(va, ROT16(vb, 7)));
+        u_int mask = (u_int)_mm_movemask_epi8(eq);
+        while (mask) {
+            int n = lowest_bit(mask);
+            if (out) out[k] = a[i + n/2];
+            k++;
+            mask &= ~(3U << n);
+        }
+        u_short amax = a[i+7], bmax = b[j+7];
+        if (amax <= bmax) i += 8;
+        if (bmax <= amax) j += 8;
+    }
+    return k + array_and_merge(out? out + k : NULL, a + i, na - i,
+                               b + j, nb - j);
+}
+
+#endif /*SPB_SSE2*/
+
+#if defined(SPB_AVX2)
+
+/* Counts bits by looking up the table for each nibble (Mula). */
+#define BITS_LOOP_AVX2(vop)                                             \
+    for (int i=0; i<(int)(BITMAP_BYTES/32); i++) {                      \
+        __m256i a = _mm256_loadu_si256((const __m256i*)x + i);          \
+        __m256i b = _mm256_loadu_si256((const __m256i*)y + i);          \
+        __m256i v = vop;                                                \
+        if (d) _mm256_storeu_si256((__m256i*)d + i, v);                 \
+        __m256i lo = _mm256_and_si256(v, m4);                           \
+        __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), m4);     \
+        __m256i c = _mm256_add_epi8(_mm256_shuffle_epi8(table, lo),     \
+                                    _mm256_shuffle_epi8(table, hi));    \
+        total = _mm256_add_epi64(total, _mm256_sad_epu8(c, zero));      \
+    }
+
+static SCM_X86_TARGET("avx2") int bits_op_avx2(int op, u_long *d,
+                                               const u_long *x,
+                                               const u_long *y)
+{
+    const __m256i table = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4,
+                                           0, 1, 1, 2, 1, 2, 2, 3,
+                                           1, 2, 2, 3, 2, 3, 3, 4);
+    const __m256i m4 = _mm256_set1_epi8(0x0f);
+    const __m256i zero = _mm256_setzero_si256();
+    __m256i total = zero;
+    ScmUInt64 sums[4];
+
+    switch (op) {
+    case SPB_OP_AND:    BITS_LOOP_AVX2(_mm256_and_si256(a, b)); break;
+    case SPB_OP_OR:     BITS_LOOP_AVX2(_mm256_or_si256(a, b)); break;
+    case SPB_OP_ANDNOT: BITS_LOOP_AVX2(_mm256_andnot_si256(b, a)); break;
+    }
+    _mm256_storeu_si256((__m256i*)sums, total);
+    return (int)(sums[0] + sums[1] + sums[2] + sums[3]);
+}
+
+#endif /*SPB_AVX2*/
+
+static int bits_op(int op, u_long *d, const u_long *x, const u_long *y)
+{
+#if defined(SPB_SSE2)
+    u_long f = Scm__CPUFeatures();
+#if defined(SPB_AVX2)
+    if (f & SCM_CPU_AVX2) return bits_op_avx2(op, d, x, y);
+#endif
+    if (f & SCM_CPU_SSE2) return bits_op_sse2(op, d, x, y);
+#endif
+    return bits_op_scalar(op, d, x, y);
+}
+
+static int array_and(u_short *out, const u_short *a, int na,
+                     const u_short *b, int nb)
+{
+    if (na*64 < nb) return array_and_gallop(out, a, na, b, nb);
+    if (nb*64 < na) return array_and_gallop(out, b, nb, a, na);
+#if defined(SPB_SSE2)
+    if (Scm__CPUFeatures() & SCM_CPU_SSE2) {
+        return array_and_sse2(out, a, na, b, nb);
+    }
+#endif
+    return array_and_merge(out, a, na, b, nb);
+}
+
+/*===================================================================
+ * Containers
+ */
+
+static SPBContainer *make_array(int capacity)
+{
+    SPBContainer *c = SCM_NEW(SPBContainer);
+    if (capacity < 4) capacity = 4;
+    c->type = SPB_ARRAY;
+    c->card = c->size = 0;
+    c->capacity = capacity;
+    c->data.array = SCM_NEW_ATOMIC_ARRAY(u_short, capacity);
+    return c;
+}
+
+/* The bits are cleared if CLEAR is true. */
+static SPBContainer *make_bitmap(int clear)
+{
+    SPBContainer *c = SCM_NEW(SPBContainer);
+    c->type = SPB_BITMAP;
+    c->card = c->size = c->capacity = 0;
+    c->data.bits = SCM_NEW_ATOMIC_ARRAY(u_long, SPB_BITMAP_WORDS);
+    if (clear) memset(c->data.bits, 0, BITMAP_BYTES);
+    return c;
+}
+
+static SPBContainer *make_run(int capacity)
+{
+    SPBContainer *c = SCM_NEW(SPBContainer);
+    if (capacity < 2) capacity = 2;
+    c->type = SPB_RUN;
+    c->card = c->size = 0;
+    c->capacity = capacity;
+    c->data.runs = SCM_NEW_ATOMIC_ARRAY(u_short, capacity*2);
+    return c;
+}
+
+static SPBContainer *container_copy(SPBContainer *c)
+{
+    SPBContainer *r = NULL;
+    switch (c->type) {
+    case SPB_ARRAY:
+        r = make_array(c->size);
+        memcpy(r->data.array, c->data.array, c->size*sizeof(u_short));
+        break;
+    case SPB_BITMAP:
+        r = make_bitmap(FALSE);
+        memcpy(r->data.bits, c->data.bits, BITMAP_BYTES);
+        break;
+    case SPB_RUN:
+        r = make_run(c->size);
+        memcpy(r->data.runs, c->data.runs, c->size*2*sizeof(u_short));
+        break;
+    }
+    r->card = c->card;
+    r->size = c->size;
+    return r;
+}
+
+/* Returns the index of V in the array, or -(insertion point)-1. */
+static int array_search(const u_short *a, int n, u_int v)
+{
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int m = (lo + hi)/2;
+        if (a[m] < v) lo = m + 1;
+        else if (a[m] > v) hi = m;
+        else return m;
+    }
+    return -lo-1;
+}
+
+/* Returns the index of the last run that starts at or before V,
+   or -1. */
+static int run_search(SPBContainer *c, u_int v)
+{
+    int lo = 0, hi = c->size;
+    while (lo < hi) {
+        int m = (lo + hi)/2;
+        if (RUN_START(c, m) <= v) lo = m + 1;
+        else hi = m;
+    }
+    return lo - 1;
+}
+
+static int container_contains(SPBContainer *c, u_int v)
+{
+    switch (c->type) {
+    case SPB_ARRAY:
+        return array_search(c->data.array, c->size, v) >= 0;
+    case SPB_BITMAP:
+        return BIT_TEST(c->data.bits, v) != 0;
+    default: {
+        int i = run_search(c, v);
+        return (i >= 0 && v <= RUN_END(c, i));
+    }
+    }
+}
+
+static int container_min(SPBContainer *c)
+{
+    switch (c->type) {
+    case SPB_ARRAY:
+        return c->data.array[0];
+    case SPB_BITMAP:
+        for (int i=0; i<SPB_BITMAP_WORDS; i++) {
+            u_long w = c->data.bits[i];
+            if (w) return i*SCM_WORD_BITS + lowest_bit(w);
+        }
+        return 0;               /* can't happen */
+    default:
+        return RUN_START(c, 0);
+    }
+}
+
+static int container_max(SPBContainer *c)
+{
+    switch (c->type) {
+    case SPB_ARRAY:
+        return c->data.array[c->size-1];
+    case SPB_BITMAP:
+        for (int i=SPB_BITMAP_WORDS-1; i>=0; i--) {
+            u_long w = c->data.bits[i];
+            if (w) return i*SCM_WORD_BITS + Scm__HighestBitNumber(w);
+        }
+        return 0;               /* can't happen */
+    default:
+        return RUN_END(c, c->size-1);
+    }
+}
+
+/*
+ * Conversions
+ */
+
+static SPBContainer *array_to_bitmap(SPBContainer *c)
+{
+    SPBContainer *r = make_bitmap(TRUE);
+    for (int i=0; i<c->size; i++) {
+        u_int v = c->data.array[i];
+        r->data.bits[BIT_WORD(v)] |= BIT_MASK(v);
+    }
+    r->card = c->card;
+    return r;
+}
+
+/* Appends the bits in the I-th word W to the array container R. */
+static inline void array_append_word(SPBContainer *r, int i, u_long w)
+{
+    u_short *p = r->data.array + r->size;
+    int base = i*SCM_WORD_BITS;
+    while (w) {
+        *p++ = (u_short)(base + lowest_bit(w));
+        w &= w - 1;
+    }
+    r->size = (int)(p - r->data.array);
+}
+
+static SPBContainer *bitmap_to_array(SPBContainer *c)
+{
+    SPBContainer *r = make_array(c->card);
+    for (int i=0; i<SPB_BITMAP_WORDS; i++) {
+        array_append_word(r, i, c->data.bits[i]);
+    }
+    r->card = r->size;
+    return r;
+}
+
+static SPBContainer *run_to_plain(SPBContainer *c)
+{
+    if (c->card > SPB_ARRAY_MAX) {
+        SPBContainer *r = make_bitmap(TRUE);
+        for (int i=0; i<c->size; i++) {
+            for (u_int v = RUN_START(c, i); v <= RUN_END(c, i); v++) {
+                r->data.bits[BIT_WORD(v)] |= BIT_MASK(v);
+            }
+        }
+        r->card = c->card;
+        return r;
+    } else {
+        SPBContainer *r = make_array(c->card);
+        int k = 0;
+        for (int i=0; i<c->size; i++) {
+            for (u_int v = RUN_START(c, i); v <= RUN_END(c, i); v++) {
+                r->data.array[k++] = (u_short)v;
+            }
+        }
+        r->card = r->size = k;
+        return r;
+    }
+}
+
+/* Array or bitmap, whichever suits the cardinality. */
+static SPBContainer *to_plain(SPBContainer *c)
+{
+    switch (c->type) {
+    case SPB_ARRAY:
+        if (c->card > SPB_ARRAY_MAX) return array_to_bitmap(c);
+        return c;
+    case SPB_BITMAP:
+        if (c->card <= SPB_ARRAY_MAX) return bitmap_to_array(c);
+        return c;
+    default:
+        return run_to_plain(c);
+    }
+}
+
+static int num_runs(SPBContainer *c)
+{
+    int n = 0;
+    switch (c->type) {
+    case SPB_ARRAY:
+        for (int i=0; i<c->size; i++) {
+            if (i == 0 || c->data.array[i-1] + 1 != c->data.array[i]) n++;
+        }
+        return n;
+    case SPB_BITMAP: {
+        u_long prev = 0;
+        for (int i=0; i<SPB_BITMAP_WORDS; i++) {
+            u_long w = c->data.bits[i];
+            /* a run starts at a bit that is 1 and whose lower bit is 0 */
+            n += Scm__CountBitsInWord(w & ~((w << 1)
+                                            | (prev >> (SCM_WORD_BITS-1))));
+            prev = w;
+        }
+        return n;
+    }
+    default:
+        return c->size;
+    }
+}
+
+static void run_append(SPBContainer *r, u_int start, u_int end)
+{
+    r->data.runs[r->size*2] = (u_short)start;
+    r->data.runs[r->size*2+1] = (u_short)(end - start);
+    r->size++;
+    r->card += end - start + 1;
+}
+
+static SPBContainer *to_run(SPBContainer *c, int nruns)
+{
+    SPBContainer *r = make_run(nruns);
+    if (c->type == SPB_ARRAY) {
+        const u_short *a = c->data.array;
+        int i = 0;
+        while (i < c->size) {
+            int j = i;
+            while (j+1 < c->size && a[j] + 1 == a[j+1]) j++;
+            run_append(r, a[i], a[j]);
+            i = j + 1;
+        }
+    } else {
+        /* Finds the lowest 1 bit, then fills the 0s below it with 1s
+           to find the lowest 0 bit above it. */
+        const u_long *bits = c->data.bits;
+        int i = 0;
+        u_long w = bits[0];
+        for (;;) {
+            while (w == 0 && i < SPB_BITMAP_WORDS-1) w = bits[++i];
+            if (w == 0) break;
+            u_int start = i*SCM_WORD_BITS + lowest_bit(w);
+            u_long w1 = w | (w - 1);
+            while (w1 == ~0UL && i < SPB_BITMAP_WORDS-1) w1 = bits[++i];
+            if (w1 == ~0UL) {
+                run_append(r, start, 65535);
+                break;
+            }
+            run_append(r, start,
+                       i*SCM_WORD_BITS + lowest_bit(~w1) - 1);
+            w = w1 & (w1 + 1);
+        }
+    }
+    return r;
+}
+
+/* Returns the most compact form of C. */
+static SPBContainer *container_optimize(SPBContainer *c)
+{
+    int nruns = num_runs(c);
+    int plainsize = (c->card <= SPB_ARRAY_MAX)? c->card*2 : (int)BITMAP_BYTES;
+    if (nruns*4 < plainsize) {
+        return (c->type == SPB_RUN)? c : to_run(c, nruns);
+    }
+    return to_plain(c);
+}
+
+/* A run container that is modified may become larger than the plain
+   one. */
+static SPBContainer *run_check_size(SPBContainer *c)
+{
+    int plainsize = (c->card <= SPB_ARRAY_MAX)? c->card*2 : (int)BITMAP_BYTES;
+    if (c->size*4 > plainsize) return run_to_plain(c);
+    return c;
+}
+
+/*
+ * Element-wise update.  These may return a new container.
+ */
+
+static void run_insert(SPBContainer *c, int i, u_int start, u_int len)
+{
+    if (c->size == c->capacity) {
+        int newcap = c->capacity*2;
+        u_short *newruns = SCM_NEW_ATOMIC_ARRAY(u_short, newcap*2);
+        memcpy(newruns, c->data.runs, c->size*2*sizeof(u_short));
+        c->data.runs = newruns;
+        c->capacity = newcap;
+    }
+    memmove(c->data.runs + (i+1)*2, c->data.runs + i*2,
+            (c->size - i)*2*sizeof(u_short));
+    c->data.runs[i*2] = (u_short)start;
+    c->data.runs[i*2+1] = (u_short)len;
+    c->size++;
+}
+
+static void run_remove(SPBContainer *c, int i)
+{
+    memmove(c->data.runs + i*2, c->data.runs + (i+1)*2,
+            (c->size - i - 1)*2*sizeof(u_short));
+    c->size--;
+}
+
+static SPBContainer *container_add(SPBContainer *c, u_int v, int *added)
+{
+    switch (c->type) {
+    case SPB_ARRAY: {
+        int i = array_search(c->data.array, c->size, v);
+        if (i >= 0) return c;
+        *added = TRUE;
+        if (c->size == SPB_ARRAY_MAX) {
+            SPBContainer *r = array_to_bitmap(c);
+            r->data.bits[BIT_WORD(v)] |= BIT_MASK(v);
+            r->card++;
+            return r;
+        }
+        i = -i-1;
+        if (c->size == c->capacity) {
+            int newcap = c->capacity*2;
+            if (newcap > SPB_ARRAY_MAX) newcap = SPB_ARRAY_MAX;
+            u_short *newa = SCM_NEW_ATOMIC_ARRAY(u_short, newcap);
+            memcpy(newa, c->data.array, c->size*sizeof(u_short));
+            c->data.array = newa;
+            c->capacity = newcap;
+        }
+        memmove(c->data.array + i + 1, c->data.array + i,
+                (c->size - i)*sizeof(u_short));
+        c->data.array[i] = (u_short)v;
+        c->size++;
+        c->card++;
+        return c;
+    }
+    case SPB_BITMAP:
+        if (BIT_TEST(c->data.bits, v)) return c;
+        *added = TRUE;
+        c->data.bits[BIT_WORD(v)] |= BIT_MASK(v);
+        c->card++;
+        return c;
+    default: {
+        int i = run_search(c, v);
+        if (i >= 0 && v <= RUN_END(c, i)) return c;
+        *added = TRUE;
+        int left = (i >= 0 && RUN_END(c, i) + 1 == v);
+        int right = (i+1 < c->size && RUN_START(c, i+1) == v + 1);
+        if (left && right) {
+            c->data.runs[i*2+1] = (u_short)(RUN_END(c, i+1) - RUN_START(c, i));
+            run_remove(c, i+1);
+        } else if (left) {
+            c->data.runs[i*2+1]++;
+        } else if (right) {
+            c->data.runs[(i+1)*2]--;
+            c->data.runs[(i+1)*2+1]++;
+        } else {
+            run_insert(c, i+1, v, 0);
+        }
+        c->card++;
+        return run_check_size(c);
+    }
+    }
+}
+
+/* The caller should discard C if its cardinality becomes 0. */
+static SPBContainer *container_remove(SPBContainer *c, u_int v, int *removed)
+{
+    switch (c->type) {
+    case SPB_ARRAY: {
+        int i = array_search(c->data.array, c->size, v);
+        if (i < 0) return c;
+        *removed = TRUE;
+        memmove(c->data.array + i, c->data.array + i + 1,
+                (c->size - i - 1)*sizeof(u_short));
+        c->size--;
+        c->card--;
+        return c;
+    }
+    case SPB_BITMAP:
+        if (!BIT_TEST(c->data.bits, v)) return c;
+        *removed = TRUE;
+        c->data.bits[BIT_WORD(v)] &= ~BIT_MASK(v);
+        c->card--;
+        if (c->card <= SPB_ARRAY_MAX) return bitmap_to_array(c);
+        return c;
+    default: {
+        int i = run_search(c, v);
+        if (i < 0 || v > RUN_END(c, i)) return c;
+        *removed = TRUE;
+        u_int start = RUN_START(c, i), end = RUN_END(c, i);
+        if (start == end) {
+            run_remove(c, i);
+        } else if (v == start) {
+            c->data.runs[i*2]++;
+            c->data.runs[i*2+1]--;
+        } else if (v == end) {
+            c->data.runs[i*2+1]--;
+        } else {
+            c->data.runs[i*2+1] = (u_short)(v - start - 1);
+            run_insert(c, i+1, v + 1, end - v - 1);
+        }
+        c->card--;
+        if (c->card == 0) return c;
+        return run_check_size(c);
+    }
+    }
+}
+
+/*
+ * Set operations.  These return a new container, or NULL if the
+ * result is empty.  X and Y are plain containers.
+ */
+
+/* Keeps the invariant that a plain container is an array iff it has
+   SPB_ARRAY_MAX or fewer elements. */
+static SPBContainer *result_bitmap(SPBContainer *r)
+{
+    if (r->card == 0) return NULL;
+    if (r->card <= SPB_ARRAY_MAX) return bitmap_to_array(r);
+    return r;
+}
+
+static SPBContainer *result_array(SPBContainer *r)
+{
+    if (r->card == 0) return NULL;
+    return r;
+}
+
+static SPBContainer *bitmap_bitmap_op(int op, SPBContainer *x,
+                                      SPBContainer *y)
+{
+    const u_long *a = x->data.bits, *b = y->data.bits;
+    SPBContainer *r;
+
+    /* The result of AND and ANDNOT is often small.  We count it first,
+       so that we don't need to allocate a bitmap only to convert it to
+       an array. */
+    if (op != SPB_OP_OR) {
+        int card = bits_op(op, NULL, a, b);
+        if (card == 0) return NULL;
+        if (card <= SPB_ARRAY_MAX) {
+            r = make_array(card);
+            for (int i=0; i<SPB_BITMAP_WORDS; i++) {
+                array_append_word(r, i, (op == SPB_OP_AND)
+                                  ? (a[i] & b[i]) : (a[i] & ~b[i]));
+            }
+            r->card = r->size;
+            return r;
+        }
+    }
+    r = make_bitmap(FALSE);
+    r->card = bits_op(op, r->data.bits, a, b);
+    return result_bitmap(r);
+}
+
+/* X is a bitmap and Y is an array. */
+static SPBContainer *bitmap_array_op(int op, SPBContainer *x,
+                                     SPBContainer *y)
+{
+    const u_short *a = y->data.array;
+    SPBContainer *r;
+
+    if (op == SPB_OP_AND) {
+        r = make_array(y->size);
+        int k = 0;
+        for (int i=0; i<y->size; i++) {
+            if (BIT_TEST(x->data.bits, a[i])) r->data.array[k++] = a[i];
+        }
+        r->card = r->size = k;
+        return result_array(r);
+    }
+    r = make_bitmap(FALSE);
+    memcpy(r->data.bits, x->data.bits, BITMAP_BYTES);
+    r->card = x->card;
+    for (int i=0; i<y->size; i++) {
+        u_long *w = &r->data.bits[BIT_WORD(a[i])];
+        u_long m = BIT_MASK(a[i]);
+        if (op == SPB_OP_OR) {
+            if (!(*w & m)) { *w |= m; r->card++; }
+        } else {
+            if (*w & m) { *w &= ~m; r->card--; }
+        }
+    }
+    return result_bitmap(r);
+}
+
+/* X is an array and Y is a bitmap. */
+static SPBContainer *array_bitmap_op(int op, SPBContainer *x,
+                                     SPBContainer *y)
+{
+    if (op != SPB_OP_ANDNOT) return bitmap_array_op(op, y, x);
+
+    SPBContainer *r = make_array(x->size);
+    const u_short *a = x->data.array;
+    int k = 0;
+    for (int i=0; i<x->size; i++) {
+        if (!BIT_TEST(y->data.bits, a[i])) r->data.array[k++] = a[i];
+    }
+    r->card = r->size = k;
+    return result_array(r);
+}
+
+static SPBContainer *array_array_op(int op, SPBContainer *x, SPBContainer *y)
+{
+    const u_short *a = x->data.array, *b = y->data.array;
+    int na = x->size, nb = y->size, i = 0, j = 0, k = 0;
+    SPBContainer *r;
+
+    switch (op) {
+    case SPB_OP_AND:
+        r = make_array(na < nb? na : nb);
+        r->card = r->size = array_and(r->data.array, a, na, b, nb);
+        return result_array(r);
+    case SPB_OP_OR:
+        if (na + nb > SPB_ARRAY_MAX) {
+            r = array_to_bitmap(x);
+            for (j=0; j<nb; j++) {
+                u_long *w = &r->data.bits[BIT_WORD(b[j])];
+                u_long m = BIT_MASK(b[j]);
+                if (!(*w & m)) { *w |= m; r->card++; }
+            }
+            return result_bitmap(r);
+        }
+        r = make_array(na + nb);
+        while (i < na && j < nb) {
+            if (a[i] < b[j])      r->data.array[k++] = a[i++];
+            else if (a[i] > b[j]) r->data.array[k++] = b[j++];
+            else { r->data.array[k++] = a[i++]; j++; }
+        }
+        while (i < na) r->data.array[k++] = a[i++];
+        while (j < nb) r->data.array[k++] = b[j++];
+        r->card = r->size = k;
+        return result_array(r);
+    default:
+        r = make_array(na);
+        while (i < na && j < nb) {
+            if (a[i] < b[j])      r->data.array[k++] = a[i++];
+            else if (a[i] > b[j]) j++;
+            else { i++; j++; }
+        }
+        while (i < na) r->data.array[k++] = a[i++];
+        r->card = r->size = k;
+        return result_array(r);
+    }
+}
+
+static SPBContainer *container_op(int op, SPBContainer *x, SPBContainer *y)
+{
+    int runp = (x->type == SPB_RUN || y->type == SPB_RUN);
+    SPBContainer *r;
+
+    x = to_plain(x);
+    y = to_plain(y);
+    if (x->type == SPB_BITMAP) {
+        if (y->type == SPB_BITMAP) r = bitmap_bitmap_op(op, x, y);
+        else                       r = bitmap_array_op(op, x, y);
+    } else {
+        if (y->type == SPB_BITMAP) r = array_bitmap_op(op, x, y);
+        else                       r = array_array_op(op, x, y);
+    }
+    /* If the operand was a run container, the result is likely to
+       have long runs as well. */
+    if (r && runp) r = container_optimize(r);
+    return r;
+}
+
+static int container_and_count(SPBContainer *x, SPBContainer *y)
+{
+    x = to_plain(x);
+    y = to_plain(y);
+    if (x->type == SPB_BITMAP && y->type == SPB_BITMAP) {
+        return bits_op(SPB_OP_AND, NULL, x->data.bits, y->data.bits);
+    }
+    if (x->type == SPB_ARRAY && y->type == SPB_ARRAY) {
+        return array_and(NULL, x->data.array, x->size,
+                         y->data.array, y->size);
+    }
+    if (x->type == SPB_BITMAP) {
+        SPBContainer *t = x; x = y; y = t;
+    }
+    int k = 0;
+    for (int i=0; i<x->size; i++) {
+        if (BIT_TEST(y->data.bits, x->data.array[i])) k++;
+    }
+    return k;
+}
+
+static int container_equal(SPBContainer *x, SPBContainer *y)
+{
+    if (x->card != y->card) return FALSE;
+    if (x->type == y->type) {
+        switch (x->type) {
+        case SPB_ARRAY:
+            return memcmp(x->data.array, y->data.array,
+                          x->size*sizeof(u_short)) == 0;
+        case SPB_BITMAP:
+            return memcmp(x->data.bits, y->data.bits, BITMAP_BYTES) == 0;
+        default:
+            return (x->size == y->size
+                    && memcmp(x->data.runs, y->data.runs,
+                              x->size*2*sizeof(u_short)) == 0);
+        }
+    }
+    /* Same cardinality, so X is equal to Y iff X is a subset of Y. */
+    return container_and_count(x, y) == x->card;
+}
+
+/*===================================================================
+ * Sparse bitmap
+ */
+
+static void spb_init(SparseBitmap *sb, int capacity)
+{
+    sb->numEntries = 0;
+    sb->numContainers = 0;
+    sb->capacity = capacity;
+    if (capacity > 0) {
+        sb->keys = SCM_NEW_ATOMIC_ARRAY(u_long, capacity);
+        sb->containers = SCM_NEW_ARRAY(SPBContainer*, capacity);
+    } else {
+        sb->keys = NULL;
+        sb->containers = NULL;
+    }
+}
+
+ScmObj MakeSparseBitmap(void)
+{
+    SparseBitmap *sb = SCM_NEW(SparseBitmap);
+    SCM_SET_CLASS(sb, SCM_CLASS_SPARSE_BITMAP);
+    spb_init(sb, 0);
+    return SCM_OBJ(sb);
+}
+
+/* Returns the index of the container for HIGH, or -(insertion point)-1. */
+static int spb_search(SparseBitmap *sb, u_long high)
+{
+    int lo = 0, hi = sb->numContainers;
+    while (lo < hi) {
+        int m = (lo + hi)/2;
+        if (sb->keys[m] < high) lo = m + 1;
+        else if (sb->keys[m] > high) hi = m;
+        else return m;
+    }
+    return -lo-1;
+}
+
+static void spb_insert(SparseBitmap *sb, int i, u_long high, SPBContainer *c)
+{
+    if (sb->numContainers == sb->capacity) {
+        int newcap = (sb->capacity < 4)? 4 : sb->capacity*2;
+        u_long *newkeys = SCM_NEW_ATOMIC_ARRAY(u_long, newcap);
+        SPBContainer **newcs = SCM_NEW_ARRAY(SPBContainer*, newcap);
+        if (sb->numContainers > 0) {
+            memcpy(newkeys, sb->keys, sb->numContainers*sizeof(u_long));
+            memcpy(newcs, sb->containers,
+                   sb->numContainers*sizeof(SPBContainer*));
+        }
+        sb->keys = newkeys;
+        sb->containers = newcs;
+        sb->capacity = newcap;
+    }
+    memmove(sb->keys + i + 1, sb->keys + i,
+            (sb->numContainers - i)*sizeof(u_long));
+    memmove(sb->containers + i + 1, sb->containers + i,
+            (sb->numContainers - i)*sizeof(SPBContainer*));
+    sb->keys[i] = high;
+    sb->containers[i] = c;
+    sb->numContainers++;
+}
+
+static void spb_remove(SparseBitmap *sb, int i)
+{
+    memmove(sb->keys + i, sb->keys + i + 1,
+            (sb->numContainers - i - 1)*sizeof(u_long));
+    memmove(sb->containers + i, sb->containers + i + 1,
+            (sb->numContainers - i - 1)*sizeof(SPBContainer*));
+    sb->numContainers--;
+    sb->containers[sb->numContainers] = NULL; /* for GC */
+}
+
+/* Appends a container; used to build a result of set operations. */
+static void spb_append(SparseBitmap *sb, u_long high, SPBContainer *c)
+{
+    sb->keys[sb->numContainers] = high;
+    sb->containers[sb->numContainers] = c;
+    sb->numContainers++;
+    sb->numEntries += c->card;
+}
+
+int SparseBitmapContains(SparseBitmap *sb, u_long key)
+{
+    int i = spb_search(sb, key >> LOW_BITS);
+    if (i < 0) return FALSE;
+    return container_contains(sb->containers[i], (u_int)(key & LOW_MASK));
+}
+
+int SparseBitmapAdd(SparseBitmap *sb, u_long key)
+{
+    u_long high = key >> LOW_BITS;
+    u_int low = (u_int)(key & LOW_MASK);
+    int i = spb_search(sb, high);
+    int added = FALSE;
+
+    if (i < 0) {
+        SPBContainer *c = make_array(0);
+        c->data.array[0] = (u_short)low;
+        c->card = c->size = 1;
+        spb_insert(sb, -i-1, high, c);
+        added = TRUE;
+    } else {
+        sb->containers[i] = container_add(sb->containers[i], low, &added);
+    }
+    if (added) sb->numEntries++;
+    return added;
+}
+
+int SparseBitmapRemove(SparseBitmap *sb, u_long key)
+{
+    int i = spb_search(sb, key >> LOW_BITS);
+    int removed = FALSE;
+
+    if (i < 0) return FALSE;
+    SPBContainer *c = container_remove(sb->containers[i],
+                                       (u_int)(key & LOW_MASK), &removed);
+    if (c->card == 0) spb_remove(sb, i);
+    else sb->containers[i] = c;
+    if (removed) sb->numEntries--;
+    return removed;
+}
+
+/* Adds keys from START (inclusive) to END (exclusive). */
+void SparseBitmapAddRange(SparseBitmap *sb, u_long start, u_long end)
+{
+    if (start >= end) return;
+    u_long last = end - 1;
+    for (u_long high = start >> LOW_BITS; high <= last >> LOW_BITS; high++) {
+        u_int lo = (high == start >> LOW_BITS)? (u_int)(start & LOW_MASK) : 0;
+        u_int hi = (high == last >> LOW_BITS)? (u_int)(last & LOW_MASK) : 65535;
+        SPBContainer *r = make_run(1);
+        run_append(r, lo, hi);
+
+        int i = spb_search(sb, high);
+        if (i < 0) {
+            spb_insert(sb, -i-1, high, container_optimize(r));
+            sb->numEntries += r->card;
+        } else {
+            SPBContainer *c = sb->containers[i];
+            sb->numEntries -= c->card;
+            c = container_op(SPB_OP_OR, c, r);
+            sb->numEntries += c->card;
+            sb->containers[i] = c;
+        }
+    }
+}
+
+void SparseBitmapClear(SparseBitmap *sb)
+{
+    spb_init(sb, 0);
+}
+
+ScmObj SparseBitmapCopy(SparseBitmap *sb)
+{
+    SparseBitmap *r = SPARSE_BITMAP(MakeSparseBitmap());
+    spb_init(r, sb->numContainers);
+    for (int i=0; i<sb->numContainers; i++) {
+        spb_append(r, sb->keys[i], container_copy(sb->containers[i]));
+    }
+    return SCM_OBJ(r);
+}
+
+int SparseBitmapMin(SparseBitmap *sb, u_long *r)
+{
+    if (sb->numContainers == 0) return FALSE;
+    *r = (sb->keys[0] << LOW_BITS) + container_min(sb->containers[0]);
+    return TRUE;
+}
+
+int SparseBitmapMax(SparseBitmap *sb, u_long *r)
+{
+    int n = sb->numContainers;
+    if (n == 0) return FALSE;
+    *r = (sb->keys[n-1] << LOW_BITS) + container_max(sb->containers[n-1]);
+    return TRUE;
+}
+
+int SparseBitmapEqual(SparseBitmap *a, SparseBitmap *b)
+{
+    if (a->numEntries != b->numEntries) return FALSE;
+    if (a->numContainers != b->numContainers) return FALSE;
+    for (int i=0; i<a->numContainers; i++) {
+        if (a->keys[i] != b->keys[i]) return FALSE;
+        if (!container_equal(a->containers[i], b->containers[i])) {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+void SparseBitmapOptimize(SparseBitmap *sb)
+{
+    for (int i=0; i<sb->numContainers; i++) {
+        sb->containers[i] = container_optimize(sb->containers[i]);
+    }
+}
+
+/* Stores the result of A op B into R.  If REUSE is true, R may share
+   the containers of A. */
+static void spb_op(int op, SparseBitmap *a, SparseBitmap *b,
+                   SparseBitmap *r, int reuse)
+{
+    int na = a->numContainers, nb = b->numContainers, i = 0, j = 0;
+
+    switch (op) {
+    case SPB_OP_AND: spb_init(r, na < nb? na : nb); break;
+    case SPB_OP_OR:  spb_init(r, na + nb); break;
+    default:         spb_init(r, na); break;
+    }
+
+    while (i < na && j < nb) {
+        u_long ka = a->keys[i], kb = b->keys[j];
+        if (ka < kb) {
+            if (op != SPB_OP_AND) {
+                SPBContainer *c = a->containers[i];
+                spb_append(r, ka, reuse? c : container_copy(c));
+            }
+            i++;
+        } else if (ka > kb) {
+            if (op == SPB_OP_OR) {
+                spb_append(r, kb, container_copy(b->containers[j]));
+            }
+            j++;
+        } else {
+            SPBContainer *c = container_op(op, a->containers[i],
+                                           b->containers[j]);
+            if (c) spb_append(r, ka, c);
+            i++; j++;
+        }
+    }
+    if (op != SPB_OP_AND) {
+        for (; i < na; i++) {
+            SPBContainer *c = a->containers[i];
+            spb_append(r, a->keys[i], reuse? c : container_copy(c));
+        }
+    }
+    if (op == SPB_OP_OR) {
+        for (; j < nb; j++) {
+            spb_append(r, b->keys[j], container_copy(b->containers[j]));
+        }
+    }
+}
+
+ScmObj SparseBitmapOp(int op, SparseBitmap *a, SparseBitmap *b)
+{
+    SparseBitmap *r = SPARSE_BITMAP(MakeSparseBitmap());
+    spb_op(op, a, b, r, FALSE);
+    return SCM_OBJ(r);
+}
+
+void SparseBitmapOpX(int op, SparseBitmap *a, SparseBitmap *b)
+{
+    SparseBitmap r;
+    spb_op(op, a, b, &r, TRUE);
+    a->numEntries = r.numEntries;
+    a->numContainers = r.numContainers;
+    a->capacity = r.capacity;
+    a->keys = r.keys;
+    a->containers = r.containers;
+}
+
+/* Returns the cardinality of A and B without creating it. */
+u_long SparseBitmapAndCount(SparseBitmap *a, SparseBitmap *b)
+{
+    int na = a->numContainers, nb = b->numContainers, i = 0, j = 0;
+    u_long cnt = 0;
+    while (i < na && j < nb) {
+        if (a->keys[i] < b->keys[j]) i++;
+        else if (a->keys[i] > b->keys[j]) j++;
+        else {
+            cnt += container_and_count(a->containers[i], b->containers[j]);
+            i++; j++;
+        }
+    }
+    return cnt;
+}
+
+/*===================================================================
+ * Iterator
+ */
+
+static void iter_enter(SparseBitmapIter *it, int ci)
+{
+    if (ci >= it->sb->numContainers) {
+        it->end = TRUE;
+        return;
+    }
+    it->c = it->sb->containers[ci];
+    it->high = it->sb->keys[ci];
+    it->index = 0;
+    it->offset = 0;
+    if (it->c->type == SPB_BITMAP) it->word = it->c->data.bits[0];
+}
+
+void SparseBitmapIterInit(SparseBitmapIter *it, SparseBitmap *sb)
+{
+    it->sb = sb;
+    it->end = FALSE;
+    iter_enter(it, 0);
+}
+
+/* Returns FALSE if there's no more keys. */
+int SparseBitmapIterNext(SparseBitmapIter *it, u_long *r)
+{
+    while (!it->end) {
+        SPBContainer *c = it->c;
+        switch (c->type) {
+        case SPB_ARRAY:
+            if (it->index < c->size) {
+                *r = (it->high << LOW_BITS) + c->data.array[it->index++];
+                return TRUE;
+            }
+            break;
+        case SPB_BITMAP:
+            while (it->word == 0 && it->index < SPB_BITMAP_WORDS-1) {
+                it->word = c->data.bits[++it->index];
+            }
+            if (it->word) {
+                *r = (it->high << LOW_BITS) + it->index*SCM_WORD_BITS
+                    + lowest_bit(it->word);
+                it->word &= it->word - 1;
+                return TRUE;
+            }
+            break;
+        default:
+            if (it->index < c->size) {
+                *r = (it->high << LOW_BITS) + RUN_START(c, it->index)
+                    + it->offset;
+                if ((u_int)it->offset++ == RUN_LEN(c, it->index)) {
+                    it->index++;
+                    it->offset = 0;
+                }
+                return TRUE;
+            }
+            break;
+        }
+        /* The containers may have been changed.  Look for the one next
+           to the current one. */
+        int i = spb_search(it->sb, it->high);
+        iter_enter(it, (i >= 0)? i+1 : -i-1);
+    }
+    return FALSE;
+}
+
+ScmObj SparseBitmapToList(SparseBitmap *sb)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    SparseBitmapIter it;
+    u_long k;
+    SparseBitmapIterInit(&it, sb);
+    while (SparseBitmapIterNext(&it, &k)) {
+        SCM_APPEND1(h, t, Scm_MakeIntegerU(k));
+    }
+    return h;
+}
+
+/*===================================================================
+ * Debugging
+ */
+
+static const char *container_type_name(SPBContainer *c)
+{
+    switch (c->type) {
+    case SPB_ARRAY:  return "array";
+    case SPB_BITMAP: return "bitmap";
+    default:         return "run";
+    }
+}
+
+/* Returns a list of (upper-bits type cardinality) for each container. */
+ScmObj SparseBitmapContainers(SparseBitmap *sb)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    for (int i=0; i<sb->numContainers; i++) {
+        SPBContainer *c = sb->containers[i];
+        SCM_APPEND1(h, t,
+                    SCM_LIST3(Scm_MakeIntegerU(sb->keys[i]),
+                              SCM_INTERN(container_type_name(c)),
+                              SCM_MAKE_INT(c->card)));
+    }
+    return h;
+}
+
+void SparseBitmapDump(SparseBitmap *sb)
+{
+    ScmPort *out = SCM_CUROUT;
+    Scm_Printf(out, "sparse-bitmap %p (%lu entries, %d containers)\n",
+               sb, sb->numEntries, sb->numContainers);
+    for (int i=0; i<sb->numContainers; i++) {
+        SPBContainer *c = sb->containers[i];
+        Scm_Printf(out, "  %08lx: %s card=%d size=%d [%d..%d]\n",
+                   sb->keys[i], container_type_name(c), c->card, c->size,
+                   container_min(c), container_max(c));
+    }
+}
+
+/*===================================================================
+ * Initialization
+ */
+
+void Scm_Init_spbitmap(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_SparseBitmapClass, "<sparse-bitmap>",
+                        mod, NULL, 0);
+}
@@ -0,0 +1,149 @@
+/*
+ * spbitmap.h - Sparse bitmaps
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GAUCHE_SPBITMAP_H
+#define GAUCHE_SPBITMAP_H
+
+#include <gauche.h>
+#include <gauche/extend.h>
+
+#if defined(EXTSPARSE_EXPORTS)
+#define LIBGAUCHE_EXT_BODY
+#endif
+#include <gauche/extern.h>      /* redefine SCM_EXTERN */
+
+/* Sparse bitmap
+ *
+ * A set of nonnegative integers, compressed in the way of Roaring
+ * bitmaps (Chambi, Lemire, Kaser and Godin, "Better bitmap performance
+ * with Roaring bitmaps", 2014).
+ *
+ * A key is split into the upper bits and the lower 16 bits.  The keys
+ * that share the upper bits are kept in a 'container', which is one of
+ * the following, whichever is compact for its content:
+ *
+ *   array  - A sorted array of the lower 16 bits, used when the
+ *            container has up to SPB_ARRAY_MAX elements.
+ *   bitmap - A flat bitmap of 2^16 bits.
+ *   run    - A sorted array of runs, each of which is a pair of the
+ *            start and the length minus one.
+ *
+ * The containers are indexed by a sorted array of the upper bits, so
+ * that the set operations can merge two bitmaps container by container.
+ * (CompactTrie doesn't iterate its keys in order.)
+ */
+
+enum {
+    SPB_ARRAY,
+    SPB_BITMAP,
+    SPB_RUN
+};
+
+#define SPB_ARRAY_MAX     4096
+#define SPB_BITMAP_WORDS  (65536/SCM_WORD_BITS)
+
+typedef struct SPBContainerRec {
+    u_short  type;              /* SPB_ARRAY, SPB_BITMAP or SPB_RUN */
+    int      card;              /* # of elements, 1 to 65536 */
+    int      size;              /* # of elements (array) or runs (run) */
+    int      capacity;          /* allocated size of array or runs */
+    union {
+        u_short *array;         /* sorted elements */
+        u_long  *bits;          /* SPB_BITMAP_WORDS words */
+        u_short *runs;          /* (start, length-1) pairs */
+    } data;
+} SPBContainer;
+
+typedef struct SparseBitmapRec {
+    SCM_HEADER;
+    u_long         numEntries;  /* cardinality */
+    int            numContainers;
+    int            capacity;
+    u_long        *keys;        /* upper bits of keys, sorted */
+    SPBContainer **containers;
+} SparseBitmap;
+
+SCM_CLASS_DECL(Scm_SparseBitmapClass);
+#define SCM_CLASS_SPARSE_BITMAP  (&Scm_SparseBitmapClass)
+#define SPARSE_BITMAP(obj)       ((SparseBitmap*)(obj))
+#define SPARSE_BITMAP_P(obj)     SCM_XTYPEP(obj, SCM_CLASS_SPARSE_BITMAP)
+
+/* Set operations */
+enum {
+    SPB_OP_AND,
+    SPB_OP_OR,
+    SPB_OP_ANDNOT
+};
+
+extern ScmObj MakeSparseBitmap(void);
+extern int    SparseBitmapContains(SparseBitmap *sb, u_long key);
+extern int    SparseBitmapAdd(SparseBitmap *sb, u_long key);
+extern int    SparseBitmapRemove(SparseBitmap *sb, u_long key);
+extern void   SparseBitmapAddRange(SparseBitmap *sb, u_long start,
+                                   u_long end);
+extern void   SparseBitmapClear(SparseBitmap *sb);
+extern ScmObj SparseBitmapCopy(SparseBitmap *sb);
+extern int    SparseBitmapMin(SparseBitmap *sb, u_long *r);
+extern int    SparseBitmapMax(SparseBitmap *sb, u_long *r);
+extern int    SparseBitmapEqual(SparseBitmap *a, SparseBitmap *b);
+extern void   SparseBitmapOptimize(SparseBitmap *sb);
+
+/* SparseBitmapOp returns a new bitmap; SparseBitmapOpX stores the
+   result into A. */
+extern ScmObj SparseBitmapOp(int op, SparseBitmap *a, SparseBitmap *b);
+extern void   SparseBitmapOpX(int op, SparseBitmap *a, SparseBitmap *b);
+extern u_long SparseBitmapAndCount(SparseBitmap *a, SparseBitmap *b);
+
+extern ScmObj SparseBitmapToList(SparseBitmap *sb);
+extern ScmObj SparseBitmapContainers(SparseBitmap *sb);
+extern void   SparseBitmapDump(SparseBitmap *sb);
+
+/* Iterator.  The bitmap may be modified during iteration; the iterator
+   doesn't crash, but may or may not see the modification. */
+typedef struct SparseBitmapIterRec {
+    SparseBitmap *sb;
+    SPBContainer *c;            /* current container */
+    u_long        high;         /* its upper bits */
+    int           index;        /* word, element or run index in c */
+    int           offset;       /* offset in the run */
+    u_long        word;         /* rest of the current bitmap word */
+    int           end;
+} SparseBitmapIter;
+
+extern void   SparseBitmapIterInit(SparseBitmapIter *it, SparseBitmap *sb);
+extern int    SparseBitmapIterNext(SparseBitmapIter *it, u_long *r);
+
+extern void   Scm_Init_spbitmap(ScmModule *mod);
+
+#endif /*GAUCHE_SPBITMAP_H*/
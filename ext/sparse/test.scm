@@ -227,4 +227,286 @@
            (begin (sparse-table-delete! u '(1 . 0)) (vals u)))
     ))
 
+(test-section "persistent maps")
+
+;; Compare with a hash table through random updates,
+;; while keeping old versions to see they're intact.
+(define (pmap-heavy name m0 ref put delete num-entries ->alist
+                    to-transient put! delete! to-persistent
+                    shadow keygen sorter)
+  (define versions '())
+  (define m
+    (let loop ([i 0] [m m0])
+      (if (= i 3000)
+        m
+        (let1 k (keygen (random-integer 500))
+          (when (zero? (modulo i 300))
+            (push! versions (cons m (hash-table-copy shadow))))
+          (if (zero? (random-integer 3))
+            (begin (hash-table-delete! shadow k)
+                   (loop (+ i 1) (delete m k)))
+            (begin (hash-table-put! shadow k i)
+                   (loop (+ i 1) (put m k i))))))))
+  (test* #"~name num-entries" (hash-table-num-entries shadow)
+         (num-entries m))
+  (test* #"~name ref" '()
+         (hash-table-fold shadow
+                          (^[k v r] (if (equal? (ref m k #f) v) r (cons k r)))
+                          '()))
+  (test* #"~name ->alist" (sorter (hash-table->alist shadow))
+         (sorter (->alist m)))
+  (test* #"~name old versions" #t
+         (every (^p (equal? (sorter (->alist (car p)))
+                            (sorter (hash-table->alist (cdr p)))))
+                versions))
+  (let* ([t (to-transient m)]
+         [m2 (begin (dotimes [i 500]
+                      (let1 k (keygen (+ i 1000))
+                        (put! t k 'x)
+                        (delete! t k)))
+                    (to-persistent t))])
+    (test* #"~name transient" (sorter (hash-table->alist shadow))
+           (sorter (->alist m2)))
+    (test* #"~name transient invalidated" (test-error)
+           (put! t (keygen 0) 'y))
+    (test* #"~name equal? after transient" #t (equal? m m2)))
+  (test* #"~name original intact" (sorter (hash-table->alist shadow))
+         (sorter (->alist m)))
+  (test* #"~name equal? (different history)" #t
+         (equal? m (fold (^[p m] (put m (car p) (cdr p)))
+                         m0 (reverse (hash-table->alist shadow)))))
+  (test* #"~name not equal?" #f
+         (equal? m (put m (keygen 2000) 'z)))
+  (test* #"~name functional update doesn't touch original" '(#f z)
+         (let1 m2 (put m (keygen 2000) 'z)
+           (list (ref m (keygen 2000) #f) (ref m2 (keygen 2000) #f)))))
+
+(pmap-heavy "persistent-hash-map (eqv?)" (make-persistent-hash-map 'eqv?)
+            persistent-hash-map-ref persistent-hash-map-put
+            persistent-hash-map-delete persistent-hash-map-num-entries
+            persistent-hash-map->alist
+            persistent-hash-map-transient transient-hash-map-put!
+            transient-hash-map-delete! transient-hash-map-persistent!
+            (make-hash-table 'eqv?) values
+            (^[alist] (sort alist (^[a b] (< (car a) (car b))))))
+(pmap-heavy "persistent-hash-map (string=?)"
+            (make-persistent-hash-map 'string=?)
+            persistent-hash-map-ref persistent-hash-map-put
+            persistent-hash-map-delete persistent-hash-map-num-entries
+            persistent-hash-map->alist
+            persistent-hash-map-transient transient-hash-map-put!
+            transient-hash-map-delete! transient-hash-map-persistent!
+            (make-hash-table 'string=?) (cut number->string <> 36)
+            (^[alist] (sort alist (^[a b] (string<? (car a) (car b))))))
+(pmap-heavy "persistent-tree-map" (make-persistent-tree-map)
+            persistent-tree-map-ref persistent-tree-map-put
+            persistent-tree-map-delete persistent-tree-map-num-entries
+            persistent-tree-map->alist
+            persistent-tree-map-transient transient-tree-map-put!
+            transient-tree-map-delete! transient-tree-map-persistent!
+            (make-hash-table 'eqv?) values
+            (^[alist] (sort alist (^[a b] (< (car a) (car b))))))
+
+;; Keys with the same hash value; see the sparse-table tests above.
+(let* ([keys '((0 . 5) (1 . 0) #(0 5) #(1 0))]
+       [m (fold (^[k i m] (persistent-hash-map-put m k i))
+                (make-persistent-hash-map 'equal?) keys (iota 4))])
+  (define (vals m) (map (cut persistent-hash-map-ref m <> #f) keys))
+  (test* "persistent-hash-map key conflicts" '(0 1 2 3) (vals m))
+  (test* "persistent-hash-map key conflicts delete" '((#f 1 #f 3) (0 1 2 3))
+         (let1 m2 (persistent-hash-map-delete
+                   (persistent-hash-map-delete m '#(0 5)) '(0 . 5))
+           (list (vals m2) (vals m))))
+  (test* "persistent-hash-map key conflicts equal?" #t
+         (equal? m (fold (^[k i m] (persistent-hash-map-put m k i))
+                         (make-persistent-hash-map 'equal?)
+                         (reverse keys) (reverse (iota 4))))))
+
+;; Keys whose hash values agree in the lower two levels.  Deleting one
+;; from a transient leaves the other as a lone leaf deep in the trie,
+;; which must be pulled up as the persistent delete does.
+(let* ([low (^k (logand (eqv-hash k) #x3ff))]
+       [full (^k (logand (eqv-hash k) #xffffffff))]
+       [b (let loop ([k 2])
+            (if (and (= (low k) (low 1)) (not (= (full k) (full 1))))
+              k
+              (loop (+ k 1))))]
+       [m0 (persistent-hash-map-put (make-persistent-hash-map 'eqv?) 1 'a)])
+  (test* "persistent-hash-map equal? after transient delete" #t
+         (let1 t (persistent-hash-map-transient
+                  (make-persistent-hash-map 'eqv?))
+           (transient-hash-map-put! t 1 'a)
+           (transient-hash-map-put! t b 'b)
+           (transient-hash-map-delete! t b)
+           (equal? m0 (transient-hash-map-persistent! t))))
+  (test* "persistent-hash-map equal? after delete" #t
+         (equal? m0 (persistent-hash-map-delete
+                     (persistent-hash-map-put m0 b 'b) b))))
+
+(let1 m (alist->persistent-tree-map '((3 . c) (1 . a) (2 . b)))
+  (test* "persistent-tree-map-min" '(1 . a) (persistent-tree-map-min m))
+  (test* "persistent-tree-map-max" '(3 . c) (persistent-tree-map-max m))
+  (test* "persistent-tree-map-keys" '(1 2 3) (persistent-tree-map-keys m))
+  (test* "persistent-tree-map-fold" '(3 2 1)
+         (persistent-tree-map-fold m (^[k v s] (cons k s)) '()))
+  (test* "persistent-tree-map custom order" '(3 2 1)
+         (persistent-tree-map-keys
+          (alist->persistent-tree-map '((3 . c) (1 . a) (2 . b))
+                                      (^[a b] (- b a))))))
+
+(let* ([m (alist->persistent-hash-map '((a . 1) (b . 2)))]
+       [t (persistent-hash-map-transient m)])
+  (test* "persistent-hash-map dict-get" 2 (dict-get m 'b))
+  (test* "persistent-hash-map dict-put! (error)" (test-error)
+         (dict-put! m 'c 3))
+  (test* "transient-hash-map dict-put!" '((a . 1) (b . 2) (c . 3))
+         (begin (dict-put! t 'c 3)
+                (sort (dict->alist t) (^[x y] (string<? (x->string (car x))
+                                                        (x->string (car y)))))))
+  (test* "persistent-hash-map unchanged" 2 (persistent-hash-map-num-entries m))
+  (test* "persistent-tree-map dict-fold-right" '(1 2 3)
+         (dict-fold-right
+          (alist->persistent-tree-map '((2 . b) (3 . c) (1 . a)))
+          (^[k v s] (cons k s)) '())))
+
+(test-section "sparse bitmaps")
+
+(let1 sb (make-sparse-bitmap)
+  (test* "sparse-bitmap empty" '(#t 0 #f #f ())
+         (list (sparse-bitmap-empty? sb) (sparse-bitmap-cardinality sb)
+               (sparse-bitmap-min sb) (sparse-bitmap-max sb)
+               (sparse-bitmap->list sb)))
+  (test* "sparse-bitmap-add!" '(#t #t #t #f)
+         (list (sparse-bitmap-add! sb 5) (sparse-bitmap-add! sb 0)
+               (sparse-bitmap-add! sb (- (expt 2 32) 1))
+               (sparse-bitmap-add! sb 5)))
+  (test* "sparse-bitmap-contains?" '(#t #t #f #t)
+         (map (cut sparse-bitmap-contains? sb <>)
+              `(0 5 6 ,(- (expt 2 32) 1))))
+  (test* "sparse-bitmap->list" `(0 5 ,(- (expt 2 32) 1))
+         (sparse-bitmap->list sb))
+  (test* "sparse-bitmap-min, max" `(0 ,(- (expt 2 32) 1))
+         (list (sparse-bitmap-min sb) (sparse-bitmap-max sb)))
+  (test* "sparse-bitmap-remove!" '(#t #f (5) 1)
+         (list (sparse-bitmap-remove! sb 0)
+               (sparse-bitmap-remove! sb 0)
+               (begin (sparse-bitmap-remove! sb (- (expt 2 32) 1))
+                      (sparse-bitmap->list sb))
+               (sparse-bitmap-cardinality sb)))
+  (test* "sparse-bitmap negative key" (test-error)
+         (sparse-bitmap-add! sb -1))
+  (test* "sparse-bitmap-clear!" '(#t ())
+         (begin (sparse-bitmap-clear! sb)
+                (list (sparse-bitmap-empty? sb) (sparse-bitmap->list sb))))
+  (test* "sparse-bitmap-add-range!" '(200000 65530 265529 #f #t #t #f)
+         (begin (sparse-bitmap-add-range! sb 65530 265530)
+                (list (sparse-bitmap-cardinality sb)
+                      (sparse-bitmap-min sb) (sparse-bitmap-max sb)
+                      (sparse-bitmap-contains? sb 65529)
+                      (sparse-bitmap-contains? sb 65536)
+                      (sparse-bitmap-contains? sb 265529)
+                      (sparse-bitmap-contains? sb 265530))))
+  (test* "sparse-bitmap run containers" '(run run run run run)
+         (map cadr (%sparse-bitmap-containers sb)))
+  (test* "sparse-bitmap-fold" '(265529 265528 265527)
+         (take (sparse-bitmap-fold sb cons '()) 3))
+  )
+
+;; Builds a bitmap and a shadow hash table with keys in various
+;; densities, so that every kind of container is used.
+(define (make-random-bitmap)
+  (let ([sb (make-sparse-bitmap)]
+        [shadow (make-hash-table 'eqv?)])
+    (define (add! k)
+      (sparse-bitmap-add! sb k)
+      (hash-table-put! shadow k #t))
+    (dotimes [i 300] (add! (random-integer 65536)))
+    (dotimes [i 20000] (add! (+ 65536 (random-integer 65536))))
+    (dotimes [i 10]
+      (let* ([s (+ 131072 (random-integer 60000))]
+             [e (+ s (random-integer 3000))])
+        (sparse-bitmap-add-range! sb s e)
+        (do ([k s (+ k 1)]) [(= k e)] (hash-table-put! shadow k #t))))
+    (dotimes [i 300] (add! (random-integer (expt 2 32))))
+    (values sb shadow)))
+
+(define (shadow-keys shadow) (sort (hash-table-keys shadow)))
+
+(receive (a sa) (make-random-bitmap)
+  (receive (b sb) (make-random-bitmap)
+    (define (shadow-op pred)
+      (let1 r (make-hash-table 'eqv?)
+        (dolist [k (append (hash-table-keys sa) (hash-table-keys sb))]
+          (when (pred (hash-table-exists? sa k) (hash-table-exists? sb k))
+            (hash-table-put! r k #t)))
+        (shadow-keys r)))
+    (define (or2 x y) (or x y))
+    (define (and2 x y) (and x y))
+    (define (andnot x y) (and x (not y)))
+
+    (test* "sparse-bitmap random contents" (shadow-keys sa)
+           (sparse-bitmap->list a))
+    (test* "sparse-bitmap container types" '(array bitmap run)
+           (sort (delete-duplicates (map cadr (%sparse-bitmap-containers a)))
+                 (^[x y] (string<? (symbol->string x) (symbol->string y)))))
+    ;; The set operations are run with the scalar code and each set
+    ;; of kernels this machine can use.
+    (let1 available (%cpu-features)
+      (dolist [fs '(() (sse2) (sse2 avx2))]
+        (define (name s) (format #f "~a, kernels ~s" s fs))
+        (when (every (cut memq <> available) fs)
+          (%cpu-features fs)
+          (test* (name "sparse-bitmap-union") (shadow-op or2)
+                 (sparse-bitmap->list (sparse-bitmap-union a b)))
+          (test* (name "sparse-bitmap-intersection") (shadow-op and2)
+                 (sparse-bitmap->list (sparse-bitmap-intersection a b)))
+          (test* (name "sparse-bitmap-difference") (shadow-op andnot)
+                 (sparse-bitmap->list (sparse-bitmap-difference a b)))
+          (test* (name "sparse-bitmap-intersection-size")
+                 (length (shadow-op and2))
+                 (sparse-bitmap-intersection-size a b))
+          (test* (name "sparse-bitmap operands intact")
+                 (list (shadow-keys sa) (shadow-keys sb))
+                 (list (sparse-bitmap->list a) (sparse-bitmap->list b)))
+          (test* (name "sparse-bitmap-union!") (shadow-op or2)
+                 (let1 c (sparse-bitmap-copy a)
+                   (sparse-bitmap->list (sparse-bitmap-union! c b))))
+          (test* (name "sparse-bitmap-intersection!") (shadow-op and2)
+                 (let1 c (sparse-bitmap-copy a)
+                   (sparse-bitmap->list (sparse-bitmap-intersection! c b))))
+          (test* (name "sparse-bitmap-difference!") (shadow-op andnot)
+                 (let1 c (sparse-bitmap-copy a)
+                   (sparse-bitmap->list (sparse-bitmap-difference! c b)))))))
+      (%cpu-features #t))
+
+    (test* "sparse-bitmap-copy independent" (shadow-keys sa)
+           (let1 c (sparse-bitmap-copy a)
+             (sparse-bitmap-clear! c)
+             (sparse-bitmap->list a)))
+    (test* "sparse-bitmap n-ary" #t
+           (let1 c (list->sparse-bitmap (iota 1000 0 200))
+             (equal? (sparse-bitmap-intersection a b c)
+                     (sparse-bitmap-intersection
+                      c (sparse-bitmap-intersection b a)))))
+    (test* "sparse-bitmap-difference with itself" #t
+           (sparse-bitmap-empty? (sparse-bitmap-difference a a)))
+    (test* "sparse-bitmap equal?" '(#t #f)
+           (list (equal? a (list->sparse-bitmap (reverse (shadow-keys sa))))
+                 (equal? a b)))
+    (test* "sparse-bitmap-optimize!" '(#t #t)
+           (let1 c (sparse-bitmap-copy a)
+             (sparse-bitmap-optimize! c)
+             (list (equal? a c)
+                   (equal? (sparse-bitmap->list a) (sparse-bitmap->list c)))))
+    (test* "sparse-bitmap-remove! all" '(#t 0)
+           (let1 c (sparse-bitmap-copy a)
+             (hash-table-for-each sa (^[k _] (sparse-bitmap-remove! c k)))
+             (list (sparse-bitmap-empty? c)
+                   (length (%sparse-bitmap-containers c)))))
+    (test* "sparse-bitmap-for-each" (hash-table-num-entries sa)
+           (let1 n 0
+             (sparse-bitmap-for-each a (^_ (inc! n)))
+             n))
+    ))
+
 (test-end)
@@ -529,6 +529,60 @@
            (for-each thread-join! ts)
            count)))
 
+;;---------------------------------------------------------------------
+(test-section "threads and symbols")
+
+;; Each thread interns the same set of fresh names in a different order;
+;; all of them must get the identical symbols.
+(let* ([names (map (^i (format "thread-test-symbol-~a" i)) (iota 3000))]
+       [ts (map (^k (make-thread
+                     (^[] (if (even? k)
+                            (map string->symbol names)
+                            (reverse (map string->symbol (reverse names)))))))
+                (iota 6))])
+  (test* "concurrent interning" #t
+         (begin
+           (for-each thread-start! ts)
+           (let1 rs (map thread-join! ts)
+             (and (every (^r (every eq? r (car rs))) rs)
+                  (every (^[s n] (eq? s (string->symbol n)))
+                         (car rs) names))))))
+
+;;---------------------------------------------------------------------
+(test-section "threads and modules")
+
+;; Some threads keep adding bindings to a module while others look them
+;; up; a reader must see either no binding or the right value.
+(let* ([m (make-module #f)]
+       [names (map (^i (string->symbol (format "thread-test-var-~a" i)))
+                   (iota 2000))]
+       [writers (map (^k (make-thread
+                          (^[] (for-each (^[n i]
+                                           (when (= (modulo i 2) k)
+                                             (eval `(define ,n ,i) m)))
+                                         names (iota 2000)))))
+                     (iota 2))]
+       [readers (map (^_ (make-thread
+                          (^[] (let loop ([r 0] [bad 0])
+                                 (if (= r 20)
+                                   bad
+                                   (loop (+ r 1)
+                                         (fold (^[n i bad]
+                                                 (let1 v (global-variable-ref
+                                                          m n #f)
+                                                   (if (or (not v) (eqv? v i))
+                                                     bad
+                                                     (+ bad 1))))
+                                               bad names (iota 2000))))))))
+                     (iota 4))])
+  (test* "concurrent definition and lookup" '(0 0 0 0 #t)
+         (begin
+           (for-each thread-start! (append readers writers))
+           (for-each thread-join! writers)
+           (append (map thread-join! readers)
+                   (list (every (^[n i] (eqv? (global-variable-ref m n #f) i))
+                                names (iota 2000)))))))
+
 ;;---------------------------------------------------------------------
 (test-section "threads and lazy sequences")
 
@@ -552,6 +606,51 @@
                   (thread-start! t1)
                   (list (thread-join! t0) (thread-join! t1))))))
 
+;;---------------------------------------------------------------------
+(test-section "threads and caches")
+
+;; Threads share a thread-safe cache of squares; whatever is evicted,
+;; every value obtained must be correct and the limit must be kept.
+(let* ([c (make-cache :type 'equal? :max-entries 500 :thread-safe #t)]
+       [ts (map (^k (make-thread
+                     (^[] (let loop ([i 0] [ok #t])
+                            (if (= i 20000)
+                              ok
+                              (let* ([n (modulo (* (+ i k) 7919) 2000)]
+                                     [v (cache-lookup! c (list n)
+                                                       (^[] (* n n)))])
+                                (loop (+ i 1) (and ok (= v (* n n))))))))))
+                (iota 6))])
+  (test* "concurrent cache access" '(#t #t)
+         (begin
+           (for-each thread-start! ts)
+           (list (every identity (map thread-join! ts))
+                 (<= (cache-num-entries c) 500)))))
+
+;; Same, with weights.  The segments share max-weight, so entries heavier
+;; than a segment's share can be stored, and the total is kept.
+(let* ([c (make-cache :type 'equal? :max-weight 1000 :thread-safe #t)]
+       [ts (map (^k (make-thread
+                     (^[] (let loop ([i 0] [ok #t])
+                            (if (= i 20000)
+                              ok
+                              (let* ([n (modulo (* (+ i k) 7919) 2000)]
+                                     [w (+ (modulo n 200) 1)])
+                                (cache-put! c (list n) (* n n) :weight w)
+                                (let1 v (cache-get c (list n) #f)
+                                  (loop (+ i 1)
+                                        (and ok (or (not v)
+                                                    (= v (* n n))))))))))))
+                (iota 6))])
+  (test* "concurrent cache access (max-weight)" '(#t #t #t)
+         (begin
+           (for-each thread-start! ts)
+           (list (every identity (map thread-join! ts))
+                 (<= (cache-weight c) 1000)
+                 (= (cache-weight c)
+                    (fold (^[k s] (+ (modulo (caar k) 200) 1 s))
+                          0 (cache->alist c)))))))
+
 ;;---------------------------------------------------------------------
 (test-section "synchrnization by queues")
 
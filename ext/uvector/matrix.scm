@@ -123,6 +123,46 @@
         [(= i n) res]
       (array-set! res i i 1))))
 
+;; Native routines for <f32array> and <f64array> (uvmatrix.c)
+;; Arrays are always mapped to their backing storage by an affine
+;; function, even if they're created by share-array.  If A is a
+;; nonempty 2D flonum array, returns a list of its storage, the offset
+;; of its first element, and the row and column strides, to be passed
+;; to the native routines.  Otherwise returns #f.
+;; The native routines take the number of threads to use as the last
+;; argument.  Their results are f32vectors only if all the operands
+;; are f32arrays; if f32 and f64 arrays are mixed, they're f64vectors.
+(define (flonum-matrix-layout a)
+  (and (memq (class-of a) `(,<f32array> ,<f64array>))
+       (= (s32vector-length (start-vector-of a)) 2)
+       (let* ([start (start-vector-of a)]
+              [end (end-vector-of a)]
+              [r (s32vector-ref start 0)]
+              [c (s32vector-ref start 1)]
+              [mapper (mapper-of a)])
+         (and (< r (s32vector-ref end 0))
+              (< c (s32vector-ref end 1))
+              (let1 off (mapper (list r c))
+                (list (backing-storage-of a)
+                      off
+                      (if (< (+ r 1) (s32vector-ref end 0))
+                        (- (mapper (list (+ r 1) c)) off)
+                        0)
+                      (if (< (+ c 1) (s32vector-ref end 1))
+                        (- (mapper (list r (+ c 1))) off)
+                        0)))))))
+
+;; Wraps the result of the native routines, a uvector that holds
+;; NxM matrix in row-major order.
+(define (flonum-matrix v n m)
+  (let ([Vb (s32vector 0 0)]
+        [Ve (s32vector n m)])
+    (make (if (f32vector? v) <f32array> <f64array>)
+      :start-vector Vb
+      :end-vector Ve
+      :mapper (generate-amap Vb Ve)
+      :backing-storage v)))
+
 ;; Gaussian elimination, returns factor applied to determinant
 (define (array-row-echelon! a)
   (let* ([start (start-vector-of a)]
@@ -198,7 +238,7 @@
               [(= j col-end)]
             (array-set! a i j (/ (array-ref a i j) divisor))))))))
 
-(define (array-inverse a)
+(define (array-inverse a :key (threads 1))
   (let* ([start (start-vector-of a)]
          [end (end-vector-of a)]
          [rank (s32vector-length start)]
@@ -208,48 +248,57 @@
       (error "can only compute inverses of 2D arrays"))
     (unless (= n m)
       (error "can only compute inverses of square matrices"))
-    (let* ([class (class-of a)]
-           [id (identity-array n (if (or (eq? class <f32array>)
-                                         (eq? class <f64array>))
-                                   class <array>))]
-           [tmp (array-concatenate a id 1)])
-      (array-solve-left-identity! tmp)
-      (and (= 1 (array-ref tmp (- (s32vector-ref end 0) 1)
-                           (- (s32vector-ref end 1) 1)))
-           (subarray tmp (shape (s32vector-ref start 0) (s32vector-ref end 0)
-                                (s32vector-ref end 1) (+ (s32vector-ref end 1) n)))))))
-
-
-(define (determinant! a)
+    (if-let1 layout (flonum-matrix-layout a)
+      (let1 v (apply %uvector-matrix-inverse `(,@layout ,n ,threads))
+        (and v (flonum-matrix v n n)))
+      (let* ([class (class-of a)]
+             [id (identity-array n (if (or (eq? class <f32array>)
+                                           (eq? class <f64array>))
+                                     class <array>))]
+             [tmp (array-concatenate a id 1)])
+        (array-solve-left-identity! tmp)
+        (and (= 1 (array-ref tmp (- (s32vector-ref end 0) 1)
+                             (- (s32vector-ref end 1) 1)))
+             (subarray tmp (shape (s32vector-ref start 0) (s32vector-ref end 0)
+                                  (s32vector-ref end 1) (+ (s32vector-ref end 1) n))))))))
+
+
+(define (determinant! a :key (threads 1))
   (let* ([start (s32vector->list (start-vector-of a))]
-         [end (s32vector->list (end-vector-of a))]
-         [row-col-offset (- (car start) (cadr start))]
-         [factor (array-row-echelon! a)])
+         [end (s32vector->list (end-vector-of a))])
     (unless (= 2 (length start)) ; add determinant for the 2x2x2 case?
       (error "can't compute hyperdeterminants in the general case"))
     (unless (apply = (map - end start))
       (error "can't compute determinants of non-square matrices"))
-    (apply * factor (map (^i (array-ref a i (- i row-col-offset)))
-                         (map (cute + <> (car start))
-                              (iota (- (car end) (car start))))))))
-
-(define (determinant a)
+    (if-let1 layout (flonum-matrix-layout a)
+      (apply %uvector-matrix-determinant
+             `(,@layout ,(- (car end) (car start)) ,threads))
+      (let ([row-col-offset (- (car start) (cadr start))]
+            [factor (array-row-echelon! a)])
+        (apply * factor (map (^i (array-ref a i (- i row-col-offset)))
+                             (map (cute + <> (car start))
+                                  (iota (- (car end) (car start))))))))))
+
+(define (determinant a :key (threads 1))
   (let1 class (class-of a)
-    (if (or (eq? class <f32array>)
-            (eq? class <f64array>)
-            (eq? class <array>))
-      (determinant! (copy-object a))
-      (let* ([rank (s32vector-length (start-vector-of a))]
-             [b (tabulate-array (array-shape a)
-                                (^[ind] (array-ref a ind))
-                                (make-vector rank))])
-        (determinant! b)))))
+    (cond [(flonum-matrix-layout a)
+           (determinant! a :threads threads)] ; native version doesn't modify a
+          [(or (eq? class <f32array>)
+               (eq? class <f64array>)
+               (eq? class <array>))
+           (determinant! (copy-object a))]
+          [else
+           (let* ([rank (s32vector-length (start-vector-of a))]
+                  [b (tabulate-array (array-shape a)
+                                     (^[ind] (array-ref a ind))
+                                     (make-vector rank))])
+             (determinant! b))])))
 
 
 ;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;;
 ;; matrix arithmetic
 
-(define (array-mul a b) ; NxM * MxP => NxP
+(define (array-mul a b :key (threads 1)) ; NxM * MxP => NxP
   (let ([a-start (start-vector-of a)]
         [a-end (end-vector-of a)]
         [b-start (start-vector-of b)]
@@ -265,20 +314,26 @@
            [n (- a-end-row a-start-row)]
            [m (- a-end-col a-start-col)]
            [p (- b-end-col b-start-col)]
-           [a-col-b-row-off (- a-start-col (s32vector-ref b-start 0))]
-           [res (make-minimal-backend-array (list a b) (shape 0 n 0 p))])
+           [a-col-b-row-off (- a-start-col (s32vector-ref b-start 0))])
       (unless (= m (- (s32vector-ref b-end 0) (s32vector-ref b-start 0)))
         (errorf "dimension mismatch: can't mul shapes ~S and ~S"
                 (array-shape a) (array-shape b)))
-      (do ([i a-start-row (+ i 1)])       ; for-each row of a
-          [(= i a-end-row) res]
-        (do ([k b-start-col (+ k 1)])     ; for-each col of b
-            [(= k b-end-col)]
-          (let1 tmp 0
-            (do ([j a-start-col (+ j 1)]) ; for-each col of a & row of b
-                [(= j a-end-col)]
-              (inc! tmp (* (array-ref a i j) (array-ref b (- j a-col-b-row-off) k))))
-            (array-set! res (- i a-start-row) (- k b-start-col) tmp)))))))
+      (or (and-let* ([a-layout (flonum-matrix-layout a)]
+                     [b-layout (flonum-matrix-layout b)])
+            (flonum-matrix (apply %uvector-matrix-mul
+                                  `(,@a-layout ,@b-layout ,n ,m ,p ,threads))
+                           n p))
+          (let1 res (make-minimal-backend-array (list a b) (shape 0 n 0 p))
+            (do ([i a-start-row (+ i 1)])       ; for-each row of a
+                [(= i a-end-row) res]
+              (do ([k b-start-col (+ k 1)])     ; for-each col of b
+                  [(= k b-end-col)]
+                (let1 tmp 0
+                  (do ([j a-start-col (+ j 1)]) ; for-each col of a & row of b
+                      [(= j a-end-col)]
+                    (inc! tmp (* (array-ref a i j)
+                                 (array-ref b (- j a-col-b-row-off) k))))
+                  (array-set! res (- i a-start-row) (- k b-start-col) tmp)))))))))
 
 (define (array-div-left a b)
   (array-mul (array-inverse b) a))
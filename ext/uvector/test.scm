@@ -1295,6 +1295,111 @@
 (clamp-test-generate u64 #u64(127 0 4 200 255)
                      #u64(3 3 3 3 3) #u64(199 199 199 199 199))
 
+;;-------------------------------------------------------------------
+(test-section "operations on long vectors")
+
+;; The common cases of f32, f64, s32 and u8 vectors are handled by SIMD
+;; kernels, which process the leading elements in chunks and leave the
+;; rest to the generic code.  We compare the results with the ones
+;; calculated by the generic code, by giving the operands as lists.
+
+(define (pseudo-random-list n seed lo hi)
+  (let loop ([i 0] [s seed] [r '()])
+    (if (= i n)
+      (reverse r)
+      (let1 s (modulo (+ (* s 1103515245) 12345) 2147483648)
+        (loop (+ i 1) s
+              (cons (+ lo (modulo (* (quotient s 16) 2654435761) (- hi lo -1)))
+                    r))))))
+
+(define (long-vector-test tag list->vec ops dot sum vmin vmax
+                          clamp range-check conv lo hi consts)
+  (define (safe thunk) (with-error-handler (^e 'error) thunk))
+  (dolist [n '(37 100)]
+    (let* ([l0 (map conv (pseudo-random-list n 1 lo hi))]
+           [l1 (map conv (pseudo-random-list n 2 lo hi))]
+           [v0 (list->vec l0)]
+           [v1 (list->vec l1)])
+      (dolist [op ops]
+        (dolist [clamp '(#f both)]
+          (test* (format #f "~svector-~a (~d, ~s)" tag (car op) n clamp)
+                 (safe (cut (cdr op) v0 l1 clamp))
+                 (safe (cut (cdr op) v0 v1 clamp)))
+          (dolist [c consts]
+            (test* (format #f "~svector-~a (~d, ~s, ~s)" tag (car op) n c clamp)
+                   (safe (cut (cdr op) v0 (make-list n c) clamp))
+                   (safe (cut (cdr op) v0 c clamp))))))
+      (test* (format #f "~svector-dot (~d)" tag n)
+             (dot v0 l1) (dot v0 v1))
+      ;; The elements are small enough so that the sum is exact
+      ;; regardless of the order of summation.
+      (test* (format #f "~svector-sum (~d)" tag n)
+             (apply + l0) (sum v0) =)
+      (test* (format #f "~svector-min (~d)" tag n)
+             (apply min l0) (vmin v0) =)
+      (test* (format #f "~svector-max (~d)" tag n)
+             (apply max l0) (vmax v0) =)
+      (dolist [lim `((,(conv (quotient lo 2)) . ,(conv (quotient hi 2)))
+                     (#f . ,(conv 0)) (,(conv 0) . #f))]
+        (let ([minl (and (car lim) (make-list n (car lim)))]
+              [maxl (and (cdr lim) (make-list n (cdr lim)))])
+          (test* (format #f "~svector-clamp (~d, ~s)" tag n lim)
+                 (clamp v0 minl maxl) (clamp v0 (car lim) (cdr lim)))
+          (test* (format #f "~svector-range-check (~d, ~s)" tag n lim)
+                 (range-check v0 minl maxl)
+                 (range-check v0 (car lim) (cdr lim))))))))
+
+(define-macro (long-vector-test-generate tag conv lo hi consts)
+  (define (sym fmt) (string->symbol (format #f fmt tag)))
+  `(long-vector-test ',tag ,(sym "list->~avector")
+                     (list (cons "add" ,(sym "~avector-add"))
+                           (cons "sub" ,(sym "~avector-sub"))
+                           (cons "mul" ,(sym "~avector-mul"))
+                           ,@(if (memq tag '(f32 f64))
+                               `((cons "div"
+                                       (^[v x c] (,(sym "~avector-div") v x))))
+                               '()))
+                     ,(sym "~avector-dot")
+                     ,(sym "~avector-sum")
+                     ,(sym "~avector-min")
+                     ,(sym "~avector-max")
+                     ,(sym "~avector-clamp")
+                     ,(sym "~avector-range-check")
+                     ,conv ,lo ,hi ',consts))
+
+(define (long-vector-tests)
+  (long-vector-test-generate f32 (cut / <> 4) -4000 4000 (0.5 0.1 -3))
+  (long-vector-test-generate f64 (cut / <> 4) -4000 4000 (0.5 0.1 -3))
+  (long-vector-test-generate s32 identity -30000 30000 (100 -100000))
+  (long-vector-test-generate s32 identity -2147483648 2147483647 (1 -1))
+  (long-vector-test-generate u8 identity 0 15 (3 200))
+  (long-vector-test-generate u8 identity 0 255 (1 2)))
+
+;; Run the tests with each set of kernels this machine can use.
+;; With the empty set, everything is done by the generic code.
+(let1 available (%cpu-features)
+  (dolist [fs '(() (sse2) (sse2 avx2))]
+    (when (every (cut memq <> available) fs)
+      (test-section (format #f "operations on long vectors, kernels ~s" fs))
+      (%cpu-features fs)
+      (long-vector-tests)))
+  (%cpu-features #t))
+
+(test* "f32vector-min (NaN)" #t
+       (nan? (f32vector-min (list->f32vector
+                             `(,@(iota 40) +nan.0 ,@(iota 40))))))
+(test* "f64vector-max (NaN)" #t
+       (nan? (f64vector-max (list->f64vector
+                             `(,@(iota 40) +nan.0 ,@(iota 40))))))
+(test* "s32vector-min (empty)" (test-error) (s32vector-min #s32()))
+(test* "u8vector-max (empty)" (test-error) (u8vector-max #u8()))
+(test* "u8vector-sum" 255000 (u8vector-sum (make-u8vector 1000 255)))
+(test* "s8vector-sum" -1280 (s8vector-sum (make-s8vector 10 -128)))
+(test* "s64vector-max" 4611686018427387904
+       (s64vector-max #s64(-1 4611686018427387904 3)))
+(test* "u64vector-min" 3 (u64vector-min #u64(18446744073709551615 3 4)))
+(test* "f16vector-sum" 3.5 (f16vector-sum #f16(1.0 2.0 0.5)))
+
 ;;-------------------------------------------------------------------
 (test-section "block i/o")
 
@@ -1376,6 +1481,29 @@
   (run-across test-reverse-endian)
   )
 
+(let1 data '#u8(0 1 2 3 255 254 253 252 4 5 6 7 251 250 249 248)
+  (call-with-output-file "test.o" (cut write-uvector data <>))
+  (test* "map-file->u8vector" data
+         (map-file->u8vector "test.o"))
+  (test* "map-file->u8vector (immutable)" (test-error)
+         (u8vector-set! (map-file->u8vector "test.o") 0 1))
+  (test* "map-file->u8vector (alias)" (uvector-alias <u32vector> data 4 12)
+         (uvector-alias <u32vector> (map-file->u8vector "test.o") 4 12))
+  (test* "map-file->u8vector (writable)" '(#u8(9 1 2 3) #u8(0 1 2 3))
+         (let1 v (map-file->u8vector "test.o" :writable? #t)
+           (u8vector-set! v 0 9)
+           (list (u8vector-copy v 0 4)
+                 (u8vector-copy (map-file->u8vector "test.o") 0 4))))
+  (test* "map-file->u8vector (empty)" '#u8()
+         (begin
+           (call-with-output-file "test.o" (^_ #f))
+           (map-file->u8vector "test.o")))
+  (test* "map-file->u8vector (nonexistent)" (test-error)
+         (begin
+           (sys-unlink "test.o")
+           (map-file->u8vector "test.o")))
+  )
+
 ;;-------------------------------------------------------------------
 (test-section "string <-> uvector")
 
@@ -2285,6 +2413,86 @@
       #,(<s16array> (0 1 0 1) 204))
      )))
 
+;; <f32array> and <f64array> are handled by native routines.  We compare
+;; the results with the ones of generic arrays.  The elements are small
+;; integers, so the products are exact in flonums.
+(define (pseudo-random-matrix make n m seed)
+  (rlet1 a (make (shape 0 n 0 m))
+    (for-each (^[k x] (array-set! a (quotient k m) (modulo k m) x))
+              (iota (* n m))
+              (pseudo-random-list (* n m) seed -9 9))))
+
+(define (flonum-matrix-test n m p)
+  (let* ([a  (pseudo-random-matrix make-array n m 1)]
+         [b  (pseudo-random-matrix make-array m p 2)]
+         [ab (array-mul a b)]
+         [a64 (pseudo-random-matrix make-f64array n m 1)]
+         [b64 (pseudo-random-matrix make-f64array m p 2)]
+         [a32 (pseudo-random-matrix make-f32array n m 1)]
+         [b32 (pseudo-random-matrix make-f32array m p 2)])
+    (define (t name a b class)
+      (test* #"array-mul ~name ~|n|x~|m|x~p" `(,class #t)
+             (let1 c (array-mul a b)
+               (list (class-of c) (array-approx-equal? ab c)))))
+    (t "f64" a64 b64 <f64array>)
+    (t "f32" a32 b32 <f32array>)
+    (t "f32*f64" a32 b64 <f64array>)
+    ;; shared arrays: transposed and flipped views of the same data
+    (t "shared" (share-array (pseudo-random-matrix make-f64array m n 1)
+                             (shape 0 n 0 m)
+                             (^[i j] (values j i)))
+       (share-array (pseudo-random-matrix make-f64array m p 2)
+                    (shape 1 (+ m 1) 0 p)
+                    (^[i j] (values (- m i) j)))
+       <f64array>)))
+
+(flonum-matrix-test 1 1 1)
+(flonum-matrix-test 3 5 2)
+(flonum-matrix-test 37 300 9)
+(flonum-matrix-test 9 11 130)
+
+(define (flonum-matrix-inverse-test n)
+  (let* ([a (pseudo-random-matrix make-array n n 3)]
+         [det (determinant a)])
+    (define (t name a)
+      (test* #"determinant ~name ~n" #t
+             (< (abs (- (determinant a) det)) (* (abs det) 1e-10)))
+      (test* #"array-inverse ~name ~n" (identity-array n)
+             (array-mul a (array-inverse a))
+             array-approx-equal?))
+    (t "f64" (pseudo-random-matrix make-f64array n n 3))
+    (t "shared" (share-array (pseudo-random-matrix make-f64array n n 3)
+                             (shape 2 (+ n 2) 0 n)
+                             (^[i j] (values (- i 2) j))))))
+
+(flonum-matrix-inverse-test 1)
+(flonum-matrix-inverse-test 5)
+(flonum-matrix-inverse-test 40)
+
+(test* "array-inverse f64 singular" #f
+       (array-inverse #,(<f64array> (0 3 0 3) 1 2 3 2 4 6 1 1 1)))
+(test* "determinant f64 singular" 0.0
+       (determinant #,(<f64array> (0 3 0 3) 1 2 3 2 4 6 1 1 1)))
+(test* "determinant f32" -2.0
+       (determinant #,(<f32array> (0 2 0 2) 1 2 3 4))
+       approx-equal?)
+
+;; The native routines accumulate each element in the same order
+;; regardless of the number of threads, so the results should be
+;; exactly the same.  The matrices are large enough to be split.
+(let ([a (pseudo-random-matrix make-f64array 150 300 4)]
+      [b (pseudo-random-matrix make-f32array 300 1100 5)]
+      [c (share-array (pseudo-random-matrix make-f64array 150 150 6)
+                      (shape 0 150 0 150)
+                      (^[i j] (values j i)))])
+  (dolist [threads '(2 3 5)]
+    (test* #"array-mul :threads ~threads" (array-mul a b)
+           (array-mul a b :threads threads))
+    (test* #"array-inverse :threads ~threads" (array-inverse c)
+           (array-inverse c :threads threads))
+    (test* #"determinant :threads ~threads" (determinant c)
+           (determinant c :threads threads))))
+
 
 ;;-------------------------------------------------------------------
 ;; NB: copy-port uses read-block! and write-block for block copy,
@@ -169,6 +169,13 @@
    Scm_WriteBlock)
  )
 
+;; mapping a file
+(inline-stub
+ (define-cproc map-file->u8vector (path::<const-cstring>
+                                   :key (writable?::<boolean> #f))
+   (result (Scm_MapFileToU8Vector path writable?)))
+ )
+
 ;; copy
 (inline-stub
  (define-cproc uvector-copy! (dest::<uvector> dstart::<int> src::<uvector>
@@ -367,6 +374,29 @@
    (result (wordvector->string (SCM_UVECTOR v) start end)))
  )
 
+;; matrix kernels for f32 and f64 arrays.  These are used by matrix.scm;
+;; see uvmatrix.h for the arguments.
+(inline-stub
+ "#include \"uvmatrix.h\""
+
+ (define-cproc %uvector-matrix-mul (a::<uvector> aoff::<int> ars::<int> acs::<int>
+                                    b::<uvector> boff::<int> brs::<int> bcs::<int>
+                                    n::<int> m::<int> p::<int>
+                                    :optional (nthreads::<int> 1))
+   Scm__UVMatrixMul)
+
+ (define-cproc %uvector-matrix-determinant (a::<uvector> off::<int>
+                                            rs::<int> cs::<int> n::<int>
+                                            :optional (nthreads::<int> 1))
+   ::<double>
+   Scm__UVMatrixDeterminant)
+
+ (define-cproc %uvector-matrix-inverse (a::<uvector> off::<int>
+                                        rs::<int> cs::<int> n::<int>
+                                        :optional (nthreads::<int> 1))
+   Scm__UVMatrixInverse)
+ )
+
 ;; for the bakcward compatibility
 (define read-block! read-uvector!)
 (define write-block write-uvector)
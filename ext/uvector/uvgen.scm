@@ -302,26 +302,102 @@
 
 (define (dummy . _) "/* not implemented */")
 
+;;===============================================================
+;; SIMD kernels
+;;
+;;  uvsimd.c has kernels that process the leading elements for some
+;;  combinations of operations and types (see uvsimd.h).  The following
+;;  procedures return a C expression that calls the kernel and yields
+;;  the number of processed elements, or "0" if there's no kernel.
+;;
+
+(define *simd-types* '(f32 f64 s32 u8))
+
+(define (simd-kernel tag name)
+  #"Scm__UVSimd~(string-upcase (symbol->string tag))~name")
+
+(define (simd-elts tag v)
+  #"SCM_~(string-upcase (symbol->string tag))VECTOR_ELEMENTS(~v)")
+
+(define (simd-numop tag opname)
+  (^[d s0 s1 size clamp]
+    (let1 op #"UVSIMD_~(string-upcase opname)"
+      (case tag
+        [(f32 f64)
+         #"~(simd-kernel tag \"Op\")(~|op|, ~(simd-elts tag d), ~(simd-elts tag s0), ~(simd-elts tag s1), ~size)"]
+        [(s32 u8)
+         #"~(simd-kernel tag \"Op\")(~|op|, ~(simd-elts tag d), ~(simd-elts tag s0), ~(simd-elts tag s1), ~|size|, ~clamp)"]
+        [else "0"]))))
+
+(define (simd-numopc tag opname)
+  (^[d s0 v1 oor size clamp]
+    (let1 op #"UVSIMD_~(string-upcase opname)"
+      (case tag
+        [(f32 f64)
+         #"(~oor ? 0 : ~(simd-kernel tag \"OpC\")(~|op|, ~(simd-elts tag d), ~(simd-elts tag s0), ~|v1|, ~size))"]
+        [(s32 u8)
+         #"(~oor ? 0 : ~(simd-kernel tag \"OpC\")(~|op|, ~(simd-elts tag d), ~(simd-elts tag s0), ~|v1|, ~|size|, ~clamp))"]
+        [else "0"]))))
+
+(define (simd-dot tag)
+  (^[x y size r rr]
+    (case tag
+      [(f32 f64)
+       #"~(simd-kernel tag \"Dot\")(~(simd-elts tag x), ~(simd-elts tag y), ~|size|, &~r)"]
+      [(s32 u8)
+       #"~(simd-kernel tag \"Dot\")(~(simd-elts tag x), ~(simd-elts tag y), ~|size|, &~rr)"]
+      [else "0"])))
+
+(define (simd-sum tag)
+  (^[x size r rr]
+    (case tag
+      [(f32 f64)
+       #"~(simd-kernel tag \"Sum\")(~(simd-elts tag x), ~|size|, &~r)"]
+      [(s32 u8)
+       #"~(simd-kernel tag \"Sum\")(~(simd-elts tag x), ~|size|, &~rr)"]
+      [else "0"])))
+
+(define (simd-minmax tag max)
+  (^[x size r]
+    (if (memq tag *simd-types*)
+      #"~(simd-kernel tag \"MinMax\")(~|max|, ~(simd-elts tag x), ~|size|, &~r)"
+      "0")))
+
+(define (simd-range tag target checkonly)
+  (^[minval mindc maxval maxdc size]
+    (if (memq tag *simd-types*)
+      #"~(simd-kernel tag \"Clamp\")(~(simd-elts tag target), ~|size|, ~|minval|, ~|mindc|, ~|maxval|, ~|maxdc|, ~checkonly)"
+      "0")))
+
 ;;===============================================================
 ;; Uvector opertaion generator
 ;;
 
 (define (generate-numop)
+  (define (rule-tag rule) (string->symbol (getval rule 't)))
   (for-each (^[opname Opname Sopname]
               (dolist [rule (make-rules)]
-                (for-each (cute substitute <> `((opname  ,opname)
-                                                (Opname  ,Opname)
-                                                (Sopname ,Sopname)
-                                                ,@rule))
+                (for-each (cute substitute <>
+                                `((opname  ,opname)
+                                  (Opname  ,Opname)
+                                  (Sopname ,Sopname)
+                                  (SIMD_NUMOP ,(simd-numop (rule-tag rule)
+                                                           opname))
+                                  (SIMD_NUMOPC ,(simd-numopc (rule-tag rule)
+                                                             opname))
+                                  ,@rule))
                           *tmpl-numop*)))
             '("add" "sub" "mul")
             '("Add" "Sub" "Mul")
             '("Add" "Sub" "Mul"))
   (dolist [rule (make-flonum-rules)]
-    (for-each (cute substitute <> `((opname  "div")
-                                    (Opname  "Div")
-                                    (Sopname  "Div")
-                                    ,@rule))
+    (for-each (cute substitute <>
+                    `((opname  "div")
+                      (Opname  "Div")
+                      (Sopname  "Div")
+                      (SIMD_NUMOP ,(simd-numop (rule-tag rule) "div"))
+                      (SIMD_NUMOPC ,(simd-numopc (rule-tag rule) "div"))
+                      ,@rule))
               *tmpl-numop*)))
 
 (define (generate-bitop)
@@ -356,9 +432,48 @@
         (case tag
           [(s64 u64) #"SCM_SET_INT64_ZERO(~r)"]
           [else #"~r = 0"]))
-      (for-each (cute substitute <> `((ZERO  ,ZERO) ,@rule))
+      (for-each (cute substitute <> `((ZERO  ,ZERO)
+                                      (SIMD_DOT ,(simd-dot tag))
+                                      ,@rule))
                 *tmpl-dotop*))))
 
+(define (generate-sumop)
+  (dolist [rule (make-rules)]
+    (let1 tag (string->symbol (getval rule 't))
+      (define (ZERO r)
+        (case tag
+          [(s64 u64) #"SCM_SET_INT64_ZERO(~r)"]
+          [else #"~r = 0"]))
+      (for-each (cute substitute <> `((ZERO  ,ZERO)
+                                      (SIMD_SUM ,(simd-sum tag))
+                                      ,@rule))
+                *tmpl-sumop*))))
+
+(define (generate-minmaxop)
+  (dolist [rule (make-rules)]
+    (let1 tag (string->symbol (getval rule 't))
+      (define (LT a b)
+        (case tag
+          [(s64 u64) #"INT64LT(~|a|, ~|b|)"]
+          [else      #"(~a < ~b)"]))
+      (define (NANP v)
+        (case tag
+          [(f16 f32 f64) #"(~v != ~v)"]
+          [else "FALSE"]))
+      (for-each (^[opname Opname max?]
+                  (for-each (cute substitute <>
+                                  `((opname ,opname)
+                                    (Opname ,Opname)
+                                    (BETTER ,(if max? (^[a b] (LT b a)) LT))
+                                    (NANP   ,NANP)
+                                    (SIMD_MINMAX
+                                     ,(simd-minmax tag (if max? "TRUE" "FALSE")))
+                                    ,@rule))
+                            *tmpl-minmaxop*))
+                '("min" "max")
+                '("Min" "Max")
+                '(#f #t)))))
+
 (define (generate-rangeop)
   (dolist [rule (make-rules)]
     (let ([tag (string->symbol (getval rule 't))]
@@ -391,15 +506,18 @@
       (dolist [ops `(("range-check" "RangeCheck"
                       ""
                       "return Scm_MakeInteger(i)"
-                      "SCM_FALSE")
+                      "SCM_FALSE"
+                      ,(simd-range tag "x" "TRUE"))
                      ("clamp" "Clamp"
                       "ScmObj d = Scm_UVectorCopy(SCM_UVECTOR(x), 0, -1)"
                       ,#"SCM_~|TAG|VECTOR_ELEMENTS(d)[i] = ~(cast \"val\")"
-                      "d")
+                      "d"
+                      ,(simd-range tag "d" "FALSE"))
                      ("clamp!" "ClampX"
                       ""
                       ,#"SCM_~|TAG|VECTOR_ELEMENTS(x)[i] = ~(cast \"val\")"
-                      "SCM_OBJ(x)")
+                      "SCM_OBJ(x)"
+                      ,(simd-range tag "x" "FALSE"))
                      )]
         (for-each (cute substitute <> `((GETLIM  ,GETLIM)
                                         (ZERO  ,ZERO)
@@ -409,6 +527,7 @@
                                         (dstdecl  ,(ref ops 2))
                                         (action   ,(ref ops 3))
                                         (okval    ,(ref ops 4))
+                                        (SIMD_RANGE ,(ref ops 5))
                                         ,@rule))
                   *tmpl-rangeop*)))))
 
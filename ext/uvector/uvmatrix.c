@@ -0,0 +1,553 @@
+/*
+ * uvmatrix.c - matrix kernels for f32 and f64 arrays
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The matrix operations in matrix.scm work on any kind of arrays through
+ * array-ref and array-set!, with generic arithmetic.  For flonum arrays
+ * we can do much better.  Multiplication is done in the usual way of
+ * blocked GEMM: the operands are split into blocks that fit in the
+ * cache, each block is packed into a contiguous buffer, and a small
+ * kernel accumulates an MRxNR tile of the result in registers.  LU
+ * decomposition (used for determinant and inverse) is the right-looking
+ * blocked algorithm with partial pivoting, whose bulk of work is done
+ * by the same multiplication routine.
+ *
+ * The routines can use more than one thread, as given by the :threads
+ * argument of array-mul and friends.  For each KC-wide panel, the
+ * blocks of A and B are packed, then the MCxNC tiles of the result are
+ * computed, each phase split across the threads.  The tiles don't
+ * overlap, and each element of the result is accumulated in the same
+ * order regardless of the number of threads, so the results don't
+ * depend on it.  LU decomposition gets parallelism from its trailing
+ * update and triangular solves, which are done by gemm.
+ */
+
+#include <math.h>
+#include <gauche.h>
+#include "uvmatrix.h"
+
+/* Block sizes.  A packed MCxKC block of A is meant to stay in L2
+   cache, and a KCxNR sliver of packed B in L1 cache while the kernel
+   sweeps the block of A.  LU_NB is the panel width of LU decomposition. */
+#define MR     4
+#define NR     4
+#define MC     128
+#define KC     256
+#define NC     1024
+#define LU_NB  32
+
+/* We don't spawn threads for gemm smaller than this (n*m*p), where
+   the thread creation would cost more than we gain. */
+#define PAR_MIN_WORK   (1L<<18)
+#define MAX_THREADS    64
+
+#define MIN(a, b)  ((a) < (b) ? (a) : (b))
+#define ROUNDUP(n, m)  (((n)+(m)-1)/(m)*(m))
+
+/*-----------------------------------------------------------
+ * Matrix views
+ */
+
+/* The element (i, j) is at elts[off + i*rs + j*cs]. */
+typedef struct mviewRec {
+    const void *elts;
+    int f32p;                   /* TRUE if elts is float*, FALSE if double* */
+    long off, rs, cs;
+} mview;
+
+static void uvector_view(mview *v, ScmUVector *u, int off, int rs, int cs,
+                         int nr, int nc)
+{
+    if (SCM_F64VECTORP(u)) {
+        v->elts = SCM_F64VECTOR_ELEMENTS(u);
+        v->f32p = FALSE;
+    } else if (SCM_F32VECTORP(u)) {
+        v->elts = SCM_F32VECTOR_ELEMENTS(u);
+        v->f32p = TRUE;
+    } else {
+        Scm_Error("f32vector or f64vector required, but got: %S", SCM_OBJ(u));
+    }
+    if (nr < 0 || nc < 0) {
+        Scm_Error("invalid matrix dimensions: %dx%d", nr, nc);
+    }
+    if (nr > 0 && nc > 0) {
+        long lo = off, hi = off;
+        long dr = (long)(nr-1)*rs, dc = (long)(nc-1)*cs;
+        if (dr < 0) lo += dr; else hi += dr;
+        if (dc < 0) lo += dc; else hi += dc;
+        if (lo < 0 || hi >= SCM_UVECTOR_SIZE(u)) {
+            Scm_Error("%dx%d matrix mapping (offset %d, strides %d and %d) "
+                      "is out of range of the storage: %S",
+                      nr, nc, off, rs, cs, SCM_OBJ(u));
+        }
+    }
+    v->off = off;
+    v->rs = rs;
+    v->cs = cs;
+}
+
+/* A view of the (i, j) corner of a row-major double matrix */
+static void double_view(mview *v, const double *m, long ld, long i, long j)
+{
+    v->elts = m;
+    v->f32p = FALSE;
+    v->off = i*ld + j;
+    v->rs = ld;
+    v->cs = 1;
+}
+
+static inline double mref(const mview *v, long i, long j)
+{
+    long k = v->off + i*v->rs + j*v->cs;
+    if (v->f32p) return ((const float*)v->elts)[k];
+    else         return ((const double*)v->elts)[k];
+}
+
+/*-----------------------------------------------------------
+ * Parallel work
+ */
+
+/* Same as Scm__ZlibParallelFor in rfc.zlib: calls PROC(DATA, i) for
+   i = 0, ..., N-1, on up to NTHREADS threads including the calling one.
+   PROC must not touch Scheme objects or allocate from the heap. */
+
+typedef struct parworkRec {
+    void (*proc)(void*, int);
+    void *data;
+    int n;
+    int next;
+    ScmInternalMutex mutex;
+} parwork;
+
+#if defined(GAUCHE_USE_PTHREADS)
+static void *parwork_run(void *arg)
+{
+    parwork *w = (parwork*)arg;
+    for (;;) {
+        (void)SCM_INTERNAL_MUTEX_LOCK(w->mutex);
+        int i = w->next++;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(w->mutex);
+        if (i >= w->n) break;
+        w->proc(w->data, i);
+    }
+    return NULL;
+}
+#endif /*GAUCHE_USE_PTHREADS*/
+
+static void parallel_for(int n, int nthreads,
+                         void (*proc)(void*, int), void *data)
+{
+#if defined(GAUCHE_USE_PTHREADS)
+    if (nthreads > n) nthreads = n;
+    if (nthreads > MAX_THREADS) nthreads = MAX_THREADS;
+    if (nthreads > 1) {
+        parwork w;
+        pthread_t threads[MAX_THREADS];
+        sigset_t all, omask;
+        int nspawned = 0;
+
+        w.proc = proc;
+        w.data = data;
+        w.n = n;
+        w.next = 0;
+        SCM_INTERNAL_MUTEX_INIT(w.mutex);
+        /* Signals should be handled by the calling thread. */
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &omask);
+        for (int i = 0; i < nthreads - 1; i++) {
+            if (pthread_create(&threads[nspawned], NULL, parwork_run, &w) == 0) {
+                nspawned++;
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &omask, NULL);
+        parwork_run(&w);
+        for (int i = 0; i < nspawned; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        SCM_INTERNAL_MUTEX_DESTROY(w.mutex);
+        return;
+    }
+#endif /*GAUCHE_USE_PTHREADS*/
+    for (int i = 0; i < n; i++) proc(data, i);
+}
+
+/*-----------------------------------------------------------
+ * Multiplication
+ */
+
+typedef struct gemm_workRec {
+    double *ap;                 /* packed KC-wide panel of A */
+    double *bp;                 /* packed KC-wide panel of B */
+    int nthreads;
+} gemm_work;
+
+/* Allocates buffers enough for gemm of up to NxM and MxP matrices. */
+static void gemm_work_init(gemm_work *w, int n, int m, int p, int nthreads)
+{
+    long kc = MIN(KC, m);
+    w->ap = SCM_NEW_ATOMIC_ARRAY(double, ROUNDUP(n, MR)*kc + 1);
+    w->bp = SCM_NEW_ATOMIC_ARRAY(double, ROUNDUP(p, NR)*kc + 1);
+    w->nthreads = (nthreads < 1)? 1 : nthreads;
+}
+
+/* Packs MCxKC block of A at (i0, k0), multiplied by alpha, into MR-row
+   slivers: ap[s*MR*kc + k*MR + r] = alpha * A[i0+s*MR+r, k0+k].
+   Rows beyond mc are padded with zeros. */
+static void pack_a(const mview *a, long i0, long k0, int mc, int kc,
+                   double alpha, double *ap)
+{
+    for (int s = 0; s < mc; s += MR) {
+        int mr = MIN(MR, mc-s);
+        for (int k = 0; k < kc; k++) {
+            int r = 0;
+            for (; r < mr; r++) *ap++ = alpha * mref(a, i0+s+r, k0+k);
+            for (; r < MR; r++) *ap++ = 0.0;
+        }
+    }
+}
+
+/* Packs KCxNC block of B at (k0, j0) into NR-column slivers:
+   bp[s*NR*kc + k*NR + c] = B[k0+k, j0+s*NR+c]. */
+static void pack_b(const mview *b, long k0, long j0, int kc, int nc,
+                   double *bp)
+{
+    for (int s = 0; s < nc; s += NR) {
+        int nr = MIN(NR, nc-s);
+        for (int k = 0; k < kc; k++) {
+            int c = 0;
+            for (; c < nr; c++) *bp++ = mref(b, k0+k, j0+s+c);
+            for (; c < NR; c++) *bp++ = 0.0;
+        }
+    }
+}
+
+/* C[0:mr, 0:nr] += A-sliver * B-sliver */
+static void gemm_kernel(int kc, const double *a, const double *b,
+                        double *c, long ldc, int mr, int nr)
+{
+    double t[MR][NR];
+
+    for (int i = 0; i < MR; i++)
+        for (int j = 0; j < NR; j++)
+            t[i][j] = 0.0;
+    for (int k = 0; k < kc; k++, a += MR, b += NR) {
+        for (int i = 0; i < MR; i++)
+            for (int j = 0; j < NR; j++)
+                t[i][j] += a[i] * b[j];
+    }
+    for (int i = 0; i < mr; i++)
+        for (int j = 0; j < nr; j++)
+            c[i*ldc + j] += t[i][j];
+}
+
+/* A KC-wide panel of gemm.  The blocks of A and B are packed at
+   ap + ic*kc and bp + jc*kc, respectively. */
+typedef struct gemm_panelRec {
+    int n, p, pc, kc;
+    int nbi, nbj;               /* # of MC-row and NC-column blocks */
+    double alpha;
+    const mview *a, *b;
+    double *c;
+    long ldc;
+    gemm_work *w;
+} gemm_panel;
+
+/* Packs i-th block of A if i < nbi, or (i-nbi)-th block of B. */
+static void gemm_pack_job(void *data, int i)
+{
+    gemm_panel *g = (gemm_panel*)data;
+    if (i < g->nbi) {
+        int ic = i*MC;
+        pack_a(g->a, ic, g->pc, MIN(MC, g->n-ic), g->kc, g->alpha,
+               g->w->ap + (long)ic*g->kc);
+    } else {
+        int jc = (i-g->nbi)*NC;
+        pack_b(g->b, g->pc, jc, g->kc, MIN(NC, g->p-jc),
+               g->w->bp + (long)jc*g->kc);
+    }
+}
+
+/* Accumulates i-th MCxNC tile of C.  Tiles are ordered in column-major,
+   so that a serial run sweeps the blocks of A on the same block of B. */
+static void gemm_tile_job(void *data, int i)
+{
+    gemm_panel *g = (gemm_panel*)data;
+    int ic = (i % g->nbi)*MC, jc = (i / g->nbi)*NC;
+    int mc = MIN(MC, g->n-ic), nc = MIN(NC, g->p-jc), kc = g->kc;
+    const double *ap = g->w->ap + (long)ic*kc;
+    const double *bp = g->w->bp + (long)jc*kc;
+
+    for (int jr = 0; jr < nc; jr += NR) {
+        for (int ir = 0; ir < mc; ir += MR) {
+            gemm_kernel(kc, ap + (long)ir*kc, bp + (long)jr*kc,
+                        g->c + (ic+ir)*g->ldc + jc+jr, g->ldc,
+                        MIN(MR, mc-ir), MIN(NR, nc-jr));
+        }
+    }
+}
+
+/* C += alpha * A * B, where A is NxM, B is MxP, and C is NxP row-major
+   matrix with the leading dimension LDC. */
+static void gemm(int n, int m, int p, double alpha,
+                 const mview *a, const mview *b, double *c, long ldc,
+                 gemm_work *w)
+{
+    gemm_panel g;
+    int nthreads = ((double)n*m*p >= PAR_MIN_WORK)? w->nthreads : 1;
+
+    if (n == 0 || p == 0) return;
+    g.n = n;
+    g.p = p;
+    g.nbi = (n+MC-1)/MC;
+    g.nbj = (p+NC-1)/NC;
+    g.alpha = alpha;
+    g.a = a;
+    g.b = b;
+    g.c = c;
+    g.ldc = ldc;
+    g.w = w;
+    for (int pc = 0; pc < m; pc += KC) {
+        g.pc = pc;
+        g.kc = MIN(KC, m-pc);
+        parallel_for(g.nbi + g.nbj, nthreads, gemm_pack_job, &g);
+        parallel_for(g.nbi * g.nbj, nthreads, gemm_tile_job, &g);
+    }
+}
+
+/* Returns a fresh f32vector (if F32P) or f64vector of size N, and its
+   elements as a double array in *BUF.  For an f32vector, *BUF is a
+   temporary buffer; call store_result to copy it to the vector. */
+static ScmObj make_result(int f32p, long n, double **buf)
+{
+    if (f32p) {
+        *buf = SCM_NEW_ATOMIC_ARRAY(double, n+1);
+        for (long i = 0; i < n; i++) (*buf)[i] = 0.0;
+        return Scm_MakeF32Vector(n, 0.0);
+    } else {
+        ScmObj v = Scm_MakeF64Vector(n, 0.0);
+        *buf = SCM_F64VECTOR_ELEMENTS(v);
+        return v;
+    }
+}
+
+static void store_result(ScmObj v, const double *buf)
+{
+    if (SCM_F32VECTORP(v)) {
+        float *d = SCM_F32VECTOR_ELEMENTS(v);
+        long n = SCM_F32VECTOR_SIZE(v);
+        for (long i = 0; i < n; i++) d[i] = (float)buf[i];
+    }
+}
+
+ScmObj Scm__UVMatrixMul(ScmUVector *a, int aoff, int ars, int acs,
+                        ScmUVector *b, int boff, int brs, int bcs,
+                        int n, int m, int p, int nthreads)
+{
+    mview av, bv;
+    gemm_work w;
+    double *c;
+
+    uvector_view(&av, a, aoff, ars, acs, n, m);
+    uvector_view(&bv, b, boff, brs, bcs, m, p);
+    ScmObj r = make_result(av.f32p && bv.f32p, (long)n*p, &c);
+    gemm_work_init(&w, n, m, p, nthreads);
+    gemm(n, m, p, 1.0, &av, &bv, c, p, &w);
+    store_result(r, c);
+    return r;
+}
+
+/*-----------------------------------------------------------
+ * LU decomposition
+ */
+
+/* Solves L X = B in place, where L is NxN unit lower triangular matrix
+   and B is NxNRHS, both row-major. */
+static void trsm_lower(int n, const double *l, long ldl,
+                       double *b, long ldb, int nrhs, gemm_work *w)
+{
+    for (int k = 0; k < n; k += LU_NB) {
+        int kb = MIN(LU_NB, n-k);
+        for (int i = k+1; i < k+kb; i++) {
+            double *bi = b + i*ldb;
+            for (int t = k; t < i; t++) {
+                double f = l[i*ldl + t];
+                const double *bt = b + t*ldb;
+                if (f == 0.0) continue;
+                for (int j = 0; j < nrhs; j++) bi[j] -= f * bt[j];
+            }
+        }
+        if (k+kb < n) {
+            mview lv, bv;
+            double_view(&lv, l, ldl, k+kb, k);
+            double_view(&bv, b, ldb, k, 0);
+            gemm(n-k-kb, kb, nrhs, -1.0, &lv, &bv, b + (k+kb)*ldb, ldb, w);
+        }
+    }
+}
+
+/* Solves U X = B in place, where U is NxN nonsingular upper triangular
+   matrix and B is NxNRHS, both row-major. */
+static void trsm_upper(int n, const double *u, long ldu,
+                       double *b, long ldb, int nrhs, gemm_work *w)
+{
+    for (int k = n; k > 0; k -= LU_NB) {
+        int k0 = (k > LU_NB)? k-LU_NB : 0;
+        for (int i = k-1; i >= k0; i--) {
+            double *bi = b + i*ldb;
+            for (int t = i+1; t < k; t++) {
+                double f = u[i*ldu + t];
+                const double *bt = b + t*ldb;
+                if (f == 0.0) continue;
+                for (int j = 0; j < nrhs; j++) bi[j] -= f * bt[j];
+            }
+            double d = u[i*ldu + i];
+            for (int j = 0; j < nrhs; j++) bi[j] /= d;
+        }
+        if (k0 > 0) {
+            mview uv, bv;
+            double_view(&uv, u, ldu, 0, k0);
+            double_view(&bv, b, ldb, k0, 0);
+            gemm(k0, k-k0, nrhs, -1.0, &uv, &bv, b, ldb, w);
+        }
+    }
+}
+
+static void swap_rows(double *a, long lda, int i, int j, int ncols)
+{
+    double *ai = a + i*lda, *aj = a + j*lda;
+    for (int k = 0; k < ncols; k++) {
+        double t = ai[k]; ai[k] = aj[k]; aj[k] = t;
+    }
+}
+
+/* Decomposes NxN row-major matrix A in place into PA = LU, where
+   the unit lower triangular L is stored below the diagonal and U on
+   and above.  The row i was swapped with piv[i] at the i-th step.
+   Returns 1 or -1, the sign of the permutation, or 0 if A is singular,
+   in which case the decomposition is abandoned. */
+static int lu_decompose(int n, double *a, int *piv, gemm_work *w)
+{
+    int sign = 1;
+
+    for (int k = 0; k < n; k += LU_NB) {
+        int kb = MIN(LU_NB, n-k);
+        /* Factorize the panel A[k:n, k:k+kb] */
+        for (int j = k; j < k+kb; j++) {
+            int p = j;
+            double pmax = fabs(a[j*n + j]);
+            for (int i = j+1; i < n; i++) {
+                double x = fabs(a[i*n + j]);
+                if (x > pmax) { p = i; pmax = x; }
+            }
+            if (pmax == 0.0) return 0;
+            piv[j] = p;
+            if (p != j) {
+                swap_rows(a, n, j, p, n);
+                sign = -sign;
+            }
+            double d = a[j*n + j];
+            const double *aj = a + j*n;
+            for (int i = j+1; i < n; i++) {
+                double *ai = a + i*n;
+                double f = (ai[j] /= d);
+                if (f == 0.0) continue;
+                for (int t = j+1; t < k+kb; t++) ai[t] -= f * aj[t];
+            }
+        }
+        if (k+kb < n) {
+            /* U12 = L11^-1 A12 */
+            trsm_lower(kb, a + k*n + k, n, a + k*n + k+kb, n, n-k-kb, w);
+            /* A22 -= L21 U12 */
+            mview lv, uv;
+            double_view(&lv, a, n, k+kb, k);
+            double_view(&uv, a, n, k, k+kb);
+            gemm(n-k-kb, kb, n-k-kb, -1.0, &lv, &uv,
+                 a + (k+kb)*n + k+kb, n, w);
+        }
+    }
+    return sign;
+}
+
+/* Copies the matrix A into a fresh row-major double array */
+static double *copy_matrix(const mview *a, int n)
+{
+    double *m = SCM_NEW_ATOMIC_ARRAY(double, (long)n*n+1);
+    for (int i = 0; i < n; i++)
+        for (int j = 0; j < n; j++)
+            m[(long)i*n + j] = mref(a, i, j);
+    return m;
+}
+
+double Scm__UVMatrixDeterminant(ScmUVector *a, int off, int rs, int cs, int n,
+                                int nthreads)
+{
+    mview av;
+    gemm_work w;
+
+    uvector_view(&av, a, off, rs, cs, n, n);
+    double *m = copy_matrix(&av, n);
+    int *piv = SCM_NEW_ATOMIC_ARRAY(int, n+1);
+    gemm_work_init(&w, n, n, n, nthreads);
+
+    int sign = lu_decompose(n, m, piv, &w);
+    if (sign == 0) return 0.0;
+    double det = sign;
+    for (int i = 0; i < n; i++) det *= m[(long)i*n + i];
+    return det;
+}
+
+ScmObj Scm__UVMatrixInverse(ScmUVector *a, int off, int rs, int cs, int n,
+                            int nthreads)
+{
+    mview av;
+    gemm_work w;
+    double *x;
+
+    uvector_view(&av, a, off, rs, cs, n, n);
+    double *m = copy_matrix(&av, n);
+    int *piv = SCM_NEW_ATOMIC_ARRAY(int, n+1);
+    gemm_work_init(&w, n, n, n, nthreads);
+
+    if (lu_decompose(n, m, piv, &w) == 0) return SCM_FALSE;
+
+    /* Solve LU X = P I */
+    ScmObj r = make_result(av.f32p, (long)n*n, &x);
+    for (int i = 0; i < n; i++) x[(long)i*n + i] = 1.0;
+    for (int i = 0; i < n; i++) {
+        if (piv[i] != i) swap_rows(x, n, i, piv[i], n);
+    }
+    trsm_lower(n, m, n, x, n, n, &w);
+    trsm_upper(n, m, n, x, n, n, &w);
+    store_result(r, x);
+    return r;
+}
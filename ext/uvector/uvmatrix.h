@@ -0,0 +1,66 @@
+/*
+ * uvmatrix.h - matrix kernels for f32 and f64 arrays
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_UVMATRIX_H
+#define GAUCHE_UVMATRIX_H
+
+/*
+ * These routines back array-mul, array-inverse and determinant of
+ * gauche.array (matrix.scm) when the arrays are <f32array> or <f64array>.
+ * A matrix is given as its backing storage V, which must be an f32vector
+ * or an f64vector, and the affine mapping from indices to the storage:
+ * the element (i, j) (0-based) is at V[off + i*rs + j*cs].  The mapping
+ * is checked against the size of V.
+ *
+ * Calculation is always done in double precision.  The results are
+ * fresh uvectors of the same type as the input (f64vector if the inputs
+ * are mixed), holding the result matrix in row-major order.
+ *
+ * NTHREADS is the number of threads to use, including the calling one.
+ * The results don't depend on it.
+ */
+
+/* Returns NxP product of NxM matrix A and MxP matrix B. */
+extern ScmObj Scm__UVMatrixMul(ScmUVector *a, int aoff, int ars, int acs,
+                               ScmUVector *b, int boff, int brs, int bcs,
+                               int n, int m, int p, int nthreads);
+
+/* Returns the determinant of NxN matrix A.  A is not modified. */
+extern double Scm__UVMatrixDeterminant(ScmUVector *a, int off, int rs, int cs,
+                                       int n, int nthreads);
+
+/* Returns the inverse of NxN matrix A, or #f if A is singular. */
+extern ScmObj Scm__UVMatrixInverse(ScmUVector *a, int off, int rs, int cs,
+                                   int n, int nthreads);
+
+#endif /*GAUCHE_UVMATRIX_H*/
@@ -0,0 +1,404 @@
+/*
+ * uvsimd.c - SIMD kernels for uniform vector arithmetic
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The element-wise operations in uvector.c are generated from a template
+ * that handles every combination of types and clamping modes with scalar
+ * loops.  For the common cases---f32, f64, s32 and u8 vectors operated
+ * with a vector of the same type or a constant---we process as many
+ * elements as possible here with SIMD instructions, and let the scalar
+ * loop handle the rest.  See uvsimd.h for the protocol.
+ *
+ * We have SSE2 and AVX2 versions on x86_64, chosen at runtime by
+ * Scm__CPUFeatures (see gauche/priv/simdP.h).  The kernel bodies are
+ * written once in uvsimd_body.c with abstract vector operations, and
+ * included for each instruction set.  On other platforms, the kernels
+ * do nothing.
+ */
+
+#include <math.h>
+#include <float.h>
+#include <gauche.h>
+#include <gauche/priv/simdP.h>
+#include "uvsimd.h"
+
+#if defined(SCM_X86_SSE2)
+#define UVSIMD_SSE2 1
+#if defined(SCM_X86_TARGET)
+#define UVSIMD_AVX2 1
+#endif
+#endif
+
+/* Returns TRUE iff Y can be represented as a float exactly. */
+static inline int float_exact_p(double y)
+{
+    return (fabs(y) <= FLT_MAX && (double)(float)y == y);
+}
+
+#if defined(UVSIMD_SSE2)
+
+#define KFN(name)  name##_sse2
+#define KATTR
+#define W8   16
+#define W32  4
+#define W64  2
+
+#define VF   __m128
+#define F_LOAD(p)         _mm_loadu_ps(p)
+#define F_STORE(p, v)     _mm_storeu_ps(p, v)
+#define F_SET1(x)         _mm_set1_ps(x)
+#define F_ADD(a, b)       _mm_add_ps(a, b)
+#define F_SUB(a, b)       _mm_sub_ps(a, b)
+#define F_MUL(a, b)       _mm_mul_ps(a, b)
+#define F_DIV(a, b)       _mm_div_ps(a, b)
+#define F_MIN(a, b)       _mm_min_ps(a, b)
+#define F_MAX(a, b)       _mm_max_ps(a, b)
+#define F_CMPLT(a, b)     _mm_cmplt_ps(a, b)
+#define F_CMPGT(a, b)     _mm_cmpgt_ps(a, b)
+#define F_CMPUNORD(a, b)  _mm_cmpunord_ps(a, b)
+#define F_OR(a, b)        _mm_or_ps(a, b)
+#define F_MOVEMASK(v)     _mm_movemask_ps(v)
+#define F_TO_D_LO(v)      _mm_cvtps_pd(v)
+#define F_TO_D_HI(v)      _mm_cvtps_pd(_mm_movehl_ps(v, v))
+#define D_TO_F(lo, hi)    _mm_movelh_ps(_mm_cvtpd_ps(lo), _mm_cvtpd_ps(hi))
+
+#define VD   __m128d
+#define D_LOAD(p)         _mm_loadu_pd(p)
+#define D_STORE(p, v)     _mm_storeu_pd(p, v)
+#define D_SET1(x)         _mm_set1_pd(x)
+#define D_ZERO()          _mm_setzero_pd()
+#define D_ADD(a, b)       _mm_add_pd(a, b)
+#define D_SUB(a, b)       _mm_sub_pd(a, b)
+#define D_MUL(a, b)       _mm_mul_pd(a, b)
+#define D_DIV(a, b)       _mm_div_pd(a, b)
+#define D_MIN(a, b)       _mm_min_pd(a, b)
+#define D_MAX(a, b)       _mm_max_pd(a, b)
+#define D_CMPLT(a, b)     _mm_cmplt_pd(a, b)
+#define D_CMPGT(a, b)     _mm_cmpgt_pd(a, b)
+#define D_CMPUNORD(a, b)  _mm_cmpunord_pd(a, b)
+#define D_OR(a, b)        _mm_or_pd(a, b)
+#define D_MOVEMASK(v)     _mm_movemask_pd(v)
+
+#define VI   __m128i
+#define I_LOAD(p)         _mm_loadu_si128((const __m128i*)(p))
+#define I_STORE(p, v)     _mm_storeu_si128((__m128i*)(p), v)
+#define I_ZERO()          _mm_setzero_si128()
+#define I_SET1_8(x)       _mm_set1_epi8((char)(x))
+#define I_SET1_16(x)      _mm_set1_epi16(x)
+#define I_SET1_32(x)      _mm_set1_epi32(x)
+#define I_SET1_64(x)      _mm_set1_epi64x(x)
+#define I_AND(a, b)       _mm_and_si128(a, b)
+#define I_OR(a, b)        _mm_or_si128(a, b)
+#define I_XOR(a, b)       _mm_xor_si128(a, b)
+#define I_ANDNOT(a, b)    _mm_andnot_si128(a, b)
+#define I_ADD8(a, b)      _mm_add_epi8(a, b)
+#define I_ADD32(a, b)     _mm_add_epi32(a, b)
+#define I_SUB32(a, b)     _mm_sub_epi32(a, b)
+#define I_ADD64(a, b)     _mm_add_epi64(a, b)
+#define I_SUB64(a, b)     _mm_sub_epi64(a, b)
+#define I_ADDS_U8(a, b)   _mm_adds_epu8(a, b)
+#define I_SUBS_U8(a, b)   _mm_subs_epu8(a, b)
+#define I_MAX_U8(a, b)    _mm_max_epu8(a, b)
+#define I_MIN_U8(a, b)    _mm_min_epu8(a, b)
+#define I_CMPEQ8(a, b)    _mm_cmpeq_epi8(a, b)
+#define I_CMPEQ16(a, b)   _mm_cmpeq_epi16(a, b)
+#define I_CMPEQ32(a, b)   _mm_cmpeq_epi32(a, b)
+#define I_CMPGT32(a, b)   _mm_cmpgt_epi32(a, b)
+#define I_SRAI32(v, n)    _mm_srai_epi32(v, n)
+#define I_SRLI16(v, n)    _mm_srli_epi16(v, n)
+#define I_SRLI64(v, n)    _mm_srli_epi64(v, n)
+#define I_SLLI64(v, n)    _mm_slli_epi64(v, n)
+#define I_UNPACKLO8(a, b) _mm_unpacklo_epi8(a, b)
+#define I_UNPACKHI8(a, b) _mm_unpackhi_epi8(a, b)
+#define I_UNPACKLO32(a, b) _mm_unpacklo_epi32(a, b)
+#define I_UNPACKHI32(a, b) _mm_unpackhi_epi32(a, b)
+#define I_MULLO16(a, b)   _mm_mullo_epi16(a, b)
+#define I_MADD16(a, b)    _mm_madd_epi16(a, b)
+#define I_SAD_U8(a, b)    _mm_sad_epu8(a, b)
+#define I_PACKUS16(a, b)  _mm_packus_epi16(a, b)
+#define I_MOVEMASK8(v)    _mm_movemask_epi8(v)
+#define I_MASK_ALL        0xffff
+/* SSE2 doesn't have signed 32x32->64 multiply; s32 mul and dot aren't
+   vectorized. */
+
+#include "uvsimd_body.c"
+
+#endif /*UVSIMD_SSE2*/
+
+#if defined(UVSIMD_AVX2)
+
+#define KFN(name)  name##_avx2
+#define KATTR      SCM_X86_TARGET("avx2")
+#define W8   32
+#define W32  8
+#define W64  4
+
+#define VF   __m256
+#define F_LOAD(p)         _mm256_loadu_ps(p)
+#define F_STORE(p, v)     _mm256_storeu_ps(p, v)
+#define F_SET1(x)         _mm256_set1_ps(x)
+#define F_ADD(a, b)       _mm256_add_ps(a, b)
+#define F_SUB(a, b)       _mm256_sub_ps(a, b)
+#define F_MUL(a, b)       _mm256_mul_ps(a, b)
+#define F_DIV(a, b)       _mm256_div_ps(a, b)
+#define F_MIN(a, b)       _mm256_min_ps(a, b)
+#define F_MAX(a, b)       _mm256_max_ps(a, b)
+#define F_CMPLT(a, b)     _mm256_cmp_ps(a, b, _CMP_LT_OQ)
+#define F_CMPGT(a, b)     _mm256_cmp_ps(a, b, _CMP_GT_OQ)
+#define F_CMPUNORD(a, b)  _mm256_cmp_ps(a, b, _CMP_UNORD_Q)
+#define F_OR(a, b)        _mm256_or_ps(a, b)
+#define F_MOVEMASK(v)     _mm256_movemask_ps(v)
+#define F_TO_D_LO(v)      _mm256_cvtps_pd(_mm256_castps256_ps128(v))
+#define F_TO_D_HI(v)      _mm256_cvtps_pd(_mm256_extractf128_ps(v, 1))
+#define D_TO_F(lo, hi)                                                  \
+    _mm256_insertf128_ps(_mm256_castps128_ps256(_mm256_cvtpd_ps(lo)),   \
+                         _mm256_cvtpd_ps(hi), 1)
+
+#define VD   __m256d
+#define D_LOAD(p)         _mm256_loadu_pd(p)
+#define D_STORE(p, v)     _mm256_storeu_pd(p, v)
+#define D_SET1(x)         _mm256_set1_pd(x)
+#define D_ZERO()          _mm256_setzero_pd()
+#define D_ADD(a, b)       _mm256_add_pd(a, b)
+#define D_SUB(a, b)       _mm256_sub_pd(a, b)
+#define D_MUL(a, b)       _mm256_mul_pd(a, b)
+#define D_DIV(a, b)       _mm256_div_pd(a, b)
+#define D_MIN(a, b)       _mm256_min_pd(a, b)
+#define D_MAX(a, b)       _mm256_max_pd(a, b)
+#define D_CMPLT(a, b)     _mm256_cmp_pd(a, b, _CMP_LT_OQ)
+#define D_CMPGT(a, b)     _mm256_cmp_pd(a, b, _CMP_GT_OQ)
+#define D_CMPUNORD(a, b)  _mm256_cmp_pd(a, b, _CMP_UNORD_Q)
+#define D_OR(a, b)        _mm256_or_pd(a, b)
+#define D_MOVEMASK(v)     _mm256_movemask_pd(v)
+
+#define VI   __m256i
+#define I_LOAD(p)         _mm256_loadu_si256((const __m256i*)(p))
+#define I_STORE(p, v)     _mm256_storeu_si256((__m256i*)(p), v)
+#define I_ZERO()          _mm256_setzero_si256()
+#define I_SET1_8(x)       _mm256_set1_epi8((char)(x))
+#define I_SET1_16(x)      _mm256_set1_epi16(x)
+#define I_SET1_32(x)      _mm256_set1_epi32(x)
+#define I_SET1_64(x)      _mm256_set1_epi64x(x)
+#define I_AND(a, b)       _mm256_and_si256(a, b)
+#define I_OR(a, b)        _mm256_or_si256(a, b)
+#define I_XOR(a, b)       _mm256_xor_si256(a, b)
+#define I_ANDNOT(a, b)    _mm256_andnot_si256(a, b)
+#define I_ADD8(a, b)      _mm256_add_epi8(a, b)
+#define I_ADD32(a, b)     _mm256_add_epi32(a, b)
+#define I_SUB32(a, b)     _mm256_sub_epi32(a, b)
+#define I_ADD64(a, b)     _mm256_add_epi64(a, b)
+#define I_SUB64(a, b)     _mm256_sub_epi64(a, b)
+#define I_ADDS_U8(a, b)   _mm256_adds_epu8(a, b)
+#define I_SUBS_U8(a, b)   _mm256_subs_epu8(a, b)
+#define I_MAX_U8(a, b)    _mm256_max_epu8(a, b)
+#define I_MIN_U8(a, b)    _mm256_min_epu8(a, b)
+#define I_CMPEQ8(a, b)    _mm256_cmpeq_epi8(a, b)
+#define I_CMPEQ16(a, b)   _mm256_cmpeq_epi16(a, b)
+#define I_CMPEQ32(a, b)   _mm256_cmpeq_epi32(a, b)
+#define I_CMPGT32(a, b)   _mm256_cmpgt_epi32(a, b)
+#define I_SRAI32(v, n)    _mm256_srai_epi32(v, n)
+#define I_SRLI16(v, n)    _mm256_srli_epi16(v, n)
+#define I_SRLI64(v, n)    _mm256_srli_epi64(v, n)
+#define I_SLLI64(v, n)    _mm256_slli_epi64(v, n)
+#define I_UNPACKLO8(a, b) _mm256_unpacklo_epi8(a, b)
+#define I_UNPACKHI8(a, b) _mm256_unpackhi_epi8(a, b)
+#define I_UNPACKLO32(a, b) _mm256_unpacklo_epi32(a, b)
+#define I_UNPACKHI32(a, b) _mm256_unpackhi_epi32(a, b)
+#define I_MULLO16(a, b)   _mm256_mullo_epi16(a, b)
+#define I_MADD16(a, b)    _mm256_madd_epi16(a, b)
+#define I_SAD_U8(a, b)    _mm256_sad_epu8(a, b)
+#define I_PACKUS16(a, b)  _mm256_packus_epi16(a, b)
+#define I_MOVEMASK8(v)    _mm256_movemask_epi8(v)
+#define I_MASK_ALL        (-1)
+#define I_MUL32X64(a, b)  _mm256_mul_epi32(a, b)
+
+#include "uvsimd_body.c"
+
+#endif /*UVSIMD_AVX2*/
+
+#if defined(UVSIMD_AVX2)
+#define DISPATCH(name, args)                                    \
+    do {                                                        \
+        u_long f_ = Scm__CPUFeatures();                         \
+        if (f_ & SCM_CPU_AVX2) return name##_avx2 args;         \
+        if (f_ & SCM_CPU_SSE2) return name##_sse2 args;         \
+        return 0;                                               \
+    } while (0)
+#elif defined(UVSIMD_SSE2)
+#define DISPATCH(name, args)                                    \
+    return ((Scm__CPUFeatures() & SCM_CPU_SSE2)? name##_sse2 args : 0)
+#else
+#define DISPATCH(name, args) return 0
+#endif
+
+/*
+ * Entry points
+ */
+
+int Scm__UVSimdF32Op(int op, float *d, const float *x, const float *y, int n)
+{
+    DISPATCH(f32_op, (op, d, x, y, n));
+}
+
+int Scm__UVSimdF32OpC(int op, float *d, const float *x, double y, int n)
+{
+    DISPATCH(f32_opc, (op, d, x, y, n));
+}
+
+int Scm__UVSimdF64Op(int op, double *d, const double *x, const double *y,
+                     int n)
+{
+    DISPATCH(f64_op, (op, d, x, y, n));
+}
+
+int Scm__UVSimdF64OpC(int op, double *d, const double *x, double y, int n)
+{
+    DISPATCH(f64_opc, (op, d, x, y, n));
+}
+
+int Scm__UVSimdS32Op(int op, ScmInt32 *d, const ScmInt32 *x,
+                     const ScmInt32 *y, int n, int clamp)
+{
+    DISPATCH(s32_op, (op, d, x, y, 0, n, clamp));
+}
+
+int Scm__UVSimdS32OpC(int op, ScmInt32 *d, const ScmInt32 *x, long y,
+                      int n, int clamp)
+{
+    if (y < -2147483647L-1 || y > 2147483647L) return 0;
+    DISPATCH(s32_op, (op, d, x, NULL, (ScmInt32)y, n, clamp));
+}
+
+int Scm__UVSimdU8Op(int op, unsigned char *d, const unsigned char *x,
+                    const unsigned char *y, int n, int clamp)
+{
+    DISPATCH(u8_op, (op, d, x, y, 0, n, clamp));
+}
+
+int Scm__UVSimdU8OpC(int op, unsigned char *d, const unsigned char *x,
+                     long y, int n, int clamp)
+{
+    if (y < 0 || y > 255) return 0;
+    DISPATCH(u8_op, (op, d, x, NULL, (unsigned char)y, n, clamp));
+}
+
+int Scm__UVSimdF32Dot(const float *x, const float *y, int n, double *r)
+{
+    DISPATCH(f32_dot, (x, y, n, r));
+}
+
+int Scm__UVSimdF64Dot(const double *x, const double *y, int n, double *r)
+{
+    DISPATCH(f64_dot, (x, y, n, r));
+}
+
+int Scm__UVSimdS32Dot(const ScmInt32 *x, const ScmInt32 *y, int n, ScmObj *r)
+{
+    DISPATCH(s32_dot, (x, y, n, r));
+}
+
+int Scm__UVSimdU8Dot(const unsigned char *x, const unsigned char *y, int n,
+                     ScmObj *r)
+{
+    DISPATCH(u8_dot, (x, y, n, r));
+}
+
+int Scm__UVSimdF32Clamp(float *v, int n, double min, int mindc,
+                        double max, int maxdc, int checkonly)
+{
+    /* The scalar code compares elements with the limits in double.
+       It is the same as comparing in float only if the limits are
+       exactly representable in float. */
+    if ((!mindc && !float_exact_p(min)) || (!maxdc && !float_exact_p(max))) {
+        return 0;
+    }
+    DISPATCH(f32_clamp, (v, n, min, mindc, max, maxdc, checkonly));
+}
+
+int Scm__UVSimdF64Clamp(double *v, int n, double min, int mindc,
+                        double max, int maxdc, int checkonly)
+{
+    DISPATCH(f64_clamp, (v, n, min, mindc, max, maxdc, checkonly));
+}
+
+int Scm__UVSimdS32Clamp(ScmInt32 *v, int n, long min, int mindc,
+                        long max, int maxdc, int checkonly)
+{
+    DISPATCH(s32_clamp, (v, n, min, mindc, max, maxdc, checkonly));
+}
+
+int Scm__UVSimdU8Clamp(unsigned char *v, int n, long min, int mindc,
+                       long max, int maxdc, int checkonly)
+{
+    DISPATCH(u8_clamp, (v, n, min, mindc, max, maxdc, checkonly));
+}
+
+int Scm__UVSimdF32Sum(const float *x, int n, double *r)
+{
+    DISPATCH(f32_sum, (x, n, r));
+}
+
+int Scm__UVSimdF64Sum(const double *x, int n, double *r)
+{
+    DISPATCH(f64_sum, (x, n, r));
+}
+
+int Scm__UVSimdS32Sum(const ScmInt32 *x, int n, ScmObj *r)
+{
+    DISPATCH(s32_sum, (x, n, r));
+}
+
+int Scm__UVSimdU8Sum(const unsigned char *x, int n, ScmObj *r)
+{
+    DISPATCH(u8_sum, (x, n, r));
+}
+
+int Scm__UVSimdF32MinMax(int max, const float *x, int n, double *r)
+{
+    DISPATCH(f32_minmax, (max, x, n, r));
+}
+
+int Scm__UVSimdF64MinMax(int max, const double *x, int n, double *r)
+{
+    DISPATCH(f64_minmax, (max, x, n, r));
+}
+
+int Scm__UVSimdS32MinMax(int max, const ScmInt32 *x, int n, long *r)
+{
+    DISPATCH(s32_minmax, (max, x, n, r));
+}
+
+int Scm__UVSimdU8MinMax(int max, const unsigned char *x, int n, long *r)
+{
+    DISPATCH(u8_minmax, (max, x, n, r));
+}
@@ -0,0 +1,111 @@
+/*
+ * uvsimd.h - SIMD kernels for uniform vector arithmetic
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_UVSIMD_H
+#define GAUCHE_UVSIMD_H
+
+/*
+ * Each kernel processes the leading elements of the vectors and returns
+ * the number of elements it has processed.  The caller handles the rest
+ * with the generic scalar loop.  A kernel may stop early (and may even
+ * return 0) if SIMD instructions aren't available, or if it finds an
+ * element that needs special handling---e.g. an integer overflow that
+ * should be signalled as an error.  In that case, the elements it has
+ * processed have already been stored, and the rest are untouched.
+ */
+
+enum {
+    UVSIMD_ADD,
+    UVSIMD_SUB,
+    UVSIMD_MUL,
+    UVSIMD_DIV                  /* flonum vectors only */
+};
+
+/* d[i] = x[i] op y[i] */
+extern int Scm__UVSimdF32Op(int op, float *d, const float *x,
+                            const float *y, int n);
+extern int Scm__UVSimdF64Op(int op, double *d, const double *x,
+                            const double *y, int n);
+extern int Scm__UVSimdS32Op(int op, ScmInt32 *d, const ScmInt32 *x,
+                            const ScmInt32 *y, int n, int clamp);
+extern int Scm__UVSimdU8Op(int op, unsigned char *d, const unsigned char *x,
+                           const unsigned char *y, int n, int clamp);
+
+/* d[i] = x[i] op y */
+extern int Scm__UVSimdF32OpC(int op, float *d, const float *x,
+                             double y, int n);
+extern int Scm__UVSimdF64OpC(int op, double *d, const double *x,
+                             double y, int n);
+extern int Scm__UVSimdS32OpC(int op, ScmInt32 *d, const ScmInt32 *x,
+                             long y, int n, int clamp);
+extern int Scm__UVSimdU8OpC(int op, unsigned char *d, const unsigned char *x,
+                            long y, int n, int clamp);
+
+/* Adds the dot product of the processed elements to *r. */
+extern int Scm__UVSimdF32Dot(const float *x, const float *y, int n,
+                             double *r);
+extern int Scm__UVSimdF64Dot(const double *x, const double *y, int n,
+                             double *r);
+extern int Scm__UVSimdS32Dot(const ScmInt32 *x, const ScmInt32 *y, int n,
+                             ScmObj *r);
+extern int Scm__UVSimdU8Dot(const unsigned char *x, const unsigned char *y,
+                            int n, ScmObj *r);
+
+/* Adds the sum of the processed elements to *r. */
+extern int Scm__UVSimdF32Sum(const float *x, int n, double *r);
+extern int Scm__UVSimdF64Sum(const double *x, int n, double *r);
+extern int Scm__UVSimdS32Sum(const ScmInt32 *x, int n, ScmObj *r);
+extern int Scm__UVSimdU8Sum(const unsigned char *x, int n, ScmObj *r);
+
+/* Updates *r with the minimum (or the maximum, if max is true) of *r
+   and the processed elements.  The kernel stops before NaN. */
+extern int Scm__UVSimdF32MinMax(int max, const float *x, int n, double *r);
+extern int Scm__UVSimdF64MinMax(int max, const double *x, int n, double *r);
+extern int Scm__UVSimdS32MinMax(int max, const ScmInt32 *x, int n, long *r);
+extern int Scm__UVSimdU8MinMax(int max, const unsigned char *x, int n,
+                               long *r);
+
+/* Clamps v[i] between min and max in place.  If mindc (maxdc) is true,
+   min (max) is ignored.  If checkonly is true, v isn't modified, and
+   the kernel stops before the first element out of the range
+   (range-check). */
+extern int Scm__UVSimdF32Clamp(float *v, int n, double min, int mindc,
+                               double max, int maxdc, int checkonly);
+extern int Scm__UVSimdF64Clamp(double *v, int n, double min, int mindc,
+                               double max, int maxdc, int checkonly);
+extern int Scm__UVSimdS32Clamp(ScmInt32 *v, int n, long min, int mindc,
+                               long max, int maxdc, int checkonly);
+extern int Scm__UVSimdU8Clamp(unsigned char *v, int n, long min, int mindc,
+                              long max, int maxdc, int checkonly);
+
+#endif /*GAUCHE_UVSIMD_H*/
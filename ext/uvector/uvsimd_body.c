@@ -0,0 +1,740 @@
+/*
+ * uvsimd_body.c - SIMD kernel bodies
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * This file is included from uvsimd.c once for each instruction set,
+ * with the macros that map the abstract vector operations to the
+ * intrinsics.  KFN(name) gives the name of the function for the
+ * instruction set, and KATTR is the attribute to compile it for the
+ * instruction set.  W8, W32 and W64 are the number of 8, 32 and 64-bit
+ * lanes in a vector.  VF, VD and VI are vector types of float, double
+ * and integers.  The macros are undefined at the end of this file.
+ */
+
+/*=============================================================
+ * Helpers
+ */
+
+static inline KATTR double KFN(d_hsum)(VD v)
+{
+    double t[W64], s = 0.0;
+    D_STORE(t, v);
+    for (int k=0; k<W64; k++) s += t[k];
+    return s;
+}
+
+static inline KATTR ScmUInt64 KFN(u32_hsum)(VI v)
+{
+    ScmUInt32 t[W32];
+    ScmUInt64 s = 0;
+    I_STORE(t, v);
+    for (int k=0; k<W32; k++) s += t[k];
+    return s;
+}
+
+static inline KATTR int KFN(all_eq8)(VI a, VI b)
+{
+    return I_MOVEMASK8(I_CMPEQ8(a, b)) == I_MASK_ALL;
+}
+
+/* OV has all bits set in the lanes that overflowed.  NEG has all bits
+   set in the lanes that overflowed toward negative.  Returns TRUE if
+   CLAMP allows saturating all of them. */
+static inline KATTR int KFN(s32_clamp_ok)(VI ov, VI neg, int clamp)
+{
+    if (!(clamp & SCM_CLAMP_HI) && I_MOVEMASK8(I_ANDNOT(neg, ov))) {
+        return FALSE;
+    }
+    if (!(clamp & SCM_CLAMP_LO) && I_MOVEMASK8(I_AND(neg, ov))) {
+        return FALSE;
+    }
+    return TRUE;
+}
+
+/*=============================================================
+ * Flonum arithmetic
+ */
+
+static KATTR int KFN(f32_op)(int op, float *d, const float *x,
+                             const float *y, int n)
+{
+    int i = 0;
+#define LOOP(OP)                                                \
+    for (; i+W32 <= n; i+=W32) {                                \
+        F_STORE(d+i, OP(F_LOAD(x+i), F_LOAD(y+i)));             \
+    }                                                           \
+    break
+
+    switch (op) {
+    case UVSIMD_ADD: LOOP(F_ADD);
+    case UVSIMD_SUB: LOOP(F_SUB);
+    case UVSIMD_MUL: LOOP(F_MUL);
+    case UVSIMD_DIV: LOOP(F_DIV);
+    }
+#undef LOOP
+    return i;
+}
+
+static KATTR int KFN(f32_opc)(int op, float *d, const float *x, double y,
+                              int n)
+{
+    int i = 0;
+    if (float_exact_p(y)) {
+        /* The scalar code computes in double and rounds the result to
+           float.  For +, -, * and /, it gives the same result as
+           computing in float, if the operands are floats. */
+        VF yv = F_SET1((float)y);
+#define LOOP(OP)                                                \
+        for (; i+W32 <= n; i+=W32) {                            \
+            F_STORE(d+i, OP(F_LOAD(x+i), yv));                  \
+        }                                                       \
+        break
+
+        switch (op) {
+        case UVSIMD_ADD: LOOP(F_ADD);
+        case UVSIMD_SUB: LOOP(F_SUB);
+        case UVSIMD_MUL: LOOP(F_MUL);
+        case UVSIMD_DIV: LOOP(F_DIV);
+        }
+#undef LOOP
+    } else {
+        VD yv = D_SET1(y);
+#define LOOP(OP)                                                        \
+        for (; i+W32 <= n; i+=W32) {                                    \
+            VF v = F_LOAD(x+i);                                         \
+            F_STORE(d+i, D_TO_F(OP(F_TO_D_LO(v), yv),                   \
+                                OP(F_TO_D_HI(v), yv)));                 \
+        }                                                               \
+        break
+
+        switch (op) {
+        case UVSIMD_ADD: LOOP(D_ADD);
+        case UVSIMD_SUB: LOOP(D_SUB);
+        case UVSIMD_MUL: LOOP(D_MUL);
+        case UVSIMD_DIV: LOOP(D_DIV);
+        }
+#undef LOOP
+    }
+    return i;
+}
+
+static KATTR int KFN(f64_op)(int op, double *d, const double *x,
+                             const double *y, int n)
+{
+    int i = 0;
+#define LOOP(OP)                                                \
+    for (; i+W64 <= n; i+=W64) {                                \
+        D_STORE(d+i, OP(D_LOAD(x+i), D_LOAD(y+i)));             \
+    }                                                           \
+    break
+
+    switch (op) {
+    case UVSIMD_ADD: LOOP(D_ADD);
+    case UVSIMD_SUB: LOOP(D_SUB);
+    case UVSIMD_MUL: LOOP(D_MUL);
+    case UVSIMD_DIV: LOOP(D_DIV);
+    }
+#undef LOOP
+    return i;
+}
+
+static KATTR int KFN(f64_opc)(int op, double *d, const double *x, double y,
+                              int n)
+{
+    int i = 0;
+    VD yv = D_SET1(y);
+#define LOOP(OP)                                                \
+    for (; i+W64 <= n; i+=W64) {                                \
+        D_STORE(d+i, OP(D_LOAD(x+i), yv));                      \
+    }                                                           \
+    break
+
+    switch (op) {
+    case UVSIMD_ADD: LOOP(D_ADD);
+    case UVSIMD_SUB: LOOP(D_SUB);
+    case UVSIMD_MUL: LOOP(D_MUL);
+    case UVSIMD_DIV: LOOP(D_DIV);
+    }
+#undef LOOP
+    return i;
+}
+
+/* Products of floats are exact in double, as in the scalar code.
+   The order of summation differs, though. */
+static KATTR int KFN(f32_dot)(const float *x, const float *y, int n,
+                              double *r)
+{
+    int i = 0;
+    VD acc0 = D_ZERO(), acc1 = D_ZERO();
+    for (; i+W32 <= n; i+=W32) {
+        VF a = F_LOAD(x+i), b = F_LOAD(y+i);
+        acc0 = D_ADD(acc0, D_MUL(F_TO_D_LO(a), F_TO_D_LO(b)));
+        acc1 = D_ADD(acc1, D_MUL(F_TO_D_HI(a), F_TO_D_HI(b)));
+    }
+    *r += KFN(d_hsum)(D_ADD(acc0, acc1));
+    return i;
+}
+
+static KATTR int KFN(f64_dot)(const double *x, const double *y, int n,
+                              double *r)
+{
+    int i = 0;
+    VD acc0 = D_ZERO(), acc1 = D_ZERO();
+    for (; i+2*W64 <= n; i+=2*W64) {
+        acc0 = D_ADD(acc0, D_MUL(D_LOAD(x+i), D_LOAD(y+i)));
+        acc1 = D_ADD(acc1, D_MUL(D_LOAD(x+i+W64), D_LOAD(y+i+W64)));
+    }
+    *r += KFN(d_hsum)(D_ADD(acc0, acc1));
+    return i;
+}
+
+/*=============================================================
+ * s32 arithmetic
+ *
+ *  Overflow is detected for each vector.  If it happens and the clamp
+ *  mode allows it, the results are saturated.  Otherwise, we stop
+ *  before the vector and let the scalar code signal an error.
+ *  If Y is NULL, YC is used as the second operand.
+ */
+
+static KATTR int KFN(s32_addsub)(int sub, ScmInt32 *d, const ScmInt32 *x,
+                                 const ScmInt32 *y, ScmInt32 yc,
+                                 int n, int clamp)
+{
+    int i = 0;
+    VI yv = I_SET1_32(yc), maxv = I_SET1_32(0x7fffffff);
+    for (; i+W32 <= n; i+=W32) {
+        VI a = I_LOAD(x+i);
+        VI b = y? I_LOAD(y+i) : yv;
+        VI r, ov;
+        if (sub) {
+            r = I_SUB32(a, b);
+            ov = I_AND(I_XOR(a, b), I_XOR(a, r));
+        } else {
+            r = I_ADD32(a, b);
+            ov = I_AND(I_XOR(a, r), I_XOR(b, r));
+        }
+        ov = I_SRAI32(ov, 31);
+        if (I_MOVEMASK8(ov)) {
+            /* An overflowed result has the opposite sign of a. */
+            VI neg = I_SRAI32(a, 31);
+            if (!KFN(s32_clamp_ok)(ov, neg, clamp)) break;
+            r = I_OR(I_AND(ov, I_XOR(neg, maxv)), I_ANDNOT(ov, r));
+        }
+        I_STORE(d+i, r);
+    }
+    return i;
+}
+
+#if defined(I_MUL32X64)
+static KATTR int KFN(s32_mul)(ScmInt32 *d, const ScmInt32 *x,
+                              const ScmInt32 *y, ScmInt32 yc,
+                              int n, int clamp)
+{
+    int i = 0;
+    VI yv = I_SET1_32(yc), maxv = I_SET1_32(0x7fffffff);
+    VI lomask = I_SET1_64(0xffffffffLL), ones = I_SET1_32(-1);
+    for (; i+W32 <= n; i+=W32) {
+        VI a = I_LOAD(x+i);
+        VI b = y? I_LOAD(y+i) : yv;
+        /* 64bit products of even and odd elements */
+        VI pe = I_MUL32X64(a, b);
+        VI po = I_MUL32X64(I_SRLI64(a, 32), I_SRLI64(b, 32));
+        /* lower and upper halves of the products, in place of elements */
+        VI r  = I_OR(I_AND(pe, lomask), I_SLLI64(po, 32));
+        VI hi = I_OR(I_SRLI64(pe, 32), I_ANDNOT(lomask, po));
+        /* a product fits in 32bit iff its upper half is the sign
+           extension of the lower half. */
+        VI ov = I_XOR(I_CMPEQ32(hi, I_SRAI32(r, 31)), ones);
+        if (I_MOVEMASK8(ov)) {
+            VI neg = I_SRAI32(I_XOR(a, b), 31);
+            if (!KFN(s32_clamp_ok)(ov, neg, clamp)) break;
+            r = I_OR(I_AND(ov, I_XOR(neg, maxv)), I_ANDNOT(ov, r));
+        }
+        I_STORE(d+i, r);
+    }
+    return i;
+}
+
+/* To avoid overflow, we accumulate the lower and upper halves of
+   64bit products separately. */
+static KATTR int KFN(s32_dot)(const ScmInt32 *x, const ScmInt32 *y, int n,
+                              ScmObj *r)
+{
+    int i = 0;
+    VI lomask = I_SET1_64(0xffffffffLL), sbit = I_SET1_64(0x80000000LL);
+    VI acclo = I_ZERO(), acchi = I_ZERO();
+    for (; i+W32 <= n; i+=W32) {
+        VI a = I_LOAD(x+i), b = I_LOAD(y+i);
+        VI pe = I_MUL32X64(a, b);
+        VI po = I_MUL32X64(I_SRLI64(a, 32), I_SRLI64(b, 32));
+        acclo = I_ADD64(acclo, I_ADD64(I_AND(pe, lomask),
+                                       I_AND(po, lomask)));
+        /* sign-extend the upper halves: (h ^ 2^31) - 2^31 */
+        VI he = I_SUB64(I_XOR(I_SRLI64(pe, 32), sbit), sbit);
+        VI ho = I_SUB64(I_XOR(I_SRLI64(po, 32), sbit), sbit);
+        acchi = I_ADD64(acchi, I_ADD64(he, ho));
+    }
+    if (i > 0) {
+        ScmInt64 lo[W64], hi[W64], slo = 0, shi = 0;
+        I_STORE(lo, acclo);
+        I_STORE(hi, acchi);
+        for (int k=0; k<W64; k++) { slo += lo[k]; shi += hi[k]; }
+        *r = Scm_Add(*r, Scm_Add(Scm_Ash(Scm_MakeInteger64(shi), 32),
+                                 Scm_MakeInteger64(slo)));
+    }
+    return i;
+}
+#else  /*!I_MUL32X64*/
+static KATTR int KFN(s32_mul)(ScmInt32 *d, const ScmInt32 *x,
+                              const ScmInt32 *y, ScmInt32 yc,
+                              int n, int clamp)
+{
+    return 0;
+}
+
+static KATTR int KFN(s32_dot)(const ScmInt32 *x, const ScmInt32 *y, int n,
+                              ScmObj *r)
+{
+    return 0;
+}
+#endif /*!I_MUL32X64*/
+
+static KATTR int KFN(s32_op)(int op, ScmInt32 *d, const ScmInt32 *x,
+                             const ScmInt32 *y, ScmInt32 yc,
+                             int n, int clamp)
+{
+    switch (op) {
+    case UVSIMD_ADD: return KFN(s32_addsub)(FALSE, d, x, y, yc, n, clamp);
+    case UVSIMD_SUB: return KFN(s32_addsub)(TRUE, d, x, y, yc, n, clamp);
+    case UVSIMD_MUL: return KFN(s32_mul)(d, x, y, yc, n, clamp);
+    default:         return 0;
+    }
+}
+
+/*=============================================================
+ * u8 arithmetic
+ *
+ *  Saturating add and sub are native.  For mul, we compute 16bit
+ *  products.
+ */
+
+static KATTR int KFN(u8_op)(int op, unsigned char *d, const unsigned char *x,
+                            const unsigned char *y, unsigned char yc,
+                            int n, int clamp)
+{
+    int i = 0;
+    VI yv = I_SET1_8(yc), zero = I_ZERO(), lo8 = I_SET1_16(0xff);
+    for (; i+W8 <= n; i+=W8) {
+        VI a = I_LOAD(x+i);
+        VI b = y? I_LOAD(y+i) : yv;
+        VI r;
+        switch (op) {
+        case UVSIMD_ADD:
+            r = I_ADDS_U8(a, b);
+            if (!(clamp & SCM_CLAMP_HI) && !KFN(all_eq8)(r, I_ADD8(a, b))) {
+                return i;
+            }
+            break;
+        case UVSIMD_SUB:
+            r = I_SUBS_U8(a, b);
+            if (!(clamp & SCM_CLAMP_LO) && !KFN(all_eq8)(I_MAX_U8(a, b), a)) {
+                return i;
+            }
+            break;
+        case UVSIMD_MUL: {
+            VI pl = I_MULLO16(I_UNPACKLO8(a, zero), I_UNPACKLO8(b, zero));
+            VI ph = I_MULLO16(I_UNPACKHI8(a, zero), I_UNPACKHI8(b, zero));
+            /* all bits set in the lanes that didn't overflow */
+            VI okl = I_CMPEQ16(I_SRLI16(pl, 8), zero);
+            VI okh = I_CMPEQ16(I_SRLI16(ph, 8), zero);
+            if (!(clamp & SCM_CLAMP_HI)
+                && I_MOVEMASK8(I_AND(okl, okh)) != I_MASK_ALL) {
+                return i;
+            }
+            pl = I_AND(I_OR(pl, I_ANDNOT(okl, lo8)), lo8);
+            ph = I_AND(I_OR(ph, I_ANDNOT(okh, lo8)), lo8);
+            r = I_PACKUS16(pl, ph);
+            break;
+        }
+        default:
+            return i;
+        }
+        I_STORE(d+i, r);
+    }
+    return i;
+}
+
+/* Each madd adds at most 2*255*255 to a 32bit lane, so we can run
+   4096 iterations before flushing the accumulator. */
+static KATTR int KFN(u8_dot)(const unsigned char *x, const unsigned char *y,
+                             int n, ScmObj *r)
+{
+    int i = 0;
+    VI zero = I_ZERO();
+    ScmUInt64 sum = 0;
+    while (i+W8 <= n) {
+        int end = (n - i > W8*4096)? i + W8*4096 : n;
+        VI acc = zero;
+        for (; i+W8 <= end; i+=W8) {
+            VI a = I_LOAD(x+i), b = I_LOAD(y+i);
+            acc = I_ADD32(acc, I_MADD16(I_UNPACKLO8(a, zero),
+                                        I_UNPACKLO8(b, zero)));
+            acc = I_ADD32(acc, I_MADD16(I_UNPACKHI8(a, zero),
+                                        I_UNPACKHI8(b, zero)));
+        }
+        sum += KFN(u32_hsum)(acc);
+    }
+    if (i > 0) *r = Scm_Add(*r, Scm_MakeIntegerU64(sum));
+    return i;
+}
+
+/*=============================================================
+ * Clamp and range check
+ *
+ *  The scalar code replaces val with min if val < min, then with max
+ *  if max < val.  MAX(minv, v) and MIN(maxv, v) do exactly that,
+ *  including NaNs, since they return the second operand unless the
+ *  comparison holds.
+ */
+
+static KATTR int KFN(f32_clamp)(float *v, int n, double min, int mindc,
+                                double max, int maxdc, int checkonly)
+{
+    int i = 0;
+    VF minv = F_SET1(mindc? -HUGE_VALF : (float)min);
+    VF maxv = F_SET1(maxdc? HUGE_VALF : (float)max);
+    if (checkonly) {
+        for (; i+W32 <= n; i+=W32) {
+            VF a = F_LOAD(v+i);
+            if (F_MOVEMASK(F_OR(F_CMPLT(a, minv), F_CMPGT(a, maxv)))) break;
+        }
+    } else {
+        for (; i+W32 <= n; i+=W32) {
+            F_STORE(v+i, F_MIN(maxv, F_MAX(minv, F_LOAD(v+i))));
+        }
+    }
+    return i;
+}
+
+static KATTR int KFN(f64_clamp)(double *v, int n, double min, int mindc,
+                                double max, int maxdc, int checkonly)
+{
+    int i = 0;
+    VD minv = D_SET1(mindc? -HUGE_VAL : min);
+    VD maxv = D_SET1(maxdc? HUGE_VAL : max);
+    if (checkonly) {
+        for (; i+W64 <= n; i+=W64) {
+            VD a = D_LOAD(v+i);
+            if (D_MOVEMASK(D_OR(D_CMPLT(a, minv), D_CMPGT(a, maxv)))) break;
+        }
+    } else {
+        for (; i+W64 <= n; i+=W64) {
+            D_STORE(v+i, D_MIN(maxv, D_MAX(minv, D_LOAD(v+i))));
+        }
+    }
+    return i;
+}
+
+static KATTR int KFN(s32_clamp)(ScmInt32 *v, int n, long min, int mindc,
+                                long max, int maxdc, int checkonly)
+{
+    int i = 0;
+    VI minv = I_SET1_32(mindc? -2147483647-1 : (ScmInt32)min);
+    VI maxv = I_SET1_32(maxdc? 2147483647 : (ScmInt32)max);
+    for (; i+W32 <= n; i+=W32) {
+        VI a = I_LOAD(v+i);
+        VI lt = I_CMPGT32(minv, a);
+        if (checkonly) {
+            if (I_MOVEMASK8(I_OR(lt, I_CMPGT32(a, maxv)))) break;
+        } else {
+            a = I_OR(I_AND(lt, minv), I_ANDNOT(lt, a));
+            VI gt = I_CMPGT32(a, maxv);
+            I_STORE(v+i, I_OR(I_AND(gt, maxv), I_ANDNOT(gt, a)));
+        }
+    }
+    return i;
+}
+
+static KATTR int KFN(u8_clamp)(unsigned char *v, int n, long min, int mindc,
+                               long max, int maxdc, int checkonly)
+{
+    int i = 0;
+    VI minv = I_SET1_8(mindc? 0 : min);
+    VI maxv = I_SET1_8(maxdc? 255 : max);
+    for (; i+W8 <= n; i+=W8) {
+        VI a = I_LOAD(v+i);
+        if (checkonly) {
+            if (!KFN(all_eq8)(I_MAX_U8(a, minv), a)
+                || !KFN(all_eq8)(I_MIN_U8(a, maxv), a)) break;
+        } else {
+            I_STORE(v+i, I_MIN_U8(I_MAX_U8(a, minv), maxv));
+        }
+    }
+    return i;
+}
+
+/*=============================================================
+ * Sum, min and max
+ *
+ *  The min and max kernels update *r, which the caller initializes
+ *  with the first element.  MIN(a, m) and MAX(a, m) return m unless
+ *  a is less (greater) than m, as the scalar code.  We stop before a
+ *  vector containing NaN and let the scalar code deal with it.
+ */
+
+static KATTR int KFN(f32_sum)(const float *x, int n, double *r)
+{
+    int i = 0;
+    VD acc0 = D_ZERO(), acc1 = D_ZERO();
+    for (; i+W32 <= n; i+=W32) {
+        VF a = F_LOAD(x+i);
+        acc0 = D_ADD(acc0, F_TO_D_LO(a));
+        acc1 = D_ADD(acc1, F_TO_D_HI(a));
+    }
+    *r += KFN(d_hsum)(D_ADD(acc0, acc1));
+    return i;
+}
+
+static KATTR int KFN(f64_sum)(const double *x, int n, double *r)
+{
+    int i = 0;
+    VD acc0 = D_ZERO(), acc1 = D_ZERO();
+    for (; i+2*W64 <= n; i+=2*W64) {
+        acc0 = D_ADD(acc0, D_LOAD(x+i));
+        acc1 = D_ADD(acc1, D_LOAD(x+i+W64));
+    }
+    *r += KFN(d_hsum)(D_ADD(acc0, acc1));
+    return i;
+}
+
+/* Elements are sign-extended to 64bit lanes.  Since n < 2^31, the
+   sum can't overflow. */
+static KATTR int KFN(s32_sum)(const ScmInt32 *x, int n, ScmObj *r)
+{
+    int i = 0;
+    VI zero = I_ZERO(), acc = I_ZERO();
+    for (; i+W32 <= n; i+=W32) {
+        VI a = I_LOAD(x+i);
+        VI sign = I_CMPGT32(zero, a);
+        acc = I_ADD64(acc, I_ADD64(I_UNPACKLO32(a, sign),
+                                   I_UNPACKHI32(a, sign)));
+    }
+    if (i > 0) {
+        ScmInt64 t[W64], sum = 0;
+        I_STORE(t, acc);
+        for (int k=0; k<W64; k++) sum += t[k];
+        *r = Scm_Add(*r, Scm_MakeInteger64(sum));
+    }
+    return i;
+}
+
+static KATTR int KFN(u8_sum)(const unsigned char *x, int n, ScmObj *r)
+{
+    int i = 0;
+    VI zero = I_ZERO(), acc = I_ZERO();
+    for (; i+W8 <= n; i+=W8) {
+        acc = I_ADD64(acc, I_SAD_U8(I_LOAD(x+i), zero));
+    }
+    if (i > 0) {
+        ScmUInt64 t[W64], sum = 0;
+        I_STORE(t, acc);
+        for (int k=0; k<W64; k++) sum += t[k];
+        *r = Scm_Add(*r, Scm_MakeIntegerU64(sum));
+    }
+    return i;
+}
+
+static KATTR int KFN(f32_minmax)(int max, const float *x, int n, double *r)
+{
+    int i = 0;
+    VF m = F_SET1((float)*r);
+    for (; i+W32 <= n; i+=W32) {
+        VF a = F_LOAD(x+i);
+        if (F_MOVEMASK(F_CMPUNORD(a, a))) break;
+        m = max? F_MAX(a, m) : F_MIN(a, m);
+    }
+    if (i > 0) {
+        float t[W32];
+        F_STORE(t, m);
+        for (int k=0; k<W32; k++) {
+            if (max? (*r < t[k]) : (t[k] < *r)) *r = t[k];
+        }
+    }
+    return i;
+}
+
+static KATTR int KFN(f64_minmax)(int max, const double *x, int n, double *r)
+{
+    int i = 0;
+    VD m = D_SET1(*r);
+    for (; i+W64 <= n; i+=W64) {
+        VD a = D_LOAD(x+i);
+        if (D_MOVEMASK(D_CMPUNORD(a, a))) break;
+        m = max? D_MAX(a, m) : D_MIN(a, m);
+    }
+    if (i > 0) {
+        double t[W64];
+        D_STORE(t, m);
+        for (int k=0; k<W64; k++) {
+            if (max? (*r < t[k]) : (t[k] < *r)) *r = t[k];
+        }
+    }
+    return i;
+}
+
+/* SSE2 doesn't have signed 32bit min and max; we select by comparison. */
+static KATTR int KFN(s32_minmax)(int max, const ScmInt32 *x, int n, long *r)
+{
+    int i = 0;
+    VI m = I_SET1_32((ScmInt32)*r);
+    for (; i+W32 <= n; i+=W32) {
+        VI a = I_LOAD(x+i);
+        VI c = max? I_CMPGT32(a, m) : I_CMPGT32(m, a);
+        m = I_OR(I_AND(c, a), I_ANDNOT(c, m));
+    }
+    if (i > 0) {
+        ScmInt32 t[W32];
+        I_STORE(t, m);
+        for (int k=0; k<W32; k++) {
+            if (max? (*r < t[k]) : (t[k] < *r)) *r = t[k];
+        }
+    }
+    return i;
+}
+
+static KATTR int KFN(u8_minmax)(int max, const unsigned char *x, int n,
+                                long *r)
+{
+    int i = 0;
+    VI m = I_SET1_8(*r);
+    for (; i+W8 <= n; i+=W8) {
+        VI a = I_LOAD(x+i);
+        m = max? I_MAX_U8(a, m) : I_MIN_U8(a, m);
+    }
+    if (i > 0) {
+        unsigned char t[W8];
+        I_STORE(t, m);
+        for (int k=0; k<W8; k++) {
+            if (max? (*r < t[k]) : (t[k] < *r)) *r = t[k];
+        }
+    }
+    return i;
+}
+
+/*=============================================================
+ * Cleanup
+ */
+
+#undef KFN
+#undef KATTR
+#undef W8
+#undef W32
+#undef W64
+
+#undef VF
+#undef F_LOAD
+#undef F_STORE
+#undef F_SET1
+#undef F_ADD
+#undef F_SUB
+#undef F_MUL
+#undef F_DIV
+#undef F_MIN
+#undef F_MAX
+#undef F_CMPLT
+#undef F_CMPGT
+#undef F_CMPUNORD
+#undef F_OR
+#undef F_MOVEMASK
+#undef F_TO_D_LO
+#undef F_TO_D_HI
+#undef D_TO_F
+
+#undef VD
+#undef D_LOAD
+#undef D_STORE
+#undef D_SET1
+#undef D_ZERO
+#undef D_ADD
+#undef D_SUB
+#undef D_MUL
+#undef D_DIV
+#undef D_MIN
+#undef D_MAX
+#undef D_CMPLT
+#undef D_CMPGT
+#undef D_CMPUNORD
+#undef D_OR
+#undef D_MOVEMASK
+
+#undef VI
+#undef I_LOAD
+#undef I_STORE
+#undef I_ZERO
+#undef I_SET1_8
+#undef I_SET1_16
+#undef I_SET1_32
+#undef I_SET1_64
+#undef I_AND
+#undef I_OR
+#undef I_XOR
+#undef I_ANDNOT
+#undef I_ADD8
+#undef I_ADD32
+#undef I_SUB32
+#undef I_ADD64
+#undef I_SUB64
+#undef I_ADDS_U8
+#undef I_SUBS_U8
+#undef I_MAX_U8
+#undef I_MIN_U8
+#undef I_CMPEQ8
+#undef I_CMPEQ16
+#undef I_CMPEQ32
+#undef I_CMPGT32
+#undef I_SRAI32
+#undef I_SRLI16
+#undef I_SRLI64
+#undef I_SLLI64
+#undef I_UNPACKLO8
+#undef I_UNPACKHI8
+#undef I_UNPACKLO32
+#undef I_UNPACKHI32
+#undef I_MULLO16
+#undef I_MADD16
+#undef I_SAD_U8
+#undef I_PACKUS16
+#undef I_MOVEMASK8
+#undef I_MASK_ALL
+#undef I_MUL32X64
@@ -0,0 +1,97 @@
+;;
+;; Compare the codecs of rfc.zlib by compression ratio and throughput.
+;; Run in the build directory:
+;;
+;;   ../../src/gosh -ftest ./bench.scm [FILE] [THREADS]
+;;
+;; Without FILE, synthesized log-like text is used.
+;;
+
+(use gauche.time)
+(use gauche.uvector)
+(use srfi-27)
+(use file.util)
+
+(load "./zlib")
+(import rfc.zlib)
+
+(define *data-size* (* 16 1024 1024))
+
+(define (synthesize)
+  (with-output-to-string
+    (^[] (let loop ([n 0] [t 1410000000])
+           (when (< n *data-size*)
+             (let1 line (format "~d host~d sshd[~d]: ~a from 10.0.~d.~d port ~d\n"
+                                t (random-integer 8) (random-integer 30000)
+                                (vector-ref #("Accepted publickey" "Failed password"
+                                              "Connection closed" "Invalid user")
+                                            (random-integer 4))
+                                (random-integer 256) (random-integer 256)
+                                (+ 1024 (random-integer 60000)))
+               (display line)
+               (loop (+ n (string-size line)) (+ t (random-integer 3)))))))))
+
+(define (compress-with open data)
+  (call-with-output-string
+    (^p (let1 p2 (open p)
+          (write-uvector data p2)
+          (close-output-port p2)))))
+
+(define (decompress-with open str)
+  (let1 in (open (open-input-string str))
+    (let loop ()
+      (unless (eof-object? (read-uvector <u8vector> 65536 in))
+        (loop)))))
+
+(define (fmt val mincol digs)
+  (let* ([scale (expt 10 digs)]
+         [n (round->exact (* val scale))])
+    (format "~vd.~v,'0d" mincol (div n scale) digs (mod n scale))))
+
+(define (mb/s bytes counter)
+  (/. bytes 1048576 (time-counter-value counter)))
+
+(define (bench name open-c open-d data)
+  (let ([ct (make <real-time-counter>)]
+        [dt (make <real-time-counter>)]
+        [size (u8vector-length data)]
+        [z #f])
+    (with-time-counter ct (set! z (compress-with open-c data)))
+    (with-time-counter dt (decompress-with open-d z))
+    (format #t "~24a ~a ~a ~a\n" name
+            (fmt (/. size (string-size z)) 2 3)
+            (fmt (mb/s size ct) 8 1) (fmt (mb/s size dt) 8 1))))
+
+(define (main args)
+  (let* ([data (string->u8vector
+                (if (and (>= (length args) 2) (not (equal? (cadr args) "-")))
+                  (file->string (cadr args))
+                  (synthesize)))]
+         [nthr (if (>= (length args) 3) (string->number (caddr args)) 4)])
+    (format #t "~d bytes, ~d threads for parallel modes\n"
+            (u8vector-length data) nthr)
+    (format #t "~24a ~6a ~10@a ~10@a\n" "codec" "ratio" "comp MB/s" "decomp MB/s")
+    (dolist [level '(1 6)]
+      (bench #"deflate -~level"
+             (cut open-deflating-port <> :compression-level level)
+             open-inflating-port data))
+    (bench #"deflate -6 threads=~nthr"
+           (cut open-deflating-port <> :threads nthr)
+           open-inflating-port data)
+    (dolist [accel '(1 8)]
+      (bench #"lz4 accel=~accel"
+             (cut open-lz4-compressing-port <> :acceleration accel)
+             open-lz4-decompressing-port data))
+    (bench #"lz4 threads=~nthr"
+           (cut open-lz4-compressing-port <> :block-size 262144 :threads nthr)
+           open-lz4-decompressing-port data)
+    (when (global-variable-bound? 'rfc.zlib 'open-zstd-compressing-port)
+      (let ([open-c (global-variable-ref 'rfc.zlib 'open-zstd-compressing-port)]
+            [open-d (global-variable-ref 'rfc.zlib 'open-zstd-decompressing-port)])
+        (dolist [level '(1 3 9)]
+          (bench #"zstd -~level"
+                 (cut open-c <> :compression-level level) open-d data))
+        (bench #"zstd -3 threads=~nthr"
+               (cut open-c <> :compression-level 3 :threads nthr)
+               open-d data))))
+  0)
@@ -0,0 +1,498 @@
+/*
+ * gauche-lz4.c - LZ4 compressing and decompressing ports
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * The ports read and write the LZ4 frame format, as described in
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Frame_format.md
+ * so that the data can be exchanged with the lz4 command.
+ *
+ * The compressing port accumulates the data in its buffer, and
+ * compresses it by blocks.  The blocks are made independent from
+ * each other, so when the port has more than one thread, the buffer
+ * can hold as many blocks as the threads and compress them in parallel.
+ * The decompressing port accepts dependent blocks as well.
+ */
+
+#include "gauche-zlib.h"
+#include <gauche/class.h>
+
+#define LZ4_MAGIC            0x184D2204U
+#define LZ4_SKIPPABLE_MAGIC  0x184D2A50U /* lower 4 bits are arbitrary */
+
+/* FLG byte */
+#define FLG_VERSION          0x40
+#define FLG_VERSION_MASK     0xc0
+#define FLG_BLOCK_INDEP      0x20
+#define FLG_BLOCK_CHECKSUM   0x10
+#define FLG_CONTENT_SIZE     0x08
+#define FLG_CONTENT_CHECKSUM 0x04
+#define FLG_DICT_ID          0x01
+
+#define UNCOMPRESSED_BIT     0x80000000U
+#define HISTORY_SIZE         65536
+
+#define DEFAULT_BLOCK_SIZE   65536
+#define DEFAULT_BUFFER_SIZE  4096
+
+static ScmClass *port_cpl[] = {
+    SCM_CLASS_STATIC_PTR(Scm_PortClass),
+    SCM_CLASS_STATIC_PTR(Scm_TopClass),
+    NULL
+};
+
+SCM_DEFINE_BASE_CLASS(Scm_LZ4CompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+SCM_DEFINE_BASE_CLASS(Scm_LZ4DecompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+static void put_le32(unsigned char *p, ScmUInt32 v)
+{
+    p[0] = v & 0xff;
+    p[1] = (v >> 8) & 0xff;
+    p[2] = (v >> 16) & 0xff;
+    p[3] = (v >> 24) & 0xff;
+}
+
+static ScmUInt32 get_le32(const unsigned char *p)
+{
+    return (ScmUInt32)p[0] | ((ScmUInt32)p[1] << 8)
+        | ((ScmUInt32)p[2] << 16) | ((ScmUInt32)p[3] << 24);
+}
+
+/* Block maximum size id in BD byte <-> size */
+static int block_size_id(int size)
+{
+    int id = 4;
+    while (id < 7 && (65536 << (2*(id-4))) < size) id++;
+    return id;
+}
+
+#define BLOCK_SIZE_OF_ID(id)  (65536 << (2*((id)-4)))
+
+static ScmObj port_name(const char *type, ScmPort *remote)
+{
+    ScmObj out = Scm_MakeOutputStringPort(TRUE);
+    Scm_Printf(SCM_PORT(out), "[%s %A]", type, Scm_PortName(remote));
+    return Scm_GetOutputStringUnsafe(SCM_PORT(out), 0);
+}
+
+static int lz4_fileno(ScmPort *port)
+{
+    return Scm_PortFileNo(SCM_PORT_LZ4_INFO(port)->remote);
+}
+
+/*================================================================
+ * Compressing port
+ */
+
+typedef struct ScmLZ4JobRec {
+    const unsigned char *src;
+    size_t srclen;
+    unsigned char *dst;
+    size_t dstlen;              /* 0 if incompressible */
+    int accel;
+} lz4_job;
+
+static void compress_job(void *data, int i)
+{
+    lz4_job *job = ((lz4_job*)data) + i;
+    /* If the result isn't smaller than the input, we store it as is. */
+    job->dstlen = Scm__LZ4CompressBlock(job->src, job->srclen,
+                                        job->dst, job->srclen - 1,
+                                        job->accel);
+}
+
+static void write_frame_header(ScmLZ4Info *info)
+{
+    unsigned char hdr[7];
+    put_le32(hdr, LZ4_MAGIC);
+    hdr[4] = (unsigned char)info->flags;
+    hdr[5] = (unsigned char)(block_size_id(info->blocksize) << 4);
+    hdr[6] = (unsigned char)((Scm__XXH32(hdr+4, 2, 0) >> 8) & 0xff);
+    Scm_Putz((char*)hdr, 7, info->remote);
+    info->in_frame = TRUE;
+}
+
+/* Compresses and writes out up to info->nthreads blocks from SRC,
+   whose length is LEN.  Returns the number of bytes consumed. */
+static int write_blocks(ScmLZ4Info *info, const unsigned char *src, int len)
+{
+    int nblocks = (len + info->blocksize - 1) / info->blocksize;
+    int bound = SCM_LZ4_COMPRESS_BOUND(info->blocksize);
+
+    if (nblocks > info->nthreads) nblocks = info->nthreads;
+    for (int i = 0; i < nblocks; i++) {
+        lz4_job *job = &info->jobs[i];
+        int off = i * info->blocksize;
+        job->src = src + off;
+        job->srclen = (len - off < info->blocksize)
+            ? len - off : info->blocksize;
+        job->dst = info->buf + i * bound;
+        job->accel = info->accel;
+    }
+    Scm__ZlibParallelFor(nblocks, info->nthreads, compress_job, info->jobs);
+
+    int total = 0;
+    for (int i = 0; i < nblocks; i++) {
+        lz4_job *job = &info->jobs[i];
+        unsigned char size[4];
+        if (job->dstlen > 0) {
+            put_le32(size, (ScmUInt32)job->dstlen);
+            Scm_Putz((char*)size, 4, info->remote);
+            Scm_Putz((char*)job->dst, (int)job->dstlen, info->remote);
+        } else {
+            put_le32(size, (ScmUInt32)job->srclen | UNCOMPRESSED_BIT);
+            Scm_Putz((char*)size, 4, info->remote);
+            Scm_Putz((char*)job->src, (int)job->srclen, info->remote);
+        }
+        if (info->flags & FLG_CONTENT_CHECKSUM) {
+            Scm__XXH32Update(&info->xxh, job->src, job->srclen);
+        }
+        total += (int)job->srclen;
+    }
+    return total;
+}
+
+/* The buffer has room for SCM_CHAR_MAX_BYTES beyond nthreads blocks,
+   so when the port asks for room, we usually have full blocks to emit
+   and keep the remainder for the next block.  We emit a partial block
+   when asked to flush everything, or when there's no full block at all,
+   since the flusher must make some room. */
+static int lz4_flusher(ScmPort *port, int cnt, int forcep)
+{
+    ScmLZ4Info *info = SCM_PORT_LZ4_INFO(port);
+    const unsigned char *inbuf = (const unsigned char*)port->src.buf.buffer;
+    int avail = SCM_PORT_BUFFER_AVAIL(port);
+    int total = 0;
+
+    if (avail == 0) return 0;
+    if (!info->in_frame) write_frame_header(info);
+
+    if (!forcep) {
+        int len = (avail / info->blocksize) * info->blocksize;
+        return write_blocks(info, inbuf, (len > 0) ? len : avail);
+    }
+    while (total < avail) {
+        total += write_blocks(info, inbuf + total, avail - total);
+    }
+    return total;
+}
+
+static void lz4_compress_closer(ScmPort *port)
+{
+    ScmLZ4Info *info = SCM_PORT_LZ4_INFO(port);
+    unsigned char trailer[8];
+    int len = 4;
+
+    /* The buffered data has been flushed by the port's cleanup. */
+    if (!info->in_frame) write_frame_header(info);
+    put_le32(trailer, 0);       /* EndMark */
+    if (info->flags & FLG_CONTENT_CHECKSUM) {
+        put_le32(trailer+4, Scm__XXH32Digest(&info->xxh));
+        len = 8;
+    }
+    Scm_Putz((char*)trailer, len, info->remote);
+    Scm_Flush(info->remote);
+    if (info->ownerp) {
+        Scm_ClosePort(info->remote);
+    }
+}
+
+ScmObj Scm_MakeLZ4CompressingPort(ScmPort *sink, int blocksize,
+                                  int accel, int checksum,
+                                  int nthreads, int ownerp)
+{
+    ScmLZ4Info *info = SCM_NEW(ScmLZ4Info);
+
+    if (blocksize <= 0) blocksize = DEFAULT_BLOCK_SIZE;
+    if (nthreads < 1) nthreads = 1;
+    if (nthreads > SCM_ZLIB_MAX_THREADS) nthreads = SCM_ZLIB_MAX_THREADS;
+
+    info->remote = sink;
+    info->ownerp = ownerp;
+    info->blocksize = BLOCK_SIZE_OF_ID(block_size_id(blocksize));
+    info->flags = FLG_VERSION | FLG_BLOCK_INDEP
+        | (checksum ? FLG_CONTENT_CHECKSUM : 0);
+    info->accel = (accel < 1) ? 1 : accel;
+    info->nthreads = nthreads;
+    info->in_frame = FALSE;
+    info->stream_endp = FALSE;
+    Scm__XXH32Init(&info->xxh, 0);
+    info->buf = SCM_NEW_ATOMIC2(unsigned char*,
+                                SCM_LZ4_COMPRESS_BOUND(info->blocksize)
+                                * nthreads);
+    info->jobs = SCM_NEW_ARRAY(lz4_job, nthreads);
+    info->window = NULL;
+    info->histlen = 0;
+    info->pos = 0;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = info->blocksize * nthreads + SCM_CHAR_MAX_BYTES;
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = NULL;
+    bufrec.flusher = lz4_flusher;
+    bufrec.closer = lz4_compress_closer;
+    bufrec.ready = NULL;
+    bufrec.filenum = lz4_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("lz4-compressing", sink);
+    return Scm_MakeBufferedPort(SCM_CLASS_LZ4_COMPRESSING_PORT, name,
+                                SCM_PORT_OUTPUT, TRUE, &bufrec);
+}
+
+/*================================================================
+ * Decompressing port
+ */
+
+/* Reads exactly N bytes, or signals an error.  If EOF_OK is true and
+   we're at EOF before reading anything, returns FALSE. */
+static int read_exact(ScmLZ4Info *info, unsigned char *buf, int n,
+                      int eof_ok)
+{
+    int nread = 0;
+    while (nread < n) {
+        int r = Scm_Getz((char*)buf + nread, n - nread, info->remote);
+        if (r <= 0) {
+            if (nread == 0 && eof_ok) return FALSE;
+            Scm_ZlibPortError(info->remote, Z_DATA_ERROR,
+                              "lz4: unexpected end of input");
+        }
+        nread += r;
+    }
+    return TRUE;
+}
+
+static void lz4_data_error(ScmLZ4Info *info, const char *what)
+{
+    Scm_ZlibPortError(info->remote, Z_DATA_ERROR, "lz4: %s", what);
+}
+
+/* Reads a frame header.  Returns FALSE if we're at EOF. */
+static int read_frame_header(ScmLZ4Info *info)
+{
+    unsigned char hdr[15];
+
+    for (;;) {
+        if (!read_exact(info, hdr, 4, TRUE)) return FALSE;
+        ScmUInt32 magic = get_le32(hdr);
+        if (magic == LZ4_MAGIC) break;
+        if ((magic & 0xfffffff0U) != LZ4_SKIPPABLE_MAGIC) {
+            lz4_data_error(info, "bad magic number");
+        }
+        /* Skippable frame */
+        read_exact(info, hdr, 4, FALSE);
+        for (ScmUInt32 len = get_le32(hdr); len > 0;) {
+            int k = (len > sizeof(hdr)) ? (int)sizeof(hdr) : (int)len;
+            read_exact(info, hdr, k, FALSE);
+            len -= k;
+        }
+    }
+
+    read_exact(info, hdr, 2, FALSE);
+    int flg = hdr[0], bd = hdr[1];
+    int len = 2;
+    if ((flg & FLG_VERSION_MASK) != FLG_VERSION) {
+        lz4_data_error(info, "unsupported frame version");
+    }
+    if (flg & FLG_DICT_ID) {
+        lz4_data_error(info, "frames with dictionary aren't supported");
+    }
+    if (flg & FLG_CONTENT_SIZE) len += 8;
+    read_exact(info, hdr+2, len-2+1, FALSE); /* optional fields and HC */
+    if (hdr[len] != ((Scm__XXH32(hdr, len, 0) >> 8) & 0xff)) {
+        lz4_data_error(info, "frame header checksum mismatch");
+    }
+    int bsid = (bd >> 4) & 7;
+    if (bsid < 4) lz4_data_error(info, "bad block maximum size");
+
+    int blocksize = BLOCK_SIZE_OF_ID(bsid);
+    if (blocksize > info->blocksize) {
+        info->buf = SCM_NEW_ATOMIC2(unsigned char*, blocksize);
+        info->window = SCM_NEW_ATOMIC2(unsigned char*,
+                                       HISTORY_SIZE + blocksize);
+    }
+    info->blocksize = blocksize;
+    info->flags = flg;
+    info->histlen = 0;
+    info->pos = 0;
+    Scm__XXH32Init(&info->xxh, 0);
+    info->in_frame = TRUE;
+    return TRUE;
+}
+
+/* Decodes the next block into the window.  Returns the number of
+   decoded bytes, which is 0 at the end of input. */
+static int read_block(ScmLZ4Info *info)
+{
+    unsigned char word[4];
+
+    for (;;) {
+        if (!info->in_frame && !read_frame_header(info)) return 0;
+        read_exact(info, word, 4, FALSE);
+        ScmUInt32 size = get_le32(word);
+        if (size == 0) {
+            /* EndMark */
+            if (info->flags & FLG_CONTENT_CHECKSUM) {
+                read_exact(info, word, 4, FALSE);
+                if (get_le32(word) != Scm__XXH32Digest(&info->xxh)) {
+                    lz4_data_error(info, "content checksum mismatch");
+                }
+            }
+            info->in_frame = FALSE;
+            continue;
+        }
+
+        int uncompressed = (size & UNCOMPRESSED_BIT) != 0;
+        size &= ~UNCOMPRESSED_BIT;
+        if (size > (ScmUInt32)info->blocksize) {
+            lz4_data_error(info, "block too large");
+        }
+        read_exact(info, info->buf, size, FALSE);
+        if (info->flags & FLG_BLOCK_CHECKSUM) {
+            read_exact(info, word, 4, FALSE);
+            if (get_le32(word) != Scm__XXH32(info->buf, size, 0)) {
+                lz4_data_error(info, "block checksum mismatch");
+            }
+        }
+
+        /* Dependent blocks may refer to the last 64KB of the previous
+           output, so we keep it at the beginning of the window. */
+        if (info->flags & FLG_BLOCK_INDEP) {
+            info->histlen = 0;
+        } else if (info->histlen > HISTORY_SIZE) {
+            memmove(info->window,
+                    info->window + info->histlen - HISTORY_SIZE,
+                    HISTORY_SIZE);
+            info->histlen = HISTORY_SIZE;
+        }
+        unsigned char *dst = info->window + info->histlen;
+        long n;
+        if (uncompressed) {
+            memcpy(dst, info->buf, size);
+            n = size;
+        } else {
+            n = Scm__LZ4DecompressBlock(info->buf, size, dst,
+                                        info->blocksize, info->window);
+            if (n < 0) lz4_data_error(info, "corrupted block");
+        }
+        if (info->flags & FLG_CONTENT_CHECKSUM) {
+            Scm__XXH32Update(&info->xxh, dst, n);
+        }
+        info->pos = info->histlen;
+        info->histlen += (int)n;
+        if (n > 0) return (int)n;
+    }
+}
+
+static int lz4_filler(ScmPort *port, int mincnt)
+{
+    ScmLZ4Info *info = SCM_PORT_LZ4_INFO(port);
+
+    if (info->stream_endp) return 0;
+    if (info->pos == info->histlen && read_block(info) == 0) {
+        info->stream_endp = TRUE;
+        return 0;
+    }
+    int n = info->histlen - info->pos;
+    int room = SCM_PORT_BUFFER_ROOM(port);
+    if (n > room) n = room;
+    memcpy(port->src.buf.end, info->window + info->pos, n);
+    info->pos += n;
+    return n;
+}
+
+static void lz4_decompress_closer(ScmPort *port)
+{
+    ScmLZ4Info *info = SCM_PORT_LZ4_INFO(port);
+    if (info->ownerp) {
+        Scm_ClosePort(info->remote);
+    }
+}
+
+static int lz4_ready(ScmPort *port)
+{
+    ScmLZ4Info *info = SCM_PORT_LZ4_INFO(port);
+    return (info->pos < info->histlen);
+}
+
+ScmObj Scm_MakeLZ4DecompressingPort(ScmPort *source, int bufsiz,
+                                    int ownerp)
+{
+    ScmLZ4Info *info = SCM_NEW(ScmLZ4Info);
+
+    if (bufsiz <= 0) bufsiz = DEFAULT_BUFFER_SIZE;
+
+    info->remote = source;
+    info->ownerp = ownerp;
+    info->blocksize = 0;        /* buffers are allocated by the header */
+    info->flags = 0;
+    info->accel = 0;
+    info->nthreads = 1;
+    info->in_frame = FALSE;
+    info->stream_endp = FALSE;
+    info->buf = NULL;
+    info->jobs = NULL;
+    info->window = NULL;
+    info->histlen = 0;
+    info->pos = 0;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = bufsiz;
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufsiz);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = lz4_filler;
+    bufrec.flusher = NULL;
+    bufrec.closer = lz4_decompress_closer;
+    bufrec.ready = lz4_ready;
+    bufrec.filenum = lz4_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("lz4-decompressing", source);
+    return Scm_MakeBufferedPort(SCM_CLASS_LZ4_DECOMPRESSING_PORT, name,
+                                SCM_PORT_INPUT, TRUE, &bufrec);
+}
+
+void Scm__InitLZ4Ports(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_LZ4CompressingPortClass,
+                        "<lz4-compressing-port>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_LZ4DecompressingPortClass,
+                        "<lz4-decompressing-port>", mod, NULL, 0);
+}
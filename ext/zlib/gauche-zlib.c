@@ -222,6 +222,74 @@ static ScmObj port_name(const char *type, ScmPort *source)
     return Scm_GetOutputStringUnsafe(SCM_PORT(out), 0);
 }
 
+/*================================================================
+ * Parallel work
+ */
+
+/* We spawn the threads for each call and let them pick up the work
+   items one by one.  The work items are usually large enough (a block
+   of compression) to amortize the cost of thread creation. */
+
+typedef struct parwork_rec {
+    void (*proc)(void*, int);
+    void *data;
+    int n;
+    int next;
+    ScmInternalMutex mutex;
+} parwork;
+
+#if defined(GAUCHE_USE_PTHREADS)
+static void *parwork_run(void *arg)
+{
+    parwork *w = (parwork*)arg;
+    for (;;) {
+        (void)SCM_INTERNAL_MUTEX_LOCK(w->mutex);
+        int i = w->next++;
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(w->mutex);
+        if (i >= w->n) break;
+        w->proc(w->data, i);
+    }
+    return NULL;
+}
+#endif /*GAUCHE_USE_PTHREADS*/
+
+void Scm__ZlibParallelFor(int n, int nthreads,
+                          void (*proc)(void*, int), void *data)
+{
+#if defined(GAUCHE_USE_PTHREADS)
+    if (nthreads > n) nthreads = n;
+    if (nthreads > SCM_ZLIB_MAX_THREADS) nthreads = SCM_ZLIB_MAX_THREADS;
+    if (nthreads > 1) {
+        parwork w;
+        pthread_t threads[SCM_ZLIB_MAX_THREADS];
+        sigset_t all, omask;
+        int nspawned = 0;
+
+        w.proc = proc;
+        w.data = data;
+        w.n = n;
+        w.next = 0;
+        SCM_INTERNAL_MUTEX_INIT(w.mutex);
+        /* Signals should be handled by the calling thread. */
+        sigfillset(&all);
+        pthread_sigmask(SIG_SETMASK, &all, &omask);
+        for (int i = 0; i < nthreads - 1; i++) {
+            if (pthread_create(&threads[nspawned], NULL, parwork_run, &w) == 0) {
+                nspawned++;
+            }
+        }
+        pthread_sigmask(SIG_SETMASK, &omask, NULL);
+        parwork_run(&w);
+        for (int i = 0; i < nspawned; i++) {
+            pthread_join(threads[i], NULL);
+        }
+        SCM_INTERNAL_MUTEX_DESTROY(w.mutex);
+        return;
+    }
+#endif /*GAUCHE_USE_PTHREADS*/
+    for (int i = 0; i < n; i++) proc(data, i);
+}
+
 /*================================================================
  * Deflating port
  */
@@ -344,6 +412,9 @@ ScmObj Scm_MakeDeflatingPort(ScmPort *source, int level,
     info->stream_endp = FALSE;
     info->level = level;
     info->strategy = strategy;
+    info->nthreads = 1;
+    info->window = NULL;
+    info->jobs = NULL;
 
     ScmPortBuffer bufrec;
     memset(&bufrec, 0, sizeof(bufrec));
@@ -362,6 +433,351 @@ ScmObj Scm_MakeDeflatingPort(ScmPort *source, int level,
                                 SCM_PORT_OUTPUT, TRUE, &bufrec);
 }
 
+/*================================================================
+ * Parallel deflating port
+ */
+
+/* This is the same idea as pigz.  The input is cut into blocks, and
+ * each block is compressed as a raw deflate stream by its own z_stream,
+ * with the last window of the preceding input given as the dictionary,
+ * so the compression ratio is almost the same as the sequential one.
+ * Each block is ended by Z_SYNC_FLUSH, which aligns the output to
+ * a byte boundary, so the compressed blocks can just be concatenated.
+ * We add zlib or gzip header and trailer by ourselves; the checksum
+ * of each block is computed in parallel, and combined.
+ *
+ * The port buffer holds as many blocks as the threads.  When it gets
+ * full, the blocks are compressed in parallel, then written out in
+ * order.  The output doesn't depend on the number of threads.
+ */
+
+#define PAR_BLOCK_SIZE   (128*1024)
+#define PAR_WINDOW_SIZE  32768
+
+typedef struct ScmZlibJobRec {
+    z_streamp strm;
+    int level;                  /* current parameters of strm */
+    int strategy;
+    const unsigned char *src;
+    int srclen;
+    const unsigned char *dict;
+    int dictlen;
+    unsigned char *dst;
+    int dstsize;
+    int dstlen;
+    int gzip;                   /* use crc32 instead of adler32 */
+    unsigned long check;
+    int error;                  /* zlib error code, or Z_OK */
+    /* set by the caller */
+    int new_level;
+    int new_strategy;
+} zjob;
+
+static void deflate_job(void *data, int i)
+{
+    zjob *job = ((zjob*)data) + i;
+    z_streamp strm = job->strm;
+    int r = deflateReset(strm);
+
+    if (r == Z_OK && (job->level != job->new_level
+                      || job->strategy != job->new_strategy)) {
+        r = deflateParams(strm, job->new_level, job->new_strategy);
+        job->level = job->new_level;
+        job->strategy = job->new_strategy;
+    }
+    if (r == Z_OK && job->dictlen > 0) {
+        r = deflateSetDictionary(strm, job->dict, job->dictlen);
+    }
+    if (r == Z_OK) {
+        strm->next_in = (unsigned char*)job->src;
+        strm->avail_in = job->srclen;
+        strm->next_out = job->dst;
+        strm->avail_out = job->dstsize;
+        r = deflate(strm, Z_SYNC_FLUSH);
+        /* dstsize is large enough to take the whole output at once */
+        if (r == Z_OK && (strm->avail_in > 0 || strm->avail_out == 0)) {
+            r = Z_BUF_ERROR;
+        }
+        job->dstlen = job->dstsize - strm->avail_out;
+    }
+    if (job->gzip) {
+        job->check = crc32(crc32(0L, NULL, 0), job->src, job->srclen);
+    } else {
+        job->check = adler32(adler32(0L, NULL, 0), job->src, job->srclen);
+    }
+    job->error = r;
+}
+
+static void par_write_header(ScmZlibInfo *info)
+{
+    unsigned char hdr[10];
+    int level = (info->level == Z_DEFAULT_COMPRESSION) ? 6 : info->level;
+
+    if (info->window_bits > 15) {
+        /* gzip, with the same fields as zlib's */
+        memset(hdr, 0, 10);
+        hdr[0] = 0x1f;
+        hdr[1] = 0x8b;
+        hdr[2] = Z_DEFLATED;
+        hdr[8] = (level == 9) ? 2
+            : ((info->strategy >= Z_HUFFMAN_ONLY || level < 2) ? 4 : 0);
+        hdr[9] = 3;             /* OS_CODE (unix) */
+        Scm_Putz((char*)hdr, 10, info->remote);
+    } else if (info->window_bits > 0) {
+        unsigned int h = (Z_DEFLATED + ((info->window_bits - 8) << 4)) << 8;
+        int flevel = (info->strategy >= Z_HUFFMAN_ONLY || level < 2) ? 0
+            : (level < 6) ? 1 : (level == 6) ? 2 : 3;
+        h |= flevel << 6;
+        if (!SCM_FALSEP(info->dict_adler)) h |= 0x20; /* FDICT */
+        h += 31 - (h % 31);
+        hdr[0] = (h >> 8) & 0xff;
+        hdr[1] = h & 0xff;
+        int len = 2;
+        if (!SCM_FALSEP(info->dict_adler)) {
+            unsigned long id = Scm_GetIntegerU(info->dict_adler);
+            hdr[2] = (id >> 24) & 0xff;
+            hdr[3] = (id >> 16) & 0xff;
+            hdr[4] = (id >> 8) & 0xff;
+            hdr[5] = id & 0xff;
+            len = 6;
+        }
+        Scm_Putz((char*)hdr, len, info->remote);
+    }
+    info->header_written = TRUE;
+}
+
+static int par_deflate_flusher(ScmPort *port, int cnt, int forcep)
+{
+    ScmZlibInfo *info = SCM_PORT_ZLIB_INFO(port);
+    z_streamp strm = SCM_PORT_ZSTREAM(port);
+    const unsigned char *inbuf = (const unsigned char*)port->src.buf.buffer;
+    int avail = SCM_PORT_BUFFER_AVAIL(port);
+    int nblocks = avail / PAR_BLOCK_SIZE;
+    int wsize = 1 << ((info->window_bits > 15)
+                      ? info->window_bits - 16
+                      : (info->window_bits < 0)
+                      ? -info->window_bits : info->window_bits);
+    if (wsize > PAR_WINDOW_SIZE) wsize = PAR_WINDOW_SIZE;
+
+    /* We emit a partial block only when asked to flush everything. */
+    if (forcep && avail % PAR_BLOCK_SIZE) nblocks++;
+    if (nblocks == 0) {
+        if (forcep && info->flush == Z_FULL_FLUSH) {
+            info->use_dict = FALSE;
+            info->windowlen = 0;
+            info->flush = Z_NO_FLUSH;
+        }
+        return 0;
+    }
+    if (!info->header_written) par_write_header(info);
+
+    for (int i = 0; i < nblocks; i++) {
+        zjob *job = &info->jobs[i];
+        int off = i * PAR_BLOCK_SIZE;
+        job->src = inbuf + off;
+        job->srclen = (avail - off < PAR_BLOCK_SIZE)
+            ? avail - off : PAR_BLOCK_SIZE;
+        if (i == 0) {
+            job->dict = info->use_dict ? info->window : NULL;
+            job->dictlen = info->use_dict ? info->windowlen : 0;
+        } else {
+            job->dict = job->src - wsize;
+            job->dictlen = wsize;
+        }
+        job->new_level = info->level;
+        job->new_strategy = info->strategy;
+    }
+    Scm__ZlibParallelFor(nblocks, info->nthreads, deflate_job, info->jobs);
+
+    int total = 0;
+    for (int i = 0; i < nblocks; i++) {
+        zjob *job = &info->jobs[i];
+        if (job->error != Z_OK) {
+            Scm_ZlibError(job->error, "deflate failed: %s",
+                          job->strm->msg ? job->strm->msg : "(no message)");
+        }
+        Scm_Putz((char*)job->dst, job->dstlen, info->remote);
+        if (job->gzip) {
+            info->check = crc32_combine(info->check, job->check, job->srclen);
+        } else {
+            info->check = adler32_combine(info->check, job->check,
+                                          job->srclen);
+        }
+        strm->total_out += job->dstlen;
+        total += job->srclen;
+    }
+    strm->total_in += total;
+    strm->adler = info->check;
+
+    /* Keep the last window for the next block.  After a full flush,
+       the next block shouldn't refer to the preceding data. */
+    if (total >= wsize) {
+        memcpy(info->window, inbuf + total - wsize, wsize);
+        info->windowlen = wsize;
+    } else {
+        int keep = wsize - total;
+        if (keep > info->windowlen) keep = info->windowlen;
+        memmove(info->window, info->window + info->windowlen - keep, keep);
+        memcpy(info->window + keep, inbuf, total);
+        info->windowlen = keep + total;
+    }
+    info->use_dict = TRUE;
+    if (info->flush == Z_FULL_FLUSH && forcep) {
+        info->use_dict = FALSE;
+        info->windowlen = 0;
+    }
+    info->flush = Z_NO_FLUSH;
+    return total;
+}
+
+static void par_deflate_closer(ScmPort *port)
+{
+    ScmZlibInfo *info = SCM_PORT_ZLIB_INFO(port);
+    z_streamp strm = SCM_PORT_ZSTREAM(port);
+    /* An empty final block with fixed Huffman codes */
+    static const unsigned char last_block[2] = { 0x03, 0x00 };
+    unsigned char trailer[8];
+
+    /* The buffered data has been flushed by the port's cleanup. */
+    if (!info->header_written) par_write_header(info);
+    Scm_Putz((const char*)last_block, 2, info->remote);
+    strm->total_out += 2;
+    if (info->window_bits > 15) {
+        unsigned long len = strm->total_in;
+        for (int i = 0; i < 4; i++) {
+            trailer[i] = (info->check >> (i*8)) & 0xff;
+            trailer[i+4] = (len >> (i*8)) & 0xff;
+        }
+        Scm_Putz((char*)trailer, 8, info->remote);
+    } else if (info->window_bits > 0) {
+        for (int i = 0; i < 4; i++) {
+            trailer[i] = (info->check >> ((3-i)*8)) & 0xff;
+        }
+        Scm_Putz((char*)trailer, 4, info->remote);
+    }
+
+    for (int i = 0; i < info->nthreads; i++) {
+        deflateEnd(info->jobs[i].strm);
+    }
+    int r = deflateEnd(strm);
+    if (r != Z_OK) {
+        Scm_ZlibError(r, "deflateEnd failed: %s", strm->msg);
+    }
+    Scm_Flush(info->remote);
+    if (info->ownerp) {
+        Scm_ClosePort(info->remote);
+    }
+}
+
+static z_streamp par_deflate_init(int level, int window_bits, int memlevel,
+                                  int strategy)
+{
+    z_streamp strm = SCM_NEW_ATOMIC2(z_streamp, sizeof(z_stream));
+    strm->zalloc = NULL;
+    strm->zfree = NULL;
+    strm->opaque = NULL;
+    strm->next_in = NULL;
+    strm->avail_in = 0;
+    int r = deflateInit2(strm, level, Z_DEFLATED, window_bits,
+                         memlevel, strategy);
+    if (r != Z_OK) {
+        Scm_ZlibError(r, "deflateInit2 error: %s", strm->msg);
+    }
+    return strm;
+}
+
+ScmObj Scm_MakeParallelDeflatingPort(ScmPort *sink, int level,
+                                     int window_bits, int memlevel,
+                                     int strategy, ScmObj dict,
+                                     int nthreads, int ownerp)
+{
+    ScmZlibInfo *info = SCM_NEW(ScmZlibInfo);
+
+    if (nthreads > SCM_ZLIB_MAX_THREADS) nthreads = SCM_ZLIB_MAX_THREADS;
+    /* Raw deflate doesn't accept 8-bit window; zlib uses 9 in that case,
+       even for zlib and gzip formats, so we follow it. */
+    if (window_bits == 8 || window_bits == -8 || window_bits == 24) {
+        window_bits += (window_bits > 0) ? 1 : -1;
+    }
+
+    /* This stream isn't used to compress, but it validates the parameters
+       and keeps the statistics for zstream-total-in etc. */
+    z_streamp strm = par_deflate_init(level, window_bits, memlevel, strategy);
+    int raw_bits = (window_bits > 15) ? -(window_bits - 16)
+        : (window_bits > 0) ? -window_bits : window_bits;
+
+    info->window = SCM_NEW_ATOMIC2(unsigned char*, PAR_WINDOW_SIZE);
+    info->windowlen = 0;
+    info->use_dict = FALSE;
+    info->dict_adler = SCM_FALSE;
+    if (!SCM_FALSEP(dict)) {
+        if (!SCM_STRINGP(dict))
+            Scm_Error("String required, but got %S", dict);
+        if (window_bits > 15)
+            Scm_Error("gzip format can't have a dictionary");
+        const ScmStringBody *b = SCM_STRING_BODY(dict);
+        const char *start = SCM_STRING_BODY_START(b);
+        int len = SCM_STRING_BODY_SIZE(b);
+        int r = deflateSetDictionary(strm, (const unsigned char*)start, len);
+        if (r != Z_OK) {
+            Scm_ZlibError(r, "deflateSetDictionary failed: %s", strm->msg);
+        }
+        info->dict_adler = Scm_MakeIntegerU(strm->adler);
+        /* The first block starts with the dictionary. */
+        if (len > PAR_WINDOW_SIZE) {
+            start += len - PAR_WINDOW_SIZE;
+            len = PAR_WINDOW_SIZE;
+        }
+        memcpy(info->window, start, len);
+        info->windowlen = len;
+        info->use_dict = TRUE;
+    }
+
+    info->jobs = SCM_NEW_ARRAY(zjob, nthreads);
+    for (int i = 0; i < nthreads; i++) {
+        zjob *job = &info->jobs[i];
+        job->strm = par_deflate_init(level, raw_bits, memlevel, strategy);
+        job->level = level;
+        job->strategy = strategy;
+        job->dstsize = deflateBound(job->strm, PAR_BLOCK_SIZE) + 64;
+        job->dst = SCM_NEW_ATOMIC2(unsigned char*, job->dstsize);
+        job->gzip = (window_bits > 15);
+    }
+
+    info->strm = strm;
+    info->remote = sink;
+    info->bufsiz = 0;
+    info->buf = NULL;
+    info->ptr = NULL;
+    info->ownerp = ownerp;
+    info->flush = Z_NO_FLUSH;
+    info->stream_endp = FALSE;
+    info->level = level;
+    info->strategy = strategy;
+    info->nthreads = nthreads;
+    info->window_bits = window_bits;
+    info->header_written = FALSE;
+    info->check = (window_bits > 15)
+        ? crc32(0L, NULL, 0) : adler32(0L, NULL, 0);
+    strm->adler = info->check;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = PAR_BLOCK_SIZE * nthreads;
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = NULL;
+    bufrec.flusher = par_deflate_flusher;
+    bufrec.closer = par_deflate_closer;
+    bufrec.ready = NULL;
+    bufrec.filenum = zlib_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("deflating", sink);
+    return Scm_MakeBufferedPort(SCM_CLASS_DEFLATING_PORT, name,
+                                SCM_PORT_OUTPUT, TRUE, &bufrec);
+}
+
 /*================================================================
  * Inflating port
  */
@@ -493,6 +909,9 @@ ScmObj Scm_MakeInflatingPort(ScmPort *sink, int bufsiz,
     info->level = 0;
     info->strategy = 0;
     info->dict_adler = SCM_FALSE;
+    info->nthreads = 1;
+    info->window = NULL;
+    info->jobs = NULL;
 
     ScmPortBuffer bufrec;
     memset(&bufrec, 0, sizeof(bufrec));
@@ -553,6 +972,250 @@ ScmObj Scm_InflateSync(ScmPort *port)
     return Scm_MakeIntegerU(strm->total_in - curr_in);
 }
 
+/*================================================================
+ * One-shot conversion
+ */
+
+/* These convert a whole data at once, without creating ports.  Setting
+ * up and tearing down a port (with its buffers and a finalizer) costs
+ * much more than the conversion itself when the data is small.
+ *
+ * The z_stream is allocated by zlib's default allocator, so we have to
+ * make sure to call inflateEnd/deflateEnd before throwing an error.
+ */
+
+static const unsigned char *get_dict(ScmObj dict, int *len)
+{
+    if (SCM_FALSEP(dict)) {
+        *len = 0;
+        return NULL;
+    }
+    if (!SCM_STRINGP(dict)) {
+        Scm_Error("String required, but got %S", dict);
+    }
+    const ScmStringBody *b = SCM_STRING_BODY(dict);
+    *len = SCM_STRING_BODY_SIZE(b);
+    return (const unsigned char*)SCM_STRING_BODY_START(b);
+}
+
+/* Wraps the output buffer with a u8vector.  If the buffer has too much
+   unused space, we copy the content so that the big buffer can be
+   reclaimed. */
+static ScmObj make_result(unsigned char *buf, int len, int cap)
+{
+    if (len < cap/2) return Scm_MakeU8VectorFromArray(len, buf);
+    else return Scm_MakeU8VectorFromArrayShared(len, buf);
+}
+
+ScmObj Scm_DeflateBytes(const unsigned char *src, int size,
+                        int level, int window_bits, int memlevel,
+                        int strategy, ScmObj dict)
+{
+    z_stream strm;
+    int dictlen;
+    const unsigned char *d = get_dict(dict, &dictlen);
+
+    memset(&strm, 0, sizeof(strm));
+    int r = deflateInit2(&strm, level, Z_DEFLATED, window_bits,
+                         memlevel, strategy);
+    if (r != Z_OK) {
+        Scm_ZlibError(r, "deflateInit2 error: %s", strm.msg);
+    }
+    if (d != NULL) {
+        r = deflateSetDictionary(&strm, d, dictlen);
+        if (r != Z_OK) {
+            deflateEnd(&strm);
+            Scm_ZlibError(r, "deflateSetDictionary failed");
+        }
+    }
+
+    /* deflateBound is enough to take the whole output by one call. */
+    int cap = deflateBound(&strm, size);
+    unsigned char *buf = SCM_NEW_ATOMIC2(unsigned char*, cap);
+    strm.next_in = (unsigned char*)src;
+    strm.avail_in = size;
+    strm.next_out = buf;
+    strm.avail_out = cap;
+    r = deflate(&strm, Z_FINISH);
+    int len = strm.total_out;
+    deflateEnd(&strm);
+    if (r != Z_STREAM_END) {
+        Scm_ZlibError(Z_STREAM_ERROR, "deflate failed (%d)", r);
+    }
+    return make_result(buf, len, cap);
+}
+
+/* Runs inflate until it consumes all the input, fills the output, or
+   reaches the end of the stream.  Returns Z_STREAM_END if the stream
+   is complete, or Z_OK otherwise.  On error, ends the stream and
+   throws. */
+static int oneshot_inflate(z_streamp strm,
+                           const unsigned char *dict, int dictlen)
+{
+    for (;;) {
+        int r = inflate(strm, Z_SYNC_FLUSH);
+        switch (r) {
+        case Z_STREAM_END:
+            return r;
+        case Z_OK:
+            if (strm->avail_in == 0 || strm->avail_out == 0) return r;
+            continue;
+        case Z_BUF_ERROR:
+            /* no progress is possible; the caller checks which buffer
+               needs to be refilled. */
+            return Z_OK;
+        case Z_NEED_DICT:
+            if (dict == NULL) {
+                inflateEnd(strm);
+                Scm_ZlibError(r, "dictionary required");
+            }
+            r = inflateSetDictionary(strm, dict, dictlen);
+            if (r != Z_OK) {
+                inflateEnd(strm);
+                Scm_ZlibError(r, "inflateSetDictionary error");
+            }
+            continue;
+        default: {
+            /* zlib's messages are static strings */
+            const char *msg = strm->msg ? strm->msg : "(no message)";
+            inflateEnd(strm);
+            if (r != Z_DATA_ERROR && r != Z_MEM_ERROR) r = Z_STREAM_ERROR;
+            Scm_ZlibError(r, "inflate error: %s", msg);
+        }
+        }
+    }
+}
+
+static void oneshot_inflate_init(z_streamp strm, int window_bits,
+                                  const unsigned char *dict, int dictlen)
+{
+    memset(strm, 0, sizeof(z_stream));
+    int r = inflateInit2(strm, window_bits);
+    if (r != Z_OK) {
+        Scm_ZlibError(r, "inflateInit2 error: %s", strm->msg);
+    }
+    /* Raw deflate stream doesn't ask for the dictionary. */
+    if (window_bits < 0 && dict != NULL) {
+        r = inflateSetDictionary(strm, dict, dictlen);
+        if (r != Z_OK) {
+            inflateEnd(strm);
+            Scm_ZlibError(r, "inflateSetDictionary error");
+        }
+    }
+}
+
+ScmObj Scm_InflateBytes(const unsigned char *src, int size,
+                        int window_bits, ScmObj dict, int size_hint)
+{
+    z_stream strm;
+    int dictlen;
+    const unsigned char *d = get_dict(dict, &dictlen);
+    int cap = (size_hint > 0) ? size_hint : (size < 64 ? 256 : size*4);
+    unsigned char *buf = SCM_NEW_ATOMIC2(unsigned char*, cap);
+
+    oneshot_inflate_init(&strm, window_bits, d, dictlen);
+    strm.next_in = (unsigned char*)src;
+    strm.avail_in = size;
+    strm.next_out = buf;
+    strm.avail_out = cap;
+    for (;;) {
+        if (oneshot_inflate(&strm, d, dictlen) == Z_STREAM_END) break;
+        if (strm.avail_out > 0) {
+            inflateEnd(&strm);
+            Scm_ZlibError(Z_DATA_ERROR, "compressed data ended prematurely");
+        }
+        int newcap = cap * 2;
+        unsigned char *newbuf = SCM_NEW_ATOMIC2(unsigned char*, newcap);
+        memcpy(newbuf, buf, cap);
+        buf = newbuf;
+        strm.next_out = buf + cap;
+        strm.avail_out = newcap - cap;
+        cap = newcap;
+    }
+    int len = strm.total_out;
+    inflateEnd(&strm);
+    return make_result(buf, len, cap);
+}
+
+/* Inflates the compressed data SOURCE, which may be a u8vector, a string
+   or an input port, into DST[start..end).  Returns the number of bytes
+   stored.  The output must fit in the region.  If SOURCE is a port,
+   we may read past the end of the compressed stream. */
+int Scm_InflateInto(ScmUVector *dst, int start, int end, ScmObj source,
+                    int window_bits, ScmObj dict)
+{
+    z_stream strm;
+    int dictlen;
+    const unsigned char *d = get_dict(dict, &dictlen);
+    const unsigned char *src = NULL;
+    int srcsize = 0;
+    ScmPort *port = NULL;
+    unsigned char inbuf[CHUNK];
+    /* When the region is filled, we let inflate write into this extra
+       byte, to see if the stream ends there or it overflows.  */
+    unsigned char extra;
+    volatile int r = Z_OK;
+
+    SCM_UVECTOR_CHECK_MUTABLE(dst);
+    SCM_CHECK_START_END(start, end, (int)SCM_UVECTOR_SIZE(dst));
+    if (SCM_U8VECTORP(source)) {
+        src = (const unsigned char*)SCM_UVECTOR_ELEMENTS(source);
+        srcsize = SCM_U8VECTOR_SIZE(source);
+    } else if (SCM_STRINGP(source)) {
+        const ScmStringBody *b = SCM_STRING_BODY(source);
+        src = (const unsigned char*)SCM_STRING_BODY_START(b);
+        srcsize = SCM_STRING_BODY_SIZE(b);
+    } else if (SCM_IPORTP(source)) {
+        port = SCM_PORT(source);
+    } else {
+        Scm_Error("u8vector, string or input port required, but got: %S",
+                  source);
+    }
+
+    oneshot_inflate_init(&strm, window_bits, d, dictlen);
+    strm.next_in = (unsigned char*)src;
+    strm.avail_in = srcsize;
+    strm.next_out = (unsigned char*)SCM_UVECTOR_ELEMENTS(dst) + start;
+    strm.avail_out = end - start;
+
+    SCM_UNWIND_PROTECT {
+        for (;;) {
+            r = oneshot_inflate(&strm, d, dictlen);
+            if (r == Z_STREAM_END) break;
+            if (strm.avail_out == 0) {
+                if (strm.next_out == &extra + 1) break; /* overflow */
+                strm.next_out = &extra;
+                strm.avail_out = 1;
+                continue;
+            }
+            if (port == NULL) break;                    /* truncated */
+            int n = Scm_Getz((char*)inbuf, CHUNK, port);
+            if (n <= 0) break;                          /* truncated */
+            strm.next_in = inbuf;
+            strm.avail_in = n;
+        }
+    }
+    SCM_WHEN_ERROR {
+        /* If the error is from zlib, the stream has already been ended;
+           calling inflateEnd again is harmless. */
+        inflateEnd(&strm);
+        SCM_NEXT_HANDLER;
+    }
+    SCM_END_PROTECT;
+
+    int len = strm.total_out;
+    int overflow = (strm.next_out == &extra + 1);
+    inflateEnd(&strm);
+    if (overflow) {
+        Scm_Error("inflated data doesn't fit in the given region (%d bytes)",
+                  end - start);
+    }
+    if (r != Z_STREAM_END) {
+        Scm_ZlibError(Z_DATA_ERROR, "compressed data ended prematurely");
+    }
+    return len;
+}
+
 /*
  * Module initialization function.
  */
@@ -597,6 +1260,9 @@ SCM_EXTENSION_ENTRY void Scm_Init_rfc__zlib(void)
                                 mod, cond_meta, SCM_FALSE,
                                 zliberror_slots, 0);
 
+    Scm__InitLZ4Ports(mod);
+    Scm__InitZstdPorts(mod);
+
     /* Register stub-generated procedures */
     Scm_Init_zliblib(mod);
 }
@@ -61,6 +61,16 @@ typedef struct ScmZlibInfoRec {
     int level;
     int strategy;
     ScmObj dict_adler;
+    /* Parallel deflating.  The input is cut into blocks, each of which is
+       compressed separately with the preceding window as the dictionary. */
+    int nthreads;               /* > 1 if compressing in parallel */
+    int window_bits;
+    int header_written;
+    int use_dict;               /* the next block uses the window */
+    unsigned long check;        /* adler32 or crc32 of the input */
+    unsigned char *window;      /* the last input bytes of the window */
+    int windowlen;
+    struct ScmZlibJobRec *jobs; /* one for each thread */
 } ScmZlibInfo;
 
 #define SCM_PORT_ZLIB_INFO(p) ((ScmZlibInfo*)(p)->src.buf.data)
@@ -77,10 +87,94 @@ extern ScmObj Scm_MakeDeflatingPort(ScmPort *source, int level,
                                     int window_bits, int memlevel,
                                     int strategy, ScmObj dict,
                                     int bufsiz, int ownerp);
+extern ScmObj Scm_MakeParallelDeflatingPort(ScmPort *sink, int level,
+                                            int window_bits, int memlevel,
+                                            int strategy, ScmObj dict,
+                                            int nthreads, int ownerp);
 extern ScmObj Scm_MakeInflatingPort(ScmPort *sink, int bufsiz,
                                     int window_bits, ScmObj dict,
                                     int ownerp);
 
+extern ScmObj Scm_DeflateBytes(const unsigned char *src, int size,
+                               int level, int window_bits, int memlevel,
+                               int strategy, ScmObj dict);
+extern ScmObj Scm_InflateBytes(const unsigned char *src, int size,
+                               int window_bits, ScmObj dict, int size_hint);
+extern int    Scm_InflateInto(ScmUVector *dst, int start, int end,
+                              ScmObj source, int window_bits, ScmObj dict);
+
+/*================================================================
+ * LZ4 ports
+ */
+
+#include "lz4codec.h"
+
+typedef struct ScmLZ4InfoRec {
+    ScmPort *remote;            /* sink or source port */
+    int ownerp;
+    int blocksize;              /* maximum block size of the frame */
+    int flags;                  /* FLG byte of the frame descriptor */
+    int accel;
+    int nthreads;
+    int in_frame;               /* frame header is written / read */
+    int stream_endp;
+    ScmXXH32State xxh;          /* for content checksum */
+    unsigned char *buf;         /* compressed blocks */
+    struct ScmLZ4JobRec *jobs;  /* compressing: one for each block */
+    unsigned char *window;      /* decompressing: history + decoded block */
+    int histlen;                /* decompressing: used part of window */
+    int pos;                    /* decompressing: start of unread data */
+} ScmLZ4Info;
+
+#define SCM_PORT_LZ4_INFO(p) ((ScmLZ4Info*)(p)->src.buf.data)
+
+SCM_CLASS_DECL(Scm_LZ4CompressingPortClass);
+#define SCM_CLASS_LZ4_COMPRESSING_PORT  (&Scm_LZ4CompressingPortClass)
+#define SCM_LZ4_COMPRESSING_PORT_P(obj) SCM_ISA(obj, SCM_CLASS_LZ4_COMPRESSING_PORT)
+SCM_CLASS_DECL(Scm_LZ4DecompressingPortClass);
+#define SCM_CLASS_LZ4_DECOMPRESSING_PORT  (&Scm_LZ4DecompressingPortClass)
+#define SCM_LZ4_DECOMPRESSING_PORT_P(obj) SCM_ISA(obj, SCM_CLASS_LZ4_DECOMPRESSING_PORT)
+
+extern ScmObj Scm_MakeLZ4CompressingPort(ScmPort *sink, int blocksize,
+                                         int accel, int checksum,
+                                         int nthreads, int ownerp);
+extern ScmObj Scm_MakeLZ4DecompressingPort(ScmPort *source, int bufsiz,
+                                           int ownerp);
+
+/*================================================================
+ * Zstandard ports (only if libzstd is available)
+ */
+
+#if defined(HAVE_ZSTD_H)
+#include <zstd.h>
+#include <zstd_errors.h>
+
+typedef struct ScmZstdInfoRec {
+    ScmPort *remote;            /* sink or source port */
+    int ownerp;
+    ZSTD_CCtx *cctx;
+    ZSTD_DCtx *dctx;
+    ZSTD_inBuffer in;           /* decompressing: pending input */
+    char *buf;
+    size_t bufsiz;
+    size_t last_result;         /* decompressing: 0 at frame boundary */
+    int stream_endp;
+} ScmZstdInfo;
+
+#define SCM_PORT_ZSTD_INFO(p) ((ScmZstdInfo*)(p)->src.buf.data)
+
+SCM_CLASS_DECL(Scm_ZstdCompressingPortClass);
+#define SCM_CLASS_ZSTD_COMPRESSING_PORT  (&Scm_ZstdCompressingPortClass)
+#define SCM_ZSTD_COMPRESSING_PORT_P(obj) SCM_ISA(obj, SCM_CLASS_ZSTD_COMPRESSING_PORT)
+SCM_CLASS_DECL(Scm_ZstdDecompressingPortClass);
+#define SCM_CLASS_ZSTD_DECOMPRESSING_PORT  (&Scm_ZstdDecompressingPortClass)
+#define SCM_ZSTD_DECOMPRESSING_PORT_P(obj) SCM_ISA(obj, SCM_CLASS_ZSTD_DECOMPRESSING_PORT)
+
+extern ScmObj Scm_MakeZstdCompressingPort(ScmPort *sink, int level,
+                                          int nthreads, int ownerp);
+extern ScmObj Scm_MakeZstdDecompressingPort(ScmPort *source, int ownerp);
+#endif /*HAVE_ZSTD_H*/
+
 /*================================================================
  * Conditions
  */
@@ -124,8 +218,26 @@ SCM_CLASS_DECL(Scm_ZlibVersionErrorClass);
 
 extern ScmObj Scm_MakeZlibError(ScmObj message, int error_code);
 extern void Scm_ZlibError(int error_code, const char *msg, ...);
+extern void Scm_ZlibPortError(ScmPort *port, int error_code,
+                              const char *msg, ...);
 extern ScmObj Scm_InflateSync(ScmPort *port);
 
+/*================================================================
+ * Utilities
+ */
+
+/* Calls PROC(DATA, i) for i = 0, ..., N-1, on up to NTHREADS threads
+   (including the calling thread) if available.  Returns after all calls
+   finish.  PROC must not touch Scheme objects or allocate from the heap. */
+extern void Scm__ZlibParallelFor(int n, int nthreads,
+                                 void (*proc)(void*, int), void *data);
+
+#define SCM_ZLIB_MAX_THREADS 64
+
+/* Called from Scm_Init_rfc__zlib */
+extern void Scm__InitLZ4Ports(ScmModule *mod);
+extern void Scm__InitZstdPorts(ScmModule *mod);
+
 /* Epilogue */
 SCM_DECL_END
 
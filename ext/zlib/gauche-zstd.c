@@ -0,0 +1,268 @@
+/*
+ * gauche-zstd.c - Zstandard compressing and decompressing ports
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * Thin port wrappers of libzstd's streaming API.  They're available
+ * only if libzstd is found at configuration time.
+ */
+
+#include "gauche-zlib.h"
+#include <gauche/class.h>
+
+#if defined(HAVE_ZSTD_H)
+
+#define CHUNK 4096
+
+static ScmClass *port_cpl[] = {
+    SCM_CLASS_STATIC_PTR(Scm_PortClass),
+    SCM_CLASS_STATIC_PTR(Scm_TopClass),
+    NULL
+};
+
+SCM_DEFINE_BASE_CLASS(Scm_ZstdCompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+SCM_DEFINE_BASE_CLASS(Scm_ZstdDecompressingPortClass,
+                      ScmPort, /* instance type */
+                      NULL, NULL, NULL, NULL, port_cpl);
+
+static ScmObj port_name(const char *type, ScmPort *remote)
+{
+    ScmObj out = Scm_MakeOutputStringPort(TRUE);
+    Scm_Printf(SCM_PORT(out), "[%s %A]", type, Scm_PortName(remote));
+    return Scm_GetOutputStringUnsafe(SCM_PORT(out), 0);
+}
+
+static int zstd_fileno(ScmPort *port)
+{
+    return Scm_PortFileNo(SCM_PORT_ZSTD_INFO(port)->remote);
+}
+
+/* zstd errors are either data errors or resource errors */
+static void zstd_error(ScmZstdInfo *info, size_t r)
+{
+    int code = (ZSTD_getErrorCode(r) == ZSTD_error_memory_allocation)
+        ? Z_MEM_ERROR : Z_DATA_ERROR;
+    Scm_ZlibPortError(info->remote, code, "zstd: %s", ZSTD_getErrorName(r));
+}
+
+/*================================================================
+ * Compressing port
+ */
+
+/* Feeds the data to the compressor with the directive END_OP, until
+   the compressor takes it all (and flushes everything, if END_OP
+   asks so). */
+static void zstd_compress(ScmZstdInfo *info, const char *data, size_t len,
+                          ZSTD_EndDirective end_op)
+{
+    ZSTD_inBuffer in = { data, len, 0 };
+    char outbuf[CHUNK];
+
+    for (;;) {
+        ZSTD_outBuffer out = { outbuf, CHUNK, 0 };
+        size_t r = ZSTD_compressStream2(info->cctx, &out, &in, end_op);
+        if (ZSTD_isError(r)) zstd_error(info, r);
+        if (out.pos > 0) Scm_Putz(outbuf, (int)out.pos, info->remote);
+        if (end_op == ZSTD_e_continue ? in.pos == in.size : r == 0) break;
+    }
+}
+
+static int zstd_flusher(ScmPort *port, int cnt, int forcep)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    int avail = SCM_PORT_BUFFER_AVAIL(port);
+    zstd_compress(info, port->src.buf.buffer, avail,
+                  forcep ? ZSTD_e_flush : ZSTD_e_continue);
+    return avail;
+}
+
+static void zstd_compress_closer(ScmPort *port)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    if (info->cctx == NULL) return;
+    zstd_compress(info, NULL, 0, ZSTD_e_end);
+    ZSTD_freeCCtx(info->cctx);
+    info->cctx = NULL;
+    Scm_Flush(info->remote);
+    if (info->ownerp) {
+        Scm_ClosePort(info->remote);
+    }
+}
+
+ScmObj Scm_MakeZstdCompressingPort(ScmPort *sink, int level,
+                                   int nthreads, int ownerp)
+{
+    ScmZstdInfo *info = SCM_NEW(ScmZstdInfo);
+
+    info->cctx = ZSTD_createCCtx();
+    if (info->cctx == NULL) {
+        Scm_ZlibError(Z_MEM_ERROR, "zstd: couldn't create a context");
+    }
+    size_t r = ZSTD_CCtx_setParameter(info->cctx, ZSTD_c_compressionLevel,
+                                      level);
+    if (ZSTD_isError(r)) {
+        ZSTD_freeCCtx(info->cctx);
+        Scm_ZlibError(Z_STREAM_ERROR, "zstd: bad compression level: %d",
+                      level);
+    }
+    if (nthreads > 1) {
+        /* This fails if libzstd is built without multithread support,
+           in which case we just compress on the calling thread. */
+        (void)ZSTD_CCtx_setParameter(info->cctx, ZSTD_c_nbWorkers, nthreads);
+    }
+    info->dctx = NULL;
+    info->remote = sink;
+    info->ownerp = ownerp;
+    info->buf = NULL;
+    info->bufsiz = 0;
+    info->last_result = 0;
+    info->stream_endp = FALSE;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = (int)ZSTD_CStreamInSize();
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = NULL;
+    bufrec.flusher = zstd_flusher;
+    bufrec.closer = zstd_compress_closer;
+    bufrec.ready = NULL;
+    bufrec.filenum = zstd_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("zstd-compressing", sink);
+    return Scm_MakeBufferedPort(SCM_CLASS_ZSTD_COMPRESSING_PORT, name,
+                                SCM_PORT_OUTPUT, TRUE, &bufrec);
+}
+
+/*================================================================
+ * Decompressing port
+ */
+
+static int zstd_filler(ScmPort *port, int mincnt)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    ZSTD_outBuffer out = { port->src.buf.end, SCM_PORT_BUFFER_ROOM(port), 0 };
+
+    if (info->stream_endp) return 0;
+    while (out.pos == 0) {
+        if (info->in.pos == info->in.size) {
+            int nread = Scm_Getz(info->buf, (int)info->bufsiz, info->remote);
+            if (nread <= 0) {
+                info->stream_endp = TRUE;
+                if (info->last_result != 0) {
+                    Scm_ZlibPortError(info->remote, Z_DATA_ERROR,
+                                      "zstd: unexpected end of input");
+                }
+                break;
+            }
+            info->in.src = info->buf;
+            info->in.size = nread;
+            info->in.pos = 0;
+        }
+        size_t r = ZSTD_decompressStream(info->dctx, &out, &info->in);
+        if (ZSTD_isError(r)) zstd_error(info, r);
+        info->last_result = r;
+    }
+    return (int)out.pos;
+}
+
+static void zstd_decompress_closer(ScmPort *port)
+{
+    ScmZstdInfo *info = SCM_PORT_ZSTD_INFO(port);
+    if (info->dctx == NULL) return;
+    ZSTD_freeDCtx(info->dctx);
+    info->dctx = NULL;
+    if (info->ownerp) {
+        Scm_ClosePort(info->remote);
+    }
+}
+
+static int zstd_ready(ScmPort *port)
+{
+    return 0;
+}
+
+ScmObj Scm_MakeZstdDecompressingPort(ScmPort *source, int ownerp)
+{
+    ScmZstdInfo *info = SCM_NEW(ScmZstdInfo);
+
+    info->dctx = ZSTD_createDCtx();
+    if (info->dctx == NULL) {
+        Scm_ZlibError(Z_MEM_ERROR, "zstd: couldn't create a context");
+    }
+    info->cctx = NULL;
+    info->remote = source;
+    info->ownerp = ownerp;
+    info->bufsiz = ZSTD_DStreamInSize();
+    info->buf = SCM_NEW_ATOMIC2(char *, info->bufsiz);
+    info->in.src = info->buf;
+    info->in.size = 0;
+    info->in.pos = 0;
+    info->last_result = 0;
+    info->stream_endp = FALSE;
+
+    ScmPortBuffer bufrec;
+    memset(&bufrec, 0, sizeof(bufrec));
+    bufrec.size = (int)ZSTD_DStreamOutSize();
+    bufrec.buffer = SCM_NEW_ATOMIC2(char *, bufrec.size);
+    bufrec.mode = SCM_PORT_BUFFER_FULL;
+    bufrec.filler = zstd_filler;
+    bufrec.flusher = NULL;
+    bufrec.closer = zstd_decompress_closer;
+    bufrec.ready = zstd_ready;
+    bufrec.filenum = zstd_fileno;
+    bufrec.data = (void*)info;
+
+    ScmObj name = port_name("zstd-decompressing", source);
+    return Scm_MakeBufferedPort(SCM_CLASS_ZSTD_DECOMPRESSING_PORT, name,
+                                SCM_PORT_INPUT, TRUE, &bufrec);
+}
+
+void Scm__InitZstdPorts(ScmModule *mod)
+{
+    Scm_InitStaticClass(&Scm_ZstdCompressingPortClass,
+                        "<zstd-compressing-port>", mod, NULL, 0);
+    Scm_InitStaticClass(&Scm_ZstdDecompressingPortClass,
+                        "<zstd-decompressing-port>", mod, NULL, 0);
+}
+
+#else  /*!HAVE_ZSTD_H*/
+
+void Scm__InitZstdPorts(ScmModule *mod)
+{
+}
+
+#endif /*!HAVE_ZSTD_H*/
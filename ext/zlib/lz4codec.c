@@ -0,0 +1,371 @@
+/*
+ * lz4codec.c - LZ4 block format and xxHash32
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/*
+ * An implementation of the LZ4 block format, as described in
+ * https://github.com/lz4/lz4/blob/dev/doc/lz4_Block_format.md
+ *
+ * A block is a sequence of (literals, match) pairs.  The compressor
+ * finds a match by looking up a hash table indexed by the next four
+ * bytes; it's a greedy one-pass search, which is what makes LZ4 fast.
+ * When it doesn't find a match for a while, it skips input faster,
+ * for incompressible data is likely to stay so.
+ */
+
+#include <gauche.h>
+#include "lz4codec.h"
+
+#define MINMATCH      4
+#define LASTLITERALS  5         /* the last 5 bytes are always literals */
+#define MFLIMIT       12        /* the last match starts before this */
+#define HASH_LOG      12
+#define SKIP_TRIGGER  6
+
+typedef unsigned char u8;
+
+static inline ScmUInt32 read32(const u8 *p)
+{
+    ScmUInt32 v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+static inline ScmUInt32 read_le32(const u8 *p)
+{
+    return (ScmUInt32)p[0] | ((ScmUInt32)p[1] << 8)
+        | ((ScmUInt32)p[2] << 16) | ((ScmUInt32)p[3] << 24);
+}
+
+static inline ScmUInt32 hash4(ScmUInt32 seq)
+{
+    return (seq * 2654435761U) >> (32 - HASH_LOG);
+}
+
+/* Returns the number of common bytes of p and m, up to limit. */
+static inline size_t count_match(const u8 *p, const u8 *m, const u8 *limit)
+{
+    const u8 *start = p;
+    while (p + 8 <= limit) {
+        ScmUInt64 a, b;
+        memcpy(&a, p, 8);
+        memcpy(&b, m, 8);
+        if (a != b) break;
+        p += 8; m += 8;
+    }
+    while (p < limit && *p == *m) { p++; m++; }
+    return p - start;
+}
+
+/* Emits a length that doesn't fit in the 4-bit field of the token. */
+static inline u8 *put_length(u8 *op, size_t len)
+{
+    while (len >= 255) { *op++ = 255; len -= 255; }
+    *op++ = (u8)len;
+    return op;
+}
+
+size_t Scm__LZ4CompressBlock(const u8 *src, size_t n,
+                             u8 *dst, size_t cap, int accel)
+{
+    const u8 *ip = src, *anchor = src;
+    const u8 *iend = src + n;
+    const u8 *mflimit = iend - MFLIMIT;
+    const u8 *matchlimit = iend - LASTLITERALS;
+    u8 *op = dst, *oend = dst + cap;
+
+    if (accel < 1) accel = 1;
+    if (n < MFLIMIT + 1) goto last_literals;
+
+    ScmUInt32 table[1<<HASH_LOG];
+    memset(table, 0, sizeof(table));
+    ip++;
+
+    for (;;) {
+        const u8 *match;
+        u8 *token;
+
+        /* Find a match */
+        {
+            const u8 *fwd = ip;
+            int step = accel;
+            int nsearch = accel << SKIP_TRIGGER;
+            do {
+                ScmUInt32 h = hash4(read32(fwd));
+                ip = fwd;
+                fwd += step;
+                step = nsearch++ >> SKIP_TRIGGER;
+                if (fwd > mflimit) goto last_literals;
+                match = src + table[h];
+                table[h] = (ScmUInt32)(ip - src);
+            } while (ip - match > SCM_LZ4_MAX_DISTANCE
+                     || read32(match) != read32(ip));
+        }
+
+        /* Extend it backwards */
+        while (ip > anchor && match > src && ip[-1] == match[-1]) {
+            ip--; match--;
+        }
+
+        /* Literals */
+        {
+            size_t litlen = ip - anchor;
+            if (op + litlen + litlen/255 + 1 + 2 + 1 > oend) return 0;
+            token = op++;
+            if (litlen >= 15) {
+                *token = 15 << 4;
+                op = put_length(op, litlen - 15);
+            } else {
+                *token = (u8)(litlen << 4);
+            }
+            memcpy(op, anchor, litlen);
+            op += litlen;
+        }
+
+      next_match:
+        /* Offset and match length */
+        {
+            size_t off = ip - match;
+            *op++ = (u8)off;
+            *op++ = (u8)(off >> 8);
+            ip += MINMATCH;
+            size_t mlen = count_match(ip, match + MINMATCH, matchlimit);
+            ip += mlen;
+            if (mlen >= 15) {
+                if (op + mlen/255 + 1 > oend) return 0;
+                *token += 15;
+                op = put_length(op, mlen - 15);
+            } else {
+                *token += (u8)mlen;
+            }
+        }
+        anchor = ip;
+        if (ip > mflimit) break;
+
+        /* Register the position we skipped, and see if we can
+           continue matching right away. */
+        table[hash4(read32(ip - 2))] = (ScmUInt32)(ip - 2 - src);
+        {
+            ScmUInt32 h = hash4(read32(ip));
+            match = src + table[h];
+            table[h] = (ScmUInt32)(ip - src);
+            if (ip - match <= SCM_LZ4_MAX_DISTANCE
+                && read32(match) == read32(ip)) {
+                if (op + 1 + 2 + 1 > oend) return 0;
+                token = op++;
+                *token = 0;
+                goto next_match;
+            }
+        }
+        ip++;
+    }
+
+  last_literals:
+    {
+        size_t litlen = iend - anchor;
+        if (op + litlen + litlen/255 + 1 > oend) return 0;
+        if (litlen >= 15) {
+            *op++ = 15 << 4;
+            op = put_length(op, litlen - 15);
+        } else {
+            *op++ = (u8)(litlen << 4);
+        }
+        memcpy(op, anchor, litlen);
+        op += litlen;
+    }
+    return op - dst;
+}
+
+/* Reads the extra bytes of a length.  Returns FALSE on overrun. */
+static inline int get_length(const u8 **pp, const u8 *end, size_t *len)
+{
+    const u8 *p = *pp;
+    unsigned int b;
+    do {
+        if (p >= end) return FALSE;
+        b = *p++;
+        *len += b;
+    } while (b == 255);
+    *pp = p;
+    return TRUE;
+}
+
+long Scm__LZ4DecompressBlock(const u8 *src, size_t n,
+                             u8 *dst, size_t cap, const u8 *low)
+{
+    const u8 *ip = src, *iend = src + n;
+    u8 *op = dst, *oend = dst + cap;
+
+    for (;;) {
+        if (ip >= iend) return -1;
+        unsigned int token = *ip++;
+
+        /* Literals */
+        size_t len = token >> 4;
+        if (len == 15 && !get_length(&ip, iend, &len)) return -1;
+        if ((size_t)(iend - ip) < len || (size_t)(oend - op) < len) return -1;
+        memcpy(op, ip, len);
+        op += len;
+        ip += len;
+        if (ip == iend) break;  /* the last sequence has no match */
+
+        /* Match */
+        if (iend - ip < 2) return -1;
+        size_t off = ip[0] | (ip[1] << 8);
+        ip += 2;
+        if (off == 0 || (size_t)(op - low) < off) return -1;
+        len = token & 15;
+        if (len == 15 && !get_length(&ip, iend, &len)) return -1;
+        len += MINMATCH;
+        if ((size_t)(oend - op) < len) return -1;
+
+        const u8 *m = op - off;
+        if (off >= len) {
+            memcpy(op, m, len);
+            op += len;
+        } else if (off >= 8) {
+            /* Overlapping, but each 8-byte chunk doesn't overlap itself */
+            u8 *mend = op + len;
+            while (op + 8 <= mend) { memcpy(op, m, 8); op += 8; m += 8; }
+            while (op < mend) *op++ = *m++;
+        } else {
+            u8 *mend = op + len;
+            while (op < mend) *op++ = *m++;
+        }
+    }
+    return op - dst;
+}
+
+/*
+ * xxHash32
+ */
+
+#define PRIME1  2654435761U
+#define PRIME2  2246822519U
+#define PRIME3  3266489917U
+#define PRIME4   668265263U
+#define PRIME5   374761393U
+
+static inline ScmUInt32 rotl(ScmUInt32 x, int r)
+{
+    return (x << r) | (x >> (32 - r));
+}
+
+static inline ScmUInt32 xxh_round(ScmUInt32 acc, ScmUInt32 input)
+{
+    acc += input * PRIME2;
+    acc = rotl(acc, 13);
+    return acc * PRIME1;
+}
+
+void Scm__XXH32Init(ScmXXH32State *s, ScmUInt32 seed)
+{
+    s->total = 0;
+    s->v[0] = seed + PRIME1 + PRIME2;
+    s->v[1] = seed + PRIME2;
+    s->v[2] = seed;
+    s->v[3] = seed - PRIME1;
+    s->memsize = 0;
+}
+
+/* Consumes 16-byte stripes; returns the pointer past the last one. */
+static const u8 *xxh_stripes(ScmUInt32 *v, const u8 *p, const u8 *end)
+{
+    ScmUInt32 v0 = v[0], v1 = v[1], v2 = v[2], v3 = v[3];
+    while (p + 16 <= end) {
+        v0 = xxh_round(v0, read_le32(p));
+        v1 = xxh_round(v1, read_le32(p+4));
+        v2 = xxh_round(v2, read_le32(p+8));
+        v3 = xxh_round(v3, read_le32(p+12));
+        p += 16;
+    }
+    v[0] = v0; v[1] = v1; v[2] = v2; v[3] = v3;
+    return p;
+}
+
+void Scm__XXH32Update(ScmXXH32State *s, const void *data, size_t n)
+{
+    const u8 *p = (const u8*)data, *end = p + n;
+    s->total += n;
+    if (s->memsize + n < 16) {
+        memcpy(s->mem + s->memsize, p, n);
+        s->memsize += (int)n;
+        return;
+    }
+    if (s->memsize > 0) {
+        int k = 16 - s->memsize;
+        memcpy(s->mem + s->memsize, p, k);
+        xxh_stripes(s->v, s->mem, s->mem + 16);
+        p += k;
+        s->memsize = 0;
+    }
+    p = xxh_stripes(s->v, p, end);
+    memcpy(s->mem, p, end - p);
+    s->memsize = (int)(end - p);
+}
+
+ScmUInt32 Scm__XXH32Digest(const ScmXXH32State *s)
+{
+    ScmUInt32 h;
+    if (s->total >= 16) {
+        h = rotl(s->v[0], 1) + rotl(s->v[1], 7)
+            + rotl(s->v[2], 12) + rotl(s->v[3], 18);
+    } else {
+        h = s->v[2] + PRIME5;   /* v[2] is the seed */
+    }
+    h += (ScmUInt32)s->total;
+
+    const u8 *p = s->mem, *end = s->mem + s->memsize;
+    while (p + 4 <= end) {
+        h += read_le32(p) * PRIME3;
+        h = rotl(h, 17) * PRIME4;
+        p += 4;
+    }
+    while (p < end) {
+        h += (*p++) * PRIME5;
+        h = rotl(h, 11) * PRIME1;
+    }
+    h ^= h >> 15;
+    h *= PRIME2;
+    h ^= h >> 13;
+    h *= PRIME3;
+    h ^= h >> 16;
+    return h;
+}
+
+ScmUInt32 Scm__XXH32(const void *data, size_t n, ScmUInt32 seed)
+{
+    ScmXXH32State s;
+    Scm__XXH32Init(&s, seed);
+    Scm__XXH32Update(&s, data, n);
+    return Scm__XXH32Digest(&s);
+}
@@ -0,0 +1,76 @@
+/*
+ * lz4codec.h - LZ4 block format and xxHash32
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#ifndef GAUCHE_LZ4CODEC_H
+#define GAUCHE_LZ4CODEC_H
+
+/*
+ * Compression and decompression of a single block in LZ4 block format,
+ * and xxHash32, which the LZ4 frame format uses for checksums.
+ * These don't touch Scheme objects, so they can be called from
+ * any thread.
+ */
+
+#define SCM_LZ4_MAX_DISTANCE 65535
+
+/* The maximum size of compressed data of N bytes input. */
+#define SCM_LZ4_COMPRESS_BOUND(n)  ((n) + (n)/255 + 16)
+
+/* Compresses N bytes at SRC into DST, which has room of CAP bytes.
+   Returns the size of compressed data, or 0 if it doesn't fit in CAP.
+   ACCEL >= 1 trades compression ratio for speed. */
+extern size_t Scm__LZ4CompressBlock(const unsigned char *src, size_t n,
+                                    unsigned char *dst, size_t cap,
+                                    int accel);
+
+/* Decompresses N bytes at SRC into DST, which has room of CAP bytes.
+   Matches may refer to the data before DST down to LOW, which is DST
+   itself for independent blocks.  Returns the size of decompressed data,
+   or -1 if the input is malformed. */
+extern long Scm__LZ4DecompressBlock(const unsigned char *src, size_t n,
+                                    unsigned char *dst, size_t cap,
+                                    const unsigned char *low);
+
+typedef struct ScmXXH32StateRec {
+    ScmUInt64 total;
+    ScmUInt32 v[4];
+    unsigned char mem[16];
+    int memsize;
+} ScmXXH32State;
+
+extern ScmUInt32 Scm__XXH32(const void *data, size_t n, ScmUInt32 seed);
+extern void Scm__XXH32Init(ScmXXH32State *s, ScmUInt32 seed);
+extern void Scm__XXH32Update(ScmXXH32State *s, const void *data, size_t n);
+extern ScmUInt32 Scm__XXH32Digest(const ScmXXH32State *s);
+
+#endif /*GAUCHE_LZ4CODEC_H*/
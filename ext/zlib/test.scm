@@ -357,4 +357,228 @@
               (v (inflate-sync in)))
          (list v (eof-object? (read-char in)))))
 
+;;------------------------------------------------------------------
+(test-section "one-shot conversion")
+
+(test* "deflate-u8vector" (string->u8vector (deflate-string "foobar"))
+       (deflate-u8vector "foobar"))
+(test* "deflate-u8vector (u8vector)" (string->u8vector (deflate-string "foobar"))
+       (deflate-u8vector (string->u8vector "foobar")))
+(test* "deflate-u8vector (empty)" (string->u8vector (deflate-string ""))
+       (deflate-u8vector #u8()))
+(test* "inflate-u8vector" (string->u8vector "foobar")
+       (inflate-u8vector (deflate-string "foobar")))
+
+(let ([data (string->u8vector (make-string 16537 #\x))])
+  (test* "inflate-u8vector (expansion)" data
+         (inflate-u8vector (deflate-u8vector data)))
+  (test* "inflate-u8vector :size-hint" data
+         (inflate-u8vector (deflate-u8vector data) :size-hint 10))
+  (test* "inflate-u8vector (gzip)" data
+         (inflate-u8vector (deflate-u8vector data :window-bits 31)
+                           :window-bits 31))
+  (test* "inflate-u8vector (raw with dictionary)" data
+         (inflate-u8vector (deflate-u8vector data :window-bits -15
+                                             :dictionary "xxxx")
+                           :window-bits -15 :dictionary "xxxx"))
+  (test* "inflate-u8vector!" '(16537 #t)
+         (let* ([v (make-u8vector 16537)]
+                [n (inflate-u8vector! v (deflate-u8vector data))])
+           (list n (equal? v data))))
+  (test* "inflate-u8vector! (port)" '(16537 #t)
+         (let* ([v (make-u8vector 20000 0)]
+                [n (inflate-u8vector! v (open-input-string
+                                         (deflate-string (u8vector->string data)))
+                                      :start 10)])
+           (list n (equal? (u8vector-copy v 10 (+ 10 n)) data))))
+  (test* "inflate-u8vector! (too small)" (test-error)
+         (inflate-u8vector! (make-u8vector 16536) (deflate-u8vector data)))
+  )
+
+(test* "inflate-u8vector (dictionary)" (string->u8vector "abcabc")
+       (inflate-u8vector (deflate-u8vector "abcabc" :dictionary "abc")
+                         :dictionary "abc"))
+(test* "inflate-u8vector (need dict)" 'OK
+       (guard (e [(<zlib-need-dict-error> e) 'OK])
+         (inflate-u8vector (deflate-u8vector "abcabc" :dictionary "abc"))))
+(test* "inflate-u8vector (truncated)" 'OK
+       (guard (e [(<zlib-data-error> e) 'OK])
+         (let1 z (deflate-u8vector "foobarbaz")
+           (inflate-u8vector (u8vector-copy z 0 5)))))
+(test* "inflate-u8vector (broken)" 'OK
+       (guard (e [(<zlib-data-error> e) 'OK])
+         (inflate-u8vector "abc")))
+
+;;------------------------------------------------------------------
+(test-section "parallel deflate")
+
+(let ([data (call-with-output-string
+              (^p (dotimes [i 40000]
+                    (format p "~a:~a " i (modulo (* i 7) 13)))))])
+  (define (pdeflate str . args)
+    (call-with-output-string
+      (^p (let1 p2 (apply open-deflating-port p args)
+            (display str p2)
+            (close-output-port p2)))))
+
+  (test* "open-deflating-port :threads" <deflating-port>
+         (class-of (open-deflating-port (open-output-string) :threads 2)))
+  (test* "parallel deflate (empty)" ""
+         (inflate-string (pdeflate "" :threads 2)))
+  (test* "parallel deflate (short)" "foobar"
+         (inflate-string (pdeflate "foobar" :threads 2)))
+  (test* "parallel deflate" #t
+         (equal? data (inflate-string (pdeflate data :threads 3))))
+  (test* "parallel deflate output doesn't depend on threads" #t
+         (equal? (pdeflate data :threads 2) (pdeflate data :threads 4)))
+  (test* "parallel deflate (gzip)" #t
+         (equal? data
+                 (gzip-decode-string
+                  (pdeflate data :threads 2 :window-bits 31))))
+  (test* "parallel deflate (raw)" #t
+         (equal? data
+                 (inflate-string (pdeflate data :threads 2 :window-bits -15)
+                                 :window-bits -15)))
+  (test* "parallel deflate (dictionary)" #t
+         (equal? data
+                 (inflate-string (pdeflate data :threads 2
+                                           :dictionary (substring data 0 300))
+                                 :dictionary (substring data 0 300))))
+  (test* "parallel deflate (gzip with dictionary)" (test-error)
+         (open-deflating-port (open-output-string) :threads 2
+                              :window-bits 31 :dictionary "abc"))
+  (test* "parallel deflate (flush)" "abcdefdef"
+         (inflate-string
+          (call-with-output-string
+            (^p (let1 p2 (open-deflating-port p :threads 2)
+                  (display "abc" p2)
+                  (flush p2)
+                  (display "def" p2)
+                  (deflating-port-full-flush p2)
+                  (display "def" p2)
+                  (close-output-port p2))))))
+  (test* "parallel deflate zstream-total-in" (string-size data)
+         (let1 p (open-deflating-port (open-output-string) :threads 2)
+           (display data p)
+           (close-output-port p)
+           (zstream-total-in p)))
+  (test* "parallel deflate zstream-adler32" (adler32 data)
+         (let1 p (open-deflating-port (open-output-string) :threads 2)
+           (display data p)
+           (close-output-port p)
+           (zstream-adler32 p)))
+  )
+
+;;------------------------------------------------------------------
+(test-section "lz4")
+
+(test* "<lz4-compressing-port>'s CPL" '(<lz4-compressing-port> <port> <top>)
+       (map class-name (class-precedence-list <lz4-compressing-port>)))
+
+(test* "lz4-encode-string / lz4-decode-string" "foobar"
+       (lz4-decode-string (lz4-encode-string "foobar")))
+
+(test* "lz4-encode-string / lz4-decode-string (empty)" ""
+       (lz4-decode-string (lz4-encode-string "")))
+
+;; output of the lz4 command
+(test* "lz4-decode-string (lz4 command)" "abcabcabcabcabcabcabcabcabcabc\n"
+       (lz4-decode-string
+        #*"\x04\x22M\x18d@\xa7\x0d\x00\x00\x00?abc\x03\x00\x04Pcabc\x0a\x00\x00\x00\x00\xe7\xe1\xcd\xca"))
+;; output of 'lz4 -BD -B4'; the second block refers to the first one.
+(let1 fox "The quick brown fox jumps over the lazy dog.\n"
+  (test* "lz4-decode-string (dependent blocks)"
+         (string-append (make-string (- 65536 (string-length fox)) #\a)
+                        fox fox fox)
+         (lz4-decode-string
+          (string-append
+           #*"\x04\x22M\x18@@\xc0\x34\x01\x00\x00\x1f\x61\x01\x00"
+           (make-byte-string 256 #xff)
+           #*"\xbf\xf0\x1eThe quick brown fox jumps over the lazy dog.\n\n\x00\x00\x00\x0f-\x00\x42Pdog.\n\x00\x00\x00\x00"))))
+
+(let ([data (with-output-to-string
+              (^[] (dotimes [i 30000]
+                     (format #t "~d ~a\n" (* i i) (make-string (modulo i 17) #\z)))))])
+  (define (roundtrip . args)
+    (let1 e (apply lz4-encode-string data args)
+      (and (< (string-size e) (string-size data))
+           (equal? data (lz4-decode-string e)))))
+  (test* "lz4 roundtrip" #t (roundtrip))
+  (test* "lz4 roundtrip :block-size 262144" #t (roundtrip :block-size 262144))
+  (test* "lz4 roundtrip :acceleration 8" #t (roundtrip :acceleration 8))
+  (test* "lz4 roundtrip :content-checksum #f" #t
+         (roundtrip :content-checksum #f))
+  (test* "lz4 roundtrip :threads 4" #t (roundtrip :threads 4))
+  (test* "lz4 :threads doesn't change the output"
+         (lz4-encode-string data)
+         (lz4-encode-string data :threads 3))
+  (test* "lz4 concatenated frames" (string-append data data)
+         (let1 e (lz4-encode-string data)
+           (lz4-decode-string (string-append e e))))
+  (test* "lz4 flush in the middle" (string-append data data)
+         (lz4-decode-string
+          (call-with-output-string
+            (^p (let1 p2 (open-lz4-compressing-port p)
+                  (display data p2)
+                  (flush p2)
+                  (display data p2)
+                  (close-output-port p2))))))
+  (test* "lz4 multibyte chars across a block boundary"
+         (string-append (make-string 65535 #\a) (make-string 10 #\x3042))
+         (lz4-decode-string
+          (call-with-output-string
+            (^p (let1 p2 (open-lz4-compressing-port p)
+                  (display (make-string 65535 #\a) p2)
+                  (dotimes [i 10] (write-char #\x3042 p2))
+                  (close-output-port p2))))))
+  (test* "lz4 read-uvector" (string->u8vector data)
+         (read-uvector <u8vector> (+ (string-size data) 1)
+                       (open-lz4-decompressing-port
+                        (open-input-string (lz4-encode-string data)))))
+  (test* "lz4 broken data" 'OK
+         (guard (e ((and (<zlib-data-error> e)
+                         (<io-read-error> e))
+                    'OK))
+           (let1 v (string->u8vector (lz4-encode-string data))
+             (u8vector-set! v 100 (logxor 85 (u8vector-ref v 100)))
+             (lz4-decode-string (u8vector->string v)))))
+  (test* "lz4 truncated data" 'OK
+         (guard (e ((<zlib-data-error> e) 'OK))
+           (let1 e (lz4-encode-string data)
+             (lz4-decode-string
+              (u8vector->string (string->u8vector e 0 (- (string-size e) 1)))))))
+  )
+
+(test* "lz4 bad magic" (test-error <zlib-data-error>)
+       (lz4-decode-string "not an lz4 frame"))
+
+(test* "lz4 owner? keyword" #t
+       (let1 p (open-input-string (lz4-encode-string "foo"))
+         (close-input-port (open-lz4-decompressing-port p :owner? #t))
+         (port-closed? p)))
+
+(when (global-variable-bound? 'rfc.zlib 'open-zstd-compressing-port)
+  (test-section "zstd")
+  (let ([data (with-output-to-string
+                (^[] (dotimes [i 30000] (format #t "~d\n" (* i i)))))]
+        [open-c (global-variable-ref 'rfc.zlib 'open-zstd-compressing-port)]
+        [open-d (global-variable-ref 'rfc.zlib 'open-zstd-decompressing-port)])
+    (define (enc str . args)
+      (call-with-output-string
+        (^p (let1 p2 (apply open-c p args)
+              (display str p2)
+              (close-output-port p2)))))
+    (define (dec str)
+      (port->string (open-d (open-input-string str))))
+    (test* "zstd roundtrip" data (dec (enc data)))
+    (test* "zstd roundtrip (empty)" "" (dec (enc "")))
+    (test* "zstd roundtrip :compression-level 19" data
+           (dec (enc data :compression-level 19)))
+    (test* "zstd roundtrip :threads 2" data (dec (enc data :threads 2)))
+    (test* "zstd truncated data" (test-error <zlib-data-error>)
+           (let1 e (enc data)
+             (dec (u8vector->string
+                   (string->u8vector e 0 (- (string-size e) 1))))))
+    ))
+
 (test-end)
@@ -49,7 +49,11 @@
           zstream-data-type
           zstream-dictionary-adler32
           gzip-encode-string gzip-decode-string
+          deflate-u8vector inflate-u8vector inflate-u8vector!
           inflate-sync
+          <lz4-compressing-port> <lz4-decompressing-port>
+          open-lz4-compressing-port open-lz4-decompressing-port
+          lz4-encode-string lz4-decode-string
           Z_NO_COMPRESSION Z_BEST_SPEED
           Z_BEST_COMPRESSION Z_DEFAULT_COMPRESSION
           Z_FILTERED Z_HUFFMAN_ONLY
@@ -61,6 +65,9 @@
 (dynamic-load "rfc--zlib")
 
 (export-if-defined Z_TEXT Z_FIXED)
+(export-if-defined zstd-version
+                   <zstd-compressing-port> <zstd-decompressing-port>
+                   open-zstd-compressing-port open-zstd-decompressing-port)
 
 ;; body
 (define (open-deflating-port source
@@ -70,11 +77,12 @@
                                   (strategy Z_DEFAULT_STRATEGY)
                                   (dictionary #f)
                                   (buffer-size 0)
+                                  (threads 1)
                                   (owner? #f))
   (%open-deflating-port source compression-level
                         window-bits memory-level
                         strategy dictionary
-                        buffer-size owner?))
+                        buffer-size threads owner?))
 
 ;; utility procedures
 (define (deflate-string str . args)
@@ -97,3 +105,14 @@
                        (open-input-string str)
                        :window-bits (+ 15 16)
                        args)))
+
+(define (lz4-encode-string str . args)
+  (call-with-output-string
+    (^p (let1 p2 (apply open-lz4-compressing-port p args)
+          (display str p2)
+          (close-output-port p2)))))
+
+(define (lz4-decode-string str . args)
+  (port->string (apply open-lz4-decompressing-port
+                       (open-input-string str)
+                       args)))
@@ -55,6 +55,25 @@ STATIC struct dl_hashtbl_s GC_dl_hashtbl = {
   STATIC struct dl_hashtbl_s GC_ll_hashtbl = { NULL, -1, 0 };
 #endif
 
+/* Ephemeron.  While the object *key_link points to is reachable, the   */
+/* object *value_link points to is kept alive.  Both locations are      */
+/* hidden from the collector by the client (e.g. they are in an atomic  */
+/* object), so that the value doesn't make the key reachable.           */
+struct ephemeron {
+    struct hash_chain_entry prolog;
+#   define eph_hidden_key_link prolog.hidden_key
+#   define eph_next(x) (struct ephemeron *)((x) -> prolog.next)
+#   define eph_set_next(x, y) \
+                (void)((x)->prolog.next = (struct hash_chain_entry *)(y))
+    word eph_hidden_value_link;
+};
+
+STATIC struct eph_hashtbl_s {
+    struct ephemeron **head;
+    signed_word log_size;
+    word entries;
+} GC_eph_hashtbl = { /* head */ NULL, /* log_size */ -1, /* entries */ 0 };
+
 STATIC struct finalizable_object {
     struct hash_chain_entry prolog;
 #   define fo_hidden_base prolog.hidden_key
@@ -88,6 +107,9 @@ GC_INNER void GC_push_finalizer_structures(void)
 
     GC_push_all((ptr_t)(&GC_dl_hashtbl.head),
                 (ptr_t)(&GC_dl_hashtbl.head) + sizeof(word));
+    GC_ASSERT((word)&GC_eph_hashtbl.head % sizeof(word) == 0);
+    GC_push_all((ptr_t)(&GC_eph_hashtbl.head),
+                (ptr_t)(&GC_eph_hashtbl.head) + sizeof(word));
     GC_push_all((ptr_t)(&GC_fo_head), (ptr_t)(&GC_fo_head) + sizeof(word));
     GC_push_all((ptr_t)(&GC_finalize_now),
                 (ptr_t)(&GC_finalize_now) + sizeof(word));
@@ -375,6 +397,110 @@ GC_API int GC_CALL GC_unregister_disappearing_link(void * * link)
 # endif /* !GC_LONG_REFS_NOT_NEEDED */
 #endif /* !GC_MOVE_DISAPPEARING_LINK_NOT_NEEDED */
 
+/* Looks for the ephemeron registered with key_link.  Lock is held.     */
+STATIC struct ephemeron *GC_find_ephemeron(void **key_link,
+                                           struct ephemeron **prev)
+{
+    struct ephemeron *curr_eph;
+    size_t index = HASH2(key_link, GC_eph_hashtbl.log_size);
+
+    *prev = NULL;
+    for (curr_eph = GC_eph_hashtbl.head[index]; curr_eph != 0;
+         curr_eph = eph_next(curr_eph)) {
+        if (curr_eph -> eph_hidden_key_link == GC_HIDE_POINTER(key_link))
+            return curr_eph;
+        *prev = curr_eph;
+    }
+    return NULL;
+}
+
+GC_API int GC_CALL GC_register_ephemeron(void **key_link, void **value_link)
+{
+    struct ephemeron *curr_eph, *prev_eph, *new_eph;
+    size_t index;
+    DCL_LOCK_STATE;
+
+    if (((word)key_link & (ALIGNMENT-1)) != 0 || NULL == key_link
+        || ((word)value_link & (ALIGNMENT-1)) != 0 || NULL == value_link)
+        ABORT("Bad arg to GC_register_ephemeron");
+
+    LOCK();
+    if (GC_eph_hashtbl.log_size == -1
+        || GC_eph_hashtbl.entries > ((word)1 << GC_eph_hashtbl.log_size)) {
+        GC_grow_table((struct hash_chain_entry ***)&GC_eph_hashtbl.head,
+                      &GC_eph_hashtbl.log_size);
+        GC_COND_LOG_PRINTF("Grew ephemeron table to %u entries\n",
+                           1 << (unsigned)GC_eph_hashtbl.log_size);
+    }
+    curr_eph = GC_find_ephemeron(key_link, &prev_eph);
+    if (curr_eph != NULL) {
+        curr_eph -> eph_hidden_value_link = GC_HIDE_POINTER(value_link);
+        UNLOCK();
+        return GC_DUPLICATE;
+    }
+    new_eph = (struct ephemeron *)
+        GC_INTERNAL_MALLOC(sizeof(struct ephemeron), NORMAL);
+    if (0 == new_eph) {
+      GC_oom_func oom_fn = GC_oom_fn;
+      UNLOCK();
+      new_eph = (struct ephemeron *)(*oom_fn)(sizeof(struct ephemeron));
+      if (0 == new_eph) {
+        return GC_NO_MEMORY;
+      }
+      LOCK();
+      /* The table may have been changed while we're unlocked.  */
+      curr_eph = GC_find_ephemeron(key_link, &prev_eph);
+      if (curr_eph != NULL) {
+        curr_eph -> eph_hidden_value_link = GC_HIDE_POINTER(value_link);
+        UNLOCK();
+#       ifndef DBG_HDRS_ALL
+          GC_free((void *)new_eph);
+#       endif
+        return GC_DUPLICATE;
+      }
+    }
+    index = HASH2(key_link, GC_eph_hashtbl.log_size);
+    new_eph -> eph_hidden_key_link = GC_HIDE_POINTER(key_link);
+    new_eph -> eph_hidden_value_link = GC_HIDE_POINTER(value_link);
+    eph_set_next(new_eph, GC_eph_hashtbl.head[index]);
+    GC_eph_hashtbl.head[index] = new_eph;
+    GC_eph_hashtbl.entries++;
+    UNLOCK();
+    return GC_SUCCESS;
+}
+
+GC_API int GC_CALL GC_unregister_ephemeron(void **key_link)
+{
+    struct ephemeron *curr_eph, *prev_eph;
+    DCL_LOCK_STATE;
+
+    if (((word)key_link & (ALIGNMENT-1)) != 0) return 0; /* Nothing to do. */
+
+    LOCK();
+    if (GC_eph_hashtbl.log_size == -1) {
+        UNLOCK();
+        return 0;
+    }
+    curr_eph = GC_find_ephemeron(key_link, &prev_eph);
+    if (curr_eph != NULL) {
+        if (NULL == prev_eph) {
+            size_t index = HASH2(key_link, GC_eph_hashtbl.log_size);
+            GC_eph_hashtbl.head[index] = eph_next(curr_eph);
+        } else {
+            eph_set_next(prev_eph, eph_next(curr_eph));
+        }
+        GC_eph_hashtbl.entries--;
+    }
+    UNLOCK();
+    if (NULL == curr_eph) return 0;
+#   ifdef DBG_HDRS_ALL
+      eph_set_next(curr_eph, NULL);
+#   else
+      GC_free(curr_eph);
+#   endif
+    return 1;
+}
+
 /* Possible finalization_marker procedures.  Note that mark stack       */
 /* overflow is handled by the caller, and is not a disaster.            */
 STATIC void GC_normal_finalize_mark_proc(ptr_t p)
@@ -622,6 +748,17 @@ GC_API void GC_CALL GC_register_finalizer_unreachable(void * obj,
       GC_printf("Disappearing long links:\n");
       GC_dump_finalization_links(&GC_ll_hashtbl);
 #   endif
+    GC_printf("Ephemerons:\n");
+    for (i = 0; i < (GC_eph_hashtbl.log_size == -1 ? 0 :
+                     (size_t)1 << GC_eph_hashtbl.log_size); i++) {
+      struct ephemeron *curr_eph;
+      for (curr_eph = GC_eph_hashtbl.head[i]; curr_eph != 0;
+           curr_eph = eph_next(curr_eph)) {
+        GC_printf("Key link: %p, value link: %p\n",
+                  GC_REVEAL_POINTER(curr_eph -> eph_hidden_key_link),
+                  GC_REVEAL_POINTER(curr_eph -> eph_hidden_value_link));
+      }
+    }
     GC_printf("Finalizers:\n");
     for (i = 0; i < fo_size; i++) {
       for (curr_fo = GC_fo_head[i]; curr_fo != 0;
@@ -731,6 +868,102 @@ GC_INLINE void GC_remove_dangling_disappearing_links(
     ITERATE_DL_HASHTBL_END(curr, prev)
 }
 
+#define ITERATE_EPH_HASHTBL_BEGIN(curr, prev) \
+  { \
+    size_t i; \
+    size_t eph_size = GC_eph_hashtbl.log_size == -1 ? 0 : \
+                                1 << GC_eph_hashtbl.log_size; \
+    for (i = 0; i < eph_size; i++) { \
+      curr = GC_eph_hashtbl.head[i]; \
+      prev = NULL; \
+      while (curr) {
+
+#define ITERATE_EPH_HASHTBL_END(curr, prev) \
+        prev = curr; \
+        curr = eph_next(curr); \
+      } \
+    } \
+  }
+
+#define DELETE_EPH_HASHTBL_ENTRY(curr, prev, next) \
+  { \
+    next = eph_next(curr); \
+    if (NULL == prev) { \
+        GC_eph_hashtbl.head[i] = next; \
+    } else { \
+        eph_set_next(prev, next); \
+    } \
+    GC_clear_mark_bit(curr); \
+    GC_eph_hashtbl.entries--; \
+    curr = next; \
+    continue; \
+  }
+
+/* Returns TRUE if the object containing key_link of the ephemeron     */
+/* is unmarked, i.e. nobody can get to the ephemeron.  If key_link      */
+/* isn't in the collected heap, the ephemeron is always alive.          */
+#define EPH_HOLDER_DEAD(key_link) \
+    (NULL != GC_base(key_link) && !GC_is_marked(GC_base(key_link)))
+
+/* Marks the values of ephemerons whose keys and holders (the objects   */
+/* containing key_link) are reachable.  Since a newly marked value may  */
+/* make other keys or holders reachable, we repeat until nothing        */
+/* changes.  Then we clear the ephemerons whose keys or holders are     */
+/* still unmarked; the latter may be resurrected by a finalizer, and    */
+/* must not point to the unmarked value then.  This must be done before */
+/* any disappearing links are cleared, for the objects reachable from   */
+/* the values are not garbage.                                          */
+STATIC void GC_mark_ephemerons(void)
+{
+    struct ephemeron *curr, *prev, *next;
+    ptr_t key_link, key, value;
+    GC_bool changed;
+
+    do {
+      changed = FALSE;
+      ITERATE_EPH_HASHTBL_BEGIN(curr, prev)
+        key_link = GC_REVEAL_POINTER(curr -> eph_hidden_key_link);
+        key = GC_base(*(ptr_t *)key_link);
+        if (!EPH_HOLDER_DEAD(key_link)
+            && (NULL == key || GC_is_marked(key))) {
+          value = GC_base(*(ptr_t *)GC_REVEAL_POINTER(curr
+                                                  -> eph_hidden_value_link));
+          if (NULL != value && !GC_is_marked(value)) {
+            GC_set_mark_bit(value);
+            GC_MARK_FO(value, GC_normal_finalize_mark_proc);
+            changed = TRUE;
+          }
+        }
+      ITERATE_EPH_HASHTBL_END(curr, prev)
+    } while (changed);
+
+    ITERATE_EPH_HASHTBL_BEGIN(curr, prev)
+      key_link = GC_REVEAL_POINTER(curr -> eph_hidden_key_link);
+      key = GC_base(*(ptr_t *)key_link);
+      if (EPH_HOLDER_DEAD(key_link) || (NULL != key && !GC_is_marked(key))) {
+        /* Clear the key first, so that the client can tell that the  */
+        /* value is invalid once it sees the cleared key.             */
+        *(word *)key_link = 0;
+        *(word *)GC_REVEAL_POINTER(curr -> eph_hidden_value_link) = 0;
+        DELETE_EPH_HASHTBL_ENTRY(curr, prev, next);
+      }
+    ITERATE_EPH_HASHTBL_END(curr, prev)
+}
+
+/* Removes the ephemerons whose key_link is in an unreachable object.   */
+STATIC void GC_remove_dangling_ephemerons(void)
+{
+    struct ephemeron *curr, *prev, *next;
+    ptr_t real_link;
+
+    ITERATE_EPH_HASHTBL_BEGIN(curr, prev)
+      real_link = GC_base(GC_REVEAL_POINTER(curr -> eph_hidden_key_link));
+      if (NULL != real_link && !GC_is_marked(real_link)) {
+        DELETE_EPH_HASHTBL_ENTRY(curr, prev, next);
+      }
+    ITERATE_EPH_HASHTBL_END(curr, prev)
+}
+
 /* Called with held lock (but the world is running).                    */
 /* Cause disappearing links to disappear and unreachable objects to be  */
 /* enqueued for finalization.                                           */
@@ -749,6 +982,8 @@ GC_INNER void GC_finalize(void)
 #     endif
 #   endif
 
+    GC_ASSERT(GC_mark_state == MS_NONE);
+    GC_mark_ephemerons();
     GC_make_disappearing_links_disappear(&GC_dl_hashtbl);
 
   /* Mark all objects reachable via chains of 1 or more pointers        */
@@ -859,6 +1094,7 @@ GC_INNER void GC_finalize(void)
   }
 
   GC_remove_dangling_disappearing_links(&GC_dl_hashtbl);
+  GC_remove_dangling_ephemerons();
 # ifndef GC_LONG_REFS_NOT_NEEDED
     GC_make_disappearing_links_disappear(&GC_ll_hashtbl);
     GC_remove_dangling_disappearing_links(&GC_ll_hashtbl);
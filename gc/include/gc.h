@@ -1120,6 +1120,36 @@ GC_API int GC_CALL GC_unregister_long_link(void ** /* link */);
         /* Similar to GC_unregister_disappearing_link but for a */
         /* registration by either of the above two routines.    */
 
+GC_API int GC_CALL GC_register_ephemeron(void ** /* key_link */,
+                                         void ** /* value_link */)
+                        GC_ATTR_NONNULL(1) GC_ATTR_NONNULL(2);
+        /* Registers an ephemeron, a pair of a key and a value  */
+        /* where the value is kept alive only while the key is  */
+        /* reachable.  *key_link and *value_link hold the key   */
+        /* and the value; both must be hidden from the          */
+        /* collector (typically they are in an atomic object).  */
+        /* If the key is reachable, so is the value.  Pointers  */
+        /* from the values of ephemerons don't make the key     */
+        /* reachable, unless the ephemeron holding that value   */
+        /* has a reachable key itself.  When the key is found   */
+        /* inaccessible, both *key_link and *value_link are     */
+        /* cleared (the key first) and the registration is      */
+        /* removed.  This happens before disappearing links     */
+        /* are processed.  If *key_link isn't a pointer to the  */
+        /* collected heap, the value is always kept alive.      */
+        /* The registration is also removed when the object     */
+        /* containing key_link becomes inaccessible, and such   */
+        /* an ephemeron doesn't keep the value alive, even if   */
+        /* the key is reachable.  Returns                       */
+        /* GC_SUCCESS, GC_DUPLICATE (if key_link was already    */
+        /* registered, in which case value_link is replaced),   */
+        /* or GC_NO_MEMORY.                                     */
+
+GC_API int GC_CALL GC_unregister_ephemeron(void ** /* key_link */);
+        /* Undoes a registration by the above routine.  Returns */
+        /* 0 if key_link was not actually registered (otherwise */
+        /* returns 1).                                          */
+
 /* Returns !=0 if GC_invoke_finalizers has something to do.     */
 GC_API int GC_CALL GC_should_invoke_finalizers(void);
 
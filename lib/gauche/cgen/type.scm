@@ -243,6 +243,7 @@
    (<comparator> "ScmComparator*" "comparator" "SCM_COMPARATORP" "SCM_COMPARATOR")
    (<hash-table> "ScmHashTable*" "hash table" "SCM_HASH_TABLE_P" "SCM_HASH_TABLE")
    (<tree-map> "ScmTreeMap*" "tree map" "SCM_TREE_MAP_P" "SCM_TREE_MAP")
+   (<cache> "ScmCache*" "cache" "SCM_CACHEP" "SCM_CACHE")
    (<class> "ScmClass*" "class" "SCM_CLASSP" "SCM_CLASS")
    (<method> "ScmMethod*" "method" "SCM_METHODP" "SCM_METHOD")
    (<module> "ScmModule*" "module" "SCM_MODULEP" "SCM_MODULE")
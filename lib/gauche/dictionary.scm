@@ -134,7 +134,7 @@
      ,@(map (^p (gen-def (car p) (cadr p))) (slices clauses 2))))
 
 ;;-----------------------------------------------
-;; Methods for hash-table, tree-map
+;; Methods for hash-table, tree-map, weak-hash-table, cache
 ;;
 
 (define-dict-interface <hash-table>
@@ -170,6 +170,26 @@
   :update!    tree-map-update!
   :->alist    tree-map->alist)
 
+(define-dict-interface <weak-hash-table>
+  :get        weak-hash-table-get
+  :put!       weak-hash-table-put!
+  :delete!    weak-hash-table-delete!
+  :exists?    weak-hash-table-exists?
+  :fold       weak-hash-table-fold
+  :keys       weak-hash-table-keys
+  :values     weak-hash-table-values)
+
+(define-dict-interface <cache>
+  :get        cache-get
+  :put!       cache-put!
+  :delete!    cache-delete!
+  :clear!     cache-clear!
+  :exists?    cache-exists?
+  :fold       cache-fold
+  :keys       cache-keys
+  :values     cache-values
+  :->alist    cache->alist)
+
 ;;-----------------------------------------------
 ;; Fallback methods
 ;;
@@ -118,10 +118,15 @@
            (%do-copy/limit1 (read-char src) (write-char data dst) size)
            (%do-copy (read-char src) (write-char data dst) (+ count 1)))]
         [(integer? unit)
-         (let ((buf (make-u8vector (if (zero? unit) 4096 unit))))
-           (if (and (integer? size) (not (negative? size)))
-             (%do-copy/limitN src dst buf unit size)
-             (%do-copy (read-block! buf src) (write-block buf dst 0 data)
-                       (+ count data))))]
+         ;; If both are file ports, the data can bypass Scheme.
+         (or ((with-module gauche.internal %copy-port-fd)
+              src dst (if (and (integer? size) (not (negative? size)))
+                        (exact size)
+                        -1))
+             (let ((buf (make-u8vector (if (zero? unit) 4096 unit))))
+               (if (and (integer? size) (not (negative? size)))
+                 (%do-copy/limitN src dst buf unit size)
+                 (%do-copy (read-block! buf src) (write-block buf dst 0 data)
+                           (+ count data)))))]
         [else (error "unit must be 'char, 'byte, or non-negative integer" unit)]
         ))
@@ -37,16 +37,26 @@
           tree-map-fold tree-map-fold-right
           tree-map-map tree-map-for-each
           tree-map-keys tree-map-values
-          tree-map->alist alist->tree-map)
+          tree-map->alist alist->tree-map alist->tree-map/sorted)
   )
 (select-module gauche.treeutil)
 
-(define make-tree-map
-  (case-lambda
-    [() (%make-tree-map compare)]
-    [(cmp) (%make-tree-map cmp)]
-    [(=? <?)
-     (%make-tree-map (^[x y](cond [(=? x y) 0] [(<? x y) -1] [else 1])))]))
+(define (make-tree-map . args)
+  ;; Comparison procedure(s) may be followed by keyword arguments.
+  (let loop ([args args] [procs '()])
+    (if (or (null? args) (keyword? (car args)))
+      (let ([type (get-keyword :type args 'rbtree)]
+            [procs (reverse procs)])
+        (case (length procs)
+          [(0) (%make-tree-map compare type)]
+          [(1) (%make-tree-map (car procs) type)]
+          [(2) (let ([=? (car procs)] [<? (cadr procs)])
+                 (%make-tree-map (^[x y]
+                                   (cond [(=? x y) 0] [(<? x y) -1] [else 1]))
+                                 type))]
+          [else (error "too many comparison procedures to make-tree-map:"
+                       procs)]))
+      (loop (cdr args) (cons (car args) procs)))))
 
 (define (tree-map-empty? tm) (zero? (tree-map-num-entries tm)))
 
@@ -91,3 +101,8 @@
     (dolist (kv alist)
       (tree-map-put! tm (car kv) (cdr kv)))))
 
+;; ALIST must be sorted by keys.  Builds a balanced tree in O(n).
+(define (alist->tree-map/sorted alist . args)
+  (rlet1 tm (apply make-tree-map args)
+    (%tree-map-build-sorted! tm alist)))
+
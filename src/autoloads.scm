@@ -176,7 +176,8 @@
                           tree-map-fold tree-map-fold-right
                           tree-map-map tree-map-for-each
                           tree-map-keys tree-map-values
-                          tree-map->alist alist->tree-map)
+                          tree-map->alist alist->tree-map
+                          alist->tree-map/sorted)
 
 (autoload gauche.libutil  library-fold library-map library-for-each
                           library-exists? library-has-module?
@@ -0,0 +1,80 @@
+/*
+ * Benchmark of bignum multiplication and division.
+ *
+ *   This is not a part of the test suite.  Run it after changing
+ *   the bignum routines, or to tune the thresholds in bignum.c
+ *   (KARATSUBA_THRESHOLD, TOOM3_THRESHOLD, DIV_NEWTON_THRESHOLD).
+ *
+ *   Usage: bench-arith [max-words]
+ */
+
+#include <time.h>
+#include "gauche.h"
+#include "gauche/bignum.h"
+
+static u_long rand_state = 0x12345678;
+
+static u_long rand_word(void)
+{
+    /* xorshift; we don't need good randomness. */
+    u_long x = rand_state;
+    x ^= x << 13;
+    x ^= x >> 7;
+    x ^= x << 17;
+    return (rand_state = x);
+}
+
+/* Returns a positive bignum of exactly N words */
+static ScmObj make_operand(int n)
+{
+    u_long *v = SCM_NEW_ATOMIC_ARRAY(u_long, n);
+    for (int i=0; i<n; i++) v[i] = rand_word();
+    if (v[n-1] == 0) v[n-1] = 1;
+    return Scm_NormalizeBignum(SCM_BIGNUM(Scm_MakeBignumFromUIArray(1, v, n)));
+}
+
+/* Calls PROC repeatedly at least for 0.2 sec, and returns the average
+   time of a call in microseconds. */
+static double measure(void (*proc)(ScmObj, ScmObj), ScmObj x, ScmObj y)
+{
+    long count = 0;
+    clock_t start = clock(), end;
+    do {
+        proc(x, y);
+        count++;
+        end = clock();
+    } while (end - start < CLOCKS_PER_SEC/5);
+    return (double)(end - start) * 1.0e6 / CLOCKS_PER_SEC / count;
+}
+
+static void do_mul(ScmObj x, ScmObj y)
+{
+    Scm_BignumMul(SCM_BIGNUM(x), SCM_BIGNUM(y));
+}
+
+static void do_divrem(ScmObj x, ScmObj y)
+{
+    Scm_BignumDivRem(SCM_BIGNUM(x), SCM_BIGNUM(y));
+}
+
+int main(int argc, char **argv)
+{
+    int maxwords = 4096;
+
+    Scm_Init(GAUCHE_SIGNATURE);
+    if (argc > 1) maxwords = atoi(argv[1]);
+
+    printf("%8s %14s %14s %14s\n",
+           "words", "n*n mul", "n*2n mul", "2n/n divrem");
+    for (int n = 4; n <= maxwords; n += (n < 64)? 4 : n/4) {
+        ScmObj x = make_operand(n);
+        ScmObj y = make_operand(n);
+        ScmObj y2 = make_operand(2*n);
+        double t_mul = measure(do_mul, x, y);
+        double t_mul2 = measure(do_mul, x, y2);
+        double t_div = measure(do_divrem, y2, x);
+        printf("%8d %12.2fus %12.2fus %12.2fus\n", n, t_mul, t_mul2, t_div);
+        fflush(stdout);
+    }
+    return 0;
+}
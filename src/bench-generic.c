@@ -0,0 +1,80 @@
+/*
+ * Benchmark of generic function calls.
+ *
+ *   This is not a part of the test suite.  Run it after changing
+ *   the method dispatch in class.c.
+ *
+ *   Usage: bench-generic [max-methods [iterations]]
+ *
+ *   For each N = 1, 2, 4, ... max-methods, we define a generic function
+ *   with N methods, each specialized to its own class, plus a fallback
+ *   method on <top>.  Then we call it repeatedly on instances of all
+ *   the N classes in turn, so the call site sees N different argument
+ *   classes.
+ */
+
+#include <sys/time.h>
+#include "gauche.h"
+
+static long iterations = 1000000;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static ScmObj eval(const char *fmt, ...)
+{
+    char buf[1024];
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(buf, sizeof(buf), fmt, ap);
+    va_end(ap);
+    return Scm_EvalCStringRec(buf, SCM_OBJ(Scm_UserModule()));
+}
+
+static double run(int nmethods)
+{
+    eval("(define-generic bench-gf-%d)", nmethods);
+    eval("(define-method bench-gf-%d (x) 0)", nmethods);
+    for (int i = 0; i < nmethods; i++) {
+        eval("(define-class <bench-%d-%d> () ())", nmethods, i);
+        eval("(define-method bench-gf-%d ((x <bench-%d-%d>)) %d)",
+             nmethods, nmethods, i, i);
+    }
+    eval("(define bench-objs-%d"
+         "  (list->vector"
+         "   (map (^i (make (global-variable-ref (current-module)"
+         "                   (string->symbol"
+         "                    (format \"<bench-~a-~a>\" %d i)))))"
+         "        (iota %d))))", nmethods, nmethods, nmethods);
+
+    double start = now();
+    eval("(let loop ([i 0] [k 0] [s 0])"
+         "  (cond [(= i %ld) s]"
+         "        [(= k %d) (loop i 0 s)]"
+         "        [else (loop (+ i 1) (+ k 1)"
+         "                    (+ s (bench-gf-%d"
+         "                          (vector-ref bench-objs-%d k))))]))",
+         iterations, nmethods, nmethods, nmethods);
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    int maxmethods = 64;
+
+    Scm_Init(GAUCHE_SIGNATURE);
+    if (argc > 1) maxmethods = atoi(argv[1]);
+    if (argc > 2) iterations = atol(argv[2]);
+
+    printf("%8s %12s %16s\n", "methods", "time", "calls/sec");
+    for (int n = 1; n <= maxmethods; n *= 2) {
+        double t = run(n);
+        printf("%8d %11.3fs %16.0f\n", n, t, iterations / t);
+        fflush(stdout);
+    }
+    return 0;
+}
@@ -0,0 +1,89 @@
+/*
+ * Benchmark of symbol interning from multiple threads.
+ *
+ *   This is not a part of the test suite.  Run it after changing
+ *   the symbol table in symbol.c.
+ *
+ *   Usage: bench-symbol [max-threads [iterations]]
+ *
+ *   Each thread interns names taken from a shared pool (all of them
+ *   already interned), and every 16th time a name of its own that
+ *   hasn't been seen.  The former is the typical use by the reader;
+ *   the latter exercises the insertion path.
+ */
+
+#include <sys/time.h>
+#include "gauche.h"
+
+#define POOL_SIZE 4096
+
+static ScmString *pool[POOL_SIZE];
+static long iterations = 1000000;
+static int round_id = 0;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+static void *worker(void *data)
+{
+    long id = (long)(intptr_t)data;
+    u_long r = 0;
+    char buf[64];
+
+    for (long i = 0; i < iterations; i++) {
+        if ((i & 15) == 15) {
+            snprintf(buf, sizeof(buf), "new-%d-%ld-%ld", round_id, id, i);
+            r += SCM_WORD(Scm_Intern(SCM_STRING(SCM_MAKE_STR_COPYING(buf))));
+        } else {
+            r += SCM_WORD(Scm_Intern(pool[(i * 7 + id) % POOL_SIZE]));
+        }
+    }
+    return (void*)(intptr_t)r;
+}
+
+static double run(int nthreads)
+{
+    double start = now();
+    round_id++;
+#if defined(GAUCHE_USE_PTHREADS)
+    pthread_t th[64];
+    for (long i = 0; i < nthreads; i++) {
+        pthread_create(&th[i], NULL, worker, (void*)(intptr_t)i);
+    }
+    for (int i = 0; i < nthreads; i++) {
+        pthread_join(th[i], NULL);
+    }
+#else
+    for (long i = 0; i < nthreads; i++) worker((void*)(intptr_t)i);
+#endif
+    return now() - start;
+}
+
+int main(int argc, char **argv)
+{
+    int maxthreads = 8;
+    char buf[64];
+
+    Scm_Init(GAUCHE_SIGNATURE);
+    if (argc > 1) maxthreads = atoi(argv[1]);
+    if (argc > 2) iterations = atol(argv[2]);
+    if (maxthreads > 64) maxthreads = 64;
+
+    for (int i = 0; i < POOL_SIZE; i++) {
+        snprintf(buf, sizeof(buf), "symbol-%d", i);
+        pool[i] = SCM_STRING(SCM_MAKE_STR_COPYING(buf));
+        Scm_Intern(pool[i]);
+    }
+
+    printf("%8s %12s %16s\n", "threads", "time", "interns/sec");
+    for (int n = 1; n <= maxthreads; n *= 2) {
+        double t = run(n);
+        printf("%8d %11.3fs %16.0f\n", n, t, n * iterations / t);
+        fflush(stdout);
+    }
+    return 0;
+}
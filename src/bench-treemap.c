@@ -0,0 +1,103 @@
+/*
+ * Benchmark of tree map cores.
+ *
+ *   This is not a part of the test suite.  Run it after changing
+ *   treemap.c.
+ *
+ *   Usage: bench-treemap [num-entries [range-scans]]
+ *
+ *   We run the same sequence of operations on the red-black tree core
+ *   and the B+ tree core: inserting random keys, looking them up,
+ *   traversing all the entries in order, scanning 100 entries from
+ *   random positions, and deleting all the entries.
+ */
+
+#include <sys/time.h>
+#include "gauche.h"
+
+static long nentries = 1000000;
+static long nscans = 100000;
+
+static double now(void)
+{
+    struct timeval tv;
+    gettimeofday(&tv, NULL);
+    return tv.tv_sec + tv.tv_usec * 1.0e-6;
+}
+
+/* Same as the default comparison, but called through the pointer,
+   like the comparison procedure of <tree-map>. */
+static int cmp(ScmTreeCore *tc, intptr_t a, intptr_t b)
+{
+    return (a < b)? -1 : (a > b)? 1 : 0;
+}
+
+static void run(const char *name, ScmTreeCoreType type,
+                ScmTreeCoreCompareProc *proc, intptr_t *keys)
+{
+    ScmTreeCore tc;
+    ScmTreeIter iter;
+    ScmDictEntry *e;
+    intptr_t sum = 0;
+    double t0, t1, t2, t3, t4, t5;
+
+    Scm_TreeCoreInitWithType(&tc, type, proc, NULL);
+    GC_gcollect();
+
+    t0 = now();
+    for (long i = 0; i < nentries; i++) {
+        e = Scm_TreeCoreSearch(&tc, keys[i], SCM_DICT_CREATE);
+        e->value = i;
+    }
+    t1 = now();
+    for (long i = 0; i < nentries; i++) {
+        e = Scm_TreeCoreSearch(&tc, keys[i], SCM_DICT_GET);
+        sum += e->value;
+    }
+    t2 = now();
+    Scm_TreeIterInit(&iter, &tc, NULL);
+    while ((e = Scm_TreeIterNext(&iter)) != NULL) sum += e->value;
+    t3 = now();
+    for (long i = 0; i < nscans; i++) {
+        ScmDictEntry *lo, *hi;
+        e = Scm_TreeCoreClosestEntries(&tc, keys[i], &lo, &hi);
+        Scm_TreeIterInit(&iter, &tc, e);
+        for (int j = 0; j < 100 && (e = Scm_TreeIterNext(&iter)); j++) {
+            sum += e->value;
+        }
+    }
+    t4 = now();
+    for (long i = 0; i < nentries; i++) {
+        Scm_TreeCoreSearch(&tc, keys[i], SCM_DICT_DELETE);
+    }
+    t5 = now();
+
+    printf("%-12s %9.3f %9.3f %9.3f %9.3f %9.3f   (%ld)\n", name,
+           t1-t0, t2-t1, t3-t2, t4-t3, t5-t4, (long)(sum & 0xff));
+    fflush(stdout);
+}
+
+int main(int argc, char **argv)
+{
+    Scm_Init(GAUCHE_SIGNATURE);
+    if (argc > 1) nentries = atol(argv[1]);
+    if (argc > 2) nscans = atol(argv[2]);
+    if (nscans > nentries) nscans = nentries;
+
+    /* Distinct keys in random order */
+    intptr_t *keys = SCM_NEW_ATOMIC_ARRAY(intptr_t, nentries);
+    for (long i = 0; i < nentries; i++) keys[i] = i * 2;
+    for (long i = nentries-1; i > 0; i--) {
+        long j = random() % (i+1);
+        intptr_t t = keys[i]; keys[i] = keys[j]; keys[j] = t;
+    }
+
+    printf("%ld entries, %ld range scans\n", nentries, nscans);
+    printf("%-12s %9s %9s %9s %9s %9s\n",
+           "core", "insert", "lookup", "traverse", "scan", "delete");
+    run("rbtree",     SCM_TREE_CORE_RBTREE, NULL, keys);
+    run("btree",      SCM_TREE_CORE_BTREE,  NULL, keys);
+    run("rbtree/cmp", SCM_TREE_CORE_RBTREE, cmp,  keys);
+    run("btree/cmp",  SCM_TREE_CORE_BTREE,  cmp,  keys);
+    return 0;
+}
@@ -833,13 +833,256 @@ static ScmBignum *bignum_mul_word(ScmBignum *br, const ScmBignum *bx,
     return br;
 }
 
+/*
+ * Multiplication of word arrays
+ *
+ *   The following routines work on raw arrays of words (least significant
+ *   word first), so that the recursive algorithms can handle parts of
+ *   numbers without allocating bignums.
+ *
+ *   Schoolbook multiplication is used for small operands.  Above
+ *   KARATSUBA_THRESHOLD words, we use Karatsuba's method, which is
+ *   O(n^1.58).  For even larger operands, Toom-3 (O(n^1.46)) is used;
+ *   see bignum_mul_toom3 below.  The thresholds are determined by
+ *   src/bench-arith.c.  On x86_64, Karatsuba beats schoolbook from
+ *   about 24 words.  A single level of Toom-3 only breaks even with
+ *   Karatsuba at about 1500 words, but recursing into Toom-3 down to
+ *   512 words makes 4096-8192 word products 10-15% faster.
+ */
+
+#define KARATSUBA_THRESHOLD  24    /* must be >= 8 */
+#define TOOM3_THRESHOLD      512
+
+/* r[0..n) = x[0..n) + y[0..n).  Returns carry.  R may be X or Y. */
+static u_long words_add(u_long *r, const u_long *x, const u_long *y, int n)
+{
+    u_long c = 0;
+    for (int i=0; i<n; i++) {
+        u_long xi = x[i], yi = y[i], t;
+        UADD(t, c, xi, yi);
+        r[i] = t;
+    }
+    return c;
+}
+
+/* r[0..n) = x[0..n) - y[0..n).  Returns borrow.  R may be X or Y. */
+static u_long words_sub(u_long *r, const u_long *x, const u_long *y, int n)
+{
+    u_long c = 0;
+    for (int i=0; i<n; i++) {
+        u_long xi = x[i], yi = y[i], t;
+        USUB(t, c, xi, yi);
+        r[i] = t;
+    }
+    return c;
+}
+
+/* Adds carry C to r[0..n).  Returns carry out. */
+static u_long words_add_carry(u_long *r, int n, u_long c)
+{
+    for (int i=0; c && i<n; i++) {
+        u_long ri = r[i], t;
+        UADD(t, c, ri, 0);
+        r[i] = t;
+    }
+    return c;
+}
+
+/* r[0..n) = |x[0..n) - y[0..m)|, m <= n.
+   Returns 1 if x >= y, -1 otherwise. */
+static int words_absdiff(u_long *r, const u_long *x, int n,
+                         const u_long *y, int m)
+{
+    int i, sign = 1;
+    /* compare x and y (y is zero-extended) */
+    for (i=n-1; i>=m; i--) if (x[i]) break;
+    if (i < m) {
+        for (i=m-1; i>=0; i--) {
+            if (x[i] != y[i]) {
+                if (x[i] < y[i]) sign = -1;
+                break;
+            }
+        }
+    }
+    if (sign > 0) {
+        u_long c = words_sub(r, x, y, m);
+        for (i=m; i<n; i++) {
+            u_long xi = x[i], t;
+            USUB(t, c, xi, 0);
+            r[i] = t;
+        }
+    } else {
+        /* here, x[m..n) is all zero */
+        words_sub(r, y, x, m);
+        for (i=m; i<n; i++) r[i] = 0;
+    }
+    return sign;
+}
+
+/* r[0..xn+yn) = x[0..xn) * y[0..yn).  R must not overlap with X or Y. */
+static void mul_basecase(u_long *r, const u_long *x, int xn,
+                         const u_long *y, int yn)
+{
+    for (int i=0; i<xn+yn; i++) r[i] = 0;
+    for (int j=0; j<yn; j++) {
+        u_long yj = y[j], cw = 0;
+        if (yj == 0) continue;
+        for (int i=0; i<xn; i++) {
+            /* NB: UADD may assume the carry variable is named 'c'. */
+            u_long hi, lo, t, c;
+            u_long xi = x[i], ri = r[i+j];
+            UMUL(hi, lo, xi, yj);
+            c = 0;
+            UADD(t, c, lo, cw);
+            hi += c;
+            c = 0;
+            UADD(lo, c, t, ri);
+            r[i+j] = lo;
+            cw = hi + c;        /* never overflows */
+        }
+        r[j+xn] = cw;
+    }
+}
+
+/* Size of the work area required by mul_karatsuba for N words. */
+static int karatsuba_work_size(int n)
+{
+    if (n < KARATSUBA_THRESHOLD) return 0;
+    int h = (n+1)/2;
+    return 4*h + max(2*h+1, karatsuba_work_size(h));
+}
+
+/* r[0..2n) = x[0..n) * y[0..n).  W is a work area of
+   karatsuba_work_size(n) words.  R must not overlap with X, Y or W.
+
+   With x = x1*B^h + x0 and y = y1*B^h + y0,
+     x*y = x1*y1*B^2h + (x0*y1 + x1*y0)*B^h + x0*y0
+   where x0*y1 + x1*y0 = x0*y0 + x1*y1 - (x0 - x1)*(y0 - y1). */
+static void mul_karatsuba(u_long *r, const u_long *x, const u_long *y,
+                          int n, u_long *w)
+{
+    if (n < KARATSUBA_THRESHOLD) {
+        mul_basecase(r, x, n, y, n);
+        return;
+    }
+    int h = (n+1)/2, l = n - h;  /* lower h words and upper l words */
+    u_long *dx = w, *dy = w + h, *z1 = w + 2*h, *ww = w + 4*h;
+
+    int s = words_absdiff(dx, x, h, x+h, l);
+    s *= words_absdiff(dy, y, h, y+h, l);
+
+    mul_karatsuba(r, x, y, h, ww);            /* x0*y0 -> r[0..2h) */
+    mul_karatsuba(r+2*h, x+h, y+h, l, ww);    /* x1*y1 -> r[2h..2n) */
+    mul_karatsuba(z1, dx, dy, h, ww);         /* |x0-x1|*|y0-y1| */
+
+    /* t = x0*y0 + x1*y1 -/+ z1.  It is nonnegative and fits in 2h+1 words.
+       We can reuse WW now. */
+    u_long *t = ww;
+    for (int i=0; i<2*h; i++) t[i] = r[i];
+    t[2*h] = 0;
+    u_long c = words_add(t, t, r+2*h, 2*l);
+    words_add_carry(t+2*l, 2*h+1-2*l, c);
+    if (s > 0) t[2*h] -= words_sub(t, t, z1, 2*h);
+    else       t[2*h] += words_add(t, t, z1, 2*h);
+
+    c = words_add(r+h, r+h, t, 2*h+1);
+    words_add_carry(r+3*h+1, 2*n-3*h-1, c);
+}
+
+/* r[0..xn+yn) = x[0..xn) * y[0..yn).  R must not overlap with X or Y. */
+static void mul_words(u_long *r, const u_long *x, int xn,
+                      const u_long *y, int yn)
+{
+    if (xn < yn) {
+        const u_long *tp = x; x = y; y = tp;
+        int tn = xn; xn = yn; yn = tn;
+    }
+    if (yn < KARATSUBA_THRESHOLD) {
+        mul_basecase(r, x, xn, y, yn);
+        return;
+    }
+    u_long *w = SCM_NEW_ATOMIC_ARRAY(u_long, karatsuba_work_size(yn));
+    if (xn == yn) {
+        mul_karatsuba(r, x, y, yn, w);
+        return;
+    }
+    /* Unbalanced case.  Split x into yn-word chunks. */
+    u_long *p = SCM_NEW_ATOMIC_ARRAY(u_long, 2*yn);
+    for (int i=0; i<xn+yn; i++) r[i] = 0;
+    for (int off=0; off<xn; off+=yn) {
+        int cn = min(yn, xn-off);
+        if (cn == yn) mul_karatsuba(p, x+off, y, yn, w);
+        else          mul_words(p, y, yn, x+off, cn);
+        u_long c = words_add(r+off, r+off, p, cn+yn);
+        words_add_carry(r+off+cn+yn, xn-off-cn, c);
+    }
+}
+
+/* Returns the N words of X from the OFF-th word, as a nonnegative
+   integer.  Words beyond X are regarded as zero. */
+static ScmObj bignum_slice(const ScmBignum *x, int off, int n)
+{
+    int size = min(n, (int)x->size - off);
+    if (size <= 0) return SCM_MAKE_INT(0);
+    ScmBignum *r = make_bignum(size);
+    for (int i=0; i<size; i++) r->values[i] = x->values[off+i];
+    return Scm_NormalizeBignum(r);
+}
+
+/* Toom-3 multiplication.  Each operand is split into three k-word parts,
+   x = x2*B^2 + x1*B + x0 where B = 2^(k*WORD_BITS), and regarded as
+   a polynomial.  The product polynomial is evaluated at 0, 1, -1, -2
+   and infinity with five recursive multiplications of about k words,
+   then interpolated (we use Bodrato's sequence).  The operations
+   other than the recursive multiplications are linear, so we use
+   generic arithmetic for simplicity.  Returns |x|*|y|. */
+static ScmObj bignum_mul_toom3(const ScmBignum *bx, const ScmBignum *by)
+{
+    int k = (max(bx->size, by->size) + 2) / 3;
+    int sh = k * WORD_BITS;
+
+    ScmObj x0 = bignum_slice(bx, 0, k);
+    ScmObj x1 = bignum_slice(bx, k, k);
+    ScmObj x2 = bignum_slice(bx, 2*k, k);
+    ScmObj y0 = bignum_slice(by, 0, k);
+    ScmObj y1 = bignum_slice(by, k, k);
+    ScmObj y2 = bignum_slice(by, 2*k, k);
+
+    /* evaluation */
+    ScmObj px = Scm_Add(x0, x2);
+    ScmObj py = Scm_Add(y0, y2);
+    ScmObj p1x = Scm_Add(px, x1),  p1y = Scm_Add(py, y1);
+    ScmObj pm1x = Scm_Sub(px, x1), pm1y = Scm_Sub(py, y1);
+    ScmObj pm2x = Scm_Sub(Scm_Ash(Scm_Add(pm1x, x2), 1), x0);
+    ScmObj pm2y = Scm_Sub(Scm_Ash(Scm_Add(pm1y, y2), 1), y0);
+
+    ScmObj r0   = Scm_Mul(x0, y0);
+    ScmObj r1   = Scm_Mul(p1x, p1y);
+    ScmObj rm1  = Scm_Mul(pm1x, pm1y);
+    ScmObj rm2  = Scm_Mul(pm2x, pm2y);
+    ScmObj rinf = Scm_Mul(x2, y2);
+
+    /* interpolation.  All divisions are exact. */
+    ScmObj r3 = Scm_Quotient(Scm_Sub(rm2, r1), SCM_MAKE_INT(3), NULL);
+    ScmObj t1 = Scm_Ash(Scm_Sub(r1, rm1), -1);
+    ScmObj r2 = Scm_Sub(rm1, r0);
+    r3 = Scm_Add(Scm_Ash(Scm_Sub(r2, r3), -1), Scm_Ash(rinf, 1));
+    r2 = Scm_Sub(Scm_Add(r2, t1), rinf);
+    r1 = Scm_Sub(t1, r3);
+
+    /* recomposition */
+    ScmObj r = Scm_Ash(rinf, sh);
+    r = Scm_Ash(Scm_Add(r, r3), sh);
+    r = Scm_Ash(Scm_Add(r, r2), sh);
+    r = Scm_Ash(Scm_Add(r, r1), sh);
+    return Scm_Add(r, r0);
+}
+
 /* returns bx * by.  not normalized */
 static ScmBignum *bignum_mul(const ScmBignum *bx, const ScmBignum *by)
 {
     ScmBignum *br = make_bignum(bx->size + by->size);
-    for (u_int i=0; i<by->size; i++) {
-        bignum_mul_word(br, bx, by->values[i], i);
-    }
+    mul_words(br->values, bx->values, bx->size, by->values, by->size);
     br->sign = bx->sign * by->sign;
     return br;
 }
@@ -864,6 +1107,11 @@ static ScmBignum *bignum_mul_si(const ScmBignum *bx, long y)
 
 ScmObj Scm_BignumMul(const ScmBignum *bx, const ScmBignum *by)
 {
+    u_int small = min(bx->size, by->size), large = max(bx->size, by->size);
+    if (small >= TOOM3_THRESHOLD && small*2 >= large) {
+        ScmObj r = bignum_mul_toom3(bx, by);
+        return (bx->sign * by->sign < 0)? Scm_Negate(r) : r;
+    }
     ScmBignum *br = bignum_mul(bx, by);
     return Scm_NormalizeBignum(br);
 }
@@ -1081,6 +1329,98 @@ long Scm_BignumRemSI(const ScmBignum *dividend, long divisor)
 #endif
 }
 
+/* Division of large numbers by Newton iteration.
+
+   When the divisor is large, we compute its reciprocal by Newton
+   iteration, so that the division is reduced to multiplications and
+   benefits from the subquadratic multiplication above.  The
+   operations are written with generic arithmetic, as the cost is
+   dominated by the multiplications.  On x86_64, dividing 2n words by
+   n words this way breaks even at about 256 words. */
+
+#define DIV_NEWTON_THRESHOLD 256   /* in words */
+
+/* Returns floor(2^(2n) / b), where b has exactly n bits. */
+static ScmObj bignum_recip(ScmObj b, int n)
+{
+    if (n <= DIV_NEWTON_THRESHOLD * WORD_BITS) {
+        return Scm_Quotient(Scm_Ash(SCM_MAKE_INT(1), 2*n), b, NULL);
+    }
+    /* Get an approximation from the upper half of b, then refine
+       it with one Newton step: x' = x + x * (2^(2n) - b*x) / 2^(2n) */
+    int h = n/2 + 1;
+    ScmObj x = Scm_Ash(bignum_recip(Scm_Ash(b, -(n-h)), h), n-h);
+    ScmObj p = Scm_Ash(SCM_MAKE_INT(1), 2*n);
+    ScmObj e = Scm_Sub(p, Scm_Mul(b, x));
+    x = Scm_Add(x, Scm_Ash(Scm_Mul(x, e), -2*n));
+    /* The result is off by a few at most; adjust it. */
+    e = Scm_Sub(p, Scm_Mul(b, x));
+    while (Scm_Sign(e) < 0) {
+        x = Scm_Sub(x, SCM_MAKE_INT(1));
+        e = Scm_Add(e, b);
+    }
+    while (Scm_NumCmp(e, b) >= 0) {
+        x = Scm_Add(x, SCM_MAKE_INT(1));
+        e = Scm_Sub(e, b);
+    }
+    return x;
+}
+
+/* Store nonnegative integer X into w[0..n).  X must fit. */
+static void store_words(u_long *w, ScmObj x, int n)
+{
+    if (SCM_INTP(x)) {
+        w[0] = (u_long)SCM_INT_VALUE(x);
+    } else {
+        ScmBignum *b = SCM_BIGNUM(x);
+        for (int i=0; i<(int)b->size && i<n; i++) w[i] = b->values[i];
+    }
+}
+
+/* Returns (quotient . remainder), as Scm_BignumDivRem.
+   The dividend is divided in chunks of the divisor's size, from the
+   most significant one.  Each chunk, prepended by the remainder of
+   the previous step, is less than divisor * 2^N, so its quotient fits
+   in a chunk and is obtained by multiplying the reciprocal. */
+static ScmObj bignum_divrem_newton(const ScmBignum *dividend,
+                                   const ScmBignum *divisor)
+{
+    int nw = divisor->size;
+    int n = nw * WORD_BITS;
+    int d = WORD_BITS - 1 - Scm__HighestBitNumber(divisor->values[nw-1]);
+
+    ScmBignum *a = SCM_BIGNUM(Scm_BignumCopy(dividend));
+    ScmBignum *b = SCM_BIGNUM(Scm_BignumCopy(divisor));
+    a->sign = b->sign = 1;
+    /* normalize so that the divisor has exactly n bits */
+    ScmObj b2 = Scm_Ash(SCM_OBJ(b), d);
+    ScmObj a2 = Scm_Ash(SCM_OBJ(a), d);
+    ScmObj recip = bignum_recip(b2, n);
+
+    int nchunks = (SCM_BIGNUM_SIZE(a2) + nw - 1) / nw;
+    ScmBignum *q = make_bignum(nchunks * nw);
+    ScmObj r = SCM_MAKE_INT(0);
+    for (int i=nchunks-1; i>=0; i--) {
+        ScmObj cur = Scm_Add(Scm_Ash(r, n),
+                             bignum_slice(SCM_BIGNUM(a2), i*nw, nw));
+        ScmObj qi = Scm_Ash(Scm_Mul(cur, recip), -2*n);
+        r = Scm_Sub(cur, Scm_Mul(qi, b2));
+        while (Scm_Sign(r) < 0) {
+            qi = Scm_Sub(qi, SCM_MAKE_INT(1));
+            r = Scm_Add(r, b2);
+        }
+        while (Scm_NumCmp(r, b2) >= 0) {
+            qi = Scm_Add(qi, SCM_MAKE_INT(1));
+            r = Scm_Sub(r, b2);
+        }
+        store_words(q->values + i*nw, qi, nw);
+    }
+    r = Scm_Ash(r, -d);
+    q->sign = dividend->sign * divisor->sign;
+    if (dividend->sign < 0) r = Scm_Negate(r);
+    return Scm_Cons(Scm_NormalizeBignum(q), r);
+}
+
 /* assuming dividend and divisor is normalized.  returns quotient and
    remainder */
 ScmObj Scm_BignumDivRem(const ScmBignum *dividend, const ScmBignum *divisor)
@@ -1090,6 +1430,11 @@ ScmObj Scm_BignumDivRem(const ScmBignum *dividend, const ScmBignum *divisor)
         return Scm_Cons(SCM_MAKE_INT(0), SCM_OBJ(dividend));
     }
 
+    if (divisor->size > DIV_NEWTON_THRESHOLD
+        && dividend->size - divisor->size > DIV_NEWTON_THRESHOLD) {
+        return bignum_divrem_newton(dividend, divisor);
+    }
+
     ScmBignum *q = make_bignum(dividend->size - divisor->size + 1);
     ScmBignum *r = bignum_gdiv(dividend, divisor, q);
     q->sign = dividend->sign * divisor->sign;
@@ -1119,11 +1464,10 @@ ScmObj Scm_BignumAsh(const ScmBignum *x, int cnt)
             }
         } else {
             if (SCM_BIGNUM_SIGN(x) < 0) {
-                /* painful way */
-                ScmObj r = Scm_Quotient(Scm_Add(SCM_OBJ(x), SCM_MAKE_INT(1)),
-                                        Scm_Ash(SCM_MAKE_INT(1), -cnt),
-                                        NULL);
-                return Scm_Add(r, SCM_MAKE_INT(-1));
+                /* floor(x / 2^c) = -((|x|-1) >> c) - 1.  Shifting |x|-1
+                   is linear, while dividing x by 2^c is not. */
+                ScmObj a = Scm_Sub(Scm_BignumNegate(x), SCM_MAKE_INT(1));
+                return Scm_Sub(SCM_MAKE_INT(-1), Scm_Ash(a, cnt));
             } else {
                 ScmBignum *r = make_bignum(rsize);
                 return Scm_NormalizeBignum(bignum_rshift(r, x, -cnt));
@@ -1272,24 +1616,116 @@ int Scm_BignumLogCount(const ScmBignum *b)
  * Printing
  */
 
+/* Radix conversion.
+ *
+ *   Converting a bignum by repeatedly dividing it by a small number
+ *   takes O(n^2).  For a large number, we divide it by radix^k that
+ *   has about a half of its digits, and convert the quotient and the
+ *   remainder recursively.  With subquadratic division, this is much
+ *   faster.  The powers of radix are cached in radix_powers.
+ */
+
+#define RADIX_CONV_THRESHOLD  32    /* in words */
+#define RADIX_POWER_LEVELS    32
+
+/* radix_powers[r][i] = r^(d*2^i), where d is radix_chunk_digits(r) */
+static ScmObj radix_powers[37][RADIX_POWER_LEVELS] = { { NULL } };
+
+/* Returns the maximum D such that radix^D fits in a half word, and
+   sets radix^D in *chunk. */
+static int radix_chunk_digits(int radix, u_long *chunk)
+{
+    u_long c = radix;
+    int d = 1;
+    while (c * radix < HALF_WORD) { c *= radix; d++; }
+    *chunk = c;
+    return d;
+}
+
+static ScmObj radix_power(int radix, int level)
+{
+    ScmObj p = radix_powers[radix][level];
+    if (p == NULL) {
+        if (level == 0) {
+            u_long c;
+            radix_chunk_digits(radix, &c);
+            p = Scm_MakeIntegerU(c);
+        } else {
+            ScmObj h = radix_power(radix, level-1);
+            p = Scm_Mul(h, h);
+        }
+        /* Races are harmless, since everyone computes the same value. */
+        radix_powers[radix][level] = p;
+    }
+    return p;
+}
+
+/* Writes the digits of a nonnegative integer X into buf[0..width),
+   right aligned and padded with '0'.  X must be less than radix^width. */
+static void radix_conv(ScmObj x, int radix, const char *tab,
+                       char *buf, int width)
+{
+    u_long chunk;
+    int d = radix_chunk_digits(radix, &chunk);
+
+    if (SCM_BIGNUMP(x) && SCM_BIGNUM_SIZE(x) >= RADIX_CONV_THRESHOLD) {
+        /* Find the level where the power has about a half digits of x. */
+        int xdigits = (int)(SCM_BIGNUM_SIZE(x) * WORD_BITS
+                            * log(2.0) / log((double)radix));
+        int level = 0;
+        while (level < RADIX_POWER_LEVELS-1 && (d << (level+2)) <= xdigits) {
+            level++;
+        }
+        int lowdigits = d << level;
+        ScmObj r;
+        ScmObj q = Scm_Quotient(x, radix_power(radix, level), &r);
+        radix_conv(q, radix, tab, buf, width - lowdigits);
+        radix_conv(r, radix, tab, buf + width - lowdigits, lowdigits);
+        return;
+    }
+
+    char *p = buf + width;
+    if (SCM_INTP(x)) {
+        u_long v = SCM_INT_VALUE(x);
+        while (v > 0 && p > buf) {
+            *--p = tab[v % radix];
+            v /= radix;
+        }
+    } else {
+        /* Take d digits at once. */
+        ScmBignum *q = SCM_BIGNUM(Scm_BignumCopy(SCM_BIGNUM(x)));
+        while (q->size > 0) {
+            u_long rem = bignum_sdiv(q, chunk);
+            for (int i=0; i<d && p > buf; i++) {
+                *--p = tab[rem % radix];
+                rem /= radix;
+            }
+            while (q->size > 0 && q->values[q->size-1] == 0) q->size--;
+        }
+    }
+    while (p > buf) *--p = '0';
+}
+
 ScmObj Scm_BignumToString(const ScmBignum *b, int radix, int use_upper)
 {
     static const char ltab[] = "0123456789abcdefghijklmnopqrstuvwxyz";
     static const char utab[] = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ";
     const char *tab = use_upper? utab : ltab;
-    ScmObj h = SCM_NIL, t = SCM_NIL;
     if (radix < 2 || radix > 36)
         Scm_Error("radix out of range: %d", radix);
-    ScmBignum *q = SCM_BIGNUM(Scm_BignumCopy(b));
-    for (;q->size > 0;) {
-        long rem = bignum_sdiv(q, radix);
-        SCM_ASSERT(rem >= 0 && rem < radix);
-        SCM_APPEND1(h, t, SCM_MAKE_CHAR(tab[rem]));
-        for (; q->values[q->size-1] == 0 && q->size > 0; q->size--)
-            ;
-    }
-    if (q->sign < 0) SCM_APPEND1(h, t, SCM_MAKE_CHAR('-'));
-    return Scm_ListToString(Scm_ReverseX(h));
+
+    /* upper bound of the number of digits.  buf[0] is for the sign. */
+    int width = (int)(b->size * WORD_BITS * log(2.0) / log((double)radix)) + 2;
+    char *buf = SCM_NEW_ATOMIC2(char*, width+1);
+    ScmBignum *x = SCM_BIGNUM(Scm_BignumCopy(b));
+    x->sign = 1;
+    radix_conv(Scm_NormalizeBignum(x), radix, tab, buf+1, width);
+
+    char *p = buf+1;
+    while (*p == '0' && p < buf+width) p++;
+    if (b->sign < 0) *--p = '-';
+    int len = (int)(buf+width+1 - p);
+    return Scm_MakeString(p, len, len, SCM_STRING_COPYING);
 }
 
 int Scm_DumpBignum(const ScmBignum *b, ScmPort *out)
@@ -0,0 +1,678 @@
+/*
+ * cache.c - bounded caches
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#define LIBGAUCHE_BODY
+#include "gauche.h"
+
+/*=============================================================
+ * Internal structures
+ *
+ *  Each segment has a hash core that maps a key to a Node, and
+ *  a circular doubly linked list of Nodes with a sentinel.
+ *  The node next to the sentinel is the most recently used one.
+ */
+
+typedef struct NodeRec {
+    struct NodeRec *prev;
+    struct NodeRec *next;
+    ScmObj key;
+    ScmObj value;
+    long   weight;
+    double expires;             /* 0 if the entry never expires */
+    u_long hashval;             /* only valid if we need it */
+    int    referenced;          /* for CLOCK policy */
+} Node;
+
+/* Frequency sketch for TinyLFU admission.  It is a count-min sketch
+   with 4 rows of small saturating counters.  All the counters are
+   halved periodically so that old accesses fade out. */
+#define SKETCH_DEPTH    4
+#define SKETCH_MAXCOUNT 15
+
+typedef struct SketchRec {
+    u_char *counters;           /* SKETCH_DEPTH rows of width counters */
+    u_long  mask;               /* width - 1 */
+    u_long  additions;
+    u_long  sampleSize;
+} Sketch;
+
+struct ScmCacheSegmentRec {
+    ScmInternalMutex mutex;
+    ScmHashCore table;          /* key -> Node* */
+    Node   head;                /* sentinel */
+    long   weight;
+    long   maxEntries;          /* 0 for unlimited */
+    long   maxWeight;           /* 0 for unlimited */
+    Sketch *sketch;             /* NULL unless admission is enabled */
+    u_long hits;
+    u_long misses;
+    u_long evictions;
+    u_long expirations;
+    u_long rejections;
+};
+
+typedef ScmCacheSegment Segment;
+
+/* Set if any entry may have expiration time, so that we need to
+   read the clock. */
+#define CACHE_TIMED   (1L<<8)
+
+/* Set if the cache has multiple segments and max-weight.  The segments
+   share the weight budget kept in the cache, so that an entry can weigh
+   up to max-weight whichever segment it goes into.  The number of
+   entries is still bounded by each segment. */
+#define CACHE_SHARED_WEIGHT (1L<<9)
+
+/* Max number of segments of a thread-safe cache. */
+#define MAX_SEGMENTS  16
+
+/* Each segment of a thread-safe cache should have at least this many
+   entries, or the eviction order gets too coarse. */
+#define MIN_SEGMENT_ENTRIES 64
+
+/* Number of entries from the tail checked for expiration by each
+   insertion. */
+#define EXPIRE_SCAN   2
+
+static void cache_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
+{
+    ScmCache *c = SCM_CACHE(obj);
+    Scm_Printf(port, "#<cache %p (%ld entries)>", c, Scm_CacheNumEntries(c));
+}
+
+SCM_DEFINE_BUILTIN_CLASS(Scm_CacheClass, cache_print, NULL, NULL, NULL,
+                         SCM_CLASS_DICTIONARY_CPL);
+
+/*=============================================================
+ * Utilities
+ */
+
+static u_long mix_hash(u_long h, int seed)
+{
+    h += (u_long)seed * 0x9e3779b9UL;
+    h ^= h >> 16;
+    h *= 0x85ebca6bUL;
+    h ^= h >> 13;
+    h *= 0xc2b2ae35UL;
+    h ^= h >> 16;
+    return h;
+}
+
+static double cache_now(void)
+{
+    u_long sec, nsec, usec;
+    if (Scm_ClockGetTimeMonotonic(&sec, &nsec)) {
+        return (double)sec + (double)nsec/1.0e9;
+    }
+    Scm_GetTimeOfDay(&sec, &usec);
+    return (double)sec + (double)usec/1.0e6;
+}
+
+static int node_expired(Node *n, double now)
+{
+    return (n->expires > 0 && now >= n->expires);
+}
+
+static void node_unlink(Node *n)
+{
+    n->prev->next = n->next;
+    n->next->prev = n->prev;
+    n->prev = n->next = NULL;
+}
+
+static void node_push_front(Segment *seg, Node *n)
+{
+    n->next = seg->head.next;
+    n->prev = &seg->head;
+    seg->head.next->prev = n;
+    seg->head.next = n;
+}
+
+static void node_move_to_front(Segment *seg, Node *n)
+{
+    if (seg->head.next != n) {
+        node_unlink(n);
+        node_push_front(seg, n);
+    }
+}
+
+/*=============================================================
+ * Frequency sketch
+ */
+
+static Sketch *sketch_new(long capacity)
+{
+    u_long width = 16;
+    while (width < (u_long)capacity) width <<= 1;
+    Sketch *s = SCM_NEW(Sketch);
+    s->counters = SCM_NEW_ATOMIC_ARRAY(u_char, width*SKETCH_DEPTH);
+    memset(s->counters, 0, width*SKETCH_DEPTH);
+    s->mask = width - 1;
+    s->additions = 0;
+    s->sampleSize = width * 10;
+    return s;
+}
+
+static u_char *sketch_counter(Sketch *s, u_long hashval, int row)
+{
+    return s->counters + row*(s->mask+1) + (mix_hash(hashval, row)&s->mask);
+}
+
+static void sketch_increment(Sketch *s, u_long hashval)
+{
+    int added = FALSE;
+    for (int i=0; i<SKETCH_DEPTH; i++) {
+        u_char *p = sketch_counter(s, hashval, i);
+        if (*p < SKETCH_MAXCOUNT) { (*p)++; added = TRUE; }
+    }
+    if (added && ++s->additions >= s->sampleSize) {
+        u_long size = (s->mask+1)*SKETCH_DEPTH;
+        for (u_long i=0; i<size; i++) s->counters[i] >>= 1;
+        s->additions /= 2;
+    }
+}
+
+static int sketch_estimate(Sketch *s, u_long hashval)
+{
+    int freq = SKETCH_MAXCOUNT;
+    for (int i=0; i<SKETCH_DEPTH; i++) {
+        u_char *p = sketch_counter(s, hashval, i);
+        if (*p < freq) freq = *p;
+    }
+    return freq;
+}
+
+/*=============================================================
+ * Segment operations
+ *
+ *  These are called with the segment locked, if the cache is
+ *  thread-safe.  They may throw an error only from the hash core
+ *  search, before modifying anything.
+ */
+
+static void seg_init(ScmCache *c, Segment *seg, long maxEntries,
+                     long maxWeight)
+{
+    if (c->flags & SCM_CACHE_THREAD_SAFE) {
+        (void)SCM_INTERNAL_MUTEX_INIT(seg->mutex);
+    }
+    Scm_HashCoreInitSimple(&seg->table, c->type, 0, NULL);
+    seg->head.next = seg->head.prev = &seg->head;
+    seg->weight = 0;
+    seg->maxEntries = maxEntries;
+    seg->maxWeight = maxWeight;
+    if (c->flags & SCM_CACHE_ADMISSION) {
+        seg->sketch = sketch_new(maxEntries > 0 ? maxEntries : 1024);
+    } else {
+        seg->sketch = NULL;
+    }
+    seg->hits = seg->misses = seg->evictions = 0;
+    seg->expirations = seg->rejections = 0;
+}
+
+/* The shared weight is locked after the segment, never before. */
+static long cache_weight(ScmCache *c)
+{
+    SCM_INTERNAL_MUTEX_LOCK(c->mutex);
+    long w = c->weight;
+    SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+    return w;
+}
+
+static void seg_add_weight(ScmCache *c, Segment *seg, long delta)
+{
+    seg->weight += delta;
+    if (c->flags & CACHE_SHARED_WEIGHT) {
+        SCM_INTERNAL_MUTEX_LOCK(c->mutex);
+        c->weight += delta;
+        SCM_INTERNAL_MUTEX_UNLOCK(c->mutex);
+    }
+}
+
+static void seg_remove(ScmCache *c, Segment *seg, Node *n)
+{
+    (void)Scm_HashCoreSearch(&seg->table, (intptr_t)n->key, SCM_DICT_DELETE);
+    node_unlink(n);
+    seg_add_weight(c, seg, -n->weight);
+}
+
+/* Returns TRUE if the segment exceeds the limit after adding NENTRIES
+   entries with total WEIGHT. */
+static int seg_over(ScmCache *c, Segment *seg, int nentries, long weight)
+{
+    int n = Scm_HashCoreNumEntries(&seg->table) + nentries;
+    long w = (c->flags & CACHE_SHARED_WEIGHT) ? cache_weight(c) : seg->weight;
+    return ((seg->maxEntries > 0 && n > seg->maxEntries)
+            || (seg->maxWeight > 0 && w + weight > seg->maxWeight));
+}
+
+/* Returns the entry to be evicted next, or NULL if there's none other
+   than PROTECT.  With CLOCK policy, referenced entries get a second
+   chance. */
+static Node *seg_victim(ScmCache *c, Segment *seg, Node *protect)
+{
+    Node *n = seg->head.prev;
+    if (c->policy == SCM_CACHE_CLOCK) {
+        while (n != &seg->head && n != protect && n->referenced) {
+            n->referenced = FALSE;
+            node_move_to_front(seg, n);
+            n = seg->head.prev;
+        }
+    }
+    if (n == &seg->head || n == protect) return NULL;
+    return n;
+}
+
+static void seg_evict(ScmCache *c, Segment *seg, int nentries, long weight,
+                      Node *protect)
+{
+    while (seg_over(c, seg, nentries, weight)) {
+        Node *n = seg_victim(c, seg, protect);
+        if (n == NULL) break;
+        seg_remove(c, seg, n);
+        seg->evictions++;
+    }
+}
+
+static void seg_expire_tail(ScmCache *c, Segment *seg, double now)
+{
+    for (int i=0; i<EXPIRE_SCAN; i++) {
+        Node *n = seg->head.prev;
+        if (n == &seg->head || !node_expired(n, now)) break;
+        seg_remove(c, seg, n);
+        seg->expirations++;
+    }
+}
+
+static ScmObj seg_ref(ScmCache *c, Segment *seg, ScmObj key, ScmObj fallback,
+                      u_long hashval, double now, int touch)
+{
+    if (touch && seg->sketch) sketch_increment(seg->sketch, hashval);
+
+    ScmDictEntry *e = Scm_HashCoreSearch(&seg->table, (intptr_t)key,
+                                         SCM_DICT_GET);
+    if (e == NULL) {
+        if (touch) seg->misses++;
+        return fallback;
+    }
+    Node *n = (Node*)e->value;
+    if (node_expired(n, now)) {
+        if (touch) {
+            seg_remove(c, seg, n);
+            seg->expirations++;
+            seg->misses++;
+        }
+        return fallback;
+    }
+    if (touch) {
+        seg->hits++;
+        if (c->policy == SCM_CACHE_CLOCK) n->referenced = TRUE;
+        else node_move_to_front(seg, n);
+    }
+    return n->value;
+}
+
+static ScmObj seg_set(ScmCache *c, Segment *seg, ScmObj key, ScmObj value,
+                      long weight, double expires, u_long hashval,
+                      double now, int flags)
+{
+    if (seg->sketch) sketch_increment(seg->sketch, hashval);
+
+    ScmDictEntry *e = Scm_HashCoreSearch(&seg->table, (intptr_t)key,
+                                         SCM_DICT_GET);
+    if (e != NULL) {
+        Node *n = (Node*)e->value;
+        if ((flags&SCM_DICT_NO_OVERWRITE) && !node_expired(n, now)) {
+            return n->value;
+        }
+        if (seg->maxWeight > 0 && weight > seg->maxWeight) {
+            seg_remove(c, seg, n);
+            seg->rejections++;
+            return SCM_UNBOUND;
+        }
+        seg_add_weight(c, seg, weight - n->weight);
+        n->value = value;
+        n->weight = weight;
+        n->expires = expires;
+        node_move_to_front(seg, n);
+        seg_evict(c, seg, 0, 0, n);
+        return value;
+    }
+
+    if (seg->maxWeight > 0 && weight > seg->maxWeight) {
+        seg->rejections++;
+        return SCM_UNBOUND;
+    }
+    if (c->flags & CACHE_TIMED) seg_expire_tail(c, seg, now);
+    if (seg_over(c, seg, 1, weight)) {
+        if (seg->sketch) {
+            Node *v = seg_victim(c, seg, NULL);
+            if (v && sketch_estimate(seg->sketch, v->hashval)
+                     >= sketch_estimate(seg->sketch, hashval)) {
+                seg->rejections++;
+                return SCM_UNBOUND;
+            }
+        }
+        seg_evict(c, seg, 1, weight, NULL);
+    }
+
+    Node *n = SCM_NEW(Node);
+    n->key = key;
+    n->value = value;
+    n->weight = weight;
+    n->expires = expires;
+    n->hashval = hashval;
+    n->referenced = FALSE;
+    e = Scm_HashCoreSearch(&seg->table, (intptr_t)key, SCM_DICT_CREATE);
+    e->value = (intptr_t)n;
+    node_push_front(seg, n);
+    seg_add_weight(c, seg, weight);
+    return value;
+}
+
+static ScmObj seg_delete(ScmCache *c, Segment *seg, ScmObj key, double now)
+{
+    ScmDictEntry *e = Scm_HashCoreSearch(&seg->table, (intptr_t)key,
+                                         SCM_DICT_DELETE);
+    if (e == NULL) return SCM_UNBOUND;
+    Node *n = (Node*)e->value;
+    node_unlink(n);
+    seg_add_weight(c, seg, -n->weight);
+    if (node_expired(n, now)) return SCM_UNBOUND;
+    return n->value;
+}
+
+static void seg_clear(ScmCache *c, Segment *seg)
+{
+    Scm_HashCoreClear(&seg->table);
+    seg->head.next = seg->head.prev = &seg->head;
+    seg_add_weight(c, seg, -seg->weight);
+}
+
+/* Runs BODY with the segment locked.  In equal?-cache, comparing keys
+   may call back Scheme code that can throw an error; we make sure
+   the lock is released in that case. */
+#define SEGMENT_LOCKED(c, seg, body)                                    \
+    do {                                                                \
+        if (!((c)->flags & SCM_CACHE_THREAD_SAFE)) {                    \
+            body;                                                       \
+        } else if ((c)->type != SCM_HASH_EQUAL) {                       \
+            SCM_INTERNAL_MUTEX_LOCK((seg)->mutex);                      \
+            body;                                                       \
+            SCM_INTERNAL_MUTEX_UNLOCK((seg)->mutex);                    \
+        } else {                                                        \
+            SCM_INTERNAL_MUTEX_LOCK((seg)->mutex);                      \
+            SCM_UNWIND_PROTECT {                                        \
+                body;                                                   \
+            }                                                           \
+            SCM_WHEN_ERROR {                                            \
+                SCM_INTERNAL_MUTEX_UNLOCK((seg)->mutex);                \
+                SCM_NEXT_HANDLER;                                       \
+            }                                                           \
+            SCM_END_PROTECT;                                            \
+            SCM_INTERNAL_MUTEX_UNLOCK((seg)->mutex);                    \
+        }                                                               \
+    } while (0)
+
+/*=============================================================
+ * Public API
+ */
+
+ScmObj Scm_MakeCache(ScmHashType type, ScmCachePolicy policy,
+                     long maxEntries, long maxWeight, double ttl, int flags)
+{
+    ScmHashProc *hashfn;
+    ScmHashCompareProc *cmpfn;
+
+    if (type == SCM_HASH_GENERAL
+        || !Scm_HashCoreTypeToProcs(type, &hashfn, &cmpfn)) {
+        Scm_Error("unsupported hash type for a cache: %d", type);
+    }
+    if (maxEntries < 0) Scm_Error("max-entries must be nonnegative: %ld",
+                                  maxEntries);
+    if (maxWeight < 0) Scm_Error("max-weight must be nonnegative: %ld",
+                                 maxWeight);
+    if (ttl < 0) Scm_Error("ttl must be nonnegative: %f", ttl);
+
+    ScmCache *c = SCM_NEW(ScmCache);
+    SCM_SET_CLASS(c, SCM_CLASS_CACHE);
+    c->type = type;
+    c->policy = policy;
+    c->flags = flags & (SCM_CACHE_THREAD_SAFE|SCM_CACHE_ADMISSION);
+    c->maxEntries = maxEntries;
+    c->maxWeight = maxWeight;
+    c->ttl = ttl;
+    if (ttl > 0) c->flags |= CACHE_TIMED;
+    c->weigher = SCM_FALSE;
+
+    int nsegs = 1;
+    if (flags & SCM_CACHE_THREAD_SAFE) {
+        nsegs = MAX_SEGMENTS;
+        if (maxEntries > 0) {
+            while (nsegs > 1 && maxEntries/nsegs < MIN_SEGMENT_ENTRIES) {
+                nsegs >>= 1;
+            }
+        }
+    }
+    c->numSegments = nsegs;
+    c->weight = 0;
+    if (nsegs > 1 && maxWeight > 0) {
+        c->flags |= CACHE_SHARED_WEIGHT;
+        (void)SCM_INTERNAL_MUTEX_INIT(c->mutex);
+    }
+    c->segments = SCM_NEW_ARRAY(Segment, nsegs);
+    for (int i=0; i<nsegs; i++) {
+        seg_init(c, &c->segments[i],
+                 (maxEntries + nsegs - 1)/nsegs, maxWeight);
+    }
+    return SCM_OBJ(c);
+}
+
+/* We need the hash value of the key if we have multiple segments
+   or a frequency sketch. */
+static u_long key_hash(ScmCache *c, ScmObj key)
+{
+    if (c->type == SCM_HASH_STRING && !SCM_STRINGP(key)) {
+        Scm_Error("Got non-string key %S to the string cache.", key);
+    }
+    if (c->numSegments == 1 && !(c->flags & SCM_CACHE_ADMISSION)) return 0;
+    ScmHashCore *core = &c->segments[0].table;
+    return core->hashfn(core, (intptr_t)key);
+}
+
+static Segment *key_segment(ScmCache *c, u_long hashval)
+{
+    if (c->numSegments == 1) return &c->segments[0];
+    return &c->segments[mix_hash(hashval, SKETCH_DEPTH)
+                        & (c->numSegments-1)];
+}
+
+static ScmObj cache_ref(ScmCache *c, ScmObj key, ScmObj fallback, int touch)
+{
+    u_long hashval = key_hash(c, key);
+    Segment *seg = key_segment(c, hashval);
+    double now = (c->flags & CACHE_TIMED) ? cache_now() : 0.0;
+    ScmObj r = SCM_UNBOUND;
+    SEGMENT_LOCKED(c, seg,
+                   r = seg_ref(c, seg, key, fallback, hashval, now, touch));
+    return r;
+}
+
+ScmObj Scm_CacheRef(ScmCache *c, ScmObj key, ScmObj fallback)
+{
+    return cache_ref(c, key, fallback, TRUE);
+}
+
+ScmObj Scm_CachePeek(ScmCache *c, ScmObj key, ScmObj fallback)
+{
+    return cache_ref(c, key, fallback, FALSE);
+}
+
+/* With the shared weight budget, seg_set may store an entry after
+   evicting everything else in its segment and still exceed max-weight.
+   We evict from other segments then, locking one at a time. */
+static void cache_reclaim(ScmCache *c, Segment *seg)
+{
+    int k = (int)(seg - c->segments);
+    for (int i=1; i<c->numSegments; i++) {
+        if (cache_weight(c) <= c->maxWeight) break;
+        Segment *s = &c->segments[(k+i) & (c->numSegments-1)];
+        SEGMENT_LOCKED(c, s, seg_evict(c, s, 0, 0, NULL));
+    }
+}
+
+ScmObj Scm_CacheSet(ScmCache *c, ScmObj key, ScmObj value,
+                    long weight, double ttl, int flags)
+{
+    if (weight < 0) {
+        if (SCM_FALSEP(c->weigher)) {
+            weight = 1;
+        } else {
+            ScmObj w = Scm_ApplyRec2(c->weigher, key, value);
+            if (!SCM_INTP(w) || SCM_INT_VALUE(w) < 0) {
+                Scm_Error("cache weigher must return a nonnegative fixnum, "
+                          "but got %S for key %S", w, key);
+            }
+            weight = SCM_INT_VALUE(w);
+        }
+    }
+    if (ttl < 0) ttl = c->ttl;
+    if (ttl > 0) c->flags |= CACHE_TIMED;
+
+    u_long hashval = key_hash(c, key);
+    Segment *seg = key_segment(c, hashval);
+    double now = (c->flags & CACHE_TIMED) ? cache_now() : 0.0;
+    double expires = (ttl > 0) ? now + ttl : 0.0;
+    ScmObj r = SCM_UNBOUND;
+    SEGMENT_LOCKED(c, seg,
+                   r = seg_set(c, seg, key, value, weight, expires,
+                               hashval, now, flags));
+    if (c->flags & CACHE_SHARED_WEIGHT) cache_reclaim(c, seg);
+    return r;
+}
+
+ScmObj Scm_CacheDelete(ScmCache *c, ScmObj key)
+{
+    u_long hashval = key_hash(c, key);
+    Segment *seg = key_segment(c, hashval);
+    double now = (c->flags & CACHE_TIMED) ? cache_now() : 0.0;
+    ScmObj r = SCM_UNBOUND;
+    SEGMENT_LOCKED(c, seg, r = seg_delete(c, seg, key, now));
+    return r;
+}
+
+void Scm_CacheClear(ScmCache *c)
+{
+    for (int i=0; i<c->numSegments; i++) {
+        Segment *seg = &c->segments[i];
+        SEGMENT_LOCKED(c, seg, seg_clear(c, seg));
+    }
+}
+
+/* NB: The count may include expired entries that haven't been
+   removed yet. */
+long Scm_CacheNumEntries(ScmCache *c)
+{
+    long n = 0;
+    for (int i=0; i<c->numSegments; i++) {
+        n += Scm_HashCoreNumEntries(&c->segments[i].table);
+    }
+    return n;
+}
+
+long Scm_CacheWeight(ScmCache *c)
+{
+    long w = 0;
+    for (int i=0; i<c->numSegments; i++) {
+        w += c->segments[i].weight;
+    }
+    return w;
+}
+
+static ScmObj seg_to_alist(Segment *seg, ScmObj *tail, ScmObj head,
+                           double now)
+{
+    for (Node *n = seg->head.next; n != &seg->head; n = n->next) {
+        if (node_expired(n, now)) continue;
+        SCM_APPEND1(head, *tail, Scm_Cons(n->key, n->value));
+    }
+    return head;
+}
+
+/* Returns ((key . value) ...), from the most recently used one
+   in each segment. */
+ScmObj Scm_CacheToAlist(ScmCache *c)
+{
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+    double now = (c->flags & CACHE_TIMED) ? cache_now() : 0.0;
+    for (int i=0; i<c->numSegments; i++) {
+        Segment *seg = &c->segments[i];
+        SEGMENT_LOCKED(c, seg, h = seg_to_alist(seg, &t, h, now));
+    }
+    return h;
+}
+
+ScmObj Scm_CacheStats(ScmCache *c)
+{
+    u_long hits = 0, misses = 0, evictions = 0, expirations = 0;
+    u_long rejections = 0;
+    for (int i=0; i<c->numSegments; i++) {
+        Segment *seg = &c->segments[i];
+        hits += seg->hits;
+        misses += seg->misses;
+        evictions += seg->evictions;
+        expirations += seg->expirations;
+        rejections += seg->rejections;
+    }
+    ScmObj h = SCM_NIL, t = SCM_NIL;
+#define STAT(name, val) \
+    SCM_APPEND1(h, t, Scm_Cons(SCM_INTERN(name), Scm_MakeIntegerU(val)))
+    STAT("hits", hits);
+    STAT("misses", misses);
+    STAT("evictions", evictions);
+    STAT("expirations", expirations);
+    STAT("rejections", rejections);
+    STAT("entries", Scm_CacheNumEntries(c));
+    STAT("weight", Scm_CacheWeight(c));
+#undef STAT
+    return h;
+}
+
+void Scm_CacheResetStats(ScmCache *c)
+{
+    for (int i=0; i<c->numSegments; i++) {
+        Segment *seg = &c->segments[i];
+        seg->hits = seg->misses = seg->evictions = 0;
+        seg->expirations = seg->rejections = 0;
+    }
+}
@@ -36,6 +36,7 @@
 #include "gauche/class.h"
 #include "gauche/code.h"
 #include "gauche/priv/builtin-syms.h"
+#include "gauche/priv/atomicP.h"
 #include "gauche/priv/macroP.h"
 #include "gauche/priv/writerP.h"
 
@@ -54,6 +55,7 @@ static void method_print(ScmObj, ScmPort *, ScmWriteContext*);
 static void next_method_print(ScmObj, ScmPort *, ScmWriteContext*);
 static void slot_accessor_print(ScmObj, ScmPort *, ScmWriteContext*);
 static void accessor_method_print(ScmObj, ScmPort *, ScmWriteContext*);
+static void slot_cache_print(ScmObj, ScmPort *, ScmWriteContext*);
 
 static ScmObj class_allocate(ScmClass *klass, ScmObj initargs);
 static ScmObj generic_allocate(ScmClass *klass, ScmObj initargs);
@@ -127,6 +129,7 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_AccessorMethodClass,
                          method_allocate,
                          Scm_MethodCPL);
 SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_NextMethodClass, next_method_print);
+SCM_DEFINE_BUILTIN_CLASS_SIMPLE(Scm_SlotCacheClass, slot_cache_print);
 
 /* Builtin generic functions */
 SCM_DEFINE_GENERIC(Scm_GenericMake, Scm_NoNextMethod, NULL);
@@ -180,6 +183,11 @@ static struct {
                                              to ensure this sturcture is
                                              placed in the data area */
 
+/* Incremented whenever a class redefinition starts or ends.  Dispatch
+   caches created before the change are regarded as empty.  Modified
+   only while class_redefinition_lock is held. */
+static volatile u_long class_epoch = 0;
+
 /* Imporant slots in <class> metaboject can be modified only when the
    class is in 'malleable' state.   Here's the check. */
 #define CHECK_MALLEABLE(k, who)                         \
@@ -984,6 +992,7 @@ void Scm_StartClassRedefinition(ScmClass *klass)
 
     /* First, acquire the global lock. */
     lock_class_redefinition(vm);
+    class_epoch++;
 
     /* Mark this class to be redefined. */
     int success = FALSE;
@@ -1028,6 +1037,7 @@ void Scm_CommitClassRedefinition(ScmClass *klass, ScmObj newklass)
     (void)SCM_INTERNAL_MUTEX_UNLOCK(klass->mutex);
 
     /* Decrement the recursive global lock. */
+    if (class_redefinition_lock.owner == vm) class_epoch++;
     unlock_class_redefinition(vm);
 }
 
@@ -1572,6 +1582,109 @@ ScmObj Scm_VMSlotSet(ScmObj obj, ScmObj slot, ScmObj val)
     else            return slot_set_using_accessor(obj, sa, val);
 }
 
+/* SLOT-REFC, SLOT-SETC
+ *
+ * slot-ref and slot-set! with a constant slot name are compiled into
+ * these instructions.  Just like GREF replaces its identifier operand
+ * with a gloc, they replace the slot name operand with a slot cache,
+ * which remembers the class of the object and its accessor of the slot.
+ * While a call site sees instances of the same class, we don't need to
+ * look up the accessor.  If the slot is an ordinary instance slot, the
+ * instruction accesses it directly without calling the routines below
+ * (see Scm__SlotCacheLocation in gauche/class.h).
+ *
+ * A slot cache is never modified once installed; when the call site
+ * sees another class, a new cache replaces the old one with a single
+ * store.  The cache is valid only while the class isn't redefined and
+ * has the same accessors list; the setter of the accessors slot always
+ * installs a new list.  If a call site has seen too many classes, we
+ * stop replacing the cache and just look up the accessor.
+ */
+#define SLOT_CACHE_MAX_MISSES  16
+
+static void slot_cache_print(ScmObj obj, ScmPort *out, ScmWriteContext *ctx)
+{
+    ScmSlotCache *c = SCM_SLOT_CACHE(obj);
+    Scm_Printf(out, "#<slot-cache %S.%S>", c->klass->name, c->name);
+}
+
+/* Returns the accessor of the slot of KLASS named by the operand, or
+   NULL if there's no such slot.  The slot name is stored in *NAME. */
+static ScmSlotAccessor *slot_cache_lookup(ScmWord *operand, ScmClass *klass,
+                                          ScmObj *name)
+{
+    ScmObj op = SCM_ATOMIC_LOAD_PTR(ScmObj, *operand);
+    int misses = 0;
+
+    if (SCM_SLOT_CACHE_P(op)) {
+        ScmSlotCache *c = SCM_SLOT_CACHE(op);
+        *name = c->name;
+        if (c->klass == klass && SCM_EQ(c->accessors, klass->accessors)) {
+            return c->sa;
+        }
+        misses = c->misses + 1;
+    } else {
+        *name = op;
+    }
+
+    ScmObj accessors = klass->accessors;
+    ScmSlotAccessor *sa = Scm_GetSlotAccessor(klass, *name);
+    if (sa != NULL && misses <= SLOT_CACHE_MAX_MISSES) {
+        ScmSlotCache *c = SCM_NEW(ScmSlotCache);
+        SCM_SET_CLASS(c, SCM_CLASS_SLOT_CACHE);
+        c->name = *name;
+        c->klass = klass;
+        c->accessors = accessors;
+        c->sa = sa;
+        if (sa->getter == NULL && sa->setter == NULL && sa->slotNumber >= 0
+            && sa->slotNumber < klass->numInstanceSlots) {
+            c->index = sa->slotNumber;
+        } else {
+            c->index = -1;
+        }
+        c->misses = misses;
+        SCM_ATOMIC_STORE_PTR(*operand, c);
+    }
+    return sa;
+}
+
+/* Returns the slot name of the operand of SLOT-REFC or SLOT-SETC. */
+ScmObj Scm__SlotCacheName(ScmObj operand)
+{
+    if (SCM_SLOT_CACHE_P(operand)) return SCM_SLOT_CACHE(operand)->name;
+    else return operand;
+}
+
+/* OPERAND points to the operand word of SLOT-REFC. */
+ScmObj Scm__VMSlotRefC(ScmObj obj, ScmWord *operand)
+{
+    ScmClass *klass = Scm_ClassOf(obj);
+    ScmObj slot;
+
+    if (!SCM_FALSEP(klass->redefined)) {
+        return Scm_VMSlotRef(obj, Scm__SlotCacheName(SCM_OBJ(*operand)),
+                             FALSE);
+    }
+    ScmSlotAccessor *sa = slot_cache_lookup(operand, klass, &slot);
+    if (sa == NULL) return SLOT_MISSING3(klass, obj, slot);
+    else            return slot_ref_using_accessor(obj, sa, FALSE);
+}
+
+/* OPERAND points to the operand word of SLOT-SETC. */
+ScmObj Scm__VMSlotSetC(ScmObj obj, ScmWord *operand, ScmObj val)
+{
+    ScmClass *klass = Scm_ClassOf(obj);
+    ScmObj slot;
+
+    if (!SCM_FALSEP(klass->redefined)) {
+        return Scm_VMSlotSet(obj, Scm__SlotCacheName(SCM_OBJ(*operand)),
+                             val);
+    }
+    ScmSlotAccessor *sa = slot_cache_lookup(operand, klass, &slot);
+    if (sa == NULL) return SLOT_MISSING4(klass, obj, slot, val);
+    else            return slot_set_using_accessor(obj, sa, val);
+}
+
 /* SLOT-SET-USING-ACCESSOR
  *
  * (define (slot-set-using-accessor obj sa val)
@@ -1984,6 +2097,72 @@ static SCM_DEFINE_METHOD(object_equalp_rec,
  * Generic function
  */
 
+/* Dispatch cache.  See Scm__GenericApplicableMethods below. */
+typedef struct DispatchEntryRec {
+    u_long hash;
+    int nargs;                  /* # of arguments */
+    int nsel;                   /* # of classes */
+    ScmObj methods;             /* sorted list of applicable methods */
+    ScmClass *classes[1];       /* variable length */
+} DispatchEntry;
+
+typedef struct DispatchCacheRec {
+    u_long epoch;               /* class_epoch when created */
+    int maxReqargs;             /* gf->maxReqargs when created */
+    int size;                   /* # of slots; power of 2 */
+    int count;                  /* # of used slots */
+    DispatchEntry *entries[1];  /* variable length */
+} DispatchCache;
+
+#define DISPATCH_CACHE_INITIAL_SIZE  8
+#define DISPATCH_CACHE_MAX_SIZE      1024
+
+static DispatchCache *make_dispatch_cache(int size, u_long epoch,
+                                          int maxReqargs)
+{
+    DispatchCache *c = SCM_NEW2(DispatchCache*,
+                                sizeof(DispatchCache)
+                                + sizeof(DispatchEntry*)*(size-1));
+    c->epoch = epoch;
+    c->maxReqargs = maxReqargs;
+    c->size = size;
+    c->count = 0;
+    for (int i=0; i<size; i++) c->entries[i] = NULL;
+    return c;
+}
+
+/* Insert E unless the same key is already there.  C must be either not
+   installed yet, or the caller must hold the lock of the generic. */
+static void dispatch_cache_insert(DispatchCache *c, DispatchEntry *e)
+{
+    u_long mask = c->size - 1;
+    for (u_long i = e->hash & mask; ; i = (i+1) & mask) {
+        DispatchEntry *ee = c->entries[i];
+        if (ee == NULL) {
+            SCM_ATOMIC_STORE_PTR(c->entries[i], e);
+            c->count++;
+            return;
+        }
+        if (ee->hash == e->hash && ee->nargs == e->nargs
+            && memcmp(ee->classes, e->classes,
+                      sizeof(ScmClass*)*e->nsel) == 0) {
+            return;
+        }
+    }
+}
+
+/* Called with gf->lock held, whenever the methods are changed.
+   EMPTY is allocated by the caller outside of the critical section. */
+static void reset_dispatch_cache(ScmGeneric *gf, DispatchCache *empty)
+{
+    empty->epoch = class_epoch;
+    empty->maxReqargs = gf->maxReqargs;
+    SCM_ATOMIC_STORE_PTR(gf->dcache, empty);
+}
+
+#define NEW_EMPTY_DISPATCH_CACHE() \
+    make_dispatch_cache(DISPATCH_CACHE_INITIAL_SIZE, 0, 0)
+
 static ScmObj generic_allocate(ScmClass *klass, ScmObj initargs)
 {
     ScmGeneric *gf = SCM_ALLOCATE(ScmGeneric, klass);
@@ -1993,6 +2172,7 @@ static ScmObj generic_allocate(ScmClass *klass, ScmObj initargs)
     gf->fallback = Scm_NoNextMethod;
     gf->data = NULL;
     gf->maxReqargs = 0;
+    gf->dcache = NULL;
     (void)SCM_INTERNAL_MUTEX_INIT(gf->lock);
     return SCM_OBJ(gf);
 }
@@ -2044,9 +2224,11 @@ static void generic_methods_set(ScmGeneric *gf, ScmObj val)
     if (!SCM_NULLP(cp)) {
         Scm_Error("The methods slot of <generic> cannot contain an improper list: %S", val);
     }
+    DispatchCache *empty = NEW_EMPTY_DISPATCH_CACHE();
     (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
     gf->methods = val;
     gf->maxReqargs = reqs;
+    reset_dispatch_cache(gf, empty);
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
 }
 
@@ -2235,6 +2417,26 @@ static SCM_DEFINE_METHOD(method_more_specific_p_rec,
  *  TODO: can't we carry around the method list in array
  *  instead of list, at least internally?
  */
+static void sort_method_array(ScmObj *array, int len,
+                              ScmClass **targv, int argc)
+{
+    for (int step = len/2; step > 0; step /= 2) {
+        for (int i=step; i<len; i++) {
+            for (int j=i-step; j >= 0; j -= step) {
+                if (method_more_specific(SCM_METHOD(array[j]),
+                                         SCM_METHOD(array[j+step]),
+                                         targv, argc)) {
+                    break;
+                } else {
+                    ScmObj tmp = array[j+step];
+                    array[j+step] = array[j];
+                    array[j] = tmp;
+                }
+            }
+        }
+    }
+}
+
 ScmObj Scm_SortMethods(ScmObj methods, ScmObj *argv, int argc)
 {
     ScmObj array_s[PREALLOC_SIZE], *array = array_s;
@@ -2253,24 +2455,161 @@ ScmObj Scm_SortMethods(ScmObj methods, ScmObj *argv, int argc)
     }
     for (int i=0; i<argc; i++) targv[i] = Scm_ClassOf(argv[i]);
 
-    for (int step = len/2; step > 0; step /= 2) {
-        for (int i=step; i<len; i++) {
-            for (int j=i-step; j >= 0; j -= step) {
-                if (method_more_specific(SCM_METHOD(array[j]),
-                                         SCM_METHOD(array[j+step]),
-                                         targv, argc)) {
-                    break;
-                } else {
-                    ScmObj tmp = array[j+step];
-                    array[j+step] = array[j];
-                    array[j] = tmp;
-                }
-            }
+    sort_method_array(array, len, targv, argc);
+    return Scm_ArrayToList(array, len);
+}
+
+/* Applicable methods for the VM
+ *
+ *  When the VM applies a pure generic function, it calls
+ *  Scm__GenericApplicableMethods to get the sorted list of applicable
+ *  methods.  The result only depends on the number of arguments and
+ *  the classes of the first gf->maxReqargs arguments, so we memoize it
+ *  in the dispatch cache of the generic function, keyed by them.
+ *
+ *  The dispatch cache is an open-addressing hashtable.  Lookup doesn't
+ *  lock.  Once a table is installed, the only modification to it is to
+ *  fill an empty slot with a fully initialized entry.  When the table
+ *  gets full, we install a new one.  When the methods of the generic
+ *  function are changed, we install an empty table, and when any class
+ *  is redefined, all the tables created before are regarded as empty
+ *  (see class_epoch).
+ *
+ *  Adding entries is serialized by gf->lock.  We remember the table
+ *  we looked up before computing the methods, and discard the result
+ *  if the table is replaced in the meantime; it may have been computed
+ *  from the old set of methods.
+ */
+
+static ScmObj generic_applicable_methods(ScmGeneric *gf, ScmClass **typev,
+                                         int nsel, int nargs)
+{
+    ScmObj array_s[PREALLOC_SIZE], *array = array_s;
+    int len = 0, alloc = PREALLOC_SIZE;
+    ScmObj mp;
+
+    SCM_FOR_EACH(mp, gf->methods) {
+        ScmMethod *m = SCM_METHOD(SCM_CAR(mp));
+        if (!Scm_MethodApplicableForClasses(m, typev, nargs)) continue;
+        if (len == alloc) {
+            ScmObj *na = SCM_NEW_ARRAY(ScmObj, alloc*2);
+            memcpy(na, array, sizeof(ScmObj)*len);
+            array = na;
+            alloc *= 2;
         }
+        array[len++] = SCM_OBJ(m);
     }
+    sort_method_array(array, len, typev, nsel);
     return Scm_ArrayToList(array, len);
 }
 
+/* Collect the classes of the first maxreq arguments into typev and
+   returns the number of them.  The total number of arguments is
+   stored in *nargs. */
+static int dispatch_classes(ScmObj *argv, int argc, int applyargs,
+                            ScmClass **typev, int maxreq, int *nargs)
+{
+    int nsel = 0;
+    if (applyargs) argc--;
+    for (int i=0; i<argc && nsel<maxreq; i++) {
+        typev[nsel++] = Scm_ClassOf(argv[i]);
+    }
+    if (applyargs) {
+        ScmObj ap;
+        SCM_FOR_EACH(ap, argv[argc]) {
+            if (nsel < maxreq) typev[nsel++] = Scm_ClassOf(SCM_CAR(ap));
+            argc++;
+        }
+    }
+    *nargs = argc;
+    return nsel;
+}
+
+static inline u_long dispatch_hash(ScmClass **typev, int nsel, int nargs)
+{
+    u_long h = (u_long)nargs;
+    for (int i=0; i<nsel; i++) {
+        h = h*31 + (SCM_WORD(typev[i]) >> 3);
+    }
+    h *= 2654435761UL;
+    return h ^ (h >> 16);
+}
+
+static void dispatch_cache_add(ScmGeneric *gf, DispatchCache *c,
+                               DispatchEntry *e, u_long epoch, int maxreq)
+{
+    DispatchCache *nc = NULL;
+
+    /* Prepare a new table outside of the critical section, if needed. */
+    if (c == NULL || c->epoch != epoch || c->maxReqargs != maxreq) {
+        nc = make_dispatch_cache(DISPATCH_CACHE_INITIAL_SIZE, epoch, maxreq);
+    } else if ((c->count+1)*2 > c->size) {
+        if (c->size >= DISPATCH_CACHE_MAX_SIZE) {
+            /* Megamorphic.  Just start over. */
+            nc = make_dispatch_cache(c->size, epoch, maxreq);
+        } else {
+            nc = make_dispatch_cache(c->size*2, epoch, maxreq);
+            for (int i=0; i<c->size; i++) {
+                DispatchEntry *ee =
+                    SCM_ATOMIC_LOAD_PTR(DispatchEntry*, c->entries[i]);
+                if (ee) dispatch_cache_insert(nc, ee);
+            }
+        }
+    }
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
+    if (gf->dcache == c) {
+        if (nc) {
+            dispatch_cache_insert(nc, e);
+            SCM_ATOMIC_STORE_PTR(gf->dcache, nc);
+        } else {
+            dispatch_cache_insert(c, e);
+        }
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
+}
+
+ScmObj Scm__GenericApplicableMethods(ScmGeneric *gf, ScmObj *argv, int argc,
+                                     int applyargs)
+{
+    ScmClass *typev_s[PREALLOC_SIZE], **typev = typev_s;
+    DispatchCache *c = SCM_ATOMIC_LOAD_PTR(DispatchCache*, gf->dcache);
+    u_long epoch = class_epoch;
+    int maxreq = gf->maxReqargs, nargs;
+
+    if (SCM_NULLP(gf->methods)) return SCM_NIL;
+    if (maxreq > PREALLOC_SIZE) {
+        typev = SCM_NEW_ATOMIC_ARRAY(ScmClass*, maxreq);
+    }
+    int nsel = dispatch_classes(argv, argc, applyargs, typev, maxreq, &nargs);
+    u_long hash = dispatch_hash(typev, nsel, nargs);
+
+    if (c && c->epoch == epoch && c->maxReqargs == maxreq) {
+        u_long mask = c->size - 1;
+        for (u_long i = hash & mask; ; i = (i+1) & mask) {
+            DispatchEntry *e =
+                SCM_ATOMIC_LOAD_PTR(DispatchEntry*, c->entries[i]);
+            if (e == NULL) break;
+            if (e->hash == hash && e->nargs == nargs
+                && memcmp(e->classes, typev, sizeof(ScmClass*)*nsel) == 0) {
+                return e->methods;
+            }
+        }
+    }
+
+    ScmObj mm = generic_applicable_methods(gf, typev, nsel, nargs);
+    DispatchEntry *e = SCM_NEW2(DispatchEntry*,
+                                sizeof(DispatchEntry)
+                                + sizeof(ScmClass*)*(nsel>0? nsel-1:0));
+    e->hash = hash;
+    e->nargs = nargs;
+    e->nsel = nsel;
+    e->methods = mm;
+    memcpy(e->classes, typev, sizeof(ScmClass*)*nsel);
+    dispatch_cache_add(gf, c, e, epoch, maxreq);
+    return mm;
+}
+
 /*=====================================================================
  * Method
  */
@@ -2435,6 +2774,14 @@ ScmObj Scm_UpdateDirectMethod(ScmMethod *m, ScmClass *old, ScmClass *newc)
     for (int i=0; i<rec; i++) {
         if (sp[i] == old) sp[i] = newc;
     }
+    /* The dispatch cache of the generic may have the stale result. */
+    ScmGeneric *gf = m->generic;
+    if (gf) {
+        DispatchCache *empty = NEW_EMPTY_DISPATCH_CACHE();
+        (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
+        reset_dispatch_cache(gf, empty);
+        (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
+    }
     if (SCM_FALSEP(Scm_Memq(SCM_OBJ(m), newc->directMethods))) {
         newc->directMethods = Scm_Cons(SCM_OBJ(m), newc->directMethods);
     }
@@ -2476,6 +2823,7 @@ ScmObj Scm_AddMethod(ScmGeneric *gf, ScmMethod *method)
     method->generic = gf;
     /* pre-allocate cons pair to avoid triggering GC in the critical region */
     ScmObj pair = Scm_Cons(SCM_OBJ(method), gf->methods);
+    DispatchCache *empty = NEW_EMPTY_DISPATCH_CACHE();
     if (SCM_PROCEDURE_REQUIRED(method) > reqs) {
         reqs = SCM_PROCEDURE_REQUIRED(method);
     }
@@ -2504,6 +2852,7 @@ ScmObj Scm_AddMethod(ScmGeneric *gf, ScmMethod *method)
         gf->methods = pair;
         gf->maxReqargs = reqs;
     }
+    reset_dispatch_cache(gf, empty);
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
     return SCM_UNDEFINED;
 }
@@ -2530,6 +2879,7 @@ ScmObj Scm_DeleteMethod(ScmGeneric *gf, ScmMethod *method)
 {
     if (!method->generic || method->generic != gf) return SCM_UNDEFINED;
 
+    DispatchCache *empty = NEW_EMPTY_DISPATCH_CACHE();
     (void)SCM_INTERNAL_MUTEX_LOCK(gf->lock);
     ScmObj mp = gf->methods;
     if (SCM_PAIRP(mp)) {
@@ -2553,6 +2903,7 @@ ScmObj Scm_DeleteMethod(ScmGeneric *gf, ScmMethod *method)
             gf->maxReqargs = SCM_PROCEDURE_REQUIRED(SCM_CAR(mp));
         }
     }
+    reset_dispatch_cache(gf, empty);
     (void)SCM_INTERNAL_MUTEX_UNLOCK(gf->lock);
     return SCM_UNDEFINED;
 }
@@ -3178,8 +3529,12 @@ void Scm__InitClass(void)
     BINIT(SCM_CLASS_ACCESSOR_METHOD, "<accessor-method>", accessor_method_slots);
     Scm_AccessorMethodClass.flags |= SCM_CLASS_APPLICABLE;
     BINIT(SCM_CLASS_SLOT_ACCESSOR,"<slot-accessor>", slot_accessor_slots);
+    CINIT(SCM_CLASS_SLOT_CACHE,   "<slot-cache>");
     BINIT(SCM_CLASS_FOREIGN_POINTER, "<foreign-pointer>", NULL);
 
+    /* cache.c */
+    CINIT(SCM_CLASS_CACHE,            "<cache>");
+
     /* char.c */
     CINIT(SCM_CLASS_CHAR_SET,         "<char-set>");
 
@@ -173,7 +173,7 @@ void Scm_CompiledCodeDump(ScmCompiledCode *cc)
             case SCM_VM_OPERAND_OBJ:
                 /* Check if we're referring to a lifted closure. */
                 lifted = check_lifted_closure(p+i, lifted);
-                Scm_Printf(out, "%S", p[i+1]);
+                Scm_Printf(out, "%S", Scm__SlotCacheName(SCM_OBJ(p[i+1])));
                 i++;
                 break;
             case SCM_VM_OPERAND_OBJ_ADDR:
@@ -852,6 +852,9 @@ ScmObj Scm_CompiledCodeToList(ScmCompiledCode *cc)
 
         switch (Scm_VMInsnOperandType(code)) {
         case SCM_VM_OPERAND_OBJ:;
+            /* SLOT-REFC and SLOT-SETC may have replaced the slot name */
+            SCM_APPEND1(h, t, Scm__SlotCacheName(SCM_OBJ(cc->code[++i])));
+            break;
         case SCM_VM_OPERAND_CODE:;
         case SCM_VM_OPERAND_CODES:;
             SCM_APPEND1(h, t, SCM_OBJ(cc->code[++i]));
@@ -1202,6 +1202,12 @@ typedef enum {
 
 #include <gauche/weak.h>
 
+/*--------------------------------------------------------
+ * CACHE
+ */
+
+#include <gauche/cache.h>
+
 /*--------------------------------------------------------
  * CHAR-SET
  */
@@ -1425,6 +1431,7 @@ struct ScmGenericRec {
     ScmObj (*fallback)(ScmObj *argv, int argc, ScmGeneric *gf);
     void *data;
     ScmInternalMutex lock;
+    void *dcache;               /* dispatch cache; see class.c */
 };
 
 SCM_CLASS_DECL(Scm_GenericClass);
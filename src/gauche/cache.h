@@ -0,0 +1,117 @@
+/*
+ * cache.h - Public API for bounded caches
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+/* This file is included from gauche.h */
+
+/*
+ * ScmCache is a hash table with bounded capacity.  When the number
+ * of entries or the total weight of entries exceeds the limit, the
+ * least recently used entries are evicted.  Each entry can also have
+ * a time-to-live.
+ *
+ * Entries are kept in a doubly linked list in the order of recency,
+ * so a hit only relinks the entry and doesn't allocate.  With the
+ * CLOCK policy, a hit merely sets the reference bit of the entry,
+ * and the entry gets a second chance when it reaches the tail.
+ *
+ * If admission is enabled, the cache keeps an approximate access
+ * frequency of keys (TinyLFU), and a new entry is stored only if
+ * it is accessed more frequently than the entry to be evicted.
+ *
+ * A thread-safe cache is split into several segments by the hash
+ * value of keys, each of which has its own lock and its own share
+ * of the capacity.
+ */
+
+#ifndef GAUCHE_CACHE_H
+#define GAUCHE_CACHE_H
+
+typedef enum {
+    SCM_CACHE_LRU,
+    SCM_CACHE_CLOCK
+} ScmCachePolicy;
+
+/* Flags for Scm_MakeCache */
+enum {
+    SCM_CACHE_THREAD_SAFE = (1L<<0),
+    SCM_CACHE_ADMISSION   = (1L<<1)
+};
+
+typedef struct ScmCacheSegmentRec ScmCacheSegment; /* opaque */
+
+typedef struct ScmCacheRec {
+    SCM_HEADER;
+    ScmHashType type;
+    ScmCachePolicy policy;
+    int flags;
+    long maxEntries;            /* 0 for unlimited */
+    long maxWeight;             /* 0 for unlimited */
+    double ttl;                 /* in seconds; 0 for no expiration */
+    ScmObj weigher;             /* procedure to compute weight, or #f */
+    int numSegments;            /* power of 2 */
+    ScmCacheSegment *segments;
+    long weight;                /* total weight, if segments share
+                                   max-weight */
+    ScmInternalMutex mutex;     /* protects weight */
+} ScmCache;
+
+SCM_CLASS_DECL(Scm_CacheClass);
+#define SCM_CLASS_CACHE          (&Scm_CacheClass)
+#define SCM_CACHE(obj)           ((ScmCache*)(obj))
+#define SCM_CACHEP(obj)          SCM_XTYPEP(obj, SCM_CLASS_CACHE)
+
+SCM_EXTERN ScmObj Scm_MakeCache(ScmHashType type, ScmCachePolicy policy,
+                                long maxEntries, long maxWeight,
+                                double ttl, int flags);
+
+/* Scm_CacheRef counts a hit or a miss and updates the recency.
+   Scm_CachePeek does neither. */
+SCM_EXTERN ScmObj Scm_CacheRef(ScmCache *c, ScmObj key, ScmObj fallback);
+SCM_EXTERN ScmObj Scm_CachePeek(ScmCache *c, ScmObj key, ScmObj fallback);
+
+/* If WEIGHT is negative, the weigher is called, or 1 is used if
+   the cache doesn't have a weigher.  If TTL is negative, the cache's
+   default is used.  Returns SCM_UNBOUND if the entry isn't stored
+   because of the admission policy or its weight. */
+SCM_EXTERN ScmObj Scm_CacheSet(ScmCache *c, ScmObj key, ScmObj value,
+                               long weight, double ttl, int flags);
+SCM_EXTERN ScmObj Scm_CacheDelete(ScmCache *c, ScmObj key);
+SCM_EXTERN void   Scm_CacheClear(ScmCache *c);
+
+SCM_EXTERN long   Scm_CacheNumEntries(ScmCache *c);
+SCM_EXTERN long   Scm_CacheWeight(ScmCache *c);
+SCM_EXTERN ScmObj Scm_CacheToAlist(ScmCache *c);
+SCM_EXTERN ScmObj Scm_CacheStats(ScmCache *c);
+SCM_EXTERN void   Scm_CacheResetStats(ScmCache *c);
+
+#endif /* GAUCHE_CACHE_H */
@@ -66,6 +66,40 @@ SCM_CLASS_DECL(Scm_SlotAccessorClass);
 #define SCM_SLOT_ACCESSOR(obj)     ((ScmSlotAccessor*)obj)
 #define SCM_SLOT_ACCESSOR_P(obj)   SCM_XTYPEP(obj, SCM_CLASS_SLOT_ACCESSOR)
 
+/*
+ * SlotCache
+ *  - SLOT-REFC and SLOT-SETC instructions replace their slot name
+ *    operand with this at the first run.  See class.c.
+ */
+typedef struct ScmSlotCacheRec {
+    SCM_HEADER;
+    ScmObj name;                /* slot name (symbol) */
+    ScmClass *klass;            /* the class the accessor was looked up */
+    ScmObj accessors;           /* klass->accessors at that time */
+    ScmSlotAccessor *sa;        /* the accessor */
+    int index;                  /* instance slot number, or -1 if the
+                                   slot isn't an ordinary instance slot */
+    int misses;                 /* # of times the cache was replaced */
+} ScmSlotCache;
+
+SCM_CLASS_DECL(Scm_SlotCacheClass);
+#define SCM_CLASS_SLOT_CACHE       (&Scm_SlotCacheClass)
+#define SCM_SLOT_CACHE(obj)        ((ScmSlotCache*)obj)
+#define SCM_SLOT_CACHE_P(obj)      SCM_XTYPEP(obj, SCM_CLASS_SLOT_CACHE)
+
+/* Fast path of SLOT-REFC and SLOT-SETC.  If the slot cache C is valid
+   for OBJ and the slot is an ordinary instance slot, returns the
+   location of the slot.  Otherwise returns NULL. */
+static inline ScmObj *Scm__SlotCacheLocation(ScmSlotCache *c, ScmObj obj)
+{
+    if (c->index >= 0 && SCM_HOBJP(obj) && SCM_CLASS_OF(obj) == c->klass
+        && SCM_FALSEP(c->klass->redefined)
+        && SCM_EQ(c->accessors, c->klass->accessors)) {
+        return SCM_INSTANCE_SLOTS(obj) + c->index;
+    }
+    return NULL;
+}
+
 /* for static declaration of fields */
 struct ScmClassStaticSlotSpecRec {
     const char *name;
@@ -120,6 +154,10 @@ SCM_EXTERN ScmObj Scm_ComputeApplicableMethods(ScmGeneric *gf,
                                                int argc,
                                                int applyargs);
 SCM_EXTERN ScmObj Scm_SortMethods(ScmObj methods, ScmObj *argv, int argc);
+SCM_EXTERN ScmObj Scm__GenericApplicableMethods(ScmGeneric *gf,
+                                                ScmObj *argv,
+                                                int argc,
+                                                int applyargs);
 SCM_EXTERN ScmObj Scm_MakeNextMethod(ScmGeneric *gf, ScmObj methods,
                                      ScmObj *argv, int argc,
                                      int copyargs, int applyargs);
@@ -135,6 +173,9 @@ SCM_EXTERN ScmObj Scm_VMSlotRefUsingAccessor(ScmObj obj,
 SCM_EXTERN ScmObj Scm_VMSlotSetUsingAccessor(ScmObj obj,
                                              ScmSlotAccessor *acc,
                                              ScmObj val);
+SCM_EXTERN ScmObj Scm__SlotCacheName(ScmObj operand);
+SCM_EXTERN ScmObj Scm__VMSlotRefC(ScmObj obj, ScmWord *operand);
+SCM_EXTERN ScmObj Scm__VMSlotSetC(ScmObj obj, ScmWord *operand, ScmObj val);
 
 SCM_EXTERN ScmObj Scm_VMClassOf(ScmObj obj);
 SCM_EXTERN ScmObj Scm_VMIsA(ScmObj obj, ScmClass *klass);
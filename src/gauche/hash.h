@@ -99,6 +99,13 @@ SCM_EXTERN int  Scm_HashCoreNumEntries(ScmHashCore *core);
 
 SCM_EXTERN void Scm_HashCoreClear(ScmHashCore *core);
 
+/* Incremental deletion of entries.  PRED returns true if the entry
+   should be deleted. */
+typedef int ScmHashSweepProc(ScmHashCore *core, ScmDictEntry *e);
+
+SCM_EXTERN int  Scm_HashCoreSweep(ScmHashCore *core, int *cursor,
+                                  int nbuckets, ScmHashSweepProc *pred);
+
 struct ScmHashIterRec {
     ScmHashCore *core;
     int   bucket;
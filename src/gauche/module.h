@@ -66,6 +66,11 @@ struct ScmModuleRec {
     ScmObj prefix;              /* if symbol, all bindings in this module
                                    appear to have the prefix.  used in an
                                    anonymous wrapper modules. */
+    ScmInternalMutex mutex;     /* lock for modifying bindings */
+    struct ScmBindingTableRec *ibindings; /* copies of internal and external,
+                                             which can be looked up without
+                                             locking.  see module.c */
+    struct ScmBindingTableRec *ebindings;
 };
 
 #define SCM_MODULE(obj)       ((ScmModule*)(obj))
@@ -347,6 +347,8 @@ SCM_EXTERN void   Scm_Putc(ScmChar c, ScmPort *port);
 SCM_EXTERN void   Scm_Puts(ScmString *s, ScmPort *port);
 SCM_EXTERN void   Scm_Putz(const char *s, int len, ScmPort *port);
 SCM_EXTERN void   Scm_Flush(ScmPort *port);
+SCM_EXTERN void   Scm_WriteStrings(ScmObj items, ScmPort *port);
+SCM_EXTERN ScmObj Scm_CopyPortFd(ScmPort *src, ScmPort *dst, off_t limit);
 
 SCM_EXTERN void   Scm_PutbUnsafe(ScmByte b, ScmPort *port);
 SCM_EXTERN void   Scm_PutcUnsafe(ScmChar c, ScmPort *port);
@@ -388,6 +390,7 @@ SCM_EXTERN ScmObj Scm_WithPort(ScmPort *port[], ScmObj thunk,
 
 SCM_EXTERN ScmObj Scm_OpenFilePort(const char *path, int flags,
                                    int buffering, int perm);
+SCM_EXTERN ScmObj Scm_OpenMappedFilePort(const char *path);
 
 SCM_EXTERN ScmObj Scm_Stdin(void);
 SCM_EXTERN ScmObj Scm_Stdout(void);
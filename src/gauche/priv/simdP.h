@@ -0,0 +1,91 @@
+/*
+ * simdP.h - SIMD support
+ *
+ *   Copyright (c) 2014  Shiro Kawai  <shiro@acm.org>
+ *
+ *   Redistribution and use in source and binary forms, with or without
+ *   modification, are permitted provided that the following conditions
+ *   are met:
+ *
+ *   1. Redistributions of source code must retain the above copyright
+ *      notice, this list of conditions and the following disclaimer.
+ *
+ *   2. Redistributions in binary form must reproduce the above copyright
+ *      notice, this list of conditions and the following disclaimer in the
+ *      documentation and/or other materials provided with the distribution.
+ *
+ *   3. Neither the name of the authors nor the names of its contributors
+ *      may be used to endorse or promote products derived from this
+ *      software without specific prior written permission.
+ *
+ *   THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ *   "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ *   LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ *   A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ *   OWNER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ *   SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT LIMITED
+ *   TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE, DATA, OR
+ *   PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY THEORY OF
+ *   LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT (INCLUDING
+ *   NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE OF THIS
+ *   SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#ifndef GAUCHE_PRIV_SIMDP_H
+#define GAUCHE_PRIV_SIMDP_H
+
+/*
+ * Common definitions for the SIMD kernels in the extensions
+ * (gauche.uvector, rfc.sha and util.sparse).
+ *
+ * SCM_X86_SSE2 is defined on x86_64 with gcc or clang.  SSE2 is a part
+ * of x86_64, so its intrinsics can be used anywhere.
+ *
+ * The other instruction sets may not be available on the CPU we run.
+ * The kernels using them are compiled with the target attribute,
+ *
+ *    static SCM_X86_TARGET("avx2") int foo_avx2(...) { ... }
+ *
+ * and called only if Scm__CPUFeatures() has the corresponding bit.
+ * SCM_X86_TARGET is defined if the compiler allows intrinsics in such
+ * functions, which gcc does since 4.9 and clang since 3.8.
+ *
+ * Kernels should check SCM_CPU_SSE2 as well before using SSE2, though
+ * it is always set on x86_64, so that the tests can force the scalar
+ * code with %cpu-features.
+ */
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#if defined(__clang__)
+#if __clang_major__ > 3 || (__clang_major__ == 3 && __clang_minor__ >= 8)
+#define SCM_X86_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#elif __GNUC__ > 4 || (__GNUC__ == 4 && __GNUC_MINOR__ >= 9)
+#define SCM_X86_TARGET(isa)  __attribute__((target(isa)))
+#endif
+#if defined(__x86_64__)
+#define SCM_X86_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(SCM_X86_TARGET)
+#include <immintrin.h>
+#endif
+#endif /*__GNUC__ && x86*/
+
+/* Bits returned by Scm__CPUFeatures */
+enum {
+    SCM_CPU_SSE2 = (1L<<0),
+    SCM_CPU_AVX2 = (1L<<1),     /* AVX2, and the OS saves YMM registers */
+    SCM_CPU_SHA  = (1L<<2)      /* SHA extensions, with SSSE3 and SSE4.1 */
+};
+
+/* Returns the features of the CPU we're running on, restricted by
+   Scm__SetCPUFeaturesMask. */
+SCM_EXTERN u_long Scm__CPUFeatures(void);
+
+/* For testing the kernels.  The features not in MASK are hidden from
+   Scm__CPUFeatures. */
+SCM_EXTERN void   Scm__SetCPUFeaturesMask(u_long mask);
+
+#endif /*GAUCHE_PRIV_SIMDP_H*/
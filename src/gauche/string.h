@@ -69,11 +69,24 @@
    and a compound ones that has cord-like structure.  We'll defer having
    >2G strings by then.
 */
+/* [Rope strings]
+ * Concatenating or slicing large strings may yield a 'rope' string, whose
+ * body has SCM_STRING_ROPE flag and whose 'start' field points to a
+ * tree of string pieces (see string.c) instead of the characters.  Only
+ * 'flags', 'length' and 'size' fields of such a body are valid.
+ *
+ * SCM_STRING_BODY flattens a rope string (i.e. replaces its body with
+ * a flat one) when it sees one, so the code that uses SCM_STRING_BODY
+ * never sees the rope.  SCM_STRING_RAW_BODY returns the body as is; use
+ * it only if you need the length, size or flags of the string.
+ */
 typedef struct ScmStringBodyRec {
     unsigned int flags;
     unsigned int length;
     unsigned int size;
     const char *start;
+    const unsigned int *index;  /* sparse character index of long multibyte
+                                   strings.  Built lazily; see string.c */
 } ScmStringBody;
 
 #define SCM_STRING_MAX_SIZE    INT_MAX
@@ -94,6 +107,8 @@ enum ScmStringFlags {
     SCM_STRING_TERMINATED = (1L<<2),     /* [R] The string content is
                                             NUL-terminated.  This flag is used
                                             internally. */
+    SCM_STRING_ROPE = (1L<<3),           /* [R] The body is a rope.  This
+                                            flag is used internally. */
     SCM_STRING_COPYING = (1L<<16),       /* [C]   Need to copy the content
                                             given to the constructor. */
 };
@@ -104,8 +119,13 @@ SCM_CLASS_DECL(Scm_StringClass);
 
 #define SCM_STRINGP(obj)        SCM_XTYPEP(obj, SCM_CLASS_STRING)
 #define SCM_STRING(obj)         ((ScmString*)(obj))
-#define SCM_STRING_BODY(obj) \
+#define SCM_STRING_RAW_BODY(obj) \
     ((const ScmStringBody*)(SCM_STRING(obj)->body?SCM_STRING(obj)->body:&SCM_STRING(obj)->initialBody))
+#define SCM_STRING_BODY(obj) \
+    ((SCM_STRING(obj)->body                                             \
+      && SCM_STRING_BODY_HAS_FLAG(SCM_STRING(obj)->body, SCM_STRING_ROPE)) \
+     ? Scm__StringFlattenRope(SCM_STRING(obj))                          \
+     : SCM_STRING_RAW_BODY(obj))
 
 /* Accessor macros for string body */
 #define SCM_STRING_BODY_LENGTH(body)       ((body)->length)
@@ -124,19 +144,19 @@ SCM_CLASS_DECL(Scm_StringClass);
 
 /* This is MT-safe, for string immutability won't change */
 #define SCM_STRING_IMMUTABLE_P(obj)  \
-    SCM_STRING_BODY_IMMUTABLE_P(SCM_STRING_BODY(obj))
+    SCM_STRING_BODY_IMMUTABLE_P(SCM_STRING_RAW_BODY(obj))
 
 #define SCM_STRING_NULL_P(obj) \
-    (SCM_STRING_BODY_SIZE(SCM_STRING_BODY(obj)) == 0)
+    (SCM_STRING_BODY_SIZE(SCM_STRING_RAW_BODY(obj)) == 0)
 
 /* Macros for backward compatibility.  Use of these are deprecated,
    since they are not MT-safe.  Use SCM_STRING_BODY_* macros or
    Scm_GetString* API. */
-#define SCM_STRING_LENGTH(obj)  (SCM_STRING_BODY(obj)->length)
-#define SCM_STRING_SIZE(obj)    (SCM_STRING_BODY(obj)->size)
+#define SCM_STRING_LENGTH(obj)  (SCM_STRING_RAW_BODY(obj)->length)
+#define SCM_STRING_SIZE(obj)    (SCM_STRING_RAW_BODY(obj)->size)
 #define SCM_STRING_START(obj)   (SCM_STRING_BODY(obj)->start)
 #define SCM_STRING_INCOMPLETE_P(obj)  \
-    (SCM_STRING_BODY_INCOMPLETE_P(SCM_STRING_BODY(obj)))
+    (SCM_STRING_BODY_INCOMPLETE_P(SCM_STRING_RAW_BODY(obj)))
 #define SCM_STRING_SINGLE_BYTE_P(obj) \
     (SCM_STRING_SIZE(obj)==SCM_STRING_LENGTH(obj))
 
@@ -156,6 +176,9 @@ SCM_EXTERN ScmObj  Scm_MakeString(const char *str,
 SCM_EXTERN ScmObj  Scm_MakeFillString(ScmSmallInt len, ScmChar fill);
 SCM_EXTERN ScmObj  Scm_CopyStringWithFlags(ScmString *str, int flags, int mask);
 
+/* Internal; called from SCM_STRING_BODY */
+SCM_EXTERN const ScmStringBody *Scm__StringFlattenRope(ScmString *str);
+
 #define SCM_MAKE_STR(cstr) \
     Scm_MakeString(cstr, -1, -1, 0)
 #define SCM_MAKE_STR_COPYING(cstr) \
@@ -290,7 +313,7 @@ SCM_EXTERN ScmObj  Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end);
 
 #define SCM_STRING_CONST_INITIALIZER(str, len, siz)             \
     { { SCM_CLASS_STATIC_TAG(Scm_StringClass) }, NULL,          \
-      { SCM_STRING_IMMUTABLE|SCM_STRING_TERMINATED, (len), (siz), (str) } }
+      { SCM_STRING_IMMUTABLE|SCM_STRING_TERMINATED, (len), (siz), (str), NULL } }
 
 #define SCM_DEFINE_STRING_CONST(name, str, len, siz)            \
     ScmString name = SCM_STRING_CONST_INITIALIZER(str, len, siz)
@@ -34,8 +34,18 @@
 /* This file is included from gauche.h */
 
 /*
- * Provides ScmTreeCore, a raw red-black tree implementation,
+ * Provides ScmTreeCore, a raw ordered map implementation,
  * and ScmTreeMap, ScmObj wrapper of ScmTreeCore.
+ *
+ * ScmTreeCore has two implementations.  The default one is a red-black
+ * tree.  The other one is a B+ tree, which keeps multiple keys in
+ * a node and chains the leaves; it consumes less memory per entry, and
+ * searching and ordered traversal are more cache friendly.
+ * Entries are allocated separately in both implementations, so an
+ * entry returned from a core stays valid until it is deleted.  In a
+ * B+ tree, insertion and deletion move the pointers to the entries
+ * between leaves; an iterator notices it and looks up its current
+ * position again.
  */
 
 #ifndef GAUCHE_TREEMAP_H
@@ -49,21 +59,31 @@ typedef struct ScmTreeCoreRec ScmTreeCore;
 
 typedef int ScmTreeCoreCompareProc(ScmTreeCore*, intptr_t, intptr_t);
 
+typedef enum ScmTreeCoreType {
+    SCM_TREE_CORE_RBTREE,
+    SCM_TREE_CORE_BTREE
+} ScmTreeCoreType;
+
 /* A general tree map for internal use.  This is NOT a Scheme object. */
 
 struct ScmTreeCoreRec {
-    ScmDictEntry *root;
+    ScmDictEntry *root;         /* the root node; the actual type depends
+                                   on the implementation */
     ScmTreeCoreCompareProc *cmp;
     int   num_entries;
     void  *data;
+    ScmTreeCoreType type;
 };
 
 #define SCM_TREE_CORE_DATA(core)  ((core)->data)
+#define SCM_TREE_CORE_TYPE(core)  ((core)->type)
 
 typedef struct ScmTreeIterRec {
     ScmTreeCore  *t;
     ScmDictEntry *e;
     int at_end;
+    void *node;                 /* B+ tree: the leaf that has E */
+    int index;                  /* B+ tree: the index of E in NODE */
 } ScmTreeIter;
 
 /*
@@ -72,6 +92,10 @@ typedef struct ScmTreeIterRec {
 SCM_EXTERN void Scm_TreeCoreInit(ScmTreeCore *tc,
                                  ScmTreeCoreCompareProc *cmp,
                                  void *data);
+SCM_EXTERN void Scm_TreeCoreInitWithType(ScmTreeCore *tc,
+                                         ScmTreeCoreType type,
+                                         ScmTreeCoreCompareProc *cmp,
+                                         void *data);
 SCM_EXTERN void Scm_TreeCoreCopy(ScmTreeCore *dst,
                                  const ScmTreeCore *src);
 SCM_EXTERN void Scm_TreeCoreClear(ScmTreeCore *tc);
@@ -105,6 +129,18 @@ SCM_EXTERN int           Scm_TreeCoreNumEntries(ScmTreeCore *tc);
 
 SCM_EXTERN int           Scm_TreeCoreEq(ScmTreeCore *a, ScmTreeCore *b);
 
+/*
+ * Bulk operations
+ */
+SCM_EXTERN void Scm_TreeCoreBuildSorted(ScmTreeCore *tc, int n,
+                                        const intptr_t *keys,
+                                        const intptr_t *values);
+SCM_EXTERN int  Scm_TreeCoreDeleteRange(ScmTreeCore *tc,
+                                        intptr_t lo, intptr_t hi);
+SCM_EXTERN void Scm_TreeCoreSplit(ScmTreeCore *tc, intptr_t key,
+                                  ScmTreeCore *dst);
+SCM_EXTERN void Scm_TreeCoreJoin(ScmTreeCore *tc, ScmTreeCore *src);
+
 /*
  * Iterators
  */
@@ -140,6 +176,9 @@ SCM_CLASS_DECL(Scm_TreeMapClass);
 
 SCM_EXTERN ScmObj    Scm_MakeTreeMap(ScmTreeCoreCompareProc *cmp,
                                      void *data);
+SCM_EXTERN ScmObj    Scm_MakeTreeMapWithType(ScmTreeCoreType type,
+                                             ScmTreeCoreCompareProc *cmp,
+                                             void *data);
 SCM_EXTERN ScmObj    Scm_TreeMapCopy(const ScmTreeMap *src);
 
 SCM_EXTERN ScmObj    Scm_TreeMapRef(ScmTreeMap *tm, ScmObj key,
@@ -147,6 +186,8 @@ SCM_EXTERN ScmObj    Scm_TreeMapRef(ScmTreeMap *tm, ScmObj key,
 SCM_EXTERN ScmObj    Scm_TreeMapSet(ScmTreeMap *tm, ScmObj key, ScmObj value,
                                     int flags);
 SCM_EXTERN ScmObj    Scm_TreeMapDelete(ScmTreeMap *tm, ScmObj key);
+SCM_EXTERN ScmObj    Scm_TreeMapUpdateMany(ScmTreeMap *tm, ScmObj keys,
+                                          ScmObj proc, ScmObj fallback);
 
 /* For debug */
 SCM_EXTERN void      Scm_TreeMapDump(ScmTreeMap *tm, ScmPort *out);
@@ -47,6 +47,22 @@ SCM_EXTERN int         Scm_WeakBoxEmptyP(ScmWeakBox *wbox);
 SCM_EXTERN void        Scm_WeakBoxSet(ScmWeakBox *wbox, void *value);
 SCM_EXTERN void       *Scm_WeakBoxRef(ScmWeakBox *wbox);
 
+/*================================================================
+ * Ephemeron
+ */
+
+/* An ephemeron is a weak box with a value that is kept alive only
+   while the key is alive.  The value referencing the key doesn't
+   prevent the key from being collected. */
+typedef struct ScmEphemeronRec ScmEphemeron; /* opaque */
+
+SCM_EXTERN ScmEphemeron *Scm_MakeEphemeron(void *key, void *value);
+SCM_EXTERN int           Scm_EphemeronBrokenP(ScmEphemeron *eph);
+SCM_EXTERN void         *Scm_EphemeronKey(ScmEphemeron *eph);
+SCM_EXTERN void         *Scm_EphemeronValue(ScmEphemeron *eph);
+SCM_EXTERN void          Scm_EphemeronSetValue(ScmEphemeron *eph,
+                                               void *value);
+
 /*================================================================
  * Weak vector
  */
@@ -92,6 +108,7 @@ typedef struct ScmWeakHashTableRec {
     ScmHashProc        *hashfn;
     ScmHashCompareProc *cmpfn;
     u_int       goneEntries;
+    int         sweepCursor;    /* incremental cleanup position */
 } ScmWeakHashTable;
 
 typedef struct ScmWeakHashIterRec {
@@ -624,6 +624,35 @@ void Scm_HashCoreClear(ScmHashCore *table)
     table->numEntries = 0;
 }
 
+/* Examines NBUCKETS buckets from *CURSOR and deletes the entries for
+   which PRED returns true.  *CURSOR is updated so that successive calls
+   cycle through the whole table; this allows the caller to spread
+   the cleanup of stale entries over normal operations.  Returns the
+   number of deleted entries. */
+int Scm_HashCoreSweep(ScmHashCore *table, int *cursor, int nbuckets,
+                      ScmHashSweepProc *pred)
+{
+    int deleted = 0;
+    int index = *cursor;
+    if (nbuckets > table->numBuckets) nbuckets = table->numBuckets;
+    for (int i=0; i<nbuckets; i++, index++) {
+        if (index >= table->numBuckets) index = 0;
+        Entry *e = BUCKETS(table)[index], *p = NULL;
+        while (e) {
+            Entry *next = e->next;
+            if (pred(table, (ScmDictEntry*)e)) {
+                delete_entry(table, e, p, index);
+                deleted++;
+            } else {
+                p = e;
+            }
+            e = next;
+        }
+    }
+    *cursor = index;
+    return deleted;
+}
+
 ScmDictEntry *Scm_HashCoreSearch(ScmHashCore *table, intptr_t key,
                                  ScmDictOp op)
 {
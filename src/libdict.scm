@@ -200,6 +200,178 @@
 (define (hash-table->alist h)
   (hash-table-map h cons))
 
+;;;
+;;; Weak hash tables
+;;;
+
+(select-module gauche)
+(define-cproc make-weak-hash-table (:optional (type eq?) (weakness key)
+                                              (default-value #f)
+                                              (init-size::<int> 0))
+  (let* ([ctype::int 0] [w::int 0])
+    (set-hash-type! ctype type)
+    (cond [(SCM_EQ weakness 'key)   (set! w SCM_WEAK_KEY)]
+          [(SCM_EQ weakness 'value) (set! w SCM_WEAK_VALUE)]
+          [(SCM_EQ weakness 'both)  (set! w SCM_WEAK_BOTH)]
+          [else (Scm_Error "unsupported weakness: %S" weakness)])
+    (result (Scm_MakeWeakHashTableSimple ctype w init-size default-value))))
+
+(define-cproc weak-hash-table? (obj) ::<boolean> SCM_WEAK_HASH_TABLE_P)
+
+(define-cproc weak-hash-table-type (hash::<weak-hash-table>)
+  (get-hash-type (-> hash type)))
+
+(define-cproc weak-hash-table-weakness (hash::<weak-hash-table>)
+  (case (-> hash weakness)
+    [(SCM_WEAK_KEY)   (result 'key)]
+    [(SCM_WEAK_VALUE) (result 'value)]
+    [else             (result 'both)]))
+
+;; NB: This may count the entries whose keys have been collected but
+;; not yet swept.
+(define-cproc weak-hash-table-num-entries (hash::<weak-hash-table>) ::<int>
+  (result (Scm_HashCoreNumEntries (SCM_WEAK_HASH_TABLE_CORE hash))))
+
+(define-cproc weak-hash-table-get (hash::<weak-hash-table> key
+                                                           :optional fallback)
+  (dict-get hash Scm_WeakHashTableRef))
+
+(define-cproc weak-hash-table-put! (hash::<weak-hash-table> key value)
+  ::<void>
+  (Scm_WeakHashTableSet hash key value 0))
+
+(define-cproc weak-hash-table-delete! (hash::<weak-hash-table> key)
+  ::<boolean>
+  (result (not (SCM_UNBOUNDP (Scm_WeakHashTableDelete hash key)))))
+
+(define-cproc weak-hash-table-exists? (hash::<weak-hash-table> key)
+  ::<boolean>
+  (result (dict-exists? hash Scm_WeakHashTableRef)))
+
+(inline-stub
+ (define-cfn weak-hash-table-iter (args::ScmObj* nargs::int data::void*)
+   :static
+   (let* ([iter::ScmWeakHashIter* (cast ScmWeakHashIter* data)]
+          [k] [v] [eofval (aref args 0)])
+     (if (Scm_WeakHashIterNext iter (& k) (& v))
+       (return (values k v))
+       (return (values eofval eofval)))))
+ )
+
+(define-cproc %weak-hash-table-iter (hash::<weak-hash-table>)
+  (let* ([iter::ScmWeakHashIter* (SCM_NEW ScmWeakHashIter)])
+    (Scm_WeakHashIterInit iter hash)
+    (result (Scm_MakeSubr weak_hash_table_iter iter 1 0
+                          '"weak-hash-table-iterator"))))
+
+(define-cproc weak-hash-table-copy (hash::<weak-hash-table>)
+  Scm_WeakHashTableCopy)
+(define-cproc weak-hash-table-keys (hash::<weak-hash-table>)
+  Scm_WeakHashTableKeys)
+(define-cproc weak-hash-table-values (hash::<weak-hash-table>)
+  Scm_WeakHashTableValues)
+
+(define (weak-hash-table-fold hash kons knil)
+  (check-arg weak-hash-table? hash)
+  (let ([eof (cons #f #f)]              ;marker
+        [i (%weak-hash-table-iter hash)])
+    (let loop ([r knil])
+      (receive [k v] (i eof)
+        (if (eq? k eof)
+          r
+          (loop (kons k v r)))))))
+
+;;;
+;;; Caches
+;;;
+
+(select-module gauche)
+(inline-stub
+ ;; Converts an optional limit; #f means no limit.
+ (define-cise-stmt get-cache-limit
+   [(_ cvar scmvar name)
+    `(cond [(SCM_FALSEP ,scmvar) (set! ,cvar 0)]
+           [(and (SCM_INTP ,scmvar) (> (SCM_INT_VALUE ,scmvar) 0))
+            (set! ,cvar (SCM_INT_VALUE ,scmvar))]
+           [else (Scm_TypeError ,name "positive fixnum or #f" ,scmvar)])])
+ (define-cise-stmt get-cache-ttl
+   [(_ cvar scmvar)
+    `(cond [(SCM_FALSEP ,scmvar) (set! ,cvar 0.0)]
+           [(and (SCM_REALP ,scmvar) (> (Scm_GetDouble ,scmvar) 0.0))
+            (set! ,cvar (Scm_GetDouble ,scmvar))]
+           [else (Scm_TypeError ":ttl" "positive real number or #f" ,scmvar)])])
+ )
+
+(define-cproc make-cache (:key (type eq?) (max-entries #f) (max-weight #f)
+                               (ttl #f) (policy lru) (admission #f)
+                               (thread-safe #f) (weigher #f))
+  (let* ([ctype::int 0] [cpolicy::int SCM_CACHE_LRU] [flags::int 0]
+         [maxe::long 0] [maxw::long 0] [cttl::double 0.0])
+    (set-hash-type! ctype type)
+    (cond [(SCM_EQ policy 'lru)   (set! cpolicy SCM_CACHE_LRU)]
+          [(SCM_EQ policy 'clock) (set! cpolicy SCM_CACHE_CLOCK)]
+          [else (Scm_Error "unsupported cache policy: %S" policy)])
+    (get-cache-limit maxe max-entries ":max-entries")
+    (get-cache-limit maxw max-weight ":max-weight")
+    (get-cache-ttl cttl ttl)
+    (unless (or (SCM_FALSEP weigher) (SCM_PROCEDUREP weigher))
+      (Scm_TypeError ":weigher" "procedure or #f" weigher))
+    (unless (SCM_FALSEP admission) (logior= flags SCM_CACHE_ADMISSION))
+    (unless (SCM_FALSEP thread-safe) (logior= flags SCM_CACHE_THREAD_SAFE))
+    (let* ([c (Scm_MakeCache ctype cpolicy maxe maxw cttl flags)])
+      (set! (-> (SCM_CACHE c) weigher) weigher)
+      (result c))))
+
+(define-cproc cache? (obj) ::<boolean> SCM_CACHEP)
+
+(define-cproc cache-type (c::<cache>)
+  (get-hash-type (-> c type)))
+
+;; NB: This may count the entries that have expired but not yet removed.
+(define-cproc cache-num-entries (c::<cache>) ::<long> Scm_CacheNumEntries)
+(define-cproc cache-weight (c::<cache>) ::<long> Scm_CacheWeight)
+
+(define-cproc cache-get (c::<cache> key :optional fallback)
+  (dict-get c Scm_CacheRef))
+
+(define-cproc cache-put! (c::<cache> key value :key (weight #f) (ttl #f))
+  ::<boolean>
+  (let* ([w::long -1] [cttl::double -1.0])
+    (unless (SCM_FALSEP weight)
+      (unless (and (SCM_INTP weight) (>= (SCM_INT_VALUE weight) 0))
+        (Scm_TypeError ":weight" "nonnegative fixnum or #f" weight))
+      (set! w (SCM_INT_VALUE weight)))
+    (unless (SCM_FALSEP ttl)
+      (get-cache-ttl cttl ttl))
+    (result (not (SCM_UNBOUNDP (Scm_CacheSet c key value w cttl 0))))))
+
+(define-cproc cache-delete! (c::<cache> key) ::<boolean>
+  (result (not (SCM_UNBOUNDP (Scm_CacheDelete c key)))))
+
+;; This doesn't count as an access.
+(define-cproc cache-exists? (c::<cache> key) ::<boolean>
+  (result (dict-exists? c Scm_CachePeek)))
+
+(define-cproc cache-clear! (c::<cache>) ::<void> Scm_CacheClear)
+(define-cproc cache->alist (c::<cache>) Scm_CacheToAlist)
+(define-cproc cache-stats (c::<cache>) Scm_CacheStats)
+(define-cproc cache-reset-stats! (c::<cache>) ::<void> Scm_CacheResetStats)
+
+(define (cache-keys c)   (map car (cache->alist c)))
+(define (cache-values c) (map cdr (cache->alist c)))
+
+(define (cache-fold c kons knil)
+  (fold (^[kv r] (kons (car kv) (cdr kv) r)) knil (cache->alist c)))
+
+;; Returns the cached value of KEY; if there's none, calls THUNK
+;; and caches its result.
+(define (cache-lookup! c key thunk)
+  (let* ([unique (list #f)]
+         [v (cache-get c key unique)])
+    (if (eq? v unique)
+      (rlet1 v (thunk) (cache-put! c key v))
+      v)))
+
 ;;;
 ;;; TreeMap
 ;;;
@@ -213,8 +385,12 @@
      (return (SCM_INT_VALUE r))))
  )
 
-(define-cproc %make-tree-map (cmp-proc)
-  (result (Scm_MakeTreeMap tree_map_cmp cmp_proc)))
+(define-cproc %make-tree-map (cmp-proc :optional (type 'rbtree))
+  (let* ([t::ScmTreeCoreType SCM_TREE_CORE_RBTREE])
+    (cond [(SCM_EQ type 'rbtree) (set! t SCM_TREE_CORE_RBTREE)]
+          [(SCM_EQ type 'btree)  (set! t SCM_TREE_CORE_BTREE)]
+          [else (Scm_Error "unsupported tree-map core type: %S" type)])
+    (result (Scm_MakeTreeMapWithType t tree_map_cmp cmp_proc))))
 
 (define-cproc tree-map-copy (tm::<tree-map>) Scm_TreeMapCopy)
 
@@ -287,6 +463,38 @@
 (define-cproc tree-map-clear! (tm::<tree-map>) ::<void>
   (Scm_TreeCoreClear (SCM_TREE_MAP_CORE tm)))
 
+;; Bulk operations.
+(define-cproc %tree-map-build-sorted! (tm::<tree-map> alist) ::<void>
+  (let* ([n::int (Scm_Length alist)])
+    (when (< n 0) (Scm_Error "proper list required, but got: %S" alist))
+    (let* ([keys::intptr_t* (SCM_NEW_ARRAY intptr_t n)]
+           [vals::intptr_t* (SCM_NEW_ARRAY intptr_t n)]
+           [i::int 0])
+      (dolist [p alist]
+        (unless (SCM_PAIRP p)
+          (Scm_Error "alist required, but got: %S" alist))
+        (set! (aref keys i) (cast intptr_t (SCM_CAR p)))
+        (set! (aref vals i) (cast intptr_t (SCM_CDR p)))
+        (post++ i))
+      (Scm_TreeCoreBuildSorted (SCM_TREE_MAP_CORE tm) n keys vals))))
+
+(define-cproc tree-map-delete-range! (tm::<tree-map> lo hi) ::<int>
+  (result (Scm_TreeCoreDeleteRange (SCM_TREE_MAP_CORE tm)
+                                   (cast intptr_t lo) (cast intptr_t hi))))
+
+(define-cproc tree-map-split! (tm::<tree-map> key)
+  (let* ([tc::ScmTreeCore* (SCM_TREE_MAP_CORE tm)]
+         [r (Scm_MakeTreeMapWithType (-> tc type) (-> tc cmp) (-> tc data))])
+    (Scm_TreeCoreSplit tc (cast intptr_t key) (SCM_TREE_MAP_CORE r))
+    (result r)))
+
+(define-cproc tree-map-join! (tm1::<tree-map> tm2::<tree-map>) ::<void>
+  (Scm_TreeCoreJoin (SCM_TREE_MAP_CORE tm1) (SCM_TREE_MAP_CORE tm2)))
+
+(define-cproc tree-map-update-many! (tm::<tree-map> keys::<list> proc
+                                     :optional fallback) ::<void>
+  (Scm_TreeMapUpdateMany tm keys proc fallback))
+
 (inline-stub
  ;;
  ;; Finds the entry closest to the given key
@@ -180,10 +180,13 @@
  )
 
 ;; Primitive open routine.  The Scheme wrapper handles other keyword args.
+;; If MAPPED is true, the file is mmap'ed and the port reads directly
+;; from the mapped region; BUFFERING is ignored then.
 (define-cproc %open-input-file (path::<string>
                                 :key (if-does-not-exist :error)
                                 (buffering #f)
-                                (element-type :character))
+                                (element-type :character)
+                                (mapped::<boolean> #f))
   (let* ([ignerr::int FALSE])
     (cond [(SCM_FALSEP if-does-not-exist) (set! ignerr TRUE)]
           [(not (SCM_EQ if-does-not-exist ':error))
@@ -191,8 +194,10 @@
                           if-does-not-exist)])
     (let* ([bufmode::int (Scm_BufferingMode buffering SCM_PORT_INPUT
                                             SCM_PORT_BUFFER_FULL)]
-           [o (Scm_OpenFilePort (Scm_GetStringConst path)
-                                O_RDONLY bufmode 0)])
+           [o (?: mapped
+                  (Scm_OpenMappedFilePort (Scm_GetStringConst path))
+                  (Scm_OpenFilePort (Scm_GetStringConst path)
+                                    O_RDONLY bufmode 0))])
       (when (and (SCM_FALSEP o) (not (%open/allow-noexist? ignerr)))
         (Scm_SysError "couldn't open input file: %S" path))
       (result o))))
@@ -368,6 +373,13 @@
 ;; useful alias
 (define (port-tell p) (port-seek p 0 SEEK_CUR))
 
+;; Fast path of copy-port between file ports.  Returns #f if not applicable.
+(select-module gauche.internal)
+(define-cproc %copy-port-fd (src::<input-port> dst::<output-port>
+                             limit::<integer>)
+  (result (Scm_CopyPortFd src dst (Scm_IntegerToOffset limit))))
+(select-module gauche)
+
 ;; useful for error messages
 (define (port-position-prefix port)
   (if-let1 n (port-name port)
@@ -640,6 +652,11 @@
 
 (define write* write-shared)
 
+(define-cproc write-strings (items
+                             :optional (port::<output-port>
+                                        (current-output-port)))
+  ::<void> (Scm_WriteStrings items port))
+
 (define-cproc flush (:optional (oport::<output-port> (current-output-port)))
   ::<void> Scm_Flush)
 
@@ -36,6 +36,7 @@
 (inline-stub
  (declcode (.include <gauche/vminsn.h>
                      <gauche/bignum.h>
+                     <gauche/priv/numberP.h>
                      <stdlib.h>
                      <math.h>))
  (when "!defined(M_PI)"
@@ -102,6 +103,11 @@
   (when (SCM_BIGNUMP obj)
     (Scm_DumpBignum (SCM_BIGNUM obj) SCM_CUROUT)))
 
+;; For testing the flonum printer.  Returns the shortest digits of
+;; a positive flonum and the exponent, (digits . exponent), computed
+;; by the fast path (it may return #f) or by the exact algorithm.
+(define-cproc %flonum-digits (x::<double> fast::<boolean>) Scm__FlonumDigits)
+
 ;;
 ;; Comparison
 ;;
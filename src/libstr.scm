@@ -96,7 +96,7 @@
 
 (select-module scheme)
 (define-cproc string-length (str::<string>) ::<fixnum> :constant
-  (result (SCM_STRING_BODY_LENGTH (SCM_STRING_BODY str))))
+  (result (SCM_STRING_BODY_LENGTH (SCM_STRING_RAW_BODY str))))
 (define-cproc string-ref (str::<string> k::<fixnum> :optional fallback)
   :constant
   (let* ([r::ScmChar (Scm_StringRef str k (SCM_UNBOUNDP fallback))])
@@ -106,7 +106,7 @@
 
 (select-module gauche)
 (define-cproc string-size (str::<string>) ::<fixnum> :constant
-  (result (SCM_STRING_BODY_SIZE (SCM_STRING_BODY str))))
+  (result (SCM_STRING_BODY_SIZE (SCM_STRING_RAW_BODY str))))
 
 (select-module gauche.internal)
 ;; see lib/gauche/stringutil.scm for generic string-split
@@ -170,7 +170,7 @@
 
 (select-module gauche.internal)
 (define-cproc %string-replace-body! (target::<string> source::<string>)
-  (result (Scm_StringReplaceBody target (SCM_STRING_BODY source))))
+  (result (Scm_StringReplaceBody target (SCM_STRING_RAW_BODY source))))
 
 (define-in-module scheme (string-set! str k ch)
   (check-arg string? str)
@@ -48,6 +48,7 @@
   (.if "HAVE_SYS_RESOURCE_H" (.include <sys/resource.h>))
   (.if "HAVE_SYS_LOADAVG_H"  (.include <sys/loadavg.h>))
   (.if "HAVE_UNISTD_H"       (.include <unistd.h>))
+  (.include <gauche/priv/simdP.h>)
 
   (.if "defined(GAUCHE_WINDOWS)"
        (.undef _SC_CLK_TCK)) ;; avoid undefined reference to sysconf
@@ -1264,7 +1265,30 @@
 
 (inline-stub
  (define-cproc sys-available-processors () ::<int>
-   Scm_AvailableProcessors))
+   Scm_AvailableProcessors)
+
+ ;; For testing SIMD kernels.  Returns the list of instruction set
+ ;; extensions the kernels can use.  If FEATURES is a list, the ones
+ ;; not in it are hidden from the kernels afterwards; #t reveals all.
+ (define-cproc %cpu-features (:optional (features #f))
+   (let* ([f::u_long 0] [r SCM_NIL])
+     (cond [(SCM_FALSEP features)]
+           [(SCM_TRUEP features) (Scm__SetCPUFeaturesMask (lognot 0))]
+           [(SCM_LISTP features)
+            (unless (SCM_FALSEP (Scm_Memq 'sse2 features))
+              (logior= f SCM_CPU_SSE2))
+            (unless (SCM_FALSEP (Scm_Memq 'avx2 features))
+              (logior= f SCM_CPU_AVX2))
+            (unless (SCM_FALSEP (Scm_Memq 'sha features))
+              (logior= f SCM_CPU_SHA))
+            (Scm__SetCPUFeaturesMask f)]
+           [else (Scm_TypeError "features" "list or boolean" features)])
+     (set! f (Scm__CPUFeatures))
+     (when (logand f SCM_CPU_SHA)  (set! r (Scm_Cons 'sha r)))
+     (when (logand f SCM_CPU_AVX2) (set! r (Scm_Cons 'avx2 r)))
+     (when (logand f SCM_CPU_SSE2) (set! r (Scm_Cons 'sse2 r)))
+     (result r)))
+ )
 
 ;;;
 ;;; Windows-specific utility
@@ -34,6 +34,7 @@
 #define LIBGAUCHE_BODY
 #include "gauche.h"
 #include "gauche/priv/builtin-syms.h"
+#include "gauche/priv/atomicP.h"
 #include "gauche/class.h"
 
 /*
@@ -75,6 +76,18 @@
  *    affect normal runtime performance.
  *
  * Benchmark showed the change made program loading 30% faster.
+ *
+ * [SK] Later, it turned out the giant lock hurts when multiple threads
+ * load libraries or call eval concurrently, for every global variable
+ * lookup during compilation goes through Scm_FindBinding.  Now lookup
+ * doesn't lock at all, and modification locks only the module to be
+ * modified (module->mutex).  To do so, each module keeps a copy of its
+ * internal and external tables in a structure that allows lock-free
+ * reading (see "Binding tables" below).  The hashtables are still kept
+ * since Scheme code may want to see them via module-table; they're
+ * always modified together with the binding tables while the module
+ * is locked.  The global lock (modules.mutex) now only protects the
+ * name -> module table.
  */
 
 static void module_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
@@ -115,6 +128,143 @@ DEFINE_STATIC_MODULE(keywordModule);  /* #<module keyword> */
 static ScmObj defaultParents = SCM_NIL; /* will be initialized */
 static ScmObj defaultMpl =     SCM_NIL; /* will be initialized */
 
+/*----------------------------------------------------------------------
+ * Binding tables
+ *
+ *  A simple chained hashtable mapping a symbol to a gloc, designed
+ *  for lock-free lookup.  Modifications must be done while the owner
+ *  module is locked.
+ *
+ *  The only field modified after an entry is linked to the table is
+ *  the next pointer, and it is changed by a single store with a release
+ *  barrier.  Insertion pushes a new entry at the head of a chain;
+ *  replacement links a new entry in place of the old one, and deletion
+ *  makes the predecessor skip the entry.  The unlinked entry keeps its
+ *  next pointer, so a reader that is looking at it can go on.
+ *  When the table grows, we build an entirely new one and swap the
+ *  pointer in the module.
+ */
+
+typedef struct BindingEntryRec {
+    struct BindingEntryRec *next;
+    ScmSymbol *name;
+    ScmGloc *gloc;
+} BindingEntry;
+
+typedef struct ScmBindingTableRec {
+    u_long numBuckets;          /* power of 2 */
+    u_long numEntries;
+    BindingEntry *buckets[1];   /* variable length */
+} BindingTable;
+
+#define BINDING_TABLE_INITIAL_SIZE 8
+
+static inline u_long binding_index(ScmSymbol *name, u_long numBuckets)
+{
+    u_long h = (SCM_WORD(name) >> 3) * 2654435761UL;
+    return (h >> 8) & (numBuckets - 1);
+}
+
+static BindingTable *make_binding_table(u_long size)
+{
+    BindingTable *t = SCM_NEW2(BindingTable*,
+                               sizeof(BindingTable)
+                               + sizeof(BindingEntry*)*(size-1));
+    t->numBuckets = size;
+    t->numEntries = 0;
+    for (u_long i=0; i<size; i++) t->buckets[i] = NULL;
+    return t;
+}
+
+static BindingEntry *make_binding_entry(ScmSymbol *name, ScmGloc *g,
+                                        BindingEntry *next)
+{
+    BindingEntry *e = SCM_NEW(BindingEntry);
+    e->name = name;
+    e->gloc = g;
+    e->next = next;
+    return e;
+}
+
+/* Lock-free lookup */
+static ScmGloc *binding_get(BindingTable **tablep, ScmSymbol *name)
+{
+    BindingTable *t = SCM_ATOMIC_LOAD_PTR(BindingTable*, *tablep);
+    BindingEntry *e =
+        SCM_ATOMIC_LOAD_PTR(BindingEntry*,
+                            t->buckets[binding_index(name, t->numBuckets)]);
+    while (e) {
+        if (e->name == name) return e->gloc;
+        e = SCM_ATOMIC_LOAD_PTR(BindingEntry*, e->next);
+    }
+    return NULL;
+}
+
+/* The following two must be called while the module is locked. */
+static void binding_put(BindingTable **tablep, ScmSymbol *name, ScmGloc *g)
+{
+    BindingTable *t = *tablep;
+    BindingEntry **loc = &t->buckets[binding_index(name, t->numBuckets)];
+
+    for (BindingEntry *e = *loc; e; loc = &e->next, e = e->next) {
+        if (e->name == name) {
+            if (e->gloc != g) {
+                SCM_ATOMIC_STORE_PTR(*loc, make_binding_entry(name, g,
+                                                              e->next));
+            }
+            return;
+        }
+    }
+    loc = &t->buckets[binding_index(name, t->numBuckets)];
+    SCM_ATOMIC_STORE_PTR(*loc, make_binding_entry(name, g, *loc));
+
+    if (++t->numEntries > t->numBuckets*2) {
+        BindingTable *nt = make_binding_table(t->numBuckets*4);
+        for (u_long i=0; i<t->numBuckets; i++) {
+            for (BindingEntry *e = t->buckets[i]; e; e = e->next) {
+                u_long k = binding_index(e->name, nt->numBuckets);
+                nt->buckets[k] = make_binding_entry(e->name, e->gloc,
+                                                    nt->buckets[k]);
+            }
+        }
+        nt->numEntries = t->numEntries;
+        SCM_ATOMIC_STORE_PTR(*tablep, nt);
+    }
+}
+
+static void binding_delete(BindingTable **tablep, ScmSymbol *name)
+{
+    BindingTable *t = *tablep;
+    BindingEntry **loc = &t->buckets[binding_index(name, t->numBuckets)];
+
+    for (BindingEntry *e = *loc; e; loc = &e->next, e = e->next) {
+        if (e->name == name) {
+            SCM_ATOMIC_STORE_PTR(*loc, e->next);
+            t->numEntries--;
+            return;
+        }
+    }
+}
+
+/* Modify bindings of the module.  The module must be locked. */
+static void set_internal(ScmModule *m, ScmSymbol *name, ScmGloc *g)
+{
+    Scm_HashTableSet(m->internal, SCM_OBJ(name), SCM_OBJ(g), 0);
+    binding_put(&m->ibindings, name, g);
+}
+
+static void set_external(ScmModule *m, ScmSymbol *name, ScmGloc *g)
+{
+    Scm_HashTableSet(m->external, SCM_OBJ(name), SCM_OBJ(g), 0);
+    binding_put(&m->ebindings, name, g);
+}
+
+static void delete_external(ScmModule *m, ScmSymbol *name)
+{
+    Scm_HashTableDelete(m->external, SCM_OBJ(name));
+    binding_delete(&m->ebindings, name);
+}
+
 /*----------------------------------------------------------------------
  * Constructor
  */
@@ -129,6 +279,9 @@ static void init_module(ScmModule *m, ScmObj name)
     m->internal = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
     m->external = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_EQ, 0));
     m->origin = m->prefix = SCM_FALSE;
+    (void)SCM_INTERNAL_MUTEX_INIT(m->mutex);
+    m->ibindings = make_binding_table(BINDING_TABLE_INITIAL_SIZE);
+    m->ebindings = make_binding_table(BINDING_TABLE_INITIAL_SIZE);
 }
 
 /* Internal */
@@ -254,20 +407,20 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
     /* First, search from the specified module.  In this phase, we just ignore
        phantom bindings, for we'll search imported bindings later anyway. */
     if (!exclude_self) {
-        ScmObj v = Scm_HashTableRef(
-            external_only? module->external : module->internal,
-            SCM_OBJ(symbol), SCM_FALSE);
-        if (SCM_GLOCP(v)) {
-            if (SCM_GLOC_PHANTOM_BINDING_P(SCM_GLOC(v))) {
+        ScmGloc *v = binding_get(external_only? &module->ebindings
+                                              : &module->ibindings,
+                                 symbol);
+        if (v) {
+            if (SCM_GLOC_PHANTOM_BINDING_P(v)) {
                 /* If we're here, the symbol is external to MODULE but
                    the real GLOC is somewhere in imported or inherited
                    modules.  We turn off external_only switch so that
                    when we search inherited modules we look into it's
                    internal bindings. */
                 external_only = FALSE;
-                symbol = SCM_GLOC(v)->name; /* in case it is renamed on export */
+                symbol = v->name; /* in case it is renamed on export */
             } else {
-                return SCM_GLOC(v);
+                return v;
             }
         }
         if (stay_in_module) return NULL;
@@ -276,7 +429,7 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
 
     ScmObj p, mp;
     /* Next, search from imported modules */
-    SCM_FOR_EACH(p, module->imported) {
+    SCM_FOR_EACH(p, SCM_ATOMIC_LOAD_PTR(ScmObj, module->imported)) {
         ScmObj elt = SCM_CAR(p);
         ScmObj sym = SCM_OBJ(symbol);
 
@@ -294,9 +447,8 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
                 if (!SCM_SYMBOLP(sym)) break;
             }
 
-            ScmObj v = Scm_HashTableRef(m->external, SCM_OBJ(sym), SCM_FALSE);
-            if (SCM_GLOCP(v)) {
-                g = SCM_GLOC(v);
+            g = binding_get(&m->ebindings, SCM_SYMBOL(sym));
+            if (g) {
                 if (g->hidden) break;
                 if (SCM_GLOC_PHANTOM_BINDING_P(g)) {
                     g = search_binding(m, g->name, FALSE, FALSE, TRUE);
@@ -320,13 +472,13 @@ static ScmGloc *search_binding(ScmModule *module, ScmSymbol *symbol,
             if (!SCM_SYMBOLP(sym)) return NULL;
             symbol = SCM_SYMBOL(sym);
         }
-        ScmObj v = Scm_HashTableRef(external_only?m->external:m->internal,
-                                    SCM_OBJ(symbol), SCM_FALSE);
-        if (SCM_GLOCP(v)) {
-            if (SCM_GLOC_PHANTOM_BINDING_P(SCM_GLOC(v))) {
+        ScmGloc *v = binding_get(external_only? &m->ebindings : &m->ibindings,
+                                 symbol);
+        if (v) {
+            if (SCM_GLOC_PHANTOM_BINDING_P(v)) {
                 external_only = FALSE; /* See above comment */
             } else {
-                return SCM_GLOC(v);
+                return v;
             }
         }
     }
@@ -337,12 +489,9 @@ ScmGloc *Scm_FindBinding(ScmModule *module, ScmSymbol *symbol, int flags)
 {
     int stay_in_module = flags&SCM_BINDING_STAY_IN_MODULE;
     int external_only = flags&SCM_BINDING_EXTERNAL;
-    ScmGloc *gloc = NULL;
 
-    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
-    gloc = search_binding(module, symbol, stay_in_module, external_only, FALSE);
-    SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
-    return gloc;
+    /* No lock is needed; see the comment at the top of this file. */
+    return search_binding(module, symbol, stay_in_module, external_only, FALSE);
 }
 
 ScmObj Scm_GlobalVariableRef(ScmModule *module,
@@ -375,20 +524,19 @@ ScmGloc *Scm_MakeBinding(ScmModule *module, ScmSymbol *symbol,
                    ? SCM_BINDING_INLINABLE
                    : 0));
 
-    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
-    ScmObj v = Scm_HashTableRef(module->internal, SCM_OBJ(symbol), SCM_FALSE);
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(module->mutex);
+    g = binding_get(&module->ibindings, symbol);
     /* NB: this function bypasses check of gloc setter */
-    if (SCM_GLOCP(v)) {
-        g = SCM_GLOC(v);
+    if (g) {
         if (Scm_GlocConstP(g))          prev_kind = SCM_BINDING_CONST;
         else if (Scm_GlocInlinableP(g)) prev_kind = SCM_BINDING_INLINABLE;
         oldval = g->value;
     } else {
         g = SCM_GLOC(Scm_MakeGloc(symbol, module));
-        Scm_HashTableSet(module->internal, SCM_OBJ(symbol), SCM_OBJ(g), 0);
+        set_internal(module, symbol, g);
         /* If module is marked 'export-all', export this binding by default */
         if (module->exportAll) {
-            Scm_HashTableSet(module->external, SCM_OBJ(symbol), SCM_OBJ(g), 0);
+            set_external(module, symbol, g);
         }
     }
     SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
@@ -435,16 +583,15 @@ void Scm_HideBinding(ScmModule *module, ScmSymbol *symbol)
 {
     int err_exists = FALSE;
 
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
-    ScmObj v = Scm_HashTableRef(module->external, SCM_OBJ(symbol), SCM_FALSE);
-    if (!SCM_FALSEP(v)) {
+    (void)SCM_INTERNAL_MUTEX_LOCK(module->mutex);
+    if (binding_get(&module->ebindings, symbol) != NULL) {
         err_exists = TRUE;
     } else {
         ScmGloc *g = SCM_GLOC(Scm_MakeGloc(symbol, module));
         g->hidden = TRUE;
-        Scm_HashTableSet(module->external, SCM_OBJ(symbol), SCM_OBJ(g), 0);
+        set_external(module, symbol, g);
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(module->mutex);
 
     if (err_exists) {
         Scm_Error("hide-binding: binding already exists: %S (exports=%S)", SCM_OBJ(symbol), Scm_ModuleExports(module));
@@ -481,9 +628,9 @@ int Scm_AliasBinding(ScmModule *target, ScmSymbol *targetName,
 {
     ScmGloc *g = Scm_FindBinding(origin, originName, SCM_BINDING_EXTERNAL);
     if (g == NULL) return FALSE;
-    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(modules.mutex);
-    Scm_HashTableSet(target->external, SCM_OBJ(targetName), SCM_OBJ(g), 0);
-    Scm_HashTableSet(target->internal, SCM_OBJ(targetName), SCM_OBJ(g), 0);
+    SCM_INTERNAL_MUTEX_SAFE_LOCK_BEGIN(target->mutex);
+    set_external(target, targetName, g);
+    set_internal(target, targetName, g);
     SCM_INTERNAL_MUTEX_SAFE_LOCK_END();
     return TRUE;
 }
@@ -511,29 +658,27 @@ ScmObj Scm_ImportModule(ScmModule *module,
         imp = SCM_MODULE(Scm__MakeWrapperModule(imp, prefix));
     }
 
-    /* Preallocate a pair, so that we won't call malloc during locking */
-    ScmObj p = Scm_Cons(SCM_OBJ(imp), SCM_NIL);
-
-    /* Prepend imported module to module->imported list. */
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    /* Prepend imported module to module->imported list.
+       Lookups traverse the list without locking, so we never modify
+       the list that is already installed.  Instead we build a new list,
+       omitting the duplicate module if any, and swap it in. */
+    (void)SCM_INTERNAL_MUTEX_LOCK(module->mutex);
     {
-        ScmObj ms, prev = p;
-        SCM_SET_CDR(p, module->imported);
-        /* Remove duplicate module, if any. */
-        SCM_FOR_EACH(ms, SCM_CDR(p)) {
+        ScmObj ms, h = SCM_NIL, t = SCM_NIL;
+        ScmObj b1 = SCM_MODULEP(imp->origin)? imp->origin : SCM_OBJ(imp);
+        SCM_APPEND1(h, t, SCM_OBJ(imp));
+        SCM_FOR_EACH(ms, module->imported) {
             ScmModule *m = SCM_MODULE(SCM_CAR(ms));
             ScmObj b0 = SCM_MODULEP(m->origin)? m->origin : SCM_OBJ(m);
-            ScmObj b1 = SCM_MODULEP(imp->origin)? imp->origin : SCM_OBJ(imp);
-            if (!SCM_EQ(b0, b1)) {
-                prev = ms;
-                continue;
+            if (SCM_EQ(b0, b1)) {
+                SCM_SET_CDR(t, SCM_CDR(ms)); /* share the rest */
+                break;
             }
-            SCM_SET_CDR(prev, SCM_CDR(ms));
-            break;
+            SCM_APPEND1(h, t, SCM_OBJ(m));
         }
-        module->imported = p;
+        SCM_ATOMIC_STORE_PTR(module->imported, h);
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(module->mutex);
 
     return module->imported;
 }
@@ -571,7 +716,7 @@ ScmObj Scm_ExportSymbols(ScmModule *module, ScmObj specs)
         }
     }
 
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_LOCK(module->mutex);
     SCM_FOR_EACH(lp, specs) {
         ScmObj spec = SCM_CAR(lp);
         ScmSymbol *name, *exported_name;
@@ -582,13 +727,11 @@ ScmObj Scm_ExportSymbols(ScmModule *module, ScmObj specs)
             name = SCM_SYMBOL(SCM_CADR(spec));
             exported_name = SCM_SYMBOL(SCM_CAR(SCM_CDDR(spec)));
         }
-        ScmDictEntry *e = Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(module->external),
-                                             (intptr_t)exported_name, SCM_DICT_GET);
+        ScmGloc *e = binding_get(&module->ebindings, exported_name);
         if (e) {
             /* If we have e, it's already exported.  Check if
                the previous export is for the same binding. */
-            SCM_ASSERT(SCM_DICT_VALUE(e) && SCM_GLOCP(SCM_DICT_VALUE(e)));
-            ScmGloc *g = SCM_GLOC(SCM_DICT_VALUE(e));
+            ScmGloc *g = e;
             if (!SCM_EQ(name, g->name)) {
                 /* exported_name got a different meaning. we record it to warn
                    later, then 'unexport' the old one. */
@@ -596,8 +739,7 @@ ScmObj Scm_ExportSymbols(ScmModule *module, ScmObj specs)
                                                  SCM_OBJ(g->name),
                                                  SCM_OBJ(name)),
                                        overwritten);
-                Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(module->external),
-                                   (intptr_t)exported_name, SCM_DICT_DELETE);
+                delete_external(module, exported_name);
                 e = NULL;
             }
         }
@@ -606,17 +748,15 @@ ScmObj Scm_ExportSymbols(ScmModule *module, ScmObj specs)
             /* This symbol hasn't been exported.  Either it only has an
                internal binding, or there's no binding at all.  In the latter
                case, we create a new binding (without value). */
-            e = Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(module->internal),
-                                   (intptr_t)name, SCM_DICT_CREATE);
-            if (!e->value) {
-                ScmGloc *g = SCM_GLOC(Scm_MakeGloc(name, module));
-                (void)SCM_DICT_SET_VALUE(e, SCM_OBJ(g));
+            ScmGloc *g = binding_get(&module->ibindings, name);
+            if (g == NULL) {
+                g = SCM_GLOC(Scm_MakeGloc(name, module));
+                set_internal(module, name, g);
             }
-            Scm_HashTableSet(module->external, SCM_OBJ(exported_name),
-                             SCM_DICT_VALUE(e), 0);
+            set_external(module, exported_name, g);
         }
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(module->mutex);
 
     /* Now, if this export changes the meaning of exported symbols, we
        warn it.  We expect this only happens at the development time, when
@@ -637,7 +777,7 @@ ScmObj Scm_ExportSymbols(ScmModule *module, ScmObj specs)
 
 ScmObj Scm_ExportAll(ScmModule *module)
 {
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_LOCK(module->mutex);
     if (!module->exportAll) {
         /* Mark the module 'export-all' so that the new bindings would get
            exported mark by default. */
@@ -648,15 +788,16 @@ ScmObj Scm_ExportAll(ScmModule *module)
         Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(module->internal));
         ScmDictEntry *e;
         while ((e = Scm_HashIterNext(&iter)) != NULL) {
-            ScmDictEntry *ee;
-            ee = Scm_HashCoreSearch(SCM_HASH_TABLE_CORE(module->external),
-                                    e->key, SCM_DICT_CREATE);
-            if (!ee->value) {
-                (void)SCM_DICT_SET_VALUE(ee, SCM_DICT_VALUE(e));
+            ScmSymbol *name = SCM_SYMBOL(SCM_DICT_KEY(e));
+            if (binding_get(&module->ebindings, name) == NULL) {
+                binding_put(&module->ebindings, name,
+                            SCM_GLOC(SCM_DICT_VALUE(e)));
+                Scm_HashTableSet(module->external, SCM_OBJ(name),
+                                 SCM_DICT_VALUE(e), 0);
             }
         }
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(module->mutex);
     return SCM_OBJ(module);
 }
 
@@ -667,14 +808,14 @@ ScmObj Scm_ModuleExports(ScmModule *module)
 {
     ScmObj h = SCM_NIL, t = SCM_NIL;
 
-    (void)SCM_INTERNAL_MUTEX_LOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_LOCK(module->mutex);
     ScmHashIter iter;
     Scm_HashIterInit(&iter, SCM_HASH_TABLE_CORE(module->external));
     ScmDictEntry *e;
     while ((e = Scm_HashIterNext(&iter)) != NULL) {
         SCM_APPEND1(h, t, SCM_DICT_KEY(e));
     }
-    (void)SCM_INTERNAL_MUTEX_UNLOCK(modules.mutex);
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(module->mutex);
     return h;
 }
 
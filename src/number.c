@@ -38,6 +38,7 @@
 #include "gauche/bits_inline.h"
 #include "gauche/priv/builtin-syms.h"
 #include "gauche/priv/arith.h"
+#include "gauche/priv/numberP.h"
 
 #include <limits.h>
 #include <float.h>
@@ -3311,7 +3312,8 @@ static double raise_pow10(double x, int n)
  *
  * This version implements Burger&Dybvig algorithm (Robert G. Burger
  * and and R. Kent Dybvig, "Priting Floating-Point Numbers Quickly and
- * Accurately", PLDI '96, pp.108--116, 1996).
+ * Accurately", PLDI '96, pp.108--116, 1996), with Grisu3 fast path
+ * (see flonum_digits_fast below).
  */
 
 /* compare x+d and y.  x, d, y are exact positive integers.
@@ -3331,6 +3333,371 @@ static inline int numcmp3(ScmObj x, ScmObj d, ScmObj y)
     }
 }
 
+/* Generates the shortest digits that uniquely identify a positive
+   flonum VAL by Burger&Dybvig algorithm.  The digits are stored in
+   DIGITS (without terminating NUL) and the number of digits is
+   returned.  *EST is set so that VAL = 0.DDDD * 10^EST. */
+static int flonum_digits_bd(double val, char *digits, int maxdigits, int *est)
+{
+    /* variable names follows Burger&Dybvig paper. mp, mm for m+, m-.
+       note that m+ == m- for most cases, and m+ == 2*m- for the rest.
+       so we calculate m+ from m- for each iteration, using the flag
+       mp2 as   m+ = mp? m- : 2*m-. */
+    ScmObj r, s, mm;
+    int exp, sign;
+    int mp2 = FALSE, fixup = FALSE;
+
+    IEXPT10_INIT();
+
+    /* initialize r, s, m+ and m- */
+    ScmObj f = Scm_DecodeFlonum(val, &exp, &sign);
+    int round = !Scm_OddP(f);
+    if (exp >= 0) {
+        ScmObj be = Scm_Ash(SCM_MAKE_INT(1), exp);
+        if (Scm_NumCmp(f, SCM_2_52) != 0) {
+            r = Scm_Ash(f, exp+1);
+            s = SCM_MAKE_INT(2);
+            mp2= FALSE;
+            mm = be;
+        } else {
+            r = Scm_Ash(f, exp+2);
+            s = SCM_MAKE_INT(4);
+            mp2 = TRUE;
+            mm = be;
+        }
+    } else {
+        if (exp == -1023 || Scm_NumCmp(f, SCM_2_52) != 0) {
+            r = Scm_Ash(f, 1);
+            s = Scm_Ash(SCM_MAKE_INT(1), -exp+1);
+            mp2 = FALSE;
+            mm = SCM_MAKE_INT(1);
+        } else {
+            r = Scm_Ash(f, 2);
+            s = Scm_Ash(SCM_MAKE_INT(1), -exp+2);
+            mp2 = TRUE;
+            mm = SCM_MAKE_INT(1);
+        }
+    }
+
+    /* estimate scale */
+    int k = (int)ceil(log10(val) - 0.1);
+    if (k >= 0) {
+        s = Scm_Mul(s, iexpt10(k));
+    } else {
+        ScmObj scale = iexpt10(-k);
+        r =  Scm_Mul(r, scale);
+        mm = Scm_Mul(mm, scale);
+    }
+
+    /* fixup.  avoid calculating m+ for obvious case. */
+    if (Scm_NumCmp(r, s) >= 0) {
+        fixup = TRUE;
+    } else {
+        ScmObj mp = (mp2? Scm_Ash(mm, 1) : mm);
+        if (round) {
+            fixup = (numcmp3(r, mp, s) >= 0);
+        } else {
+            fixup = (numcmp3(r, mp, s) > 0);
+        }
+    }
+    if (fixup) {
+        s = Scm_Mul(s, SCM_MAKE_INT(10));
+        k++;
+    }
+    *est = k;
+
+    /* Scm_Printf(SCM_CURERR, "k=%d, r=%S, s=%S, mp=%S, mm=%S\n",
+       k, r, s, mp, mm); */
+
+    /* generate the digits */
+    int n;
+    for (n=0; n<maxdigits;) {
+        ScmObj r10 = Scm_Mul(r, SCM_MAKE_INT(10));
+        ScmObj q = Scm_Quotient(r10, s, &r);
+        mm = Scm_Mul(mm, SCM_MAKE_INT(10));
+        ScmObj mp = (mp2? Scm_Ash(mm, 1) : mm);
+
+        /* Scm_Printf(SCM_CURERR, "q=%S, r=%S, mp=%S, mm=%S\n",
+           q, r, mp, mm);*/
+
+        SCM_ASSERT(SCM_INTP(q));
+        int tc1, tc2;
+        if (round) {
+            tc1 = (Scm_NumCmp(r, mm) <= 0);
+            tc2 = (numcmp3(r, mp, s) >= 0);
+        } else {
+            tc1 = (Scm_NumCmp(r, mm) < 0);
+            tc2 = (numcmp3(r, mp, s) > 0);
+        }
+        if (!tc1) {
+            if (!tc2) {
+                digits[n++] = (char)SCM_INT_VALUE(q) + '0';
+                continue;
+            } else {
+                digits[n++] = (char)SCM_INT_VALUE(q) + '1';
+                break;
+            }
+        } else {
+            if (!tc2) {
+                digits[n++] = (char)SCM_INT_VALUE(q) + '0';
+                break;
+            } else {
+                int tc3 = numcmp3(r, r, s); /* r*2 <=> s */
+                if ((round && tc3 <= 0) || (!round && tc3 < 0)) {
+                    digits[n++] = (char)SCM_INT_VALUE(q) + '0';
+                    break;
+                } else {
+                    digits[n++] = (char)SCM_INT_VALUE(q) + '1';
+                    break;
+                }
+            }
+        }
+    }
+    return n;
+}
+
+/*
+ * Fast path of flonum printing.
+ *
+ * Grisu3 algorithm by Florian Loitsch ("Printing Floating-Point Numbers
+ * Quickly and Accurately with Integers", PLDI '10) generates the
+ * shortest digits with 64bit integer arithmetic.  It can't decide
+ * the result in about 0.5% of inputs, including the ties of two
+ * closest candidates; it reports failure and we fall back to
+ * the exact algorithm above.  When it succeeds, the result is
+ * the same as flonum_digits_bd.
+ */
+
+#if !SCM_EMULATE_INT64
+
+/* "do-it-yourself floating point": f * 2^e */
+typedef struct {
+    uint64_t f;
+    int e;
+} diyfp;
+
+/* Normalized and rounded 64bit approximations of 10^k, for
+   k = FLONUM_POW10_KMIN + i*8 (i = 0 .. FLONUM_POW10_SIZE-1). */
+#define FLONUM_POW10_KMIN  -348
+#define FLONUM_POW10_SIZE   87
+static diyfp flonum_pow10[FLONUM_POW10_SIZE];
+static int   flonum_pow10_initialized = FALSE;
+
+static int exact_integer_length(ScmObj n) /* n > 0 */
+{
+    if (SCM_INTP(n)) return Scm__HighestBitNumber(SCM_INT_VALUE(n)) + 1;
+    u_int size = SCM_BIGNUM_SIZE(n);
+    return (size-1)*SCM_WORD_BITS
+        + Scm__HighestBitNumber(SCM_BIGNUM(n)->values[size-1]) + 1;
+}
+
+static void flonum_pow10_init(void)
+{
+    IEXPT10_INIT();
+    for (int i=0; i<FLONUM_POW10_SIZE; i++) {
+        int k = FLONUM_POW10_KMIN + i*8;
+        ScmObj f;
+        int e;
+        if (k >= 0) {
+            ScmObj n = iexpt10(k);
+            e = exact_integer_length(n) - 64;
+            if (e > 0) {
+                f = Scm_Ash(Scm_Add(n, Scm_Ash(SCM_MAKE_INT(1), e-1)), -e);
+            } else {
+                f = Scm_Ash(n, -e);
+            }
+        } else {
+            /* round(2^(63+L) / 10^-k), where L is the length of 10^-k */
+            ScmObj d = iexpt10(-k);
+            int len = exact_integer_length(d);
+            f = Scm_Quotient(Scm_Add(Scm_Ash(SCM_MAKE_INT(1), 64+len), d),
+                             Scm_Ash(d, 1), NULL);
+            e = -(63+len);
+        }
+        if (exact_integer_length(f) > 64) {
+            f = Scm_Ash(f, -1);
+            e++;
+        }
+        flonum_pow10[i].f = Scm_GetIntegerU64Clamp(f, SCM_CLAMP_NONE, NULL);
+        flonum_pow10[i].e = e;
+    }
+    flonum_pow10_initialized = TRUE;
+}
+
+/* Rounded upper 64bit of the 128bit product */
+static inline diyfp diyfp_mul(diyfp x, diyfp y)
+{
+    const uint64_t m32 = 0xffffffffUL;
+    uint64_t a = x.f >> 32, b = x.f & m32, c = y.f >> 32, d = y.f & m32;
+    uint64_t ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+    uint64_t t = (bd >> 32) + (ad & m32) + (bc & m32) + (1UL << 31);
+    diyfp r;
+    r.f = ac + (ad >> 32) + (bc >> 32) + (t >> 32);
+    r.e = x.e + y.e + 64;
+    return r;
+}
+
+static inline diyfp diyfp_normalize(diyfp x)
+{
+    while (!(x.f & ((uint64_t)1 << 63))) { x.f <<= 1; x.e--; }
+    return x;
+}
+
+/* Adjusts the last digit to get the candidate closest to the value,
+   and checks if the result is safely within the boundaries. */
+static int grisu_round_weed(char *digits, int len, uint64_t dist_high_w,
+                            uint64_t unsafe, uint64_t rest,
+                            uint64_t ten_kappa, uint64_t unit)
+{
+    uint64_t small = dist_high_w - unit;
+    uint64_t big = dist_high_w + unit;
+    while (rest < small && unsafe - rest >= ten_kappa
+           && (rest + ten_kappa < small
+               || small - rest >= rest + ten_kappa - small)) {
+        digits[len-1]--;
+        rest += ten_kappa;
+    }
+    if (rest < big && unsafe - rest >= ten_kappa
+        && (rest + ten_kappa < big
+            || big - rest > rest + ten_kappa - big)) {
+        return FALSE;
+    }
+    return (2*unit <= rest) && (rest <= unsafe - 4*unit);
+}
+
+/* Same interface as flonum_digits_bd, but may return 0 for failure. */
+static int flonum_digits_fast(double val, char *digits, int *est)
+{
+    u_long mant1, mant0;
+    int bexp, sign;
+    decode_double(val, &mant1, &mant0, &bexp, &sign);
+#if SIZEOF_LONG >= 8
+    uint64_t mant = mant0;
+#else
+    uint64_t mant = ((uint64_t)mant0 << 32) | mant1;
+#endif
+
+    if (!flonum_pow10_initialized) flonum_pow10_init();
+
+    /* the value w and its boundaries m- and m+ */
+    diyfp w, mp, mm;
+    if (bexp > 0) {
+        w.f = mant | ((uint64_t)1 << 52);
+        w.e = bexp - 0x3ff - 52;
+    } else {
+        w.f = mant;
+        w.e = -0x3fe - 52;
+    }
+    mp.f = (w.f << 1) + 1;
+    mp.e = w.e - 1;
+    mp = diyfp_normalize(mp);
+    if (mant == 0 && bexp > 1) {
+        /* the lower boundary is closer */
+        mm.f = (w.f << 2) - 1;
+        mm.e = w.e - 2;
+    } else {
+        mm.f = (w.f << 1) - 1;
+        mm.e = w.e - 1;
+    }
+    mm.f <<= mm.e - mp.e;
+    mm.e = mp.e;
+    w = diyfp_normalize(w);
+
+    /* choose 10^-k so that the scaled numbers have binary exponent
+       in [-60, -32]. */
+    int i = ((int)ceil((-61 - w.e) * 0.30102999566398114)
+             - FLONUM_POW10_KMIN) / 8;
+    if (i < 0) i = 0;
+    if (i >= FLONUM_POW10_SIZE) i = FLONUM_POW10_SIZE-1;
+    while (i > 0 && w.e + flonum_pow10[i].e + 64 > -32) i--;
+    while (i < FLONUM_POW10_SIZE-1 && w.e + flonum_pow10[i].e + 64 < -60) i++;
+    int mk = FLONUM_POW10_KMIN + i*8;
+    diyfp sw = diyfp_mul(w, flonum_pow10[i]);
+    diyfp slow = diyfp_mul(mm, flonum_pow10[i]);
+    diyfp shigh = diyfp_mul(mp, flonum_pow10[i]);
+
+    /* generate digits.  the boundaries are widened by the unit of error,
+       and grisu_round_weed checks the result is safe. */
+    uint64_t unit = 1;
+    uint64_t too_low = slow.f - unit, too_high = shigh.f + unit;
+    uint64_t unsafe = too_high - too_low;
+    int shift = -sw.e;
+    uint64_t one = (uint64_t)1 << shift;
+    uint32_t integrals = (uint32_t)(too_high >> shift);
+    uint64_t fractionals = too_high & (one - 1);
+    uint32_t divisor = 0;
+    int kappa = 0, len = 0;
+
+    if (integrals > 0) {
+        uint64_t d = 1;
+        for (kappa = 1; d*10 <= integrals; kappa++) d *= 10;
+        divisor = (uint32_t)d;
+    }
+    while (kappa > 0) {
+        digits[len++] = (char)('0' + integrals / divisor);
+        integrals %= divisor;
+        kappa--;
+        uint64_t rest = ((uint64_t)integrals << shift) + fractionals;
+        if (rest < unsafe) {
+            if (!grisu_round_weed(digits, len, too_high - sw.f, unsafe, rest,
+                                  (uint64_t)divisor << shift, unit)) {
+                return 0;
+            }
+            goto done;
+        }
+        divisor /= 10;
+    }
+    for (;;) {
+        fractionals *= 10;
+        unit *= 10;
+        unsafe *= 10;
+        digits[len++] = (char)('0' + (fractionals >> shift));
+        fractionals &= one - 1;
+        kappa--;
+        if (fractionals < unsafe) {
+            if (!grisu_round_weed(digits, len, (too_high - sw.f) * unit,
+                                  unsafe, fractionals, one, unit)) {
+                return 0;
+            }
+            goto done;
+        }
+    }
+ done:
+    /* VAL = DIGITS * 10^(kappa-mk).  Strip trailing zeros to match
+       flonum_digits_bd. */
+    *est = len + kappa - mk;
+    while (len > 1 && digits[len-1] == '0') len--;
+    return len;
+}
+#else  /*SCM_EMULATE_INT64*/
+static int flonum_digits_fast(double val, char *digits, int *est)
+{
+    return 0;
+}
+#endif /*SCM_EMULATE_INT64*/
+
+#define FLONUM_DIGITS_MAX 24    /* enough for 17 digits of double */
+
+/* For testing.  Returns (DIGITS . EST) of a positive flonum D,
+   by the fast path if USE_FAST_PATH is true, or #f if it fails. */
+ScmObj Scm__FlonumDigits(double d, int use_fast_path)
+{
+    char digits[FLONUM_DIGITS_MAX];
+    int est, n;
+    if (!(d > 0.0) || SCM_IS_INF(d)) {
+        Scm_Error("positive finite flonum required, but got %S",
+                  Scm_MakeFlonum(d));
+    }
+    if (use_fast_path) {
+        n = flonum_digits_fast(d, digits, &est);
+        if (n == 0) return SCM_FALSE;
+    } else {
+        n = flonum_digits_bd(d, digits, FLONUM_DIGITS_MAX, &est);
+    }
+    return Scm_Cons(Scm_MakeString(digits, n, n, SCM_STRING_COPYING),
+                    Scm_MakeInteger(est));
+}
+
 /* The main routine to get string representation of double.
    Convert VAL to a string and store to BUF, which must have at least FLT_BUF
    bytes long.
@@ -3366,76 +3733,15 @@ static void print_double(char *buf, int buflen, double val, int plus_sign,
     if (val < 0.0) *buf++ = '-', buflen--;
     else if (plus_sign) *buf++ = '+', buflen--;
     {
-        /* variable names follows Burger&Dybvig paper. mp, mm for m+, m-.
-           note that m+ == m- for most cases, and m+ == 2*m- for the rest.
-           so we calculate m+ from m- for each iteration, using the flag
-           mp2 as   m+ = mp? m- : 2*m-. */
-        ScmObj r, s, mm;
-        int exp, sign;
-        int mp2 = FALSE, fixup = FALSE;
-
-        IEXPT10_INIT();
+        char digits[FLONUM_DIGITS_MAX];
+        int est;
         if (val < 0) val = -val;
 
-        /* initialize r, s, m+ and m- */
-        ScmObj f = Scm_DecodeFlonum(val, &exp, &sign);
-        int round = !Scm_OddP(f);
-        if (exp >= 0) {
-            ScmObj be = Scm_Ash(SCM_MAKE_INT(1), exp);
-            if (Scm_NumCmp(f, SCM_2_52) != 0) {
-                r = Scm_Ash(f, exp+1);
-                s = SCM_MAKE_INT(2);
-                mp2= FALSE;
-                mm = be;
-            } else {
-                r = Scm_Ash(f, exp+2);
-                s = SCM_MAKE_INT(4);
-                mp2 = TRUE;
-                mm = be;
-            }
-        } else {
-            if (exp == -1023 || Scm_NumCmp(f, SCM_2_52) != 0) {
-                r = Scm_Ash(f, 1);
-                s = Scm_Ash(SCM_MAKE_INT(1), -exp+1);
-                mp2 = FALSE;
-                mm = SCM_MAKE_INT(1);
-            } else {
-                r = Scm_Ash(f, 2);
-                s = Scm_Ash(SCM_MAKE_INT(1), -exp+2);
-                mp2 = TRUE;
-                mm = SCM_MAKE_INT(1);
-            }
+        int ndigits = flonum_digits_fast(val, digits, &est);
+        if (ndigits == 0) {
+            ndigits = flonum_digits_bd(val, digits, FLONUM_DIGITS_MAX, &est);
         }
 
-        /* estimate scale */
-        int est = (int)ceil(log10(val) - 0.1);
-        if (est >= 0) {
-            s = Scm_Mul(s, iexpt10(est));
-        } else {
-            ScmObj scale = iexpt10(-est);
-            r =  Scm_Mul(r, scale);
-            mm = Scm_Mul(mm, scale);
-        }
-
-        /* fixup.  avoid calculating m+ for obvious case. */
-        if (Scm_NumCmp(r, s) >= 0) {
-            fixup = TRUE;
-        } else {
-            ScmObj mp = (mp2? Scm_Ash(mm, 1) : mm);
-            if (round) {
-                fixup = (numcmp3(r, mp, s) >= 0);
-            } else {
-                fixup = (numcmp3(r, mp, s) > 0);
-            }
-        }
-        if (fixup) {
-            s = Scm_Mul(s, SCM_MAKE_INT(10));
-            est++;
-        }
-
-        /* Scm_Printf(SCM_CURERR, "est=%d, r=%S, s=%S, mp=%S, mm=%S\n",
-           est, r, s, mp, mm); */
-
         /* Determine position of decimal point.  we avoid exponential
            notation if exponent is small, i.e. 0.9 and 30.0 instead of
            9.0e-1 and 3.0e1.  */
@@ -3457,51 +3763,13 @@ static void print_double(char *buf, int buflen, double val, int plus_sign,
             }
         }
 
-        /* generate the digits */
+        /* copy the digits */
         int digs;
-        for (digs=1;buflen>5;digs++) {
-            ScmObj r10 = Scm_Mul(r, SCM_MAKE_INT(10));
-            ScmObj q = Scm_Quotient(r10, s, &r);
-            mm = Scm_Mul(mm, SCM_MAKE_INT(10));
-            ScmObj mp = (mp2? Scm_Ash(mm, 1) : mm);
-
-            /* Scm_Printf(SCM_CURERR, "q=%S, r=%S, mp=%S, mm=%S\n",
-               q, r, mp, mm);*/
-
-            SCM_ASSERT(SCM_INTP(q));
-            int tc1, tc2;
-            if (round) {
-                tc1 = (Scm_NumCmp(r, mm) <= 0);
-                tc2 = (numcmp3(r, mp, s) >= 0);
-            } else {
-                tc1 = (Scm_NumCmp(r, mm) < 0);
-                tc2 = (numcmp3(r, mp, s) > 0);
-            }
-            if (!tc1) {
-                if (!tc2) {
-                    *buf++ = (char)SCM_INT_VALUE(q) + '0';
-                    if (digs == point) *buf++ = '.', buflen--;
-                    continue;
-                } else {
-                    *buf++ = (char)SCM_INT_VALUE(q) + '1';
-                    break;
-                }
-            } else {
-                if (!tc2) {
-                    *buf++ = (char)SCM_INT_VALUE(q) + '0';
-                    break;
-                } else {
-                    int tc3 = numcmp3(r, r, s); /* r*2 <=> s */
-                    if ((round && tc3 <= 0) || (!round && tc3 < 0)) {
-                        *buf++ = (char)SCM_INT_VALUE(q) + '0';
-                        break;
-                    } else {
-                        *buf++ = (char)SCM_INT_VALUE(q) + '1';
-                        break;
-                    }
-                }
-            }
+        for (digs=1; digs<=ndigits && buflen>5; digs++) {
+            *buf++ = digits[digs-1];
+            if (digs == point && digs < ndigits) *buf++ = '.', buflen--;
         }
+        digs--;
 
         /* print the trailing zeros if necessary */
         if (digs <= point) {
@@ -3622,7 +3890,7 @@ size_t Scm_PrintNumber(ScmPort *port, ScmObj n, ScmNumberFormat *fmt)
     return print_number(port, n, fmt->flags, fmt);
 }
 
-/* API.  FMT can be NULL.  Utility to expose Burger&Dybvig algorithm. */
+/* API.  FMT can be NULL.  Utility to expose the flonum printer. */
 size_t Scm_PrintDouble(ScmPort *port, double d, ScmNumberFormat *fmt)
 {
     if (fmt == NULL) {
@@ -3705,6 +3973,52 @@ static u_long bigdig[RADIX_MAX-RADIX_MIN+1] = { 0 };
 
 static ScmObj numread_error(const char *msg, struct numread_packet *context);
 
+/* When a long integer is read, its digits are accumulated into
+   "big digits" (see bigdig above) and then combined.  If there are
+   many of them, we combine them in divide-and-conquer way, using
+   bigdig_pow[R][i] = bigdig[R]^(2^i), to avoid O(n^2) behavior. */
+#define READ_UINT_DC_THRESHOLD 32  /* # of big digits */
+#define BIGDIG_POW_LEVELS      32
+static ScmObj bigdig_pow[RADIX_MAX-RADIX_MIN+1][BIGDIG_POW_LEVELS]
+    = { { NULL } };
+
+static ScmObj bigdig_power(int radix, int level)
+{
+    ScmObj p = bigdig_pow[radix-RADIX_MIN][level];
+    if (p == NULL) {
+        if (level == 0) {
+            p = Scm_MakeIntegerU(bigdig[radix-RADIX_MIN]);
+        } else {
+            ScmObj h = bigdig_power(radix, level-1);
+            p = Scm_Mul(h, h);
+        }
+        /* Races are harmless, since everyone computes the same value. */
+        bigdig_pow[radix-RADIX_MIN][level] = p;
+    }
+    return p;
+}
+
+/* Returns the integer represented by big digits chunks[0..n),
+   most significant first. */
+static ScmObj combine_bigdigs(const u_long *chunks, int n, int radix)
+{
+    if (n <= READ_UINT_DC_THRESHOLD) {
+        u_long bdig = bigdig[radix-RADIX_MIN];
+        ScmBignum *b = Scm_MakeBignumWithSize(n, chunks[0]);
+        for (int i=1; i<n; i++) {
+            b = Scm_BignumAccMultAddUI(b, bdig, chunks[i]);
+        }
+        return Scm_NormalizeBignum(b);
+    }
+    /* split so that the lower part has 2^level big digits */
+    int level = 0;
+    while ((2 << level) < n) level++;
+    int low = 1 << level;
+    ScmObj hi = combine_bigdigs(chunks, n - low, radix);
+    ScmObj lo = combine_bigdigs(chunks + n - low, low, radix);
+    return Scm_Add(Scm_Mul(hi, bigdig_power(radix, level)), lo);
+}
+
 /* Returns either small integer or bignum.
    initval may be a Scheme integer that will be 'concatenated' before
    the integer to be read; it is used to read floating-point number.
@@ -3721,6 +4035,8 @@ static ScmObj read_uint(const char **strp, int *lenp,
     u_long limit = longlimit[radix-RADIX_MIN], bdig = bigdig[radix-RADIX_MIN];
     u_long value_int = 0;
     ScmBignum *value_big = NULL;
+    u_long chunkbuf[READ_UINT_DC_THRESHOLD], *chunks = chunkbuf;
+    int nchunks = 0, nsaved = 0, chunksize = READ_UINT_DC_THRESHOLD;
     static const char tab[] = "0123456789abcdefghijklmnopqrstuvwxyz";
 
     if (!SCM_FALSEP(initval)) {
@@ -3775,7 +4091,19 @@ static ScmObj read_uint(const char **strp, int *lenp,
                 value_int = digits = 0;
             }
         } else if (digits > diglimit) {
-            value_big = Scm_BignumAccMultAddUI(value_big, bdig, value_int);
+            if (nchunks < READ_UINT_DC_THRESHOLD) {
+                value_big = Scm_BignumAccMultAddUI(value_big, bdig, value_int);
+                nchunks++;
+            } else {
+                /* Too many digits; save big digits to combine later. */
+                if (nsaved == chunksize) {
+                    u_long *nc = SCM_NEW_ATOMIC_ARRAY(u_long, chunksize*2);
+                    memcpy(nc, chunks, sizeof(u_long)*nsaved);
+                    chunks = nc;
+                    chunksize *= 2;
+                }
+                chunks[nsaved++] = value_int;
+            }
             value_int = digits = 0;
         }
     }
@@ -3783,6 +4111,19 @@ static ScmObj read_uint(const char **strp, int *lenp,
     *lenp = len+1;
 
     if (value_big == NULL) return Scm_MakeInteger(value_int);
+    if (nsaved > 0) {
+        /* value_big * bigdig^nsaved + saved big digits */
+        ScmObj v = Scm_NormalizeBignum(value_big);
+        for (int i=0; (nsaved >> i) > 0; i++) {
+            if ((nsaved >> i) & 1) v = Scm_Mul(v, bigdig_power(radix, i));
+        }
+        v = Scm_Add(v, combine_bigdigs(chunks, nsaved, radix));
+        if (digits > 0) {
+            v = Scm_Add(Scm_Mul(v, Scm_MakeIntegerU(ipow(radix, digits))),
+                        Scm_MakeIntegerU(value_int));
+        }
+        return v;
+    }
     if (digits > 0) {
         value_big = Scm_BignumAccMultAddUI(value_big,
                                            ipow(radix, digits),
@@ -3791,6 +4132,127 @@ static ScmObj read_uint(const char **strp, int *lenp,
     return Scm_NormalizeBignum(SCM_BIGNUM(value_big));
 }
 
+/*
+ * Fast path of reading decimal numbers.
+ *
+ * Eisel-Lemire algorithm (Daniel Lemire, "Number Parsing at a Gigabyte
+ * per Second", Software: Practice and Experience 51(8), 2021) finds
+ * the double closest to w * 10^q, where w is a 64bit integer, using
+ * a 128bit approximation of 5^q.  If the approximation isn't precise
+ * enough to decide the rounding, it reports failure and we use the
+ * exact algorithm (algorithmR).
+ */
+
+#if !SCM_EMULATE_INT64
+
+#define POW5_QMIN  -342
+#define POW5_QMAX   308
+
+/* Upper 128 bits of 5^q (q >= 0) or 2^b/5^-q (q < 0), in the same way
+   as the reference implementation (fast_float), for POW5_QMIN <= q <=
+   POW5_QMAX.  pow5_128[i][0] is the upper half. */
+static uint64_t pow5_128[POW5_QMAX-POW5_QMIN+1][2];
+static int pow5_128_initialized = FALSE;
+
+static void pow5_128_init(void)
+{
+    ScmObj two64 = Scm_Ash(SCM_MAKE_INT(1), 64);
+    for (int q = POW5_QMIN; q <= POW5_QMAX; q++) {
+        ScmObj c;
+        if (q < 0) {
+            ScmObj p = Scm_ExactIntegerExpt(SCM_MAKE_INT(5), SCM_MAKE_INT(-q));
+            int z = exact_integer_length(p);
+            int b = (q >= -27)? z + 127 : 2*z + 128;
+            c = Scm_Add(Scm_Quotient(Scm_Ash(SCM_MAKE_INT(1), b), p, NULL),
+                        SCM_MAKE_INT(1));
+        } else {
+            c = Scm_ExactIntegerExpt(SCM_MAKE_INT(5), SCM_MAKE_INT(q));
+        }
+        /* normalize to 128 bits, truncating extra bits */
+        c = Scm_Ash(c, 128 - exact_integer_length(c));
+        ScmObj hi, lo;
+        hi = Scm_Quotient(c, two64, &lo);
+        pow5_128[q-POW5_QMIN][0] = Scm_GetIntegerU64Clamp(hi, SCM_CLAMP_NONE, NULL);
+        pow5_128[q-POW5_QMIN][1] = Scm_GetIntegerU64Clamp(lo, SCM_CLAMP_NONE, NULL);
+    }
+    pow5_128_initialized = TRUE;
+}
+
+/* 64x64->128bit multiplication */
+static inline void umul128(uint64_t x, uint64_t y, uint64_t *hi, uint64_t *lo)
+{
+#if defined(__SIZEOF_INT128__)
+    unsigned __int128 p = (unsigned __int128)x * y;
+    *hi = (uint64_t)(p >> 64);
+    *lo = (uint64_t)p;
+#else
+    const uint64_t m32 = 0xffffffffUL;
+    uint64_t a = x >> 32, b = x & m32, c = y >> 32, d = y & m32;
+    uint64_t ac = a*c, bc = b*c, ad = a*d, bd = b*d;
+    uint64_t mid = (bd >> 32) + (bc & m32) + (ad & m32);
+    *hi = ac + (bc >> 32) + (ad >> 32) + (mid >> 32);
+    *lo = (mid << 32) | (bd & m32);
+#endif
+}
+
+/* Tries to compute the double closest to W * 10^Q.  Returns TRUE and
+   sets the result to *R on success.  Returns FALSE if the result is
+   ambiguous, or it underflows or overflows. */
+static int read_double_fast(uint64_t w, int q, double *r)
+{
+    if (w == 0 || q < POW5_QMIN || q > POW5_QMAX) return FALSE;
+    if (!pow5_128_initialized) pow5_128_init();
+
+#if defined(__GNUC__)
+    int lz = __builtin_clzll(w);
+    w <<= lz;
+#else
+    int lz = 0;
+    while (!(w & ((uint64_t)1 << 63))) { w <<= 1; lz++; }
+#endif
+
+    /* We need the upper 55 bits (53 bits + 2 bits to round) of the
+       product.  If the lower bits of the first product are all 1, adding
+       the lower part may carry into them; compute it. */
+    const uint64_t *p5 = pow5_128[q - POW5_QMIN];
+    uint64_t hi, lo;
+    umul128(w, p5[0], &hi, &lo);
+    if ((hi & 0x1ff) == 0x1ff) {
+        uint64_t hi2, lo2;
+        umul128(w, p5[1], &hi2, &lo2);
+        lo += hi2;
+        if (lo < hi2) hi++;
+    }
+    /* The remaining error may affect the result.  This check is from
+       the original paper, and is very rare to hit. */
+    if (lo == ~(uint64_t)0 && (q < -27 || q > 55)) return FALSE;
+
+    int upperbit = (int)(hi >> 63);
+    uint64_t mant = hi >> (upperbit + 9);
+    /* binary exponent, biased.  (217706*q)>>16 is floor(q*log2(10)) */
+    int power2 = ((217706 * q) >> 16) + 63 + upperbit - lz + 1023;
+
+    if (power2 <= 0) {
+        /* subnormal.  we leave the edge cases to algorithmR. */
+        return FALSE;
+    }
+    /* If we're exactly at the halfway, round to even. */
+    if (lo <= 1 && q >= -4 && q <= 23 && (mant & 3) == 1
+        && (mant << (upperbit + 9)) == hi) {
+        mant &= ~(uint64_t)1;
+    }
+    mant += (mant & 1);
+    mant >>= 1;
+    if (mant >= ((uint64_t)2 << 52)) {
+        mant = (uint64_t)1 << 52;
+        power2++;
+    }
+    if (power2 >= 0x7ff) return FALSE;  /* overflow */
+    *r = ldexp((double)mant, power2 - 1075);
+    return TRUE;
+}
+#endif /*!SCM_EMULATE_INT64*/
+
 /*
  * Find a double number closest to f * 10^e, using z as the starting
  * approximation.  The algorithm (and its name) is taken from Will Clinger's
@@ -4061,6 +4523,21 @@ static ScmObj read_real(const char **strp, int *lenp,
        AlgorithmR.  We have to be careful, however, not to overflow
        the following GetDouble call. */
     int raise_factor = exponent - fracdigs;
+
+#if !SCM_EMULATE_INT64
+    /* Most of the numbers we read have 19 or less significant digits.
+       Try the fast path; it decides the correctly rounded value in
+       most cases without going through algorithmR. */
+    if ((SCM_INTP(fraction) && SCM_INT_VALUE(fraction) > 0)
+        || (SCM_BIGNUMP(fraction) && exact_integer_length(fraction) <= 64)) {
+        double d;
+        uint64_t w = Scm_GetIntegerU64Clamp(fraction, SCM_CLAMP_NONE, NULL);
+        if (read_double_fast(w, raise_factor, &d)) {
+            return Scm_MakeFlonum(minusp? -d : d);
+        }
+    }
+#endif /*!SCM_EMULATE_INT64*/
+
     double realnum = Scm_GetDouble(fraction);
 
     if (SCM_IS_INF(realnum)) {
@@ -40,6 +40,18 @@
 #include <fcntl.h>
 #include <errno.h>
 #include <ctype.h>
+#if defined(HAVE_SYS_MMAN_H) && defined(HAVE_MMAP)
+#include <sys/mman.h>
+#define USE_MAPPED_FILE_PORT 1
+#endif
+#if defined(HAVE_SYS_UIO_H) && defined(HAVE_WRITEV)
+#include <sys/uio.h>
+#define USE_WRITEV 1
+#endif
+#if defined(HAVE_SYS_SENDFILE_H) && defined(HAVE_SENDFILE)
+#include <sys/sendfile.h>
+#define USE_SENDFILE 1
+#endif
 
 #undef MAX
 #undef MIN
@@ -60,8 +72,17 @@ static void port_finalize(ScmObj obj, void* data);
 static void register_buffered_port(ScmPort *port);
 static void unregister_buffered_port(ScmPort *port);
 static void bufport_flush(ScmPort*, int, int);
+static int  file_flusher(ScmPort *p, int cnt, int forcep);
 static void file_closer(ScmPort *p);
 
+/* A piece of data to be written by file_gather_write */
+typedef struct gather_chunk_rec {
+    const char *ptr;
+    size_t len;
+} gather_chunk;
+
+static void file_gather_write(ScmPort *p, gather_chunk *chunks, int nchunks);
+
 SCM_DEFINE_BASE_CLASS(Scm_PortClass,
                       ScmPort, /* instance type */
                       port_print, NULL, NULL, NULL, NULL);
@@ -420,6 +441,11 @@ int Scm_FdReady(int fd, int dir)
  *        ^                                   ^
  *        bc                                  e
  *
+ *    If port->src.buf.filler is NULL, the buffer is assumed to hold
+ *    the entire data from the beginning (e.g. a file port on a mapped
+ *    file), so there's nothing to fill.  The buffer pointers are never
+ *    shifted in that case.
+ *
  *  Close
  *    Port is closed either explicitly (via close-port etc) or implicity
  *    (via GC -> finalizer).   In either case, the flusher is called first
@@ -574,9 +600,20 @@ static void bufport_flush(ScmPort *p, int cnt, int forcep)
 }
 
 /* Writes siz bytes in src to the buffered port.  siz may be larger than
-   the port's buffer.  Won't return until entire siz bytes are written. */
+   the port's buffer.  Won't return until entire siz bytes are written.
+   If the data doesn't fit in the room of a file port's buffer, we hand
+   the buffered data and src to the OS together, instead of copying src
+   into the buffer piece by piece. */
 static void bufport_write(ScmPort *p, const char *src, int siz)
 {
+    if (p->src.buf.flusher == file_flusher
+        && siz > (int)(p->src.buf.end - p->src.buf.current)) {
+        gather_chunk chunks[2];
+        chunks[1].ptr = src;
+        chunks[1].len = (size_t)siz;
+        file_gather_write(p, chunks, 2);
+        return;
+    }
     do {
         int room = (int)(p->src.buf.end - p->src.buf.current);
         if (room >= siz) {
@@ -600,6 +637,8 @@ static void bufport_write(ScmPort *p, const char *src, int siz)
  */
 static int bufport_fill(ScmPort *p, int min, int allow_less)
 {
+    if (p->src.buf.filler == NULL) return 0; /* the buffer has everything */
+
     int cursiz = (int)(p->src.buf.end - p->src.buf.current);
     int nread = 0, toread;
     if (cursiz > 0) {
@@ -910,6 +949,21 @@ static int file_filler(ScmPort *p, int cnt)
     return nread;
 }
 
+static void file_write_failed(ScmPort *p)
+{
+    if (SCM_PORT_BUFFER_SIGPIPE_SENSITIVE_P(p)) {
+        /* (sort of) emulate termination by SIGPIPE.
+           NB: The difference is visible from the outside world
+           as the process exit status differ (WIFEXITED
+           instead of WIFSIGNALED).  If it becomes a problem,
+           we can reset the signal handler to SIG_DFL and
+           send SIGPIPE to self. */
+        Scm_Exit(1);    /* exit code is somewhat arbitrary */
+    }
+    p->error = TRUE;
+    Scm_SysError("write failed on %S", p);
+}
+
 static int file_flusher(ScmPort *p, int cnt, int forcep)
 {
     int nwrote = 0;
@@ -924,17 +978,7 @@ static int file_flusher(ScmPort *p, int cnt, int forcep)
         errno = 0;
         SCM_SYSCALL(r, write(fd, datptr, datsiz-nwrote));
         if (r < 0) {
-            if (SCM_PORT_BUFFER_SIGPIPE_SENSITIVE_P(p)) {
-                /* (sort of) emulate termination by SIGPIPE.
-                   NB: The difference is visible from the outside world
-                   as the process exit status differ (WIFEXITED
-                   instead of WIFSIGNALED).  If it becomes a problem,
-                   we can reset the signal handler to SIG_DFL and
-                   send SIGPIPE to self. */
-                Scm_Exit(1);    /* exit code is somewhat arbitrary */
-            }
-            p->error = TRUE;
-            Scm_SysError("write failed on %S", p);
+            file_write_failed(p);
         } else {
             datptr += r;
             nwrote += r;
@@ -943,6 +987,128 @@ static int file_flusher(ScmPort *p, int cnt, int forcep)
     return nwrote;
 }
 
+/* Gather write.
+   Writes out the pending data in the buffer of file port P, followed by
+   the data in CHUNKS[1] ... CHUNKS[NCHUNKS-1], without copying them into
+   the buffer.  CHUNKS[0] is reserved; we use it for the buffer content.
+   With writev(2), the whole data usually goes to the OS in one system call.
+   Won't return until everything is written.  The buffer is empty on return.
+   CHUNKS is modified. */
+
+#if defined(USE_WRITEV)
+# if defined(IOV_MAX)
+#  define GATHER_IOV_MAX  (IOV_MAX < 64 ? IOV_MAX : 64)
+# else
+#  define GATHER_IOV_MAX  16
+# endif
+#endif /*USE_WRITEV*/
+
+static void file_gather_write(ScmPort *p, gather_chunk *chunks, int nchunks)
+{
+    int fd = (int)(intptr_t)p->src.buf.data;
+    SCM_ASSERT(fd >= 0);
+
+    chunks[0].ptr = p->src.buf.buffer;
+    chunks[0].len = (size_t)SCM_PORT_BUFFER_AVAIL(p);
+
+    for (int i = 0; i < nchunks;) {
+        if (chunks[i].len == 0) { i++; continue; }
+        ssize_t r;
+        errno = 0;
+#if defined(USE_WRITEV)
+        struct iovec iov[GATHER_IOV_MAX];
+        int niov = 0;
+        for (int j = i; j < nchunks && niov < GATHER_IOV_MAX; j++) {
+            if (chunks[j].len == 0) continue;
+            iov[niov].iov_base = (void*)chunks[j].ptr;
+            iov[niov].iov_len = chunks[j].len;
+            niov++;
+        }
+        SCM_SYSCALL(r, writev(fd, iov, niov));
+#else  /*!USE_WRITEV*/
+        SCM_SYSCALL(r, write(fd, chunks[i].ptr, chunks[i].len));
+#endif /*!USE_WRITEV*/
+        if (r < 0) {
+            p->src.buf.current = p->src.buf.buffer; /* for safety */
+            file_write_failed(p);
+        }
+        /* Skip what's written.  We may have a partial write. */
+        size_t n = (size_t)r;
+        while (n > 0) {
+            if (n >= chunks[i].len) {
+                n -= chunks[i].len;
+                chunks[i].len = 0;
+                i++;
+            } else {
+                chunks[i].ptr += n;
+                chunks[i].len -= n;
+                n = 0;
+            }
+        }
+    }
+    p->src.buf.current = p->src.buf.buffer;
+}
+
+/* Writes the strings and/or uniform vectors in the list ITEMS to the port.
+   Uniform vectors are written as raw bytes in native endian.  On file
+   ports, the data is gathered and written with the content of the buffer
+   in as few system calls as possible; it is useful to emit, e.g. a header
+   and a body of a response at once. */
+void Scm_WriteStrings(ScmObj items, ScmPort *port)
+{
+    ScmObj cp;
+    int nitems = 0;
+
+    SCM_FOR_EACH(cp, items) {
+        ScmObj z = SCM_CAR(cp);
+        if (!SCM_STRINGP(z) && !SCM_UVECTORP(z)) {
+            Scm_Error("string or uniform vector required, but got: %S", z);
+        }
+        nitems++;
+    }
+    if (!SCM_NULLP(cp)) Scm_Error("proper list required, but got: %S", items);
+
+    if (SCM_PORT_TYPE(port) != SCM_PORT_FILE
+        || port->src.buf.flusher != file_flusher) {
+        SCM_FOR_EACH(cp, items) {
+            ScmObj z = SCM_CAR(cp);
+            if (SCM_STRINGP(z)) {
+                Scm_Puts(SCM_STRING(z), port);
+            } else {
+                Scm_Putz((const char*)SCM_UVECTOR_ELEMENTS(z),
+                         Scm_UVectorSizeInBytes(SCM_UVECTOR(z)), port);
+            }
+        }
+        return;
+    }
+
+    gather_chunk *chunks = SCM_NEW_ATOMIC_ARRAY(gather_chunk, nitems+1);
+    int i = 1;
+    SCM_FOR_EACH(cp, items) {
+        ScmObj z = SCM_CAR(cp);
+        if (SCM_STRINGP(z)) {
+            const ScmStringBody *b = SCM_STRING_BODY(z);
+            chunks[i].ptr = SCM_STRING_BODY_START(b);
+            chunks[i].len = (size_t)SCM_STRING_BODY_SIZE(b);
+        } else {
+            chunks[i].ptr = (const char*)SCM_UVECTOR_ELEMENTS(z);
+            chunks[i].len = (size_t)Scm_UVectorSizeInBytes(SCM_UVECTOR(z));
+        }
+        i++;
+    }
+
+    ScmVM *vm = Scm_VM();
+    PORT_LOCK(port, vm);
+    if (SCM_PORT_CLOSED_P(port)) {
+        PORT_UNLOCK(port);
+        Scm_PortError(port, SCM_PORT_ERROR_CLOSED,
+                      "I/O attempted on closed port: %S", port);
+    }
+    PORT_SAFE_CALL(port, file_gather_write(port, chunks, nitems+1),
+                   /*no cleanup*/);
+    PORT_UNLOCK(port);
+}
+
 static void file_closer(ScmPort *p)
 {
     int fd = (int)(intptr_t)p->src.buf.data;
@@ -1035,6 +1201,237 @@ ScmObj Scm_MakePortWithFd(ScmObj name, int direction,
     return p;
 }
 
+/*===============================================================
+ * Mapped file port
+ *
+ *   An input file port whose buffer is the mmap'ed file content itself.
+ *   All the data is in the buffer from the beginning, so we never call
+ *   the filler (it is NULL; see bufport_fill), and seeking is merely
+ *   to move the current pointer.
+ *
+ *   From Scm_PortSeek's point of view, the underlying file position is
+ *   always at the end of the buffer, since everything has already been
+ *   "read" into it.  Scm_PortSeek adjusts the offset relative to it.
+ *
+ *   If the file can't be mapped (not a regular file, empty, or too large
+ *   to fit in the buffer size field), or the platform doesn't support
+ *   mmap, we fall back to the ordinary file port.
+ */
+
+#if defined(USE_MAPPED_FILE_PORT)
+static void mapped_closer(ScmPort *p)
+{
+    munmap(p->src.buf.buffer, p->src.buf.size);
+}
+
+static off_t mapped_seeker(ScmPort *p, off_t offset, int whence)
+{
+    off_t size = (off_t)p->src.buf.size, pos;
+
+    /* Query of the underlying position.  Don't move. */
+    if (whence == SEEK_CUR && offset == 0) return size;
+
+    switch (whence) {
+    case SEEK_SET: pos = offset; break;
+    case SEEK_CUR: /*FALLTHROUGH*/
+    case SEEK_END: pos = size + offset; break;
+    default: return (off_t)-1;
+    }
+    if (pos < 0 || pos > size) return (off_t)-1;
+    p->src.buf.current = p->src.buf.buffer + pos;
+    return pos;
+}
+#endif /*USE_MAPPED_FILE_PORT*/
+
+ScmObj Scm_OpenMappedFilePort(const char *path)
+{
+#if defined(USE_MAPPED_FILE_PORT)
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return SCM_FALSE;
+
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode)
+        && st.st_size > 0 && st.st_size <= INT_MAX) {
+        void *m = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE,
+                       fd, 0);
+        if (m != MAP_FAILED) {
+            close(fd);          /* the mapping remains valid */
+            ScmPortBuffer bufrec;
+            bufrec.mode = SCM_PORT_BUFFER_FULL;
+            bufrec.buffer = (char*)m;
+            bufrec.size = (int)st.st_size;
+            bufrec.filler = NULL;
+            bufrec.flusher = NULL;
+            bufrec.closer = mapped_closer;
+            bufrec.ready = NULL;
+            bufrec.filenum = NULL;
+            bufrec.seeker = mapped_seeker;
+            bufrec.data = NULL;
+            ScmObj p = Scm_MakeBufferedPort(SCM_CLASS_PORT,
+                                            SCM_MAKE_STR_COPYING(path),
+                                            SCM_PORT_INPUT, TRUE, &bufrec);
+            SCM_PORT(p)->src.buf.end = (char*)m + st.st_size;
+            return p;
+        }
+    }
+    /* Can't map it.  Use the fd as an ordinary file port. */
+    return Scm_MakePortWithFd(SCM_MAKE_STR_COPYING(path), SCM_PORT_INPUT,
+                              fd, SCM_PORT_BUFFER_FULL, TRUE);
+#else  /*!USE_MAPPED_FILE_PORT*/
+    return Scm_OpenFilePort(path, O_RDONLY, SCM_PORT_BUFFER_FULL, 0);
+#endif /*!USE_MAPPED_FILE_PORT*/
+}
+
+/*===============================================================
+ * Port-to-port copy
+ *
+ *   Scm_CopyPortFd moves data from an input file port to an output
+ *   file port directly between the underlying file descriptors, without
+ *   passing it through Scheme.  If the source is a regular file and the
+ *   platform has sendfile(2), the kernel copies the data; otherwise we
+ *   use read(2)/write(2) with the destination port's buffer.
+ *
+ *   It is only applicable when SRC is an fd-backed (or mapped) file
+ *   input port and DST is an fd-backed file output port.  Otherwise it
+ *   returns #f without touching the ports, so that the caller can fall
+ *   back to the generic copy loop.
+ *
+ *   The data already read into SRC (the peeked char, the scratch buffer
+ *   and the port buffer) is written out to DST first, and DST's buffer
+ *   is flushed before we touch the fds, so the order is preserved.
+ *
+ *   LIMIT is the maximum number of bytes to copy; negative means no
+ *   limit.  Returns the number of bytes copied as an integer.
+ */
+
+#define COPY_FD_CHUNK  (1L<<24)   /* max bytes per sendfile call */
+
+static off_t copy_fd(ScmPort *src, ScmPort *dst, off_t limit)
+{
+    int ifd = (int)(intptr_t)src->src.buf.data;
+    int ofd = (int)(intptr_t)dst->src.buf.data;
+    off_t total = 0;
+    int use_sendfile = FALSE;
+
+#if defined(USE_SENDFILE)
+    struct stat st;
+    if (fstat(ifd, &st) == 0 && S_ISREG(st.st_mode)) use_sendfile = TRUE;
+#endif /*USE_SENDFILE*/
+
+    while (limit < 0 || total < limit) {
+        ssize_t r = 0;
+        errno = 0;
+#if defined(USE_SENDFILE)
+        if (use_sendfile) {
+            size_t req = COPY_FD_CHUNK;
+            if (limit >= 0 && (off_t)req > limit - total) {
+                req = (size_t)(limit - total);
+            }
+            SCM_SYSCALL(r, sendfile(ofd, ifd, NULL, req));
+            if (r < 0 && total == 0 && (errno == EINVAL || errno == ENOSYS)) {
+                /* The fds are not suitable for sendfile after all. */
+                use_sendfile = FALSE;
+                continue;
+            }
+            if (r < 0) {
+                if (errno == EPIPE) file_write_failed(dst);
+                src->error = TRUE;
+                Scm_SysError("copying data from %S to %S failed", src, dst);
+            }
+            if (r == 0) break;
+            total += r;
+            continue;
+        }
+#endif /*USE_SENDFILE*/
+        /* DST's buffer is empty; we use it as a bounce buffer. */
+        char *buf = dst->src.buf.buffer;
+        size_t req = (size_t)dst->src.buf.size;
+        if (limit >= 0 && (off_t)req > limit - total) {
+            req = (size_t)(limit - total);
+        }
+        SCM_SYSCALL(r, read(ifd, buf, req));
+        if (r < 0) {
+            src->error = TRUE;
+            Scm_SysError("read failed on %S", src);
+        }
+        if (r == 0) break;
+        for (ssize_t nw = 0; nw < r;) {
+            ssize_t w;
+            SCM_SYSCALL(w, write(ofd, buf + nw, r - nw));
+            if (w < 0) file_write_failed(dst);
+            nw += w;
+        }
+        total += r;
+    }
+    src->bytes += total;
+    return total;
+}
+
+static off_t copy_port_fd_unsafe(ScmPort *src, ScmPort *dst, off_t limit)
+{
+    off_t count = 0;
+
+    /* Pushed back data */
+    if (src->ungotten != SCM_CHAR_INVALID) {
+        SCM_CHAR_PUT(src->scratch, src->ungotten);
+        src->scrcnt = SCM_CHAR_NBYTES(src->ungotten);
+        src->ungotten = SCM_CHAR_INVALID;
+    }
+    if (src->scrcnt > 0) {
+        int n = (int)src->scrcnt;
+        if (limit >= 0 && n > limit) n = (int)limit;
+        Scm_PutzUnsafe(src->scratch, n, dst);
+        src->scrcnt -= n;
+        shift_scratch(src, n);
+        count += n;
+    }
+
+    /* Buffered data */
+    off_t avail = src->src.buf.end - src->src.buf.current;
+    if (limit >= 0 && avail > limit - count) avail = limit - count;
+    if (avail > 0) {
+        Scm_PutzUnsafe(src->src.buf.current, (int)avail, dst);
+        src->src.buf.current += avail;
+        src->bytes += avail;
+        count += avail;
+    }
+
+    /* The mapped port has everything in the buffer. */
+    if (src->src.buf.filler == NULL) return count;
+    if (limit >= 0 && count >= limit) return count;
+
+    Scm_FlushUnsafe(dst);
+    return count + copy_fd(src, dst, (limit < 0)? -1 : limit - count);
+}
+
+ScmObj Scm_CopyPortFd(ScmPort *src, ScmPort *dst, off_t limit)
+{
+    if (!SCM_IPORTP(src) || !SCM_OPORTP(dst)
+        || SCM_PORT_TYPE(src) != SCM_PORT_FILE
+        || SCM_PORT_TYPE(dst) != SCM_PORT_FILE
+        || !(src->src.buf.filler == file_filler
+             || src->src.buf.filler == NULL)
+        || dst->src.buf.flusher != file_flusher) {
+        return SCM_FALSE;
+    }
+
+    ScmVM *vm = Scm_VM();
+    off_t count = 0;
+    PORT_LOCK(src, vm);
+    PORT_LOCK(dst, vm);
+    if (SCM_PORT_CLOSED_P(src) || SCM_PORT_CLOSED_P(dst)) {
+        ScmPort *closed = SCM_PORT_CLOSED_P(src)? src : dst;
+        PORT_UNLOCK(dst);
+        PORT_UNLOCK(src);
+        Scm_PortError(closed, SCM_PORT_ERROR_CLOSED,
+                      "I/O attempted on closed port: %S", closed);
+    }
+    PORT_SAFE_CALL(src, count = copy_port_fd_unsafe(src, dst, limit),
+                   PORT_UNLOCK(dst));
+    PORT_UNLOCK(src);
+    return Scm_OffsetToInteger(count);
+}
+
 /*===============================================================
  * String port
  */
@@ -70,6 +70,7 @@ static ScmString *make_str(ScmSmallInt len, ScmSmallInt siz,
     s->initialBody.length = len;
     s->initialBody.size = siz;
     s->initialBody.start = p;
+    s->initialBody.index = NULL;
     return s;
 }
 
@@ -486,6 +487,312 @@ int Scm_StringCiCmp(ScmString *x, ScmString *y)
     }
 }
 
+/*----------------------------------------------------------------
+ * Rope
+ */
+
+/* A rope is a binary tree whose leaves are flat string bodies.  Leaves
+   may share the character array with other strings (as substrings do),
+   so concatenation and substring of ropes don't copy the characters.
+   Nodes are immutable once created, hence can be shared among ropes.
+
+   The body of a rope string has SCM_STRING_ROPE flag, and its 'start'
+   field points to the root node.  We only make ropes of complete strings;
+   for incomplete ones, length and size differ in meaning and it isn't
+   worth complicating things.
+
+   We merge small leaves to keep the number of nodes down, and rebalance
+   the tree when it gets too deep.  Ropes smaller than ROPE_MIN_SIZE are
+   always flattened.
+*/
+
+typedef struct ScmStringRopeRec {
+    unsigned int length;
+    unsigned int size;
+    unsigned int depth;                 /* 0 for leaf */
+    const ScmStringBody *leaf;          /* leaf body if depth == 0 */
+    const struct ScmStringRopeRec *left;
+    const struct ScmStringRopeRec *right;
+} ScmStringRope;
+
+#define ROPE_MIN_SIZE    1024   /* smaller strings are kept flat */
+#define ROPE_LEAF_MAX    512    /* small leaves are merged up to this size */
+#define ROPE_MAX_DEPTH   48     /* rebalance if deeper than this */
+
+#define ROPE_LEAF_P(r)   ((r)->depth == 0)
+#define BODY_ROPE_P(b)   SCM_STRING_BODY_HAS_FLAG(b, SCM_STRING_ROPE)
+#define BODY_ROPE(b)     ((const ScmStringRope*)SCM_STRING_BODY_START(b))
+
+static const char *body_position(const ScmStringBody *b, ScmSmallInt offset);
+
+static const ScmStringRope *rope_leaf(const ScmStringBody *b)
+{
+    ScmStringRope *r = SCM_NEW(ScmStringRope);
+    r->length = SCM_STRING_BODY_LENGTH(b);
+    r->size = SCM_STRING_BODY_SIZE(b);
+    r->depth = 0;
+    r->leaf = b;
+    r->left = r->right = NULL;
+    return r;
+}
+
+/* Returns a rope that represents the string body B. */
+static const ScmStringRope *body_rope(const ScmStringBody *b)
+{
+    if (BODY_ROPE_P(b)) return BODY_ROPE(b);
+    else return rope_leaf(b);
+}
+
+static const ScmStringRope *rope_node(const ScmStringRope *a,
+                                      const ScmStringRope *b)
+{
+    if ((ScmSmallInt)a->size + (ScmSmallInt)b->size > SCM_STRING_MAX_SIZE) {
+        Scm_Error("string size too big: %ld",
+                  (ScmSmallInt)a->size + (ScmSmallInt)b->size);
+    }
+    ScmStringRope *r = SCM_NEW(ScmStringRope);
+    r->length = a->length + b->length;
+    r->size = a->size + b->size;
+    r->depth = ((a->depth > b->depth)? a->depth : b->depth) + 1;
+    r->leaf = NULL;
+    r->left = a;
+    r->right = b;
+    return r;
+}
+
+/* Copies the content of rope R into DST.  Returns the end of the copy. */
+static char *rope_copy(const ScmStringRope *r, char *dst)
+{
+    while (!ROPE_LEAF_P(r)) {
+        dst = rope_copy(r->left, dst);
+        r = r->right;
+    }
+    memcpy(dst, SCM_STRING_BODY_START(r->leaf), r->size);
+    return dst + r->size;
+}
+
+/* Concatenates two small leaves into a new flat leaf. */
+static const ScmStringRope *rope_leaf_merge(const ScmStringRope *a,
+                                            const ScmStringRope *b)
+{
+    char *p = SCM_NEW_ATOMIC2(char *, a->size + b->size + 1);
+    memcpy(p, SCM_STRING_BODY_START(a->leaf), a->size);
+    memcpy(p + a->size, SCM_STRING_BODY_START(b->leaf), b->size);
+    p[a->size + b->size] = '\0';
+    ScmStringBody *body = SCM_NEW(ScmStringBody);
+    body->flags = SCM_STRING_TERMINATED;
+    body->length = a->length + b->length;
+    body->size = a->size + b->size;
+    body->start = p;
+    return rope_leaf(body);
+}
+
+/* Rebalancing is done as in Boehm's cords.  A rope of depth D is
+   balanced if its size is at least minsize[D], the (D+2)-th Fibonacci
+   number.  We put the pieces of the rope into a forest, whose slot I
+   holds a balanced rope of size in [minsize[I], minsize[I+1]), and
+   concatenate the slots in the end.  Balanced subtrees are put as a
+   whole, so after a series of appends to a balanced rope, we only
+   visit the nodes added since then, instead of all the leaves. */
+typedef struct rope_forest_rec {
+    unsigned int minsize[ROPE_MAX_DEPTH+2];
+    const ScmStringRope *slot[ROPE_MAX_DEPTH+2];
+} rope_forest;
+
+/* rope_node, but either A or B may be NULL. */
+static const ScmStringRope *rope_join(const ScmStringRope *a,
+                                      const ScmStringRope *b)
+{
+    if (a == NULL) return b;
+    if (b == NULL) return a;
+    return rope_node(a, b);
+}
+
+static void rope_forest_add(rope_forest *f, const ScmStringRope *r)
+{
+    const ScmStringRope *sum = NULL;
+    int i = 0;
+
+    /* Concatenate the smaller ropes first, so that the order is kept. */
+    while (r->size > f->minsize[i+1]) {
+        sum = rope_join(f->slot[i], sum);
+        f->slot[i++] = NULL;
+    }
+    sum = rope_join(sum, r);
+    /* Now SUM is balanced.  Merge it with the larger ones. */
+    while (sum->size >= f->minsize[i]) {
+        sum = rope_join(f->slot[i], sum);
+        f->slot[i++] = NULL;
+    }
+    f->slot[i-1] = sum;
+}
+
+static void rope_forest_insert(rope_forest *f, const ScmStringRope *r)
+{
+    while (!ROPE_LEAF_P(r)
+           && (r->depth >= ROPE_MAX_DEPTH || r->size < f->minsize[r->depth])) {
+        rope_forest_insert(f, r->left);
+        r = r->right;
+    }
+    if (r->size > 0) rope_forest_add(f, r);
+}
+
+static const ScmStringRope *rope_balance(const ScmStringRope *r)
+{
+    rope_forest f;
+    f.minsize[0] = 1;
+    f.minsize[1] = 2;
+    for (int i=2; i<ROPE_MAX_DEPTH+2; i++) {
+        unsigned int a = f.minsize[i-1], b = f.minsize[i-2];
+        f.minsize[i] = (a > UINT_MAX - b)? UINT_MAX : a + b;
+    }
+    for (int i=0; i<ROPE_MAX_DEPTH+2; i++) f.slot[i] = NULL;
+
+    rope_forest_insert(&f, r);
+
+    const ScmStringRope *sum = NULL;
+    for (int i=0; i<ROPE_MAX_DEPTH+2; i++) sum = rope_join(f.slot[i], sum);
+    return sum;
+}
+
+static const ScmStringRope *rope_concat(const ScmStringRope *a,
+                                        const ScmStringRope *b)
+{
+    if (a->size == 0) return b;
+    if (b->size == 0) return a;
+    /* Appending a small piece, e.g. accumulating a string by
+       (string-append acc piece) repeatedly. */
+    if (ROPE_LEAF_P(b) && b->size < ROPE_LEAF_MAX) {
+        if (ROPE_LEAF_P(a)) {
+            if (a->size + b->size <= ROPE_LEAF_MAX) {
+                return rope_leaf_merge(a, b);
+            }
+        } else if (ROPE_LEAF_P(a->right)
+                   && a->right->size + b->size <= ROPE_LEAF_MAX) {
+            return rope_node(a->left, rope_leaf_merge(a->right, b));
+        }
+    }
+    const ScmStringRope *r = rope_node(a, b);
+    if (r->depth > ROPE_MAX_DEPTH) r = rope_balance(r);
+    return r;
+}
+
+/* Returns a rope of the characters from START to END of R.
+   The range is assumed to be valid. */
+static const ScmStringRope *rope_slice(const ScmStringRope *r,
+                                       ScmSmallInt start, ScmSmallInt end)
+{
+    if (start == 0 && end == r->length) return r;
+    if (ROPE_LEAF_P(r)) {
+        const ScmStringBody *b = r->leaf;
+        const char *s, *e;
+        int flags = 0;
+        if (SCM_STRING_BODY_SINGLE_BYTE_P(b)) {
+            s = SCM_STRING_BODY_START(b) + start;
+            e = SCM_STRING_BODY_START(b) + end;
+        } else {
+            s = body_position(b, start);
+            e = body_position(b, end);
+        }
+        if (end == r->length) {
+            flags = SCM_STRING_BODY_FLAGS(b) & SCM_STRING_TERMINATED;
+        }
+        ScmStringBody *nb = SCM_NEW(ScmStringBody);
+        nb->flags = flags;
+        nb->length = (unsigned int)(end - start);
+        nb->size = (unsigned int)(e - s);
+        nb->start = s;
+        return rope_leaf(nb);
+    }
+    ScmSmallInt llen = r->left->length;
+    if (end <= llen) return rope_slice(r->left, start, end);
+    if (start >= llen) return rope_slice(r->right, start - llen, end - llen);
+    return rope_concat(rope_slice(r->left, start, llen),
+                       rope_slice(r->right, 0, end - llen));
+}
+
+/* Finds the leaf that contains the POS-th character of R.  *PPOS
+   is updated to the index within the leaf. */
+static const ScmStringBody *rope_leaf_at(const ScmStringRope *r,
+                                         ScmSmallInt *ppos)
+{
+    ScmSmallInt pos = *ppos;
+    while (!ROPE_LEAF_P(r)) {
+        if (pos < r->left->length) {
+            r = r->left;
+        } else {
+            pos -= r->left->length;
+            r = r->right;
+        }
+    }
+    *ppos = pos;
+    return r->leaf;
+}
+
+/* Creates a string from rope R.  Small ropes are flattened. */
+static ScmObj rope_to_string(const ScmStringRope *r)
+{
+    if (ROPE_LEAF_P(r)) {
+        const ScmStringBody *b = r->leaf;
+        return SCM_OBJ(make_str(r->length, r->size, SCM_STRING_BODY_START(b),
+                                SCM_STRING_BODY_FLAGS(b) & SCM_STRING_TERMINATED));
+    }
+    if (r->size < ROPE_MIN_SIZE) {
+        char *p = SCM_NEW_ATOMIC2(char *, r->size + 1);
+        rope_copy(r, p);
+        p[r->size] = '\0';
+        return SCM_OBJ(make_str(r->length, r->size, p, SCM_STRING_TERMINATED));
+    }
+    ScmStringBody *b = SCM_NEW(ScmStringBody);
+    b->flags = SCM_STRING_ROPE;
+    b->length = r->length;
+    b->size = r->size;
+    b->start = (const char *)r;
+    ScmString *s = make_str(0, 0, "", SCM_STRING_TERMINATED);
+    s->body = b;
+    return SCM_OBJ(s);
+}
+
+/* Whether concatenating the bodies B[0] ... B[N-1] should make a rope.
+   We do so if the result is complete and large enough, and some of the
+   pieces are large or already ropes, so that we can avoid copying them.
+   Concatenating lots of small strings is faster in a flat array. */
+static int rope_concat_p(const ScmStringBody **b, int n)
+{
+    ScmSmallInt size = 0;
+    int large = FALSE;
+    for (int i=0; i<n; i++) {
+        if (SCM_STRING_BODY_INCOMPLETE_P(b[i])) return FALSE;
+        if (BODY_ROPE_P(b[i])
+            || SCM_STRING_BODY_SIZE(b[i]) >= ROPE_LEAF_MAX) large = TRUE;
+        size += SCM_STRING_BODY_SIZE(b[i]);
+    }
+    return large && size >= ROPE_MIN_SIZE;
+}
+
+/* Called via SCM_STRING_BODY macro when STR's body is a rope.  We flatten
+   the rope and replaces STR's body with it.  The operation is idempotent,
+   so it doesn't matter if more than one threads do this simultaneously. */
+const ScmStringBody *Scm__StringFlattenRope(ScmString *str)
+{
+    const ScmStringBody *rb = SCM_STRING_RAW_BODY(str);
+    if (!BODY_ROPE_P(rb)) return rb;
+
+    const ScmStringRope *r = BODY_ROPE(rb);
+    char *p = SCM_NEW_ATOMIC2(char *, r->size + 1);
+    rope_copy(r, p);
+    p[r->size] = '\0';
+
+    ScmStringBody *b = SCM_NEW(ScmStringBody);
+    b->flags = (SCM_STRING_BODY_FLAGS(rb) & ~SCM_STRING_ROPE)
+        | SCM_STRING_TERMINATED;
+    b->length = r->length;
+    b->size = r->size;
+    b->start = p;
+    str->body = b;
+    return b;
+}
+
 /*----------------------------------------------------------------
  * Reference
  */
@@ -500,6 +807,49 @@ static const char *forward_pos(const char *current, ScmSmallInt offset)
     return current;
 }
 
+/* Finding the position of a character in a multibyte string requires to
+   scan it from the beginning.  For long strings, we build a sparse index
+   at the first indexed access, which keeps the byte offset of every
+   STRING_INDEX_INTERVAL-th character.  With it, the scan is limited to
+   STRING_INDEX_INTERVAL characters.
+
+   The index is cached in the 'index' field of the body.  Like
+   get_string_from_body, it breaks 'const', but it is idempotent from the
+   outside and safe even if multiple threads build it simultaneously.
+   The offsets are relative to 'start', so they remain valid when
+   get_string_from_body replaces 'start' with a NUL-terminated copy. */
+#define STRING_INDEX_INTERVAL   64
+#define STRING_INDEX_THRESHOLD  256     /* minimum length to be indexed */
+
+static const unsigned int *build_index(const ScmStringBody *b)
+{
+    ScmSmallInt n = SCM_STRING_BODY_LENGTH(b)/STRING_INDEX_INTERVAL + 1;
+    unsigned int *v = SCM_NEW_ATOMIC_ARRAY(unsigned int, n);
+    const char *s = SCM_STRING_BODY_START(b), *p = s;
+
+    for (ScmSmallInt i=0; i<n; i++) {
+        v[i] = (unsigned int)(p - s);
+        if (i < n-1) p = forward_pos(p, STRING_INDEX_INTERVAL);
+    }
+    ((ScmStringBody*)b)->index = v; /* discard const qualifier */
+    return v;
+}
+
+/* Returns the pointer to the OFFSET-th character of a complete, multibyte
+   string body B.  OFFSET may be equal to the length of B. */
+static const char *body_position(const ScmStringBody *b, ScmSmallInt offset)
+{
+    if (offset < STRING_INDEX_INTERVAL
+        || SCM_STRING_BODY_LENGTH(b) < STRING_INDEX_THRESHOLD) {
+        return forward_pos(SCM_STRING_BODY_START(b), offset);
+    }
+    const unsigned int *v = b->index;
+    if (v == NULL) v = build_index(b);
+    return forward_pos(SCM_STRING_BODY_START(b)
+                       + v[offset/STRING_INDEX_INTERVAL],
+                       offset%STRING_INDEX_INTERVAL);
+}
+
 /* string-ref.
  * If POS is out of range,
  *   - returns SCM_CHAR_INVALID if range_error is FALSE
@@ -510,7 +860,7 @@ static const char *forward_pos(const char *current, ScmSmallInt offset)
  */
 ScmChar Scm_StringRef(ScmString *str, ScmSmallInt pos, int range_error)
 {
-    const ScmStringBody *b = SCM_STRING_BODY(str);
+    const ScmStringBody *b = SCM_STRING_RAW_BODY(str);
     ScmSmallInt len = SCM_STRING_BODY_LENGTH(b);
 
     /* we can't allow string-ref on incomplete strings, since it may yield
@@ -525,10 +875,11 @@ ScmChar Scm_StringRef(ScmString *str, ScmSmallInt pos, int range_error)
             return SCM_CHAR_INVALID;
         }
     }
+    if (BODY_ROPE_P(b)) b = rope_leaf_at(BODY_ROPE(b), &pos);
     if (SCM_STRING_BODY_SINGLE_BYTE_P(b)) {
         return (ScmChar)(((unsigned char *)SCM_STRING_BODY_START(b))[pos]);
     } else {
-        const char *p = forward_pos(SCM_STRING_BODY_START(b), pos);
+        const char *p = body_position(b, pos);
         ScmChar c;
         SCM_CHAR_GET(p, c);
         return c;
@@ -566,7 +917,7 @@ const char *Scm_StringBodyPosition(const ScmStringBody *b, ScmSmallInt offset)
     if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
         return (SCM_STRING_BODY_START(b)+offset);
     } else {
-        return (forward_pos(SCM_STRING_BODY_START(b), offset));
+        return body_position(b, offset);
     }
 }
 
@@ -584,6 +935,13 @@ const char *Scm_StringPosition(ScmString *str, ScmSmallInt offset)
 
 ScmObj Scm_StringAppend2(ScmString *x, ScmString *y)
 {
+    const ScmStringBody *bs[2];
+    bs[0] = SCM_STRING_RAW_BODY(x);
+    bs[1] = SCM_STRING_RAW_BODY(y);
+    if (rope_concat_p(bs, 2)) {
+        return rope_to_string(rope_concat(body_rope(bs[0]), body_rope(bs[1])));
+    }
+
     const ScmStringBody *xb = SCM_STRING_BODY(x);
     const ScmStringBody *yb = SCM_STRING_BODY(y);
     ScmSmallInt sizex = SCM_STRING_BODY_SIZE(xb);
@@ -653,7 +1011,7 @@ ScmObj Scm_StringAppend(ScmObj strs)
         if (!SCM_STRINGP(SCM_CAR(cp))) {
             Scm_Error("string required, but got %S\n", SCM_CAR(cp));
         }
-        b = SCM_STRING_BODY(SCM_CAR(cp));
+        b = SCM_STRING_RAW_BODY(SCM_CAR(cp));
         size += SCM_STRING_BODY_SIZE(b);
         len += SCM_STRING_BODY_LENGTH(b);
         if (SCM_STRING_BODY_INCOMPLETE_P(b)) {
@@ -662,10 +1020,22 @@ ScmObj Scm_StringAppend(ScmObj strs)
         bodies[i++] = b;
     }
 
+    if (rope_concat_p(bodies, numstrs)) {
+        const ScmStringRope *r = body_rope(bodies[0]);
+        for (i=1; i<numstrs; i++) {
+            r = rope_concat(r, body_rope(bodies[i]));
+        }
+        return rope_to_string(r);
+    }
+
     char *buf = SCM_NEW_ATOMIC2(char *, size+1);
     char *bufp = buf;
     for (i=0; i<numstrs; i++) {
         const ScmStringBody *b = bodies[i];
+        if (BODY_ROPE_P(b)) {
+            bufp = rope_copy(BODY_ROPE(b), bufp);
+            continue;
+        }
         memcpy(bufp, SCM_STRING_BODY_START(b), SCM_STRING_BODY_SIZE(b));
         bufp += SCM_STRING_BODY_SIZE(b);
     }
@@ -803,12 +1173,12 @@ static ScmObj substring(const ScmStringBody *xb,
                                 flags));
     } else {
         const char *s, *e;
-        if (start) s = forward_pos(SCM_STRING_BODY_START(xb), start);
+        if (start) s = body_position(xb, start);
         else s = SCM_STRING_BODY_START(xb);
         if (len == end) {
             e = SCM_STRING_BODY_START(xb) + SCM_STRING_BODY_SIZE(xb);
         } else {
-            e = forward_pos(s, end - start);
+            e = body_position(xb, end);
             flags &= ~SCM_STRING_TERMINATED;
         }
         return SCM_OBJ(make_str((int)(end - start), (int)(e - s), s, flags));
@@ -818,6 +1188,12 @@ static ScmObj substring(const ScmStringBody *xb,
 ScmObj Scm_Substring(ScmString *x, ScmSmallInt start, ScmSmallInt end,
                      int byterangep)
 {
+    const ScmStringBody *xb = SCM_STRING_RAW_BODY(x);
+    if (BODY_ROPE_P(xb) && !byterangep) {
+        ScmSmallInt len = SCM_STRING_BODY_LENGTH(xb);
+        SCM_CHECK_START_END(start, end, len);
+        return rope_to_string(rope_slice(BODY_ROPE(xb), start, end));
+    }
     return substring(SCM_STRING_BODY(x), start, end, byterangep);
 }
 
@@ -827,7 +1203,7 @@ ScmObj Scm_Substring(ScmString *x, ScmSmallInt start, ScmSmallInt end,
 ScmObj Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end)
 {
     ScmSmallInt istart, iend;
-    const ScmStringBody *xb = SCM_STRING_BODY(x);
+    const ScmStringBody *xb = SCM_STRING_RAW_BODY(x);
     if (SCM_UNBOUNDP(start) || SCM_UNDEFINEDP(start) || SCM_FALSEP(start)) {
         istart = 0;
     } else {
@@ -844,6 +1220,7 @@ ScmObj Scm_MaybeSubstring(ScmString *x, ScmObj start, ScmObj end)
             Scm_Error("exact integer required for start, but got %S", end);
         iend = SCM_INT_VALUE(end);
     }
+    if (BODY_ROPE_P(xb)) return Scm_Substring(x, istart, iend, FALSE);
     return substring(xb, istart, iend, FALSE);
 }
 
@@ -1421,12 +1798,12 @@ ScmObj Scm_MakeStringPointer(ScmString *src, ScmSmallInt index,
         ptr = sptr + index;
         effective_size = end - start;
     } else {
-        sptr = forward_pos(SCM_STRING_BODY_START(srcb), start);
-        ptr = forward_pos(sptr, index);
+        sptr = body_position(srcb, start);
+        ptr = body_position(srcb, start + index);
         if (end == len) {
             eptr = SCM_STRING_BODY_START(srcb) + SCM_STRING_BODY_SIZE(srcb);
         } else {
-            eptr = forward_pos(sptr, end - start);
+            eptr = body_position(srcb, end);
         }
         effective_size = (int)(eptr - ptr);
     }
@@ -34,6 +34,7 @@
 #define LIBGAUCHE_BODY
 #include "gauche.h"
 #include "gauche/priv/builtin-syms.h"
+#include "gauche/priv/atomicP.h"
 
 /*-----------------------------------------------------------
  * Symbols
@@ -51,9 +52,142 @@ static ScmClass *keyword_cpl[] = {
 SCM_DEFINE_BUILTIN_CLASS(Scm_KeywordClass, symbol_print,
                          NULL, NULL, NULL, keyword_cpl);
 
-/* name -> symbol mapper */
-static ScmInternalMutex obtable_mutex = SCM_INTERNAL_MUTEX_INITIALIZER;
-static ScmHashTable *obtable = NULL;
+/* name -> symbol mapper
+ *
+ * Symbols are looked up far more often than created, and lookups come
+ * from every thread that reads or parses something.  So lookup doesn't
+ * take a lock.  The table is split into shards by the hash value of
+ * the name, and each shard is a chained hash table with the following
+ * properties:
+ *
+ *  - An entry is never modified once it is linked to the table, and
+ *    a new entry is always pushed at the head of a chain, with a release
+ *    barrier.  So a reader walking a chain always sees a consistent one.
+ *  - When a shard grows, we build a new bucket array with fresh entries
+ *    and swap the pointer.  A reader that still looks at the old array
+ *    sees a valid table, which may lack only the symbol being added
+ *    concurrently; the writer side resolves such a race.
+ *
+ * Insertion and growth take the mutex of the shard only, so threads
+ * creating different symbols rarely contend.  The uniqueness is kept
+ * by looking up the chain again with the lock held before insertion.
+ */
+typedef struct ObEntryRec {
+    struct ObEntryRec *next;
+    u_long hashval;
+    ScmSymbol *sym;
+} ObEntry;
+
+typedef struct ObBucketsRec {
+    u_long size;                /* power of 2 */
+    ObEntry *buckets[1];        /* variable length */
+} ObBuckets;
+
+#define OBTABLE_SHARD_BITS   6
+#define OBTABLE_NUM_SHARDS   (1UL<<OBTABLE_SHARD_BITS)
+#define OBTABLE_INITIAL_SIZE 64  /* initial number of buckets per shard */
+
+static struct {
+    ObBuckets *buckets;         /* read with acquire barrier */
+    u_long count;               /* protected by mutex */
+    ScmInternalMutex mutex;
+} obtable[OBTABLE_NUM_SHARDS];
+
+/* STRING_HASH in hash.c is weak in lower bits for short names. */
+static inline u_long obtable_hash(const ScmStringBody *b)
+{
+    const unsigned char *p = (const unsigned char*)SCM_STRING_BODY_START(b);
+    u_long h = 0;
+    for (u_long i = SCM_STRING_BODY_SIZE(b); i > 0; i--) {
+        h = (h<<5) - h + *p++;
+    }
+    h *= 2654435761UL;
+    return h ^ (h >> 16);
+}
+
+#define OBTABLE_SHARD(hv)       ((hv) & (OBTABLE_NUM_SHARDS-1))
+#define OBTABLE_INDEX(hv, size) (((hv) >> OBTABLE_SHARD_BITS) & ((size)-1))
+
+static inline int obtable_match(ObEntry *e, u_long hv, const ScmStringBody *b)
+{
+    if (e->hashval != hv) return FALSE;
+    const ScmStringBody *eb = SCM_STRING_BODY(e->sym->name);
+    return (SCM_STRING_BODY_SIZE(eb) == SCM_STRING_BODY_SIZE(b)
+            && !((SCM_STRING_BODY_FLAGS(eb)^SCM_STRING_BODY_FLAGS(b))
+                 & SCM_STRING_INCOMPLETE)
+            && memcmp(SCM_STRING_BODY_START(eb), SCM_STRING_BODY_START(b),
+                      SCM_STRING_BODY_SIZE(b)) == 0);
+}
+
+/* Lock-free lookup.  Returns NULL if not found. */
+static ScmSymbol *obtable_get(const ScmStringBody *b, u_long hv)
+{
+    ObBuckets *t = SCM_ATOMIC_LOAD_PTR(ObBuckets*,
+                                       obtable[OBTABLE_SHARD(hv)].buckets);
+    ObEntry *e = SCM_ATOMIC_LOAD_PTR(ObEntry*,
+                                     t->buckets[OBTABLE_INDEX(hv, t->size)]);
+    for (; e; e = e->next) {
+        if (obtable_match(e, hv, b)) return e->sym;
+    }
+    return NULL;
+}
+
+static ObBuckets *make_buckets(u_long size)
+{
+    ObBuckets *t = SCM_NEW2(ObBuckets*,
+                            sizeof(ObBuckets) + sizeof(ObEntry*)*(size-1));
+    t->size = size;
+    for (u_long i = 0; i < size; i++) t->buckets[i] = NULL;
+    return t;
+}
+
+/* Called with the shard locked. */
+static void obtable_grow(u_long shard)
+{
+    ObBuckets *ot = obtable[shard].buckets;
+    ObBuckets *nt = make_buckets(ot->size * 2);
+    /* We can't relink the existing entries, for readers may be
+       traversing them. */
+    for (u_long i = 0; i < ot->size; i++) {
+        for (ObEntry *e = ot->buckets[i]; e; e = e->next) {
+            ObEntry *ne = SCM_NEW(ObEntry);
+            u_long k = OBTABLE_INDEX(e->hashval, nt->size);
+            ne->hashval = e->hashval;
+            ne->sym = e->sym;
+            ne->next = nt->buckets[k];
+            nt->buckets[k] = ne;
+        }
+    }
+    SCM_ATOMIC_STORE_PTR(obtable[shard].buckets, nt);
+}
+
+/* Registers SYM to the table, unless a symbol with the same name has
+   been registered.  Returns the registered symbol. */
+static ScmSymbol *obtable_put(ScmSymbol *sym)
+{
+    const ScmStringBody *b = SCM_STRING_BODY(sym->name);
+    u_long hv = obtable_hash(b);
+    u_long shard = OBTABLE_SHARD(hv);
+    ScmSymbol *r = sym;
+
+    (void)SCM_INTERNAL_MUTEX_LOCK(obtable[shard].mutex);
+    ObBuckets *t = obtable[shard].buckets;
+    u_long k = OBTABLE_INDEX(hv, t->size);
+    ObEntry *e = t->buckets[k];
+    for (; e; e = e->next) {
+        if (obtable_match(e, hv, b)) { r = e->sym; break; }
+    }
+    if (e == NULL) {
+        ObEntry *ne = SCM_NEW(ObEntry);
+        ne->hashval = hv;
+        ne->sym = sym;
+        ne->next = t->buckets[k];
+        SCM_ATOMIC_STORE_PTR(t->buckets[k], ne);
+        if (++obtable[shard].count > t->size) obtable_grow(shard);
+    }
+    (void)SCM_INTERNAL_MUTEX_UNLOCK(obtable[shard].mutex);
+    return r;
+}
 
 #if GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION
 /* Global keyword table. */
@@ -68,14 +202,6 @@ static int keyword_disjoint_p = FALSE;
 /* internal constructor.  NAME must be an immutable string. */
 static ScmSymbol *make_sym(ScmClass *klass, ScmString *name, int interned)
 {
-    if (interned) {
-        /* fast path */
-        SCM_INTERNAL_MUTEX_LOCK(obtable_mutex);
-        ScmObj e = Scm_HashTableRef(obtable, SCM_OBJ(name), SCM_FALSE);
-        SCM_INTERNAL_MUTEX_UNLOCK(obtable_mutex);
-        if (!SCM_FALSEP(e)) return SCM_SYMBOL(e);
-    }
-
     ScmSymbol *sym = SCM_NEW(ScmSymbol);
     SCM_SET_CLASS(sym, klass);
     sym->name = name;
@@ -84,20 +210,22 @@ static ScmSymbol *make_sym(ScmClass *klass, ScmString *name, int interned)
     if (!interned) {
         return sym;
     } else {
-        /* Using SCM_DICT_NO_OVERWRITE ensures that if another thread interns
-           the same name symbol between above HashTableRef and here, we'll
-           get the already interned symbol. */
-        SCM_INTERNAL_MUTEX_LOCK(obtable_mutex);
-        ScmObj e = Scm_HashTableSet(obtable, SCM_OBJ(name), SCM_OBJ(sym),
-                                    SCM_DICT_NO_OVERWRITE);
-        SCM_INTERNAL_MUTEX_UNLOCK(obtable_mutex);
-        return SCM_SYMBOL(e);
+        /* If another thread interns the same name symbol between the
+           caller's lookup and here, we'll get the already interned
+           symbol. */
+        return obtable_put(sym);
     }
 }
 
 /* Intern */
 ScmObj Scm_MakeSymbol(ScmString *name, int interned)
 {
+    if (interned) {
+        /* fast path.  we don't need to copy NAME for lookup. */
+        const ScmStringBody *b = SCM_STRING_BODY(name);
+        ScmSymbol *s = obtable_get(b, obtable_hash(b));
+        if (s != NULL) return SCM_OBJ(s);
+    }
     ScmObj sname = Scm_CopyStringWithFlags(name, SCM_STRING_IMMUTABLE,
                                            SCM_STRING_IMMUTABLE);
     return SCM_OBJ(make_sym(SCM_CLASS_SYMBOL, SCM_STRING(sname), interned));
@@ -128,7 +256,9 @@ ScmObj Scm_MakeKeyword(ScmString *name)
     }
 #endif /*GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION*/
     ScmObj sname = Scm_StringAppend2(&keyword_prefix, name);
-    ScmSymbol *s = make_sym(SCM_CLASS_KEYWORD, SCM_STRING(sname), TRUE);
+    const ScmStringBody *b = SCM_STRING_BODY(sname);
+    ScmSymbol *s = obtable_get(b, obtable_hash(b));
+    if (s == NULL) s = make_sym(SCM_CLASS_KEYWORD, SCM_STRING(sname), TRUE);
     Scm_DefineConst(Scm_KeywordModule(), s, SCM_OBJ(s));
     return SCM_OBJ(s);
 }
@@ -393,8 +523,11 @@ ScmObj Scm_DeleteKeywordX(ScmObj key, ScmObj list)
 
 void Scm__InitSymbol(void)
 {
-    SCM_INTERNAL_MUTEX_INIT(obtable_mutex);
-    obtable = SCM_HASH_TABLE(Scm_MakeHashTableSimple(SCM_HASH_STRING, 4096));
+    for (u_long i = 0; i < OBTABLE_NUM_SHARDS; i++) {
+        (void)SCM_INTERNAL_MUTEX_INIT(obtable[i].mutex);
+        obtable[i].buckets = make_buckets(OBTABLE_INITIAL_SIZE);
+        obtable[i].count = 0;
+    }
     init_builtin_syms();
 #if GAUCHE_KEEP_DISJOINT_KEYWORD_OPTION
     (void)SCM_INTERNAL_MUTEX_INIT(keywords.mutex);
@@ -36,6 +36,7 @@
 #include "gauche/class.h"
 #include "gauche/bignum.h"
 #include "gauche/priv/builtin-syms.h"
+#include "gauche/priv/simdP.h"
 
 #include <locale.h>
 #include <errno.h>
@@ -2412,6 +2413,53 @@ int Scm_AvailableProcessors()
 #endif /*defined(GAUCHE_WINDOWS)*/
 }
 
+/* Find the instruction set extensions the SIMD kernels can use.
+   See gauche/priv/simdP.h. */
+#if defined(SCM_X86_TARGET) || defined(SCM_X86_SSE2)
+#include <cpuid.h>
+#endif
+
+static u_long cpu_features = 0;
+static int    cpu_features_checked = FALSE;  /* benign race */
+static u_long cpu_features_mask = ~0UL;
+
+static u_long check_cpu_features(void)
+{
+    u_long f = 0;
+#if defined(SCM_X86_TARGET) || defined(SCM_X86_SSE2)
+    unsigned int a, b, c, d, max = __get_cpuid_max(0, NULL);
+    if (max < 1) return 0;
+    __cpuid(1, a, b, c, d);
+    if ((d >> 26) & 1) f |= SCM_CPU_SSE2;
+    int ssse3 = (c >> 9) & 1, sse41 = (c >> 19) & 1;
+    int osxsave = (c >> 27) & 1, avx = (c >> 28) & 1;
+    if (max < 7) return f;
+    __cpuid_count(7, 0, a, b, c, d);
+    if (ssse3 && sse41 && ((b >> 29) & 1)) f |= SCM_CPU_SHA;
+    if (avx && osxsave && ((b >> 5) & 1)) {
+        /* The OS must save YMM registers */
+        unsigned int lo, hi;
+        __asm__ ("xgetbv" : "=a"(lo), "=d"(hi) : "c"(0));
+        if ((lo & 6) == 6) f |= SCM_CPU_AVX2;
+    }
+#endif
+    return f;
+}
+
+u_long Scm__CPUFeatures(void)
+{
+    if (!cpu_features_checked) {
+        cpu_features = check_cpu_features();
+        cpu_features_checked = TRUE;
+    }
+    return cpu_features & cpu_features_mask;
+}
+
+void Scm__SetCPUFeaturesMask(u_long mask)
+{
+    cpu_features_mask = mask;
+}
+
 /*===============================================================
  * Emulation layer for Windows
  */
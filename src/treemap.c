@@ -40,11 +40,13 @@
  */
 
 /* The actual node structure.  The first two elements must match
-   ScmDictEntry. */
+   ScmDictEntry.  SIZE is the number of nodes in the subtree, which
+   lets split find its position in O(log n). */
 typedef struct NodeRec {
     intptr_t     key;
     intptr_t     value;
     int          color;
+    int          size;
     struct NodeRec *parent;
     struct NodeRec *left;
     struct NodeRec *right;
@@ -66,6 +68,8 @@ enum TreeOp {
 
 #define PAINT(n, c)      (n->color = c)
 
+#define SIZE(n)          ((n)? (n)->size : 0)
+
 /* The following three macros assume N has a parent. */
 #define LEFTP(n)         (n == n->parent->left)
 #define RIGHTP(n)        (n == n->parent->right)
@@ -87,6 +91,25 @@ static Node *next_node(Node *n);
 static Node *prev_node(Node *n);
 static Node *delete_node(ScmTreeCore *tc, Node *n);
 static Node *copy_tree(Node *parent, Node *self);
+static Node *build_tree(Node **v, int lo, int hi, Node *parent,
+                        int depth, int reddepth);
+
+/* B+ tree */
+typedef struct BNodeRec BNode;
+typedef struct BLeafRec BLeaf;
+
+#define BTREEP(tc)  ((tc)->type == SCM_TREE_CORE_BTREE)
+
+static ScmDictEntry *bt_search(ScmTreeCore *tc, intptr_t key, ScmDictOp op);
+static ScmDictEntry *bt_closest(ScmTreeCore *tc, intptr_t key,
+                                ScmDictEntry **lo, ScmDictEntry **hi);
+static ScmDictEntry *bt_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op,
+                              int pop);
+static ScmDictEntry *bt_iter_step(ScmTreeIter *iter, int backward);
+static BNode *bt_copy(BNode *n, BLeaf **last);
+static void bt_build(ScmTreeCore *tc, ScmDictEntry **v, int n);
+static void bt_check_consistency(ScmTreeCore *tc);
+static void bt_dump(BNode *n, int depth, ScmPort *out, int scmobj);
 
 /*
  * Public API
@@ -95,23 +118,36 @@ static Node *copy_tree(Node *parent, Node *self);
 void Scm_TreeCoreInit(ScmTreeCore *tc,
                       ScmTreeCoreCompareProc *cmp,
                       void *data)
+{
+    Scm_TreeCoreInitWithType(tc, SCM_TREE_CORE_RBTREE, cmp, data);
+}
+
+void Scm_TreeCoreInitWithType(ScmTreeCore *tc,
+                              ScmTreeCoreType type,
+                              ScmTreeCoreCompareProc *cmp,
+                              void *data)
 {
     tc->root = NULL;
     tc->cmp = cmp;
     tc->num_entries = 0;
     tc->data = data;
+    tc->type = type;
 }
 
 void Scm_TreeCoreCopy(ScmTreeCore *dst, const ScmTreeCore *src)
 {
-    if (ROOT(src)) {
-        SET_ROOT(dst, copy_tree(NULL, ROOT(src)));
+    if (src->root == NULL) {
+        dst->root = NULL;
+    } else if (BTREEP(src)) {
+        BLeaf *last = NULL;
+        dst->root = (ScmDictEntry*)bt_copy((BNode*)src->root, &last);
     } else {
-        SET_ROOT(dst, NULL);
+        SET_ROOT(dst, copy_tree(NULL, ROOT(src)));
     }
     dst->cmp = src->cmp;
     dst->num_entries = src->num_entries;
     dst->data = src->data;
+    dst->type = src->type;
 }
 
 void Scm_TreeCoreClear(ScmTreeCore *tc)
@@ -124,6 +160,7 @@ ScmDictEntry *Scm_TreeCoreSearch(ScmTreeCore *tc,
                                  intptr_t key,
                                  ScmDictOp op)
 {
+    if (BTREEP(tc)) return bt_search(tc, key, op);
     return (ScmDictEntry*)core_ref(tc, key, (enum TreeOp)op, NULL, NULL);
 }
 
@@ -132,6 +169,7 @@ ScmDictEntry *Scm_TreeCoreClosestEntries(ScmTreeCore *tc,
                                          ScmDictEntry **lo,
                                          ScmDictEntry **hi)
 {
+    if (BTREEP(tc)) return bt_closest(tc, key, lo, hi);
     Node *l, *h;
     Node *r = core_ref(tc, key, TREE_NEAR, &l, &h);
     *lo = (ScmDictEntry*)l;
@@ -141,6 +179,11 @@ ScmDictEntry *Scm_TreeCoreClosestEntries(ScmTreeCore *tc,
 
 ScmDictEntry *Scm_TreeCoreNextEntry(ScmTreeCore *tc, intptr_t key)
 {
+    if (BTREEP(tc)) {
+        ScmDictEntry *lo, *hi;
+        bt_closest(tc, key, &lo, &hi);
+        return hi;
+    }
     Node *l, *h;
     core_ref(tc, key, TREE_NEAR, &l, &h);
     return (ScmDictEntry*)h;
@@ -148,13 +191,20 @@ ScmDictEntry *Scm_TreeCoreNextEntry(ScmTreeCore *tc, intptr_t key)
 
 ScmDictEntry *Scm_TreeCorePrevEntry(ScmTreeCore *tc, intptr_t key)
 {
+    if (BTREEP(tc)) {
+        ScmDictEntry *lo, *hi;
+        bt_closest(tc, key, &lo, &hi);
+        return lo;
+    }
     Node *l, *h;
     core_ref(tc, key, TREE_NEAR, &l, &h);
     return (ScmDictEntry*)l;
 }
 
-static Node *core_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, int pop)
+static ScmDictEntry *core_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op,
+                                int pop)
 {
+    if (BTREEP(tc)) return bt_bound(tc, op, pop);
     Node *root = ROOT(tc);
     if (root) {
         Node *n = (op == SCM_TREE_CORE_MIN)? leftmost(root) : rightmost(root);
@@ -162,7 +212,7 @@ static Node *core_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, int pop)
             n = delete_node(tc, n);
             tc->num_entries--;
         }
-        return n;
+        return (ScmDictEntry*)n;
     } else {
         return NULL;
     }
@@ -170,12 +220,12 @@ static Node *core_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op, int pop)
 
 ScmDictEntry *Scm_TreeCoreGetBound(ScmTreeCore *tc, ScmTreeCoreBoundOp op)
 {
-    return (ScmDictEntry*)core_bound(tc, op, FALSE);
+    return core_bound(tc, op, FALSE);
 }
 
 ScmDictEntry *Scm_TreeCorePopBound(ScmTreeCore *tc, ScmTreeCoreBoundOp op)
 {
-    return (ScmDictEntry*)core_bound(tc, op, TRUE);
+    return core_bound(tc, op, TRUE);
 }
 
 int Scm_TreeCoreNumEntries(ScmTreeCore *tc)
@@ -214,12 +264,16 @@ void Scm_TreeIterInit(ScmTreeIter *iter,
     iter->t = tc;
     iter->e = start;
     iter->at_end = FALSE;
+    iter->node = NULL;          /* B+ tree looks up START on demand */
+    iter->index = 0;
 }
 
 ScmDictEntry *Scm_TreeIterNext(ScmTreeIter *iter)
 {
     if (iter->at_end) return NULL;
-    if (iter->e) {
+    if (BTREEP(iter->t)) {
+        iter->e = bt_iter_step(iter, FALSE);
+    } else if (iter->e) {
         iter->e = (ScmDictEntry*)next_node((Node*)iter->e);
     } else {
         iter->e = Scm_TreeCoreGetBound(iter->t, SCM_TREE_CORE_MIN);
@@ -231,7 +285,9 @@ ScmDictEntry *Scm_TreeIterNext(ScmTreeIter *iter)
 ScmDictEntry *Scm_TreeIterPrev(ScmTreeIter *iter)
 {
     if (iter->at_end) return NULL;
-    if (iter->e) {
+    if (BTREEP(iter->t)) {
+        iter->e = bt_iter_step(iter, TRUE);
+    } else if (iter->e) {
         iter->e = (ScmDictEntry*)prev_node((Node*)iter->e);
     } else {
         iter->e = Scm_TreeCoreGetBound(iter->t, SCM_TREE_CORE_MAX);
@@ -256,7 +312,7 @@ int Scm_TreeIterAtEnd(ScmTreeIter *iter)
 /* depth is # of black nodes. */
 static int check_traverse(Node *node, int depth, int *count)
 {
-    int ld, rd;
+    int ld, rd, start = *count;
 
     (*count)++;                 /* entry count */
     if (BLACKP(node)) depth++;
@@ -280,11 +336,18 @@ static int check_traverse(Node *node, int depth, int *count)
     if (ld != rd) {
         Scm_Error("[internal] tree map has different black-node depth (L:%d vs R:%d)", ld, rd);
     }
+    if (node->size != *count - start) {
+        Scm_Error("[internal] tree map node size mismatch: record %d vs actual %d", node->size, *count - start);
+    }
     return ld;
 }
 
 void Scm_TreeCoreCheckConsistency(ScmTreeCore *tc)
 {
+    if (BTREEP(tc)) {
+        bt_check_consistency(tc);
+        return;
+    }
     Node *r = ROOT(tc);
     int cnt = 0;
 
@@ -314,11 +377,17 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_TreeMapClass, treemap_print, NULL, NULL, NULL,
  */
 
 ScmObj Scm_MakeTreeMap(ScmTreeCoreCompareProc *cmp, void *data)
+{
+    return Scm_MakeTreeMapWithType(SCM_TREE_CORE_RBTREE, cmp, data);
+}
+
+ScmObj Scm_MakeTreeMapWithType(ScmTreeCoreType type,
+                               ScmTreeCoreCompareProc *cmp, void *data)
 {
     ScmTreeMap *tm = SCM_NEW(ScmTreeMap);
     SCM_SET_CLASS(tm, SCM_CLASS_TREE_MAP);
     /* TODO: default cmp should be different from TreeCore */
-    Scm_TreeCoreInit(SCM_TREE_MAP_CORE(tm), cmp, data);
+    Scm_TreeCoreInitWithType(SCM_TREE_MAP_CORE(tm), type, cmp, data);
     return SCM_OBJ(tm);
 }
 
@@ -387,7 +456,8 @@ void Scm_TreeMapDump(ScmTreeMap *tm, ScmPort *out)
     Node *r = ROOT(tc);
     Scm_Printf(out, "Entries=%d\n", tc->num_entries);
     if (r) {
-        dump_traverse(r, 0, out, TRUE);
+        if (BTREEP(tc)) bt_dump((BNode*)r, 0, out, TRUE);
+        else            dump_traverse(r, 0, out, TRUE);
     }
 }
 
@@ -396,7 +466,8 @@ void Scm_TreeCoreDump(ScmTreeCore *tc, ScmPort *out)
     Node *r = ROOT(tc);
     Scm_Printf(out, "Entries=%d\n", tc->num_entries);
     if (r) {
-        dump_traverse(r, 0, out, FALSE);
+        if (BTREEP(tc)) bt_dump((BNode*)r, 0, out, FALSE);
+        else            dump_traverse(r, 0, out, FALSE);
     }
 }
 
@@ -446,6 +517,7 @@ static Node *new_node(Node *parent, intptr_t key)
     n->key = key;
     n->value = 0;
     n->color = RED;             /* default is red */
+    n->size = 1;
     n->parent = parent;
     n->left = n->right = NULL;
     return n;
@@ -457,6 +529,12 @@ static void clear_node(Node *node)
     node->parent = node->left = node->right = NULL;
 }
 
+/* Adds D to the sizes of N and its ancestors. */
+static void add_size(Node *n, int d)
+{
+    for (; n; n = n->parent) n->size += d;
+}
+
 /* replace N's position by M. M could be NULL. */
 static void replace_node(ScmTreeCore *tc, Node *n, Node *m)
 {
@@ -487,6 +565,8 @@ static void rotate_right(ScmTreeCore *tc, Node *n)
     replace_node(tc, n, l);
     l->right = n;  n->parent = l;
     n->left = gr;  if (gr) gr->parent = n;
+    l->size = n->size;
+    n->size = SIZE(n->left) + SIZE(n->right) + 1;
 }
 
 /* rotate_left:
@@ -506,6 +586,8 @@ static void rotate_left(ScmTreeCore *tc, Node *n)
     replace_node(tc, n, r);
     r->left = n;   n->parent = r;
     n->right = gl; if (gl) gl->parent = n;
+    r->size = n->size;
+    n->size = SIZE(n->left) + SIZE(n->right) + 1;
 }
 
 #if 0 /* for debug */
@@ -514,13 +596,14 @@ static void rotate_left(ScmTreeCore *tc, Node *n)
 #define BALANCE_CASE(n) /*nothing*/
 #endif
 
-/* balance tree after insertion of N */
-static void balance_tree(ScmTreeCore *tc, Node *n)
+/* balance tree after insertion of N.  Returns TRUE if the black height
+   of the whole tree has grown, which join_tree needs to know. */
+static int balance_tree(ScmTreeCore *tc, Node *n)
 {
     Node *p = n->parent;
 
-    if (!p) { BALANCE_CASE("1"); n->color = BLACK; return; }  /* root */
-    if (BLACKP(p)) { BALANCE_CASE("2"); return; }      /* nothing to do */
+    if (!p) { BALANCE_CASE("1"); n->color = BLACK; return TRUE; }  /* root */
+    if (BLACKP(p)) { BALANCE_CASE("2"); return FALSE; } /* nothing to do */
 
     /* Here we're sure we have grandparent. */
     Node *g = p->parent;
@@ -531,8 +614,7 @@ static void balance_tree(ScmTreeCore *tc, Node *n)
         p->color = u->color = BLACK;
         g->color = RED;
         BALANCE_CASE("3");
-        balance_tree(tc, g);
-        return;
+        return balance_tree(tc, g);
     }
     if (n == p->right && p == g->left) {
         rotate_left(tc, p);
@@ -554,6 +636,7 @@ static void balance_tree(ScmTreeCore *tc, Node *n)
         rotate_left(tc, g);
         BALANCE_CASE("5b");
     }
+    return FALSE;
 }
 
 #if 0 /* for debug */
@@ -568,6 +651,7 @@ static void delete_node1(ScmTreeCore *tc, Node *todie, Node *child)
 {
     Node *parent = todie->parent;
 
+    add_size(parent, -1);
     replace_node(tc, todie, child);
     if (REDP(todie)) { DELETE_CASE("1"); return; }
     if (REDP(child)) { DELETE_CASE("2"); child->color = BLACK; return; }
@@ -663,6 +747,7 @@ static void swap_node(ScmTreeCore *tc, Node *x, Node *y)
 
     int c;
     SWAP(x->color, y->color, c);
+    SWAP(x->size, y->size, c);
     if (x == ROOT(tc)) SET_ROOT(tc, y);
     else if (y == ROOT(tc)) SET_ROOT(tc, x);
 #undef SWAP
@@ -734,6 +819,7 @@ Node *core_ref(ScmTreeCore *tc, intptr_t key, enum TreeOp op,
                 if (op == TREE_CREATE) {
                     n = new_node(e, key);
                     e->right = n;
+                    add_size(e, 1);
                     balance_tree(tc, n);
                     tc->num_entries++;
                     return n;
@@ -752,6 +838,7 @@ Node *core_ref(ScmTreeCore *tc, intptr_t key, enum TreeOp op,
                 if (op == TREE_CREATE) {
                     n = new_node(e, key);
                     e->left = n;
+                    add_size(e, 1);
                     balance_tree(tc, n);
                     tc->num_entries++;
                     return n;
@@ -772,7 +859,1301 @@ static Node *copy_tree(Node *parent, Node *self)
     Node *n = new_node(parent, self->key);
     n->value = self->value;
     n->color = self->color;
+    n->size = self->size;
     if (self->left)  n->left = copy_tree(n, self->left);
     if (self->right) n->right = copy_tree(n, self->right);
     return n;
 }
+
+/* Builds a tree from the sorted nodes V[LO] ... V[HI-1].  Since we
+   always split at the middle, all the leaves are at the depth
+   REDDEPTH or REDDEPTH-1.  Painting the nodes at REDDEPTH red keeps
+   the number of black nodes the same on every path. */
+static Node *build_tree(Node **v, int lo, int hi, Node *parent,
+                        int depth, int reddepth)
+{
+    if (lo >= hi) return NULL;
+    int mid = (lo + hi) / 2;
+    Node *n = v[mid];
+    n->parent = parent;
+    n->color = (depth == reddepth)? RED : BLACK;
+    n->size = hi - lo;
+    n->left  = build_tree(v, lo, mid, n, depth+1, reddepth);
+    n->right = build_tree(v, mid+1, hi, n, depth+1, reddepth);
+    return n;
+}
+
+/*=============================================================
+ * Internal stuff (B+ tree implementation)
+ */
+
+/* Each node has up to BT_MAX keys.  A leaf has the same number of
+   entries, and an inner node has one more children than keys.
+   Keys in CHILDREN[i+1] are greater than or equal to KEYS[i], and
+   keys in CHILDREN[i] are less than KEYS[i].
+
+   Entries are allocated separately and a leaf only keeps pointers
+   to them, for the callers may hold and modify an entry returned
+   from the API.  The keys are copied into the leaf, so that the
+   search within a node doesn't need to chase the pointers.
+
+   The first three members are common to leaves and inner nodes. */
+
+/* An entry.  Must match ScmDictEntry. */
+typedef struct BEntryRec {
+    intptr_t     key;
+    intptr_t     value;
+} BEntry;
+
+#define BT_MAX   16
+#define BT_MIN   (BT_MAX/2)
+#define BT_MAX_DEPTH 32
+
+struct BNodeRec {
+    int          leafp;
+    int          n;             /* # of keys */
+    intptr_t     keys[BT_MAX];
+};
+
+struct BLeafRec {
+    int          leafp;
+    int          n;
+    intptr_t     keys[BT_MAX];
+    ScmDictEntry *entries[BT_MAX];
+    BLeaf       *prev;
+    BLeaf       *next;
+};
+
+typedef struct BInnerRec {
+    int          leafp;
+    int          n;
+    intptr_t     keys[BT_MAX];
+    BNode        *children[BT_MAX+1];
+    int          size;          /* # of entries under this node */
+} BInner;
+
+/* The route from the root to a leaf. */
+typedef struct BPathRec {
+    int          depth;
+    struct {
+        BInner  *node;
+        int      index;         /* index of the child we went down */
+    } e[BT_MAX_DEPTH];
+} BPath;
+
+#define BROOT(tc)         ((BNode*)tc->root)
+#define SET_BROOT(tc, n)  (tc->root = (ScmDictEntry*)(n))
+
+static int bt_cmp(ScmTreeCore *tc, intptr_t a, intptr_t b)
+{
+    if (tc->cmp) return tc->cmp(tc, a, b);
+    return (a < b)? -1 : (a > b)? 1 : 0;
+}
+
+/* Returns the smallest index whose key isn't less than KEY.
+   FOUND is set to TRUE if the key is equal to KEY. */
+static int bt_lower(ScmTreeCore *tc, BNode *n, intptr_t key, int *found)
+{
+    int lo = 0, hi = n->n;
+    *found = FALSE;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int c = bt_cmp(tc, n->keys[mid], key);
+        if (c == 0) { *found = TRUE; return mid; }
+        if (c < 0) lo = mid + 1;
+        else       hi = mid;
+    }
+    return lo;
+}
+
+static BLeaf *bt_descend(ScmTreeCore *tc, intptr_t key, BPath *path)
+{
+    BNode *n = BROOT(tc);
+    path->depth = 0;
+    while (!n->leafp) {
+        int found;
+        int i = bt_lower(tc, n, key, &found);
+        if (found) i++;
+        SCM_ASSERT(path->depth < BT_MAX_DEPTH);
+        path->e[path->depth].node = (BInner*)n;
+        path->e[path->depth].index = i;
+        path->depth++;
+        n = ((BInner*)n)->children[i];
+    }
+    return (BLeaf*)n;
+}
+
+/* Descends to the leftmost or rightmost leaf. */
+static BLeaf *bt_descend_edge(ScmTreeCore *tc, int rightp, BPath *path)
+{
+    BNode *n = BROOT(tc);
+    path->depth = 0;
+    while (!n->leafp) {
+        int i = rightp? n->n : 0;
+        path->e[path->depth].node = (BInner*)n;
+        path->e[path->depth].index = i;
+        path->depth++;
+        n = ((BInner*)n)->children[i];
+    }
+    return (BLeaf*)n;
+}
+
+static BLeaf *bt_new_leaf(void)
+{
+    BLeaf *l = SCM_NEW(BLeaf);
+    l->leafp = TRUE;
+    l->n = 0;
+    l->prev = l->next = NULL;
+    return l;
+}
+
+static BInner *bt_new_inner(void)
+{
+    BInner *b = SCM_NEW(BInner);
+    b->leafp = FALSE;
+    b->n = 0;
+    b->size = 0;
+    return b;
+}
+
+/* Returns the number of entries under N. */
+static int bt_size(BNode *n)
+{
+    return n->leafp? n->n : ((BInner*)n)->size;
+}
+
+/* Recomputes the size of P from its children. */
+static void bt_recount(BInner *p)
+{
+    p->size = 0;
+    for (int i=0; i<=p->n; i++) p->size += bt_size(p->children[i]);
+}
+
+/* Returns the I-th entry of leaf L.  I may be -1 or L->n, in which case
+   we look at the adjacent leaves.  */
+static ScmDictEntry *bt_entry_at(BLeaf *l, int i)
+{
+    if (i < 0) {
+        l = l->prev;
+        return l? l->entries[l->n-1] : NULL;
+    }
+    if (i >= l->n) {
+        l = l->next;
+        return l? l->entries[0] : NULL;
+    }
+    return l->entries[i];
+}
+
+/*
+ * Insertion
+ */
+
+static void bt_leaf_insert(BLeaf *l, int i, intptr_t key, ScmDictEntry *e)
+{
+    memmove(l->keys+i+1, l->keys+i, sizeof(intptr_t)*(l->n-i));
+    memmove(l->entries+i+1, l->entries+i, sizeof(ScmDictEntry*)*(l->n-i));
+    l->keys[i] = key;
+    l->entries[i] = e;
+    l->n++;
+}
+
+/* We've split a node at the bottom of PATH, and got a new node RIGHT
+   whose keys are all greater than or equal to SEP.  Insert it to the
+   parent, splitting the ancestors as needed.  The sizes of the nodes
+   in PATH must already count the entries under RIGHT. */
+static void bt_insert_up(ScmTreeCore *tc, BPath *path,
+                         intptr_t sep, BNode *right)
+{
+    for (int level = path->depth-1; level >= 0; level--) {
+        BInner *p = path->e[level].node;
+        int i = path->e[level].index;
+
+        if (p->n < BT_MAX) {
+            memmove(p->keys+i+1, p->keys+i, sizeof(intptr_t)*(p->n-i));
+            memmove(p->children+i+2, p->children+i+1,
+                    sizeof(BNode*)*(p->n-i));
+            p->keys[i] = sep;
+            p->children[i+1] = right;
+            p->n++;
+            return;
+        }
+
+        /* Split P.  We build the merged sequence in a temporary
+           storage, then distribute it. */
+        intptr_t keys[BT_MAX+1];
+        BNode   *children[BT_MAX+2];
+        memcpy(keys, p->keys, sizeof(intptr_t)*i);
+        keys[i] = sep;
+        memcpy(keys+i+1, p->keys+i, sizeof(intptr_t)*(BT_MAX-i));
+        memcpy(children, p->children, sizeof(BNode*)*(i+1));
+        children[i+1] = right;
+        memcpy(children+i+2, p->children+i+1, sizeof(BNode*)*(BT_MAX-i));
+
+        int m = (BT_MAX+1)/2;
+        BInner *q = bt_new_inner();
+        memcpy(p->keys, keys, sizeof(intptr_t)*m);
+        memcpy(p->children, children, sizeof(BNode*)*(m+1));
+        p->n = m;
+        memcpy(q->keys, keys+m+1, sizeof(intptr_t)*(BT_MAX-m));
+        memcpy(q->children, children+m+1, sizeof(BNode*)*(BT_MAX-m+1));
+        q->n = BT_MAX-m;
+        /* Clear the unused slots for GC */
+        memset(p->keys+m, 0, sizeof(intptr_t)*(BT_MAX-m));
+        memset(p->children+m+1, 0, sizeof(BNode*)*(BT_MAX-m));
+        bt_recount(p);
+        bt_recount(q);
+
+        sep = keys[m];
+        right = (BNode*)q;
+    }
+
+    /* The root has been split. */
+    BInner *r = bt_new_inner();
+    r->n = 1;
+    r->keys[0] = sep;
+    r->children[0] = BROOT(tc);
+    r->children[1] = right;
+    bt_recount(r);
+    SET_BROOT(tc, r);
+}
+
+static ScmDictEntry *bt_insert(ScmTreeCore *tc, BLeaf *l, int i,
+                               intptr_t key, BPath *path)
+{
+    BEntry *be = SCM_NEW(BEntry);
+    be->key = key;
+    be->value = 0;
+    ScmDictEntry *e = (ScmDictEntry*)be;
+    tc->num_entries++;
+    for (int k=0; k<path->depth; k++) path->e[k].node->size++;
+
+    if (l->n < BT_MAX) {
+        bt_leaf_insert(l, i, key, e);
+        return e;
+    }
+
+    /* Split the leaf */
+    int m = BT_MAX/2;
+    BLeaf *r = bt_new_leaf();
+    memcpy(r->keys, l->keys+m, sizeof(intptr_t)*(BT_MAX-m));
+    memcpy(r->entries, l->entries+m, sizeof(ScmDictEntry*)*(BT_MAX-m));
+    r->n = BT_MAX-m;
+    memset(l->keys+m, 0, sizeof(intptr_t)*(BT_MAX-m));
+    memset(l->entries+m, 0, sizeof(ScmDictEntry*)*(BT_MAX-m));
+    l->n = m;
+    r->next = l->next;
+    if (r->next) r->next->prev = r;
+    r->prev = l;
+    l->next = r;
+
+    if (i < m) bt_leaf_insert(l, i, key, e);
+    else       bt_leaf_insert(r, i-m, key, e);
+    bt_insert_up(tc, path, r->keys[0], (BNode*)r);
+    return e;
+}
+
+/*
+ * Deletion
+ */
+
+/* Removes the I-th key and the (I+1)-th child of an inner node. */
+static void bt_inner_remove(BInner *p, int i)
+{
+    memmove(p->keys+i, p->keys+i+1, sizeof(intptr_t)*(p->n-i-1));
+    memmove(p->children+i+1, p->children+i+2, sizeof(BNode*)*(p->n-i-1));
+    p->n--;
+    p->keys[p->n] = 0;
+    p->children[p->n+1] = NULL;
+}
+
+static void bt_leaf_remove(BLeaf *l, int i)
+{
+    memmove(l->keys+i, l->keys+i+1, sizeof(intptr_t)*(l->n-i-1));
+    memmove(l->entries+i, l->entries+i+1, sizeof(ScmDictEntry*)*(l->n-i-1));
+    l->n--;
+    l->keys[l->n] = 0;
+    l->entries[l->n] = NULL;
+}
+
+/* Moves all the contents of the right sibling R into N.  SEP is the
+   separator between them in the parent (ignored for leaves). */
+static void bt_merge(BNode *n, intptr_t sep, BNode *r)
+{
+    if (n->leafp) {
+        BLeaf *a = (BLeaf*)n, *b = (BLeaf*)r;
+        memcpy(a->keys+a->n, b->keys, sizeof(intptr_t)*b->n);
+        memcpy(a->entries+a->n, b->entries, sizeof(ScmDictEntry*)*b->n);
+        a->n += b->n;
+        a->next = b->next;
+        if (a->next) a->next->prev = a;
+        /* B may still be referred from an iterator.  Make it empty so
+           that the iterator won't believe its entries. */
+        b->n = 0;
+        b->prev = b->next = NULL;
+    } else {
+        BInner *a = (BInner*)n, *b = (BInner*)r;
+        a->keys[a->n] = sep;
+        memcpy(a->keys+a->n+1, b->keys, sizeof(intptr_t)*b->n);
+        memcpy(a->children+a->n+1, b->children, sizeof(BNode*)*(b->n+1));
+        a->n += b->n + 1;
+        a->size += b->size;
+    }
+}
+
+/* Moves one entry from the left sibling L to N, which is the I-th child
+   of P. */
+static void bt_borrow_left(BInner *p, int i, BNode *l, BNode *n)
+{
+    if (n->leafp) {
+        BLeaf *a = (BLeaf*)l, *b = (BLeaf*)n;
+        bt_leaf_insert(b, 0, a->keys[a->n-1], a->entries[a->n-1]);
+        bt_leaf_remove(a, a->n-1);
+        p->keys[i-1] = b->keys[0];
+    } else {
+        BInner *a = (BInner*)l, *b = (BInner*)n;
+        memmove(b->keys+1, b->keys, sizeof(intptr_t)*b->n);
+        memmove(b->children+1, b->children, sizeof(BNode*)*(b->n+1));
+        b->keys[0] = p->keys[i-1];
+        b->children[0] = a->children[a->n];
+        b->n++;
+        b->size += bt_size(b->children[0]);
+        a->size -= bt_size(b->children[0]);
+        p->keys[i-1] = a->keys[a->n-1];
+        a->keys[a->n-1] = 0;
+        a->children[a->n] = NULL;
+        a->n--;
+    }
+}
+
+/* Moves one entry from the right sibling R to N, which is the I-th child
+   of P. */
+static void bt_borrow_right(BInner *p, int i, BNode *n, BNode *r)
+{
+    if (n->leafp) {
+        BLeaf *a = (BLeaf*)n, *b = (BLeaf*)r;
+        bt_leaf_insert(a, a->n, b->keys[0], b->entries[0]);
+        bt_leaf_remove(b, 0);
+        p->keys[i] = b->keys[0];
+    } else {
+        BInner *a = (BInner*)n, *b = (BInner*)r;
+        a->keys[a->n] = p->keys[i];
+        a->children[a->n+1] = b->children[0];
+        a->n++;
+        a->size += bt_size(b->children[0]);
+        b->size -= bt_size(b->children[0]);
+        p->keys[i] = b->keys[0];
+        memmove(b->keys, b->keys+1, sizeof(intptr_t)*(b->n-1));
+        memmove(b->children, b->children+1, sizeof(BNode*)*b->n);
+        b->n--;
+        b->keys[b->n] = 0;
+        b->children[b->n+1] = NULL;
+    }
+}
+
+static ScmDictEntry *bt_delete(ScmTreeCore *tc, BLeaf *l, int i,
+                               BPath *path)
+{
+    ScmDictEntry *e = l->entries[i];
+    bt_leaf_remove(l, i);
+    tc->num_entries--;
+    for (int k=0; k<path->depth; k++) path->e[k].node->size--;
+
+    BNode *n = (BNode*)l;
+    for (int level = path->depth-1; level >= 0; level--) {
+        if (n->n >= BT_MIN) return e;
+        BInner *p = path->e[level].node;
+        int ci = path->e[level].index;
+        BNode *left  = (ci > 0)? p->children[ci-1] : NULL;
+        BNode *right = (ci < p->n)? p->children[ci+1] : NULL;
+
+        if (left && left->n > BT_MIN) {
+            bt_borrow_left(p, ci, left, n);
+            return e;
+        }
+        if (right && right->n > BT_MIN) {
+            bt_borrow_right(p, ci, n, right);
+            return e;
+        }
+        if (left) {
+            bt_merge(left, p->keys[ci-1], n);
+            bt_inner_remove(p, ci-1);
+        } else {
+            bt_merge(n, p->keys[ci], right);
+            bt_inner_remove(p, ci);
+        }
+        n = (BNode*)p;
+    }
+
+    /* N is the root. */
+    if (n->n == 0) {
+        if (n->leafp) SET_BROOT(tc, NULL);
+        else          SET_BROOT(tc, ((BInner*)n)->children[0]);
+    }
+    return e;
+}
+
+/*
+ * Entry points
+ */
+
+static ScmDictEntry *bt_search(ScmTreeCore *tc, intptr_t key, ScmDictOp op)
+{
+    if (BROOT(tc) == NULL) {
+        if (op != SCM_DICT_CREATE) return NULL;
+        SET_BROOT(tc, bt_new_leaf());
+    }
+
+    BPath path;
+    BLeaf *l = bt_descend(tc, key, &path);
+    int found;
+    int i = bt_lower(tc, (BNode*)l, key, &found);
+
+    if (found) {
+        if (op == SCM_DICT_DELETE) return bt_delete(tc, l, i, &path);
+        return l->entries[i];
+    }
+    if (op == SCM_DICT_CREATE) return bt_insert(tc, l, i, key, &path);
+    return NULL;
+}
+
+static ScmDictEntry *bt_closest(ScmTreeCore *tc, intptr_t key,
+                                ScmDictEntry **lo, ScmDictEntry **hi)
+{
+    if (BROOT(tc) == NULL) {
+        *lo = *hi = NULL;
+        return NULL;
+    }
+    BPath path;
+    BLeaf *l = bt_descend(tc, key, &path);
+    int found;
+    int i = bt_lower(tc, (BNode*)l, key, &found);
+    *lo = bt_entry_at(l, i-1);
+    if (found) {
+        *hi = bt_entry_at(l, i+1);
+        return l->entries[i];
+    } else {
+        *hi = bt_entry_at(l, i);
+        return NULL;
+    }
+}
+
+static ScmDictEntry *bt_bound(ScmTreeCore *tc, ScmTreeCoreBoundOp op,
+                              int pop)
+{
+    if (BROOT(tc) == NULL) return NULL;
+    BPath path;
+    int rightp = (op == SCM_TREE_CORE_MAX);
+    BLeaf *l = bt_descend_edge(tc, rightp, &path);
+    int i = rightp? l->n-1 : 0;
+    if (pop) return bt_delete(tc, l, i, &path);
+    return l->entries[i];
+}
+
+/* Iterator.  We keep the leaf and the index of the current entry as
+   a hint.  If the tree has been modified since then, we look up the
+   current entry again by its key.  If the entry itself has been
+   deleted, we continue from the position it used to be. */
+static ScmDictEntry *bt_iter_step(ScmTreeIter *iter, int backward)
+{
+    ScmTreeCore *tc = iter->t;
+    BLeaf *l = (BLeaf*)iter->node;
+    int i = iter->index;
+
+    if (BROOT(tc) == NULL) return NULL;
+    if (iter->e == NULL) {
+        BPath path;
+        l = bt_descend_edge(tc, backward, &path);
+        i = backward? l->n-1 : 0;
+    } else if (l == NULL || i >= l->n || l->entries[i] != iter->e) {
+        BPath path;
+        int found;
+        l = bt_descend(tc, iter->e->key, &path);
+        i = bt_lower(tc, (BNode*)l, iter->e->key, &found);
+        if (found) {
+            i += backward? -1 : 1;
+        } else {
+            if (backward) i--;
+        }
+    } else {
+        i += backward? -1 : 1;
+    }
+
+    if (i < 0) {
+        l = l->prev;
+        if (l == NULL) return NULL;
+        i = l->n-1;
+    } else if (i >= l->n) {
+        l = l->next;
+        if (l == NULL) return NULL;
+        i = 0;
+    }
+    iter->node = l;
+    iter->index = i;
+    return l->entries[i];
+}
+
+static BNode *bt_copy(BNode *n, BLeaf **last)
+{
+    if (n->leafp) {
+        BLeaf *s = (BLeaf*)n, *d = bt_new_leaf();
+        for (int i=0; i<s->n; i++) {
+            BEntry *e = SCM_NEW(BEntry);
+            e->key = s->entries[i]->key;
+            e->value = s->entries[i]->value;
+            d->keys[i] = s->keys[i];
+            d->entries[i] = (ScmDictEntry*)e;
+        }
+        d->n = s->n;
+        d->prev = *last;
+        if (*last) (*last)->next = d;
+        *last = d;
+        return (BNode*)d;
+    } else {
+        BInner *s = (BInner*)n, *d = bt_new_inner();
+        memcpy(d->keys, s->keys, sizeof(intptr_t)*s->n);
+        for (int i=0; i<=s->n; i++) {
+            d->children[i] = bt_copy(s->children[i], last);
+        }
+        d->n = s->n;
+        d->size = s->size;
+        return (BNode*)d;
+    }
+}
+
+/* Builds the tree from the sorted entries.  We fill the nodes evenly,
+   so that every node has at least BT_MIN keys unless it's the root. */
+static void bt_build(ScmTreeCore *tc, ScmDictEntry **v, int n)
+{
+    if (n == 0) {
+        SET_BROOT(tc, NULL);
+        return;
+    }
+
+    int count = (n + BT_MAX - 1) / BT_MAX;
+    BNode **level = SCM_NEW_ARRAY(BNode*, count);
+    intptr_t *mins = SCM_NEW_ATOMIC_ARRAY(intptr_t, count);
+    BLeaf *prev = NULL;
+    for (int i=0, k=0; i<count; i++) {
+        int size = n / count + ((i < n % count)? 1 : 0);
+        BLeaf *l = bt_new_leaf();
+        for (int j=0; j<size; j++, k++) {
+            l->keys[j] = v[k]->key;
+            l->entries[j] = v[k];
+        }
+        l->n = size;
+        l->prev = prev;
+        if (prev) prev->next = l;
+        prev = l;
+        level[i] = (BNode*)l;
+        mins[i] = l->keys[0];
+    }
+
+    while (count > 1) {
+        int ngroups = (count + BT_MAX) / (BT_MAX + 1);
+        for (int i=0, k=0; i<ngroups; i++) {
+            int size = count / ngroups + ((i < count % ngroups)? 1 : 0);
+            BInner *b = bt_new_inner();
+            intptr_t min = mins[k];
+            for (int j=0; j<size; j++, k++) {
+                b->children[j] = level[k];
+                b->size += bt_size(level[k]);
+                if (j > 0) b->keys[j-1] = mins[k];
+            }
+            b->n = size - 1;
+            level[i] = (BNode*)b;
+            mins[i] = min;
+        }
+        count = ngroups;
+    }
+    SET_BROOT(tc, level[0]);
+}
+
+/* Consistency check.  Keys under N must be within [LO, HI), where
+   LO and HI may be NULL for no limit.  Returns the depth. */
+static int bt_check(ScmTreeCore *tc, BNode *n, int rootp,
+                    intptr_t *lo, intptr_t *hi, int *count, BLeaf **last)
+{
+    if (!rootp && n->n < BT_MIN) {
+        Scm_Error("[internal] btree map has an underfull node (%d)", n->n);
+    }
+    for (int i=0; i<n->n; i++) {
+        if (i > 0 && bt_cmp(tc, n->keys[i-1], n->keys[i]) >= 0) {
+            Scm_Error("[internal] btree map node isn't ordered");
+        }
+        if ((lo && bt_cmp(tc, *lo, n->keys[i]) > 0)
+            || (hi && bt_cmp(tc, n->keys[i], *hi) >= 0)) {
+            Scm_Error("[internal] btree map key is out of range");
+        }
+    }
+    if (n->leafp) {
+        BLeaf *l = (BLeaf*)n;
+        for (int i=0; i<l->n; i++) {
+            if (l->entries[i]->key != l->keys[i]) {
+                Scm_Error("[internal] btree map entry key mismatch");
+            }
+        }
+        if (l->prev != *last || (*last && (*last)->next != l)) {
+            Scm_Error("[internal] btree map leaf chain is broken");
+        }
+        *last = l;
+        *count += l->n;
+        return 1;
+    } else {
+        BInner *b = (BInner*)n;
+        int depth = -1, start = *count;
+        for (int i=0; i<=b->n; i++) {
+            intptr_t *clo = (i == 0)? lo : &b->keys[i-1];
+            intptr_t *chi = (i == b->n)? hi : &b->keys[i];
+            int d = bt_check(tc, b->children[i], FALSE, clo, chi, count, last);
+            if (depth >= 0 && d != depth) {
+                Scm_Error("[internal] btree map has leaves at different depth");
+            }
+            depth = d;
+        }
+        if (b->size != *count - start) {
+            Scm_Error("[internal] btree map node size mismatch: record %d vs actual %d", b->size, *count - start);
+        }
+        return depth + 1;
+    }
+}
+
+static void bt_check_consistency(ScmTreeCore *tc)
+{
+    int cnt = 0;
+    BLeaf *last = NULL;
+    if (BROOT(tc)) {
+        bt_check(tc, BROOT(tc), TRUE, NULL, NULL, &cnt, &last);
+        if (last->next != NULL) {
+            Scm_Error("[internal] btree map leaf chain is broken");
+        }
+    }
+    if (cnt != tc->num_entries) {
+        Scm_Error("[internal] btree map entry count mismatch: record %d vs actual %d", tc->num_entries, cnt);
+    }
+}
+
+static void bt_dump(BNode *n, int depth, ScmPort *out, int scmobj)
+{
+    for (int i=0; i<depth; i++) Scm_Printf(out, "  ");
+    if (n->leafp) {
+        BLeaf *l = (BLeaf*)n;
+        Scm_Printf(out, "L(%d):", l->n);
+        for (int i=0; i<l->n; i++) {
+            if (scmobj) {
+                Scm_Printf(out, " %S => %S", SCM_OBJ(l->entries[i]->key),
+                           SCM_OBJ(l->entries[i]->value));
+            } else {
+                Scm_Printf(out, " %08x => %08x", l->entries[i]->key,
+                           l->entries[i]->value);
+            }
+        }
+        Scm_Printf(out, "\n");
+    } else {
+        BInner *b = (BInner*)n;
+        Scm_Printf(out, "I(%d):", b->n);
+        for (int i=0; i<b->n; i++) {
+            if (scmobj) Scm_Printf(out, " %S", SCM_OBJ(b->keys[i]));
+            else        Scm_Printf(out, " %08x", b->keys[i]);
+        }
+        Scm_Printf(out, "\n");
+        for (int i=0; i<=b->n; i++) {
+            bt_dump(b->children[i], depth+1, out, scmobj);
+        }
+    }
+}
+
+/*================================================================
+ * Bulk operations
+ *
+ *   Building and large range deletion rebuild the tree from the sorted
+ *   array of entries in O(n), without comparing keys.  Split and join
+ *   rearrange the tree structure around the boundary instead.  Either
+ *   way the existing entries are reused, so the pointers to them stay
+ *   valid.
+ */
+
+static ScmDictEntry *core_new_entry(ScmTreeCore *tc, intptr_t key)
+{
+    if (BTREEP(tc)) {
+        BEntry *e = SCM_NEW(BEntry);
+        e->key = key;
+        e->value = 0;
+        return (ScmDictEntry*)e;
+    } else {
+        return (ScmDictEntry*)new_node(NULL, key);
+    }
+}
+
+/* Returns all the entries in the increasing order of keys. */
+static ScmDictEntry **core_collect(ScmTreeCore *tc)
+{
+    ScmDictEntry **v = SCM_NEW_ARRAY(ScmDictEntry*, tc->num_entries);
+    ScmTreeIter iter;
+    ScmDictEntry *e;
+    int i = 0;
+    Scm_TreeIterInit(&iter, tc, NULL);
+    while ((e = Scm_TreeIterNext(&iter)) != NULL) v[i++] = e;
+    SCM_ASSERT(i == tc->num_entries);
+    return v;
+}
+
+/* Replaces the content of TC with the sorted entries V. */
+static void core_build(ScmTreeCore *tc, ScmDictEntry **v, int n)
+{
+    if (BTREEP(tc)) {
+        bt_build(tc, v, n);
+    } else if (n == 0) {
+        SET_ROOT(tc, NULL);
+    } else {
+        int reddepth = 0;
+        while ((2 << reddepth) <= n) reddepth++; /* floor(log2(n)) */
+        Node *r = build_tree((Node**)v, 0, n, NULL, 0, reddepth);
+        PAINT(r, BLACK);
+        SET_ROOT(tc, r);
+    }
+    tc->num_entries = n;
+}
+
+/* Returns the first index in V whose key isn't less than KEY. */
+static int core_lower_index(ScmTreeCore *tc, ScmDictEntry **v, int n,
+                            intptr_t key)
+{
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = (lo + hi) / 2;
+        int c = tc->cmp? tc->cmp(tc, v[mid]->key, key)
+            : (v[mid]->key < key)? -1 : (v[mid]->key > key)? 1 : 0;
+        if (c < 0) lo = mid + 1;
+        else       hi = mid;
+    }
+    return lo;
+}
+
+static int core_cmp(ScmTreeCore *tc, intptr_t a, intptr_t b)
+{
+    if (tc->cmp) return tc->cmp(tc, a, b);
+    return (a < b)? -1 : (a > b)? 1 : 0;
+}
+
+/* KEYS must be sorted in increasing order.  If the same key appears
+   more than once, the last one wins. */
+void Scm_TreeCoreBuildSorted(ScmTreeCore *tc, int n,
+                             const intptr_t *keys, const intptr_t *values)
+{
+    ScmDictEntry **v = SCM_NEW_ARRAY(ScmDictEntry*, n);
+    int cnt = 0;
+    for (int i=0; i<n; i++) {
+        if (cnt > 0) {
+            int c = core_cmp(tc, v[cnt-1]->key, keys[i]);
+            if (c > 0) {
+                /* Keys may not be ScmObj, so we only tell the index. */
+                Scm_Error("keys aren't sorted: the key at index %d is "
+                          "smaller than the preceding one", i);
+            }
+            if (c == 0) {
+                v[cnt-1]->value = values[i];
+                continue;
+            }
+        }
+        v[cnt] = core_new_entry(tc, keys[i]);
+        v[cnt]->value = values[i];
+        cnt++;
+    }
+    core_build(tc, v, cnt);
+}
+
+/* Deletes entries whose keys are in [LO, HI).  Returns the number of
+   deleted entries.  If we're deleting only a small portion, we delete
+   them one by one; otherwise we rebuild the tree. */
+int Scm_TreeCoreDeleteRange(ScmTreeCore *tc, intptr_t lo, intptr_t hi)
+{
+    if (core_cmp(tc, lo, hi) >= 0) return 0;
+
+    ScmDictEntry *l, *h, *e, *start;
+    ScmTreeIter iter;
+    int k = 0;
+    start = Scm_TreeCoreClosestEntries(tc, lo, &l, &h);
+    if (start == NULL) start = h;
+    if (start == NULL) return 0;
+
+    Scm_TreeIterInit(&iter, tc, start);
+    for (e = start; e && core_cmp(tc, e->key, hi) < 0;
+         e = Scm_TreeIterNext(&iter)) {
+        k++;
+    }
+    if (k == 0) return 0;
+
+    int n = tc->num_entries;
+    if (k <= n/16) {
+        ScmDictEntry **v = SCM_NEW_ARRAY(ScmDictEntry*, k);
+        Scm_TreeIterInit(&iter, tc, start);
+        e = start;
+        for (int i=0; i<k; i++, e = Scm_TreeIterNext(&iter)) v[i] = e;
+        for (int i=0; i<k; i++) {
+            if (BTREEP(tc)) {
+                Scm_TreeCoreSearch(tc, v[i]->key, SCM_DICT_DELETE);
+            } else {
+                delete_node(tc, (Node*)v[i]);
+                tc->num_entries--;
+            }
+        }
+    } else {
+        ScmDictEntry **v = core_collect(tc);
+        int s = core_lower_index(tc, v, n, lo);
+        if (!BTREEP(tc)) {
+            for (int i=s; i<s+k; i++) clear_node((Node*)v[i]);
+        }
+        memmove(v+s, v+s+k, sizeof(ScmDictEntry*)*(n-s-k));
+        core_build(tc, v, n-k);
+    }
+    return k;
+}
+
+static void check_compatible(ScmTreeCore *a, ScmTreeCore *b)
+{
+    if (a->type != b->type || a->cmp != b->cmp || a->data != b->data) {
+        Scm_Error("tree cores with different type or comparison "
+                  "procedure can't be combined");
+    }
+}
+
+/*
+ * Split and join
+ *
+ *   Joining two trees hangs the lower one on the edge of the taller
+ *   one.  Splitting joins the subtrees left on each side of the search
+ *   path.  Both take O(log n).  The sizes kept in the nodes tell how
+ *   many entries go to each side.
+ */
+
+/* Returns the number of entries in TC whose keys are less than KEY. */
+static int core_count_below(ScmTreeCore *tc, intptr_t key)
+{
+    int k = 0;
+    if (BTREEP(tc)) {
+        BNode *n = BROOT(tc);
+        int found;
+        if (n == NULL) return 0;
+        while (!n->leafp) {
+            BInner *p = (BInner*)n;
+            int i = bt_lower(tc, n, key, &found);
+            if (found) i++;
+            for (int j=0; j<i; j++) k += bt_size(p->children[j]);
+            n = p->children[i];
+        }
+        return k + bt_lower(tc, n, key, &found);
+    } else {
+        Node *n = ROOT(tc);
+        while (n) {
+            if (core_cmp(tc, key, n->key) <= 0) {
+                n = n->left;
+            } else {
+                k += SIZE(n->left) + 1;
+                n = n->right;
+            }
+        }
+        return k;
+    }
+}
+
+/* Red-black tree.  We need the black height of each tree; the root
+   is always black. */
+static int black_height(Node *n)
+{
+    int h = 0;
+    for (; n; n = n->left) {
+        if (BLACKP(n)) h++;
+    }
+    return h;
+}
+
+/* Joins the trees L and R, whose black heights are LH and RH, with M
+   between them.  Keys in L are less than M's, which is less than the
+   keys in R.  Returns the new root and sets its black height in *H.
+
+   We go down the edge of the taller tree until we find a black node C
+   of the same black height as the other tree, then put M in C's place
+   with C and the other tree as its children.  M is painted red, so the
+   black heights are kept and we only need to fix red-red conflict as
+   in the insertion.  It takes O(|LH-RH|+1). */
+static Node *join_tree(Node *l, int lh, Node *m, Node *r, int rh, int *h)
+{
+    ScmTreeCore t, *tc = &t;    /* just to keep the root */
+
+    if (l) { l->parent = NULL; if (REDP(l)) { PAINT(l, BLACK); lh++; } }
+    if (r) { r->parent = NULL; if (REDP(r)) { PAINT(r, BLACK); rh++; } }
+    PAINT(m, RED);
+
+    Node *p = NULL, *c;
+    if (lh >= rh) {
+        int ch = lh;
+        for (c = l; ch > rh || REDP(c); c = c->right) {
+            if (BLACKP(c)) ch--;
+            p = c;
+        }
+        m->left = c;  if (c) c->parent = m;
+        m->right = r; if (r) r->parent = m;
+        m->parent = p;
+        m->size = SIZE(c) + SIZE(r) + 1;
+        if (p) p->right = m;
+        add_size(p, SIZE(r) + 1);
+        SET_ROOT(tc, (p? l : m));
+    } else {
+        int ch = rh;
+        for (c = r; ch > lh || REDP(c); c = c->left) {
+            if (BLACKP(c)) ch--;
+            p = c;
+        }
+        m->right = c; if (c) c->parent = m;
+        m->left = l;  if (l) l->parent = m;
+        m->parent = p;
+        m->size = SIZE(c) + SIZE(l) + 1;
+        if (p) p->left = m;
+        add_size(p, SIZE(l) + 1);
+        SET_ROOT(tc, (p? r : m));
+    }
+    *h = ((lh > rh)? lh : rh) + balance_tree(tc, m);
+    return ROOT(tc);
+}
+
+/* Splits the tree N, whose black height is H, into the nodes whose
+   keys are less than KEY and the rest.  Their roots and black heights
+   are returned in *L, *LH, *R and *RH.  Each node on the search path
+   joins the subtree on its other side to the result of the lower
+   level. */
+static void split_tree(ScmTreeCore *tc, Node *n, int h, intptr_t key,
+                       Node **l, int *lh, Node **r, int *rh)
+{
+    if (n == NULL) {
+        *l = *r = NULL;
+        *lh = *rh = 0;
+        return;
+    }
+    Node *left = n->left, *right = n->right;
+    int ch = BLACKP(n)? h-1 : h;
+    if (core_cmp(tc, key, n->key) <= 0) {
+        split_tree(tc, left, ch, key, l, lh, r, rh);
+        *r = join_tree(*r, *rh, n, right, ch, rh);
+    } else {
+        split_tree(tc, right, ch, key, l, lh, r, rh);
+        *l = join_tree(left, ch, n, *l, *lh, lh);
+    }
+}
+
+/* B+ tree.  Here the height counts a leaf as 1. */
+static int bt_height(BNode *n)
+{
+    int h = 1;
+    for (; !n->leafp; n = ((BInner*)n)->children[0]) h++;
+    return h;
+}
+
+/* Joins the trees A and B, whose heights are HA and HB.  Keys in A are
+   less than SEP, and keys in B are greater than or equal to it.  Either
+   may be NULL, and the roots may be underfull (but not empty).  Returns
+   the new root and sets its height in *H.
+
+   We go down the edge of the taller tree to the node X of the same
+   height as the other tree's root Y (or the other way around).  If X
+   and Y fit in one node, we merge them.  Otherwise we move entries
+   between them until both have at least BT_MIN, and insert the right
+   one to the parent as if the left one had been split. */
+static BNode *bt_join(BNode *a, int ha, BNode *b, int hb, intptr_t sep,
+                      int *h)
+{
+    if (a == NULL) { *h = hb; return b; }
+    if (b == NULL) { *h = ha; return a; }
+
+    ScmTreeCore t, *tc = &t;    /* just to keep the root */
+    BPath path;
+    BNode *x = a, *y = b, *n;
+
+    /* Connect the leaf chains. */
+    for (n = a; !n->leafp; n = ((BInner*)n)->children[n->n])
+        ;
+    BLeaf *la = (BLeaf*)n;
+    for (n = b; !n->leafp; n = ((BInner*)n)->children[0])
+        ;
+    la->next = (BLeaf*)n;
+    ((BLeaf*)n)->prev = la;
+
+    path.depth = 0;
+    if (ha >= hb) {
+        SET_BROOT(tc, a);
+        for (int d = ha; d > hb; d--) {
+            path.e[path.depth].node = (BInner*)x;
+            path.e[path.depth].index = x->n;
+            path.depth++;
+            x = ((BInner*)x)->children[x->n];
+        }
+    } else {
+        SET_BROOT(tc, b);
+        for (int d = hb; d > ha; d--) {
+            path.e[path.depth].node = (BInner*)y;
+            path.e[path.depth].index = 0;
+            path.depth++;
+            y = ((BInner*)y)->children[0];
+        }
+    }
+
+    /* The nodes in PATH get all the entries of the lower tree. */
+    int gain = bt_size((ha >= hb)? b : a);
+    for (int k=0; k<path.depth; k++) path.e[k].node->size += gain;
+
+    BNode *root = BROOT(tc);
+    if (x->n + y->n + (x->leafp? 0 : 1) <= BT_MAX) {
+        bt_merge(x, sep, y);
+        if (ha < hb) path.e[path.depth-1].node->children[0] = x;
+    } else {
+        /* Only one of them can be underfull.  P stands for their
+           parent to keep the separator. */
+        BInner p;
+        p.n = 1;
+        p.keys[0] = sep;
+        while (x->n < BT_MIN) bt_borrow_right(&p, 0, x, y);
+        while (y->n < BT_MIN) bt_borrow_left(&p, 1, x, y);
+        if (ha < hb) path.e[path.depth-1].node->children[0] = x;
+        bt_insert_up(tc, &path, p.keys[0], y);
+    }
+    *h = ((ha > hb)? ha : hb) + (BROOT(tc) != root);
+    return BROOT(tc);
+}
+
+/* Splits the tree N of height H into the keys less than KEY and the
+   rest, in the same way as split_tree.  The results are returned in
+   *L and *R with their heights in *LH and *RH; their roots may be
+   underfull.  The leaf chain is kept connected, and the caller cuts
+   it at the end. */
+static void bt_split(ScmTreeCore *tc, BNode *n, int h, intptr_t key,
+                     BNode **l, int *lh, BNode **r, int *rh)
+{
+    int found;
+    int i = bt_lower(tc, n, key, &found);
+
+    if (n->leafp) {
+        BLeaf *a = (BLeaf*)n;
+        *lh = *rh = 1;
+        if (i == 0) {
+            *l = NULL;
+            *r = n;
+        } else if (i == a->n) {
+            *l = n;
+            *r = NULL;
+        } else {
+            BLeaf *b = bt_new_leaf();
+            memcpy(b->keys, a->keys+i, sizeof(intptr_t)*(a->n-i));
+            memcpy(b->entries, a->entries+i, sizeof(ScmDictEntry*)*(a->n-i));
+            b->n = a->n-i;
+            memset(a->keys+i, 0, sizeof(intptr_t)*(a->n-i));
+            memset(a->entries+i, 0, sizeof(ScmDictEntry*)*(a->n-i));
+            a->n = i;
+            b->next = a->next;
+            if (b->next) b->next->prev = b;
+            b->prev = a;
+            a->next = b;
+            *l = n;
+            *r = (BNode*)b;
+        }
+        return;
+    }
+
+    BInner *p = (BInner*)n;
+    if (found) i++;
+    BNode *cl, *cr;
+    int clh, crh;
+    bt_split(tc, p->children[i], h-1, key, &cl, &clh, &cr, &crh);
+
+    /* The children on the left of I are kept in P, and the ones on the
+       right are moved to Q.  If only one child is left, it becomes the
+       root by itself. */
+    BNode *pl = NULL, *pr = NULL;
+    int plh = h, prh = h;
+    intptr_t sepl = (i > 0)? p->keys[i-1] : 0;
+    intptr_t sepr = (i < p->n)? p->keys[i] : 0;
+    if (i == p->n - 1) {
+        pr = p->children[p->n];
+        prh = h-1;
+    } else if (i < p->n - 1) {
+        BInner *q = bt_new_inner();
+        q->n = p->n-i-1;
+        memcpy(q->keys, p->keys+i+1, sizeof(intptr_t)*q->n);
+        memcpy(q->children, p->children+i+1, sizeof(BNode*)*(q->n+1));
+        bt_recount(q);
+        pr = (BNode*)q;
+    }
+    if (i == 1) {
+        pl = p->children[0];
+        plh = h-1;
+    } else if (i > 1) {
+        memset(p->keys+i-1, 0, sizeof(intptr_t)*(BT_MAX-i+1));
+        memset(p->children+i, 0, sizeof(BNode*)*(BT_MAX-i+1));
+        p->n = i-1;
+        bt_recount(p);
+        pl = n;
+    }
+    *l = bt_join(pl, plh, cl, clh, sepl, lh);
+    *r = bt_join(cr, crh, pr, prh, sepr, rh);
+}
+
+/* Moves the entries whose keys are greater than or equal to KEY into
+   DST, which must be empty. */
+void Scm_TreeCoreSplit(ScmTreeCore *tc, intptr_t key, ScmTreeCore *dst)
+{
+    check_compatible(tc, dst);
+    if (dst->num_entries != 0) {
+        Scm_Error("Scm_TreeCoreSplit: destination isn't empty");
+    }
+    int n = tc->num_entries;
+    int s = core_count_below(tc, key);
+    if (s == n) return;
+    if (s == 0) {
+        dst->root = tc->root;
+        dst->num_entries = n;
+        Scm_TreeCoreClear(tc);
+        return;
+    }
+    if (BTREEP(tc)) {
+        BNode *l, *r;
+        int lh, rh;
+        BPath path;
+        bt_split(tc, BROOT(tc), bt_height(BROOT(tc)), key, &l, &lh, &r, &rh);
+        SET_BROOT(tc, l);
+        SET_BROOT(dst, r);
+        bt_descend_edge(tc, TRUE, &path)->next = NULL;
+        bt_descend_edge(dst, FALSE, &path)->prev = NULL;
+    } else {
+        Node *l, *r;
+        int lh, rh;
+        split_tree(tc, ROOT(tc), black_height(ROOT(tc)), key,
+                   &l, &lh, &r, &rh);
+        SET_ROOT(tc, l);
+        SET_ROOT(dst, r);
+    }
+    tc->num_entries = s;
+    dst->num_entries = n - s;
+}
+
+/* Moves all the entries of SRC into TC.  All the keys in SRC must be
+   greater than the ones in TC. */
+void Scm_TreeCoreJoin(ScmTreeCore *tc, ScmTreeCore *src)
+{
+    check_compatible(tc, src);
+    if (tc == src) {
+        Scm_Error("Scm_TreeCoreJoin: can't join a tree core to itself");
+    }
+    if (src->num_entries == 0) return;
+    if (tc->num_entries == 0) {
+        tc->root = src->root;
+        tc->num_entries = src->num_entries;
+        Scm_TreeCoreClear(src);
+        return;
+    }
+    ScmDictEntry *a = Scm_TreeCoreGetBound(tc, SCM_TREE_CORE_MAX);
+    ScmDictEntry *b = Scm_TreeCoreGetBound(src, SCM_TREE_CORE_MIN);
+    if (core_cmp(tc, a->key, b->key) >= 0) {
+        Scm_Error("Scm_TreeCoreJoin: keys overlap");
+    }
+    int n = tc->num_entries + src->num_entries;
+    if (BTREEP(tc)) {
+        int h;
+        SET_BROOT(tc, bt_join(BROOT(tc), bt_height(BROOT(tc)),
+                              BROOT(src), bt_height(BROOT(src)),
+                              b->key, &h));
+    } else {
+        /* The minimum of SRC becomes the middle node. */
+        int h;
+        Node *m = delete_node(src, (Node*)b);
+        SET_ROOT(tc, join_tree(ROOT(tc), black_height(ROOT(tc)), m,
+                               ROOT(src), black_height(ROOT(src)), &h));
+    }
+    Scm_TreeCoreClear(src);
+    tc->num_entries = n;
+}
+
+/* Stable merge sort of keys V[0] ... V[N-1], using TMP as a work area. */
+static void sort_keys(ScmTreeCore *tc, intptr_t *v, intptr_t *tmp, int n)
+{
+    if (n < 2) return;
+    int m = n / 2;
+    sort_keys(tc, v, tmp, m);
+    sort_keys(tc, v+m, tmp, n-m);
+    int i = 0, j = m, k = 0;
+    while (i < m && j < n) {
+        if (core_cmp(tc, v[j], v[i]) < 0) tmp[k++] = v[j++];
+        else                              tmp[k++] = v[i++];
+    }
+    while (i < m) tmp[k++] = v[i++];
+    while (j < n) tmp[k++] = v[j++];
+    memcpy(v, tmp, sizeof(intptr_t)*n);
+}
+
+/* Updates the values of KEYS with PROC.  PROC is called with the
+   current value (or FALLBACK if the key doesn't exist), and the
+   result becomes the new value.  If the same key appears more than
+   once, PROC is applied repeatedly.
+
+   We compute all the new values before modifying the tree, so if
+   PROC raises an error, the tree is left intact.  When we update
+   a large portion of the tree, we merge the sorted keys into the
+   entries and rebuild the tree instead of inserting them one by one. */
+ScmObj Scm_TreeMapUpdateMany(ScmTreeMap *tm, ScmObj keys, ScmObj proc,
+                             ScmObj fallback)
+{
+    ScmTreeCore *tc = SCM_TREE_MAP_CORE(tm);
+    int m = Scm_Length(keys);
+    if (m < 0) Scm_Error("proper list required, but got: %S", keys);
+    if (m == 0) return SCM_UNDEFINED;
+
+    intptr_t *ks = SCM_NEW_ARRAY(intptr_t, m);
+    intptr_t *vs = SCM_NEW_ARRAY(intptr_t, m);
+    int i = 0;
+    ScmObj cp;
+    SCM_FOR_EACH(cp, keys) ks[i++] = (intptr_t)SCM_CAR(cp);
+    sort_keys(tc, ks, vs, m);
+
+    /* Compute new values.  After this, KS has unique keys and VS
+       has their new values. */
+    int cnt = 0;
+    for (i=0; i<m; cnt++) {
+        intptr_t key = ks[i];
+        ScmObj val = Scm_TreeMapRef(tm, SCM_OBJ(key), fallback);
+        for (; i<m && core_cmp(tc, ks[i], key) == 0; i++) {
+            if (SCM_UNBOUNDP(val)) {
+                Scm_Error("%S doesn't have an entry for key %S",
+                          SCM_OBJ(tm), SCM_OBJ(key));
+            }
+            val = Scm_ApplyRec1(proc, val);
+        }
+        ks[cnt] = key;
+        vs[cnt] = (intptr_t)val;
+    }
+
+    int n = tc->num_entries;
+    if (cnt < n/8) {
+        for (i=0; i<cnt; i++) {
+            ScmDictEntry *e = Scm_TreeCoreSearch(tc, ks[i], SCM_DICT_CREATE);
+            (void)SCM_DICT_SET_VALUE(e, SCM_OBJ(vs[i]));
+        }
+    } else {
+        ScmDictEntry **es = core_collect(tc);
+        ScmDictEntry **v = SCM_NEW_ARRAY(ScmDictEntry*, n+cnt);
+        int j = 0, k = 0;
+        i = 0;
+        while (i < cnt || j < n) {
+            int c = (i == cnt)? 1 : (j == n)? -1 : core_cmp(tc, ks[i], es[j]->key);
+            ScmDictEntry *e;
+            if (c < 0) {
+                e = core_new_entry(tc, ks[i]);
+                (void)SCM_DICT_SET_VALUE(e, SCM_OBJ(vs[i++]));
+            } else if (c == 0) {
+                e = es[j++];
+                (void)SCM_DICT_SET_VALUE(e, SCM_OBJ(vs[i++]));
+            } else {
+                e = es[j++];
+            }
+            v[k++] = e;
+        }
+        core_build(tc, v, k);
+    }
+    return SCM_UNDEFINED;
+}
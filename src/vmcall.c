@@ -248,33 +248,16 @@
         }
       GENERIC_ENTRY:
         /* pure generic application.  we implement MOP in C. */
-        mm = Scm_ComputeApplicableMethods(SCM_GENERIC(VAL0), ARGP, argc, APP);
+        /* The methods are already sorted; they are memoized in the
+           dispatch cache of the generic function (see class.c). */
+        mm = Scm__GenericApplicableMethods(SCM_GENERIC(VAL0), ARGP, argc, APP);
         if (!SCM_NULLP(mm)) {
-            /* sort methods.  we only need as many args as
-               gf->maxReqargs to order methods, so we only unfold that
-               many args if applyargs.
-            */
-#if defined(APPLY_CALL)
-            if (argc-1<SCM_GENERIC(VAL0)->maxReqargs) {
-                ScmObj args;
-                POP_ARG(args);
-                CHECK_STACK(SCM_GENERIC(VAL0)->maxReqargs - argc);
-                while (argc <= SCM_GENERIC(VAL0)->maxReqargs
-                       && SCM_PAIRP(args)) {
-                    PUSH_ARG(SCM_CAR(args));
-                    args = SCM_CDR(args);
-                    argc++;
-                }
-                PUSH_ARG(args);
-            }
-#endif /*APPLY_CALL*/
 #if GAUCHE_FFX
             {
                 ScmObj *ap = ARGP;
                 for (int i=0;i<argc; i++, ap++) SCM_FLONUM_ENSURE_MEM(*ap);
             }
 #endif /*GAUCHE_FFX*/
-            mm = Scm_SortMethods(mm, ARGP, argc);
             nm = Scm_MakeNextMethod(SCM_GENERIC(VAL0), SCM_CDR(mm),
                                     ARGP, argc, TRUE, APP);
             VAL0 = SCM_CAR(mm);
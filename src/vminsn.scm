@@ -1368,22 +1368,37 @@
       (SCM_FLONUM_ENSURE_MEM VAL0)
       ($result (Scm_VMSlotSet obj slot VAL0)))))
 
+;; SLOT-REFC and SLOT-SETC replace the slot name operand with a slot
+;; cache at the first run.  If the cache is valid for the object and
+;; the slot is an ordinary instance slot, we access it directly.
+;; See Scm__VMSlotRefC in class.c.
 (define-insn SLOT-REFC   0 obj #f       ; slot-ref with constant slot name
-  (let* ((slot))
+  (let* ([slot] [operand::ScmWord* PC] [loc::ScmObj* NULL])
     (FETCH-OPERAND slot)
     INCR-PC
-    (TAIL-CALL-INSTRUCTION)
-    (SCM_FLONUM_ENSURE_MEM VAL0)
-    ($result (Scm_VMSlotRef VAL0 slot FALSE))))
+    (when (SCM_SLOT_CACHE_P slot)
+      (set! loc (Scm__SlotCacheLocation (SCM_SLOT_CACHE slot) VAL0)))
+    (if (and loc (not (SCM_UNBOUNDP (* loc))) (not (SCM_UNDEFINEDP (* loc))))
+      ($result (* loc))
+      (begin
+        (TAIL-CALL-INSTRUCTION)
+        (SCM_FLONUM_ENSURE_MEM VAL0)
+        ($result (Scm__VMSlotRefC VAL0 operand))))))
 
 (define-insn SLOT-SETC   0 obj #f       ; slot-set! with constant slot name
-  (let* ((slot))
+  (let* ([slot] [operand::ScmWord* PC] [loc::ScmObj* NULL])
     (FETCH-OPERAND slot)
     INCR-PC
     ($w/argp obj
-      (TAIL-CALL-INSTRUCTION)
       (SCM_FLONUM_ENSURE_MEM VAL0)
-      ($result (Scm_VMSlotSet obj slot VAL0)))))
+      (when (SCM_SLOT_CACHE_P slot)
+        (set! loc (Scm__SlotCacheLocation (SCM_SLOT_CACHE slot) obj)))
+      (if loc
+        (begin (set! (* loc) VAL0)
+               ($result SCM_UNDEFINED))
+        (begin
+          (TAIL-CALL-INSTRUCTION)
+          ($result (Scm__VMSlotSetC obj operand VAL0)))))))
 
 ;;;
 ;;; Additional instructions
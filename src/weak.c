@@ -198,6 +198,74 @@ void *Scm_WeakBoxRef(ScmWeakBox *wbox)
                                    be GCed. */
 }
 
+/*=============================================================
+ * Ephemeron
+ */
+
+/* An ephemeron is registered to GC, which keeps the value alive as long
+   as the key is reachable, and clears both when the key is found
+   unreachable.  The value can refer to the key without making it
+   reachable.  Both slots are in an ATOMIC object so that GC won't trace
+   them by itself.
+
+   If the key isn't a GC_malloced object, it never goes away, so we
+   allocate the ephemeron as a normal object and let GC trace both
+   slots.  Either way, the key is never NULL unless it has been
+   collected. */
+struct ScmEphemeronRec {
+    void *key;
+    void *value;
+};
+
+ScmEphemeron *Scm_MakeEphemeron(void *key, void *value)
+{
+    ScmEphemeron *eph;
+    SCM_ASSERT(key != NULL);
+    if (GC_base(key) != NULL) {
+        eph = SCM_NEW_ATOMIC(ScmEphemeron);
+        eph->key = key;
+        eph->value = value;
+        GC_register_ephemeron(&eph->key, &eph->value);
+    } else {
+        eph = SCM_NEW(ScmEphemeron);
+        eph->key = key;
+        eph->value = value;
+    }
+    return eph;
+}
+
+/* Unregisters EPH when it is no longer used, e.g. its entry is removed
+   from a weak hash table.  Otherwise GC would keep the value alive as
+   long as the key is reachable. */
+static void ephemeron_release(ScmEphemeron *eph)
+{
+    if (eph->key != NULL) GC_unregister_ephemeron(&eph->key);
+    eph->value = NULL;
+}
+
+/* NB: GC clears the key before the value.  So, as with Scm_WeakBoxRef,
+   ALWAYS read the value first and then check if the ephemeron is broken;
+   if it isn't, the value you've read is valid. */
+int Scm_EphemeronBrokenP(ScmEphemeron *eph)
+{
+    return (eph->key == NULL);
+}
+
+void *Scm_EphemeronKey(ScmEphemeron *eph)
+{
+    return eph->key;
+}
+
+void *Scm_EphemeronValue(ScmEphemeron *eph)
+{
+    return eph->value;
+}
+
+void Scm_EphemeronSetValue(ScmEphemeron *eph, void *value)
+{
+    eph->value = value;
+}
+
 /*=============================================================
  * Weak Hash Table
  */
@@ -209,15 +277,21 @@ void *Scm_WeakBoxRef(ScmWeakBox *wbox)
  * If a value is GC-ed, the entry returns the default value specified
  * at the hash table creation time.
  *
- * If a key is GC-ed, the entry becomes inaccessible---from outside it
- * looks as if the entry is deleted.  We don't immediately delete the entry
- * at the time we found its key has been GC-ed, since the caller may not
- * expect the table is modified.  Instead we flag the table and delete
- * those entries when the table is modified.
+ * In a key-weak table, the key of each entry is an ephemeron that holds
+ * the real key and the value (or the weak box of the value, if the table
+ * is also value-weak).  So the value that refers to its key doesn't
+ * keep the entry alive.  If a key is GC-ed, the entry becomes
+ * inaccessible---from outside it looks as if the entry is deleted.
+ * We don't delete the entry when we look it up, since the caller may
+ * not expect the table is modified.  Instead, every modifying operation
+ * sweeps a few buckets and removes the entries whose keys are gone,
+ * so the cost of cleanup is amortized.
  */
 
 #define MARK_GONE_ENTRY(ht, e)  (ht->goneEntries++)
 
+/* Number of buckets swept by each modifying operation. */
+#define WEAK_SWEEP_BUCKETS  2
 
 static void weakhash_print(ScmObj obj, ScmPort *port, ScmWriteContext *ctx)
 {
@@ -240,45 +314,114 @@ SCM_DEFINE_BUILTIN_CLASS(Scm_WeakHashTableClass, weakhash_print,
                          NULL, NULL, NULL,
                          SCM_CLASS_DICTIONARY_CPL);
 
-/* Custom hasher & comparer for key-weak table, in which we insert
-   one indirection to the real key via WeakBox. */
+/* Custom hasher & comparer for key-weak table.  Both the key given
+   to the search and the entry's key are ephemerons. */
 static u_long weak_key_hash(const ScmHashCore *hc, intptr_t key)
 {
     ScmWeakHashTable *wh = SCM_WEAK_HASH_TABLE(hc->data);
-    ScmWeakBox *box = (ScmWeakBox *)key;
-    intptr_t realkey = (intptr_t)Scm_WeakBoxRef(box);
-    if (Scm_WeakBoxEmptyP(box)) {
-        /* There IS a small possibility that the real key has already been
-           GCed.  We return an arbitrary value (0 here); the entry won't
-           match anyway. */
-        return 0;
-    } else {
-        u_long k= wh->hashfn(hc, realkey);
-        return k;
-    }
+    ScmEphemeron *eph = (ScmEphemeron *)key;
+    return wh->hashfn(hc, (intptr_t)Scm_EphemeronKey(eph));
 }
 
-
 static int weak_key_compare(const ScmHashCore *hc, intptr_t key,
                             intptr_t entrykey)
 {
     ScmWeakHashTable *wh = SCM_WEAK_HASH_TABLE(hc->data);
-    ScmWeakBox *box = (ScmWeakBox *)entrykey;
-    intptr_t realkey = (intptr_t)Scm_WeakBoxRef(box);
-    if (Scm_WeakBoxEmptyP(box)) {
+    ScmEphemeron *eph = (ScmEphemeron *)entrykey;
+    intptr_t realkey = (intptr_t)Scm_EphemeronKey(eph);
+    if (Scm_EphemeronBrokenP(eph)) {
         return FALSE;
     } else {
-        return wh->cmpfn(hc, key, realkey);
+        return wh->cmpfn(hc, (intptr_t)Scm_EphemeronKey((ScmEphemeron*)key),
+                         realkey);
     }
 }
 
-/* Scan through  */
-#if 0
-static void weak_hash_cleanup(ScmWeakHashTable *wh)
+static int weak_entry_gone(ScmHashCore *hc, ScmDictEntry *e)
 {
+    return Scm_EphemeronBrokenP((ScmEphemeron*)e->key);
 }
-#endif
 
+/* Removes some of the entries whose keys are gone. */
+static void weak_hash_sweep(ScmWeakHashTable *wh)
+{
+    if (!(wh->weakness & SCM_WEAK_KEY)) return;
+    u_int n = (u_int)Scm_HashCoreSweep(SCM_WEAK_HASH_TABLE_CORE(wh),
+                                       &wh->sweepCursor, WEAK_SWEEP_BUCKETS,
+                                       weak_entry_gone);
+    wh->goneEntries = (wh->goneEntries > n)? wh->goneEntries - n : 0;
+}
+
+/* Searches the entry for KEY.  For key-weak table, we wrap KEY with
+   a temporary ephemeron on the stack for lookup, and allocate a real
+   one only when we insert a new entry. */
+static ScmDictEntry *weak_search(ScmWeakHashTable *wh, ScmObj key,
+                                 ScmDictOp op)
+{
+    ScmHashCore *core = SCM_WEAK_HASH_TABLE_CORE(wh);
+    if (!(wh->weakness & SCM_WEAK_KEY)) {
+        return Scm_HashCoreSearch(core, (intptr_t)key, op);
+    }
+
+    ScmEphemeron probe;
+    probe.key = key;
+    probe.value = NULL;
+    ScmDictEntry *e = Scm_HashCoreSearch(core, (intptr_t)&probe,
+                                         (op == SCM_DICT_CREATE)
+                                         ? SCM_DICT_GET : op);
+    if (e != NULL || op != SCM_DICT_CREATE) return e;
+    return Scm_HashCoreSearch(core, (intptr_t)Scm_MakeEphemeron(key, NULL),
+                              SCM_DICT_CREATE);
+}
+
+/* Returns what is stored as the value of entry E; it's the weak box
+   if the table is value-weak.  NULL if the value hasn't been set. */
+static void *entry_value(ScmWeakHashTable *wh, ScmDictEntry *e)
+{
+    if (wh->weakness & SCM_WEAK_KEY) {
+        return Scm_EphemeronValue((ScmEphemeron*)e->key);
+    } else {
+        return (void*)e->value;
+    }
+}
+
+static void entry_set_value(ScmWeakHashTable *wh, ScmDictEntry *e,
+                            ScmObj value)
+{
+    void *v = (void*)value;
+    if (wh->weakness & SCM_WEAK_VALUE) v = Scm_MakeWeakBox(value);
+    if (wh->weakness & SCM_WEAK_KEY) {
+        Scm_EphemeronSetValue((ScmEphemeron*)e->key, v);
+    } else {
+        e->value = (intptr_t)v;
+    }
+}
+
+/* Retrieves the key and the value of entry E.  Returns FALSE if the
+   key has been GC-ed. */
+static int entry_get(ScmWeakHashTable *wh, ScmDictEntry *e,
+                     ScmObj *key, ScmObj *value)
+{
+    void *v = entry_value(wh, e);
+    if (wh->weakness & SCM_WEAK_KEY) {
+        ScmEphemeron *eph = (ScmEphemeron*)e->key;
+        void *k = Scm_EphemeronKey(eph);
+        if (Scm_EphemeronBrokenP(eph)) return FALSE;
+        *key = SCM_OBJ(k);
+    } else {
+        *key = SCM_OBJ(e->key);
+    }
+
+    if (wh->weakness & SCM_WEAK_VALUE) {
+        ScmWeakBox *box = (ScmWeakBox*)v;
+        void *val = Scm_WeakBoxRef(box);
+        if (Scm_WeakBoxEmptyP(box)) *value = wh->defaultValue;
+        else                        *value = SCM_OBJ(val);
+    } else {
+        *value = SCM_OBJ(v);
+    }
+    return TRUE;
+}
 
 ScmObj Scm_MakeWeakHashTableSimple(ScmHashType type,
                                    ScmWeakness weakness,
@@ -291,6 +434,7 @@ ScmObj Scm_MakeWeakHashTableSimple(ScmHashType type,
     wh->type = type;
     wh->defaultValue = defaultValue;
     wh->goneEntries = 0;
+    wh->sweepCursor = 0;
 
     if (weakness & SCM_WEAK_KEY) {
         if (!Scm_HashCoreTypeToProcs(type, &wh->hashfn, &wh->cmpfn)) {
@@ -306,6 +450,21 @@ ScmObj Scm_MakeWeakHashTableSimple(ScmHashType type,
 
 ScmObj Scm_WeakHashTableCopy(ScmWeakHashTable *src)
 {
+    if (src->weakness & SCM_WEAK_KEY) {
+        /* The ephemerons hold the values, so we can't share them. */
+        ScmWeakHashTable *wh = SCM_WEAK_HASH_TABLE(
+            Scm_MakeWeakHashTableSimple(src->type, src->weakness,
+                                        Scm_HashCoreNumEntries(&src->core),
+                                        src->defaultValue));
+        ScmWeakHashIter iter;
+        ScmObj k, v;
+        Scm_WeakHashIterInit(&iter, src);
+        while (Scm_WeakHashIterNext(&iter, &k, &v)) {
+            Scm_WeakHashTableSet(wh, k, v, 0);
+        }
+        return SCM_OBJ(wh);
+    }
+
     ScmWeakHashTable *wh = SCM_NEW(ScmWeakHashTable);
     SCM_SET_CLASS(wh, SCM_CLASS_WEAK_HASH_TABLE);
 
@@ -315,76 +474,59 @@ ScmObj Scm_WeakHashTableCopy(ScmWeakHashTable *src)
     wh->hashfn = src->hashfn;
     wh->cmpfn = src->cmpfn;
     wh->goneEntries = 0;
+    wh->sweepCursor = 0;
     Scm_HashCoreCopy(&wh->core, &src->core);
+    wh->core.data = wh;
     return SCM_OBJ(wh);
 }
 
 ScmObj Scm_WeakHashTableRef(ScmWeakHashTable *ht, ScmObj key, ScmObj fallback)
 {
-    ScmDictEntry *e = Scm_HashCoreSearch(SCM_WEAK_HASH_TABLE_CORE(ht),
-                                         (intptr_t)key, SCM_DICT_GET);
-    if (!e) return fallback;
-    if (ht->weakness & SCM_WEAK_VALUE) {
-        void *val = Scm_WeakBoxRef((ScmWeakBox*)e->value);
-        if (Scm_WeakBoxEmptyP((ScmWeakBox*)e->value)) return ht->defaultValue;
-        SCM_ASSERT(val != NULL);
-        return SCM_OBJ(val);
-    } else {
-        return SCM_DICT_VALUE(e);
-    }
+    ScmDictEntry *e = weak_search(ht, key, SCM_DICT_GET);
+    ScmObj k, v;
+    if (!e || !entry_get(ht, e, &k, &v)) return fallback;
+    return v;
 }
 
 ScmObj Scm_WeakHashTableSet(ScmWeakHashTable *ht, ScmObj key, ScmObj value,
                             int flags)
 {
-    intptr_t proxy;
+    weak_hash_sweep(ht);
 
-    if (ht->weakness&SCM_WEAK_KEY) {
-        proxy = (intptr_t)Scm_MakeWeakBox(key);
-    } else {
-        proxy = (intptr_t)key;
-    }
-
-    ScmDictEntry *e = Scm_HashCoreSearch(
-        SCM_WEAK_HASH_TABLE_CORE(ht), proxy,
-        (flags&SCM_DICT_NO_CREATE)?SCM_DICT_GET:SCM_DICT_CREATE);
+    ScmDictEntry *e = weak_search(ht, key,
+                                  (flags&SCM_DICT_NO_CREATE)
+                                  ? SCM_DICT_GET : SCM_DICT_CREATE);
     if (!e) return SCM_UNBOUND;
-    if (ht->weakness&SCM_WEAK_VALUE) {
-        if (flags&SCM_DICT_NO_OVERWRITE) {
-            if (e->value) {
-                void *val = Scm_WeakBoxRef((ScmWeakBox*)e->value);
-                if (!Scm_WeakBoxEmptyP((ScmWeakBox*)e->value))
-                    return SCM_OBJ(val);
+    if ((flags&SCM_DICT_NO_OVERWRITE) && entry_value(ht, e) != NULL) {
+        ScmObj k, v;
+        if (entry_get(ht, e, &k, &v)) {
+            /* If the value has been GC-ed, we overwrite it. */
+            if (!(ht->weakness&SCM_WEAK_VALUE)
+                || !Scm_WeakBoxEmptyP((ScmWeakBox*)entry_value(ht, e))) {
+                return v;
             }
         }
-        e->value = (intptr_t)Scm_MakeWeakBox(value);
-        return value;
-    } else {
-        if (flags&SCM_DICT_NO_OVERWRITE && e->value) {
-            return SCM_DICT_VALUE(e);
-        }
-        (void)SCM_DICT_SET_VALUE(e, value);
-        return value;
     }
+    entry_set_value(ht, e, value);
+    return value;
 }
 
 ScmObj Scm_WeakHashTableDelete(ScmWeakHashTable *ht, ScmObj key)
 {
-    ScmDictEntry *e = Scm_HashCoreSearch(SCM_WEAK_HASH_TABLE_CORE(ht),
-                                         (intptr_t)key, SCM_DICT_DELETE);
-    if (e && e->value) {
-        if (ht->weakness&SCM_WEAK_VALUE) {
-            void *val = Scm_WeakBoxRef((ScmWeakBox*)e->value);
-            if (!Scm_WeakBoxEmptyP((ScmWeakBox*)e->value))
-                return SCM_OBJ(val);
-            else
-                return SCM_UNBOUND;
-        } else {
-            return SCM_DICT_VALUE(e);
+    weak_hash_sweep(ht);
+
+    ScmDictEntry *e = weak_search(ht, key, SCM_DICT_DELETE);
+    ScmObj k, v, r = SCM_UNBOUND;
+    if (e && entry_value(ht, e) && entry_get(ht, e, &k, &v)) {
+        if (!(ht->weakness&SCM_WEAK_VALUE)
+            || !Scm_WeakBoxEmptyP((ScmWeakBox*)entry_value(ht, e))) {
+            r = v;
         }
-    } else {
-        return SCM_UNBOUND;
     }
+    if (e && (ht->weakness & SCM_WEAK_KEY)) {
+        ephemeron_release((ScmEphemeron*)e->key);
+    }
+    return r;
 }
 
 void Scm_WeakHashIterInit(ScmWeakHashIter *iter, ScmWeakHashTable *ht)
@@ -398,30 +540,8 @@ int Scm_WeakHashIterNext(ScmWeakHashIter *iter, ScmObj *key, ScmObj *value)
     for (;;) {
         ScmDictEntry *e = Scm_HashIterNext(&iter->iter);
         if (e == NULL) return FALSE;
-        if (iter->table->weakness & SCM_WEAK_KEY) {
-            ScmWeakBox *box = (ScmWeakBox*)e->key;
-            ScmObj realkey = SCM_OBJ(Scm_WeakBoxRef(box));
-            if (Scm_WeakBoxEmptyP(box)) {
-                MARK_GONE_ENTRY(iter->table, e);
-                continue;
-            }
-            *key = realkey;
-        } else {
-            *key = (ScmObj)e->key;
-        }
-
-        if (iter->table->weakness & SCM_WEAK_VALUE) {
-            ScmWeakBox *box = (ScmWeakBox*)e->value;
-            ScmObj realval = SCM_OBJ(Scm_WeakBoxRef(box));
-            if (Scm_WeakBoxEmptyP(box)) {
-                *value = iter->table->defaultValue;
-            } else {
-                *value = realval;
-            }
-        } else {
-            *value = (ScmObj)e->value;
-        }
-        return TRUE;
+        if (entry_get(iter->table, e, key, value)) return TRUE;
+        MARK_GONE_ENTRY(iter->table, e);
     }
 }
 
@@ -32,6 +32,10 @@
 (test-basics
  (make-tree-map eq? (^[a b] (string<? (x->string a) (x->string b)))))
 
+(test-section "cache as dictionary")
+
+(test-basics (make-cache :max-entries 10))
+
 (test-section "bimap")
 
 (test-basics (make-bimap (make-hash-table 'eq?) (make-hash-table 'eqv?)))
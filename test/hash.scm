@@ -325,6 +325,100 @@
          (list (assoc "a" a)
                (assoc "b" a))))
 
+;;------------------------------------------------------------------
+(test-section "caches")
+
+(let1 c (make-cache :max-entries 3)
+  (test* "cache?" '(#t #f) (list (cache? c) (cache? (make-hash-table))))
+  (test* "cache-type" 'eq? (cache-type c))
+  (test* "cache-get (nonexistent)" (test-error) (cache-get c 'a))
+  (test* "cache-get (fallback)" 'none (cache-get c 'a 'none))
+  (test* "cache-put!/get" '(1 2 3)
+         (begin (cache-put! c 'a 1)
+                (cache-put! c 'b 2)
+                (cache-put! c 'c 3)
+                (map (cut cache-get c <>) '(a b c))))
+  (test* "LRU eviction" '((d . 4) (a . 1) (c . 3))
+         (begin (cache-get c 'a)
+                (cache-put! c 'd 4)
+                (cache->alist c)))
+  (test* "cache-exists? doesn't touch" '(#t ((e . 5) (d . 4) (a . 1)))
+         (let1 r (cache-exists? c 'c)
+           (cache-put! c 'e 5)
+           (list r (cache->alist c))))
+  (test* "cache-delete!" '(#t #f (e a))
+         (list (cache-delete! c 'd) (cache-delete! c 'd) (cache-keys c)))
+  (test* "cache-stats" '(4 2 2)
+         (let1 s (cache-stats c)
+           (map (^k (assq-ref s k)) '(hits misses evictions))))
+  (test* "cache-reset-stats!/clear!" '(0 0 ())
+         (begin (cache-reset-stats! c)
+                (cache-clear! c)
+                (let1 s (cache-stats c)
+                  (list (assq-ref s 'hits) (cache-num-entries c)
+                        (cache->alist c))))))
+
+(let1 c (make-cache :max-entries 3 :policy 'clock)
+  (test* "CLOCK eviction" '(a c d)
+         (begin (dolist [k '(a b c)] (cache-put! c k k))
+                (cache-get c 'a)
+                (cache-put! c 'd 'd)
+                (sort (cache-keys c)
+                      (^[x y] (string<? (symbol->string x)
+                                        (symbol->string y))))))))
+
+(let1 c (make-cache :type 'string=? :max-weight 10
+                    :weigher (^[k v] (string-length v)))
+  (test* "max-weight" '(("c" . "xxx") ("b" . "xxxxx"))
+         (begin (cache-put! c "a" "xxxxx")
+                (cache-put! c "b" "xxxxx")
+                (cache-put! c "c" "xxx")
+                (cache->alist c)))
+  (test* "cache-weight" 8 (cache-weight c))
+  (test* "too heavy" '(#f #f)
+         (list (cache-put! c "d" "x" :weight 11)
+               (cache-exists? c "d"))))
+
+;; The segments of a thread-safe cache share max-weight, so an entry
+;; can weigh up to the whole limit.
+(let1 c (make-cache :max-weight 10 :thread-safe #t)
+  (test* "max-weight (thread-safe)" '(10 5)
+         (begin (dotimes [i 20] (cache-put! c i i :weight 2))
+                (list (cache-weight c) (cache-num-entries c))))
+  (test* "max-weight (thread-safe, heavy entry)" '(#t (big) 10)
+         (list (cache-put! c 'big 'big :weight 10)
+               (cache-keys c)
+               (cache-weight c)))
+  (test* "too heavy (thread-safe)" '(#f (big))
+         (list (cache-put! c 'd 'd :weight 11)
+               (cache-keys c))))
+
+(let1 c (make-cache :type 'equal? :ttl 0.05)
+  (test* "ttl" '((1 2) none (3 4))
+         (begin (cache-put! c '(1) '(1 2))
+                (cache-put! c '(3) '(3 4) :ttl 60)
+                (let1 r (cache-get c '(1))
+                  (sys-nanosleep 1e8)
+                  (list r (cache-get c '(1) 'none) (cache-get c '(3))))))
+  (test* "ttl (expirations)" 1 (assq-ref (cache-stats c) 'expirations)))
+
+(let ([c (make-cache :max-entries 100 :admission #t)]
+      [hits 0])
+  ;; Hot keys should survive a scan of keys that are used only once.
+  (dotimes [i 10000]
+    (cache-lookup! c i (^[] i))
+    (let1 k (- (modulo i 100))
+      (cache-lookup! c k (^[] (inc! hits -1) k))
+      (inc! hits)))
+  (test* "admission" #t (> hits 5000)))
+
+(test* "cache-lookup!" '(1 1 1)
+       (let ([c (make-cache :type 'equal?)]
+             [n 0])
+         (list (cache-lookup! c "a" (^[] (inc! n) n))
+               (cache-lookup! c "a" (^[] (inc! n) n))
+               n)))
+
 (test-module 'gauche.hashutil) ; autoloaded module
 
 (test-end)
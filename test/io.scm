@@ -39,6 +39,67 @@
 (test* "open-output-file :if-exists :error" (test-error)
        (open-output-file "tmp2.o" :if-exists :error))
 
+(test* "large write" #t
+       (let1 s (make-string 100000 #\z)
+         (call-with-output-file "tmp2.o"
+           (^p (display "abc" p) (display s p) (display "def" p)))
+         (equal? (call-with-input-file "tmp2.o" port->string)
+                 (string-append "abc" s "def"))))
+
+(test* "write-strings" (string-append "abc" (make-string 20000 #\y) "ABC"
+                                      "def")
+       (begin
+         (call-with-output-file "tmp2.o"
+           (^p (display "abc" p)
+               (write-strings (list (make-string 20000 #\y)
+                                    '#u8(65 66 67)
+                                    "")
+                              p)
+               (display "def" p)))
+         (call-with-input-file "tmp2.o" port->string)))
+
+(test* "write-strings (string port)" "abcABCdef"
+       (call-with-output-string
+         (^p (write-strings (list "abc" '#u8(65 66 67) "def") p))))
+
+(test* "write-strings (bad item)" (test-error)
+       (write-strings '("abc" def) (open-output-string)))
+
+;; copy-port between file ports bypasses Scheme.  Make sure the data
+;; already buffered in the ports are preserved.
+(let ()
+  (define data (string-append "abcdef" (make-string 50000 #\x) "ghi"))
+  (define (copy-file-with proc)
+    (call-with-output-file "tmp2.o" (cut display data <>))
+    (unwind-protect
+        (list (call-with-input-file "tmp2.o"
+                (^i (call-with-output-file "tmp3.o"
+                      (^o (proc i o)))))
+              (call-with-input-file "tmp3.o" port->string))
+      (sys-unlink "tmp3.o")))
+
+  (test* "copy-port (file to file)" (list (string-length data) data)
+         (copy-file-with (^[i o] (copy-port i o))))
+  (test* "copy-port (file to file, buffered)"
+         (list (- (string-length data) 2) data)
+         (copy-file-with (^[i o]
+                           (display (read-char i) o)
+                           (display (read-char i) o)
+                           (peek-char i)
+                           (copy-port i o))))
+  (test* "copy-port (file to file, size)"
+         (list 10 (string-append "a" (substring data 1 11)))
+         (copy-file-with (^[i o]
+                           (peek-char i)
+                           (display (read-char i) o)
+                           (copy-port i o :size 10))))
+  (test* "copy-port (mapped file to file)" (list (string-length data) data)
+         (copy-file-with (^[i o]
+                           (call-with-input-file "tmp2.o"
+                             (cut copy-port <> o)
+                             :mapped #t))))
+  )
+
 (test* "open-output-file :if-exists :supersede" 'cdefg
        (let1 o (open-output-file "tmp2.o")
          (display "cdefg" o)
@@ -573,6 +634,61 @@
                       [second (read-zstring p)])
                  (list first second)))))))
 
+(test* "seek (mapped ifile)" "abcdecdefgfghijabchij"
+       (begin
+         (sys-unlink "test.o")
+         (with-output-to-file "test.o" (cut display "abcdefghij"))
+         (with-output-to-string
+           (cut call-with-input-file "test.o" seek-tester1 :mapped #t))))
+
+(test* "seek (mapped ifile, large)"
+       "0000050055019999050100027500"
+       (begin
+         (sys-unlink "test.o")
+         (with-output-to-file "test.o"
+           (^() (dotimes (n 10000) (format #t "~4,'0d" n))))
+         (with-output-to-string
+           (^()
+             (call-with-input-file "test.o"
+               (^p
+                 (display (read-block 4 p))
+                 (port-seek p 2000)
+                 (display (read-block 4 p))
+                 (let1 p0 (port-tell p)
+                   (port-seek p 20000 SEEK_CUR)
+                   (display (read-block 4 p))
+                   (port-seek p -4 SEEK_END)
+                   (display (read-block 4 p))
+                   (port-seek p p0)
+                   (display (read-block 4 p))
+                   (port-seek p -2000 SEEK_CUR)
+                   (display (read-block 4 p))
+                   (port-seek p -10000 SEEK_END)
+                   (display (read-block 4 p))
+                   ))
+               :mapped #t)))))
+
+(test* "seek (mapped ifile, out of range)" '(#f #f #\0)
+       (call-with-input-file "test.o"
+         (^p (list (port-seek p -1)
+                   (port-seek p 40001)
+                   (read-char p)))
+         :mapped #t))
+
+(test* "mapped ifile, reading to eof" '(40000 #t)
+       (call-with-input-file "test.o"
+         (^p (let1 s (port->string p)
+               (list (string-length s) (eof-object? (read-char p)))))
+         :mapped #t))
+
+(test* "mapped ifile, empty file" #t
+       (begin
+         (sys-unlink "test.o")
+         (with-output-to-file "test.o" (^[] #f))
+         (call-with-input-file "test.o"
+           (^p (eof-object? (read-char p)))
+           :mapped #t)))
+
 (sys-unlink "test.o")
 
 ;;-------------------------------------------------------------------
@@ -0,0 +1,46 @@
+;;;
+;;; Some performance test for reading flonums.
+;;;
+
+;; Reading decimal flonums used to go through algorithmR (exact bignum
+;; arithmetic) whenever the number has more than 15 digits or a large
+;; exponent, which is the common case of data written by other programs.
+;; The Eisel-Lemire fast path handles most of them with a couple of
+;; 64bit multiplications.  The corpus mixes short numbers (which the
+;; old code read fast), full-precision numbers, and numbers with
+;; large exponents.
+
+(use gauche.time)
+
+(define (make-corpus n)
+  (let1 seed 12345
+    (define (rand k)
+      (set! seed (modulo (+ (* seed 1103515245) 12345) 2147483648))
+      (modulo (quotient seed 16) k))
+    (map (^i (case (modulo i 3)
+               [(0) (number->string (/ (rand 100000) 100.0))]
+               [(1) (number->string (/ (+ (rand 1000000) 1) 7.0))]
+               [else (number->string (* (/ (+ (rand 1000000) 1) 3.0)
+                                        (expt 10.0 (- (rand 600) 300))))]))
+         (iota n))))
+
+(define (read-corpus corpus)
+  (dolist [s corpus] (string->number s)))
+
+(define (read-corpus/port text)
+  (with-input-from-string text
+    (^[] (port-for-each identity read))))
+
+(define (run n)
+  (let* ([corpus (make-corpus n)]
+         [text (string-join corpus " ")])
+    (print #"corpus: ~n numbers, ~(string-length text) characters")
+    (time-these/report
+     '(cpu 5)
+     `((string->number . ,(cut read-corpus corpus))
+       (read           . ,(cut read-corpus/port text))))))
+
+#|
+(run 1000)
+(run 100000)
+|#
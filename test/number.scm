@@ -299,6 +299,50 @@
 (test* "flonum reader (minimum normalized number)" #t
        (= (expt 2.0 (- 52 1074))
           (string->number "2.2250738585072012e-308")))
+
+;; These are decided by the fast path (Eisel-Lemire), except the ones
+;; that need algorithmR.  Note that 'exact' returns the simplest rational
+;; within the flonum's precision, so we use decode-float to get the exact
+;; binary value.
+(define (flonum-binary-value x)
+  (let1 v (decode-float x)
+    (* (vector-ref v 0) (expt 2 (vector-ref v 1)) (vector-ref v 2))))
+
+(test* "flonum reader (correct rounding)"
+       '(9007199254740992 9007199254740996 9007199254740994
+         3602879701896397/36028797018963968 99999999999999991611392 0)
+       (map (^s (flonum-binary-value (string->number s)))
+            '("9007199254740993" "9007199254740995" "9007199254740993.0000001"
+              "0.1" "1e23" "0e100")))
+(test* "flonum reader (correct rounding)" #t
+       (= (* (- 2 (expt 2 -52)) (expt 2 1023))
+          (flonum-binary-value (string->number "1.7976931348623157e308"))))
+(test* "flonum reader (correct rounding)" #t
+       (= (expt 2 -1022)
+          (flonum-binary-value (string->number "2.2250738585072014e-308"))))
+(test* "flonum reader (correct rounding)" #t
+       (= (expt 2 -1074)
+          (flonum-binary-value (string->number "4.9406564584124654e-324"))))
+
+;; Random decimals with up to 19 digits; the result must be within
+;; a half ulp of the exact value.
+(let ()
+  (define seed 7)
+  (define (rand64)                      ; 64bit LCG
+    (set! seed (logand (+ (* seed 6364136223846793005) 1442695040888963407)
+                       #xffffffffffffffff))
+    seed)
+  (define (bad? m e)
+    (let* ([x (string->number (format "~de~d" m e))]
+           [ulp (expt 2 (vector-ref (decode-float x) 1))])
+      (> (abs (- (flonum-binary-value x) (* m (expt 10 e)))) (/ ulp 2))))
+  (test* "flonum reader (random)" '()
+         (let loop ([i 0] [r '()])
+           (if (= i 3000)
+             r
+             (let ([m (+ (ash (rand64) (- (modulo (rand64) 60))) 1)]
+                   [e (- (modulo (rand64) 580) 300)])
+               (loop (+ i 1) (if (bad? m e) (cons (list m e) r) r)))))))
        
 ;; We used to allow 1#1 to be read as a symbol.  As of 0.9.4, it is an error.
 (test* "padding" '(10.0 #t) (flonum-test "1#"))
@@ -474,6 +518,67 @@
         "-340282366920938463463374607431768211457")
       (i-tester2 (exp2 127)))
 
+;; Large numbers are converted in divide-and-conquer way.
+(let ()
+  (define (digits n c) (make-string n c))
+  (dolist [n '(100 1000 5000 20000)]
+    (test* (format "10^~a" n)
+           (string-append "1" (digits n #\0))
+           (number->string (expt 10 n)))
+    (test* (format "-10^~a+1" n)
+           (string-append "-" (digits n #\9))
+           (number->string (- 1 (expt 10 n))))
+    (test* (format "read 10^~a-1" n)
+           (- (expt 10 n) 1)
+           (string->number (digits n #\9)))
+    (test* (format "2^~a-1 in hex" (* n 4))
+           (list (digits n #\f) (- (ash 1 (* n 4)) 1))
+           (list (number->string (- (ash 1 (* n 4)) 1) 16)
+                 (string->number (digits n #\f) 16)))
+    (let1 x (expt 7 n)
+      (test* (format "round trip 7^~a" n)
+             '(#t #t #t #t)
+             (map (^r (= x (string->number (number->string x r) r)))
+                  '(2 10 17 36))))))
+
+;;------------------------------------------------------------------
+(test-section "flonum writer")
+
+(test* "flonum writer"
+       '("1.0" "0.1" "-1.5e-7" "1.0e23" "1.7976931348623157e308" "5.0e-324"
+         "123.456" "0.001" "1.0e10" "123456789.0" "1.152921504606847e18")
+       (map number->string
+            '(1.0 0.1 -1.5e-7 1e23 1.7976931348623157e308 5e-324
+              123.456 0.001 1e10 123456789.0 1152921504606846976.0)))
+
+;; Differential test of the flonum printer.  The fast path must agree
+;; with the exact algorithm whenever it succeeds.
+(let ()
+  (define flonum-digits (with-module gauche.internal %flonum-digits))
+  (define seed 1)
+  (define (rand64)                      ; 64bit LCG
+    (set! seed (logand (+ (* seed 6364136223846793005) 1442695040888963407)
+                       #xffffffffffffffff))
+    seed)
+  (define (random-flonum)
+    (let ([mant (ash (rand64) -12)]
+          [e (ash (rand64) -53)])
+      (cond [(= e #x7ff) (random-flonum)]
+            [(= e 0) (if (zero? mant)
+                       (random-flonum)
+                       (ldexp (exact->inexact mant) -1074))]
+            [else (ldexp (exact->inexact (+ mant (expt 2 52))) (- e 1075))])))
+  (define (bad? x)
+    (let1 fast (flonum-digits x #t)
+      (or (and fast (not (equal? fast (flonum-digits x #f))))
+          (not (= x (string->number (number->string x)))))))
+  (test* "fast flonum printer vs exact algorithm" '()
+         (let loop ([i 0] [r '()])
+           (if (= i 10000)
+             r
+             (let1 x (random-flonum)
+               (loop (+ i 1) (if (bad? x) (cons x r) r)))))))
+
 ;;==================================================================
 ;; Conversions
 ;;
@@ -1222,6 +1327,22 @@
            173462447179147555430258970864309778377421844723664084649347019061363579192879108857591038330408837177983810868451546421940712978306134189864280826014542758708589243873685563973118948869399158545506611147420216132557017260564139394366945793220968665108959685482705388072645828554151936401912464931182546092879815733057795573358504982279280090942872567591518912118622751714319229788100979251036035496917279912663527358783236647193154777091427745377038294584918917590325110939381322486044298573971650711059244462177542540706913047034664643603491382441723306598834177
            ))
 
+;; Large operands, for which subquadratic algorithms are used.
+;; The expected values are computed without general multiplication.
+(let ()
+  (define (ones n) (- (ash 1 n) 1))
+  (dolist [n '(1000 3000 10000 40000)]
+    (test* (format "(2^~a-1)^2" n)
+           (+ (- (ash 1 (* 2 n)) (ash 1 (+ n 1))) 1)
+           (* (ones n) (ones n)))
+    (test* (format "(2^~a-1)*(2^~a-1)" (* n 3) n)
+           (+ (- (ash 1 (* 4 n)) (ash 1 (* 3 n)) (ash 1 n)) 1)
+           (* (ones (* n 3)) (ones n)))
+    (let1 x (expt 3 n)
+      (test* (format "3^~a*(2^~a+1)" n n)
+             (m-result (+ (ash x n) x))
+             (m-tester x (+ (ash 1 n) 1))))))
+
 ;;------------------------------------------------------------------
 (test-section "multiplication short cuts")
 
@@ -1559,6 +1680,27 @@
   (do-exactness 7 9)
   )
 
+;; Large divisors
+(let ()
+  (define (ones n) (- (ash 1 n) 1))
+  (define (check a b)
+    (test* (format "quotient&remainder (~a bits) (~a bits)"
+                   (integer-length a) (integer-length b))
+           '(#t #t #t)
+           (receive (q r) (quotient&remainder a b)
+             (list (= a (+ (* q b) r))
+                   (<= 0 r)
+                   (< r b)))))
+  (dolist [n '(1000 10000 30000)]
+    (test* (format "quotient&remainder (2^~a-1) (2^~a-1)" (* n 3) n)
+           (list (+ (ash 1 (* n 2)) (ash 1 n) 1) 0)
+           (receive r (quotient&remainder (ones (* n 3)) (ones n)) r))
+    (test* (format "quotient&remainder 2^~a (2^~a-1)" (* n 3) n)
+           (list (+ (ash 1 (* n 2)) (ash 1 n) 1) 1)
+           (receive r (quotient&remainder (ash 1 (* n 3)) (ones n)) r))
+    (check (expt 3 (* n 4)) (+ (expt 7 n) 12345))
+    (check (ones (* n 5)) (expt 5 n))))
+
 ;;------------------------------------------------------------------
 (test-section "div and mod")
 
@@ -288,6 +288,63 @@
 (test* "method sorting" 2 (ms-1 "a" "a"))
 (test* "method sorting" 1 (ms-1 "a"))
 
+;;----------------------------------------------------------------
+(test-section "dispatch cache")
+
+;; The result of dispatch is memoized per generic function.  Make sure
+;; it is invalidated properly.
+
+(define-class <dc-a> () ())
+(define-class <dc-b> (<dc-a>) ())
+(define-method dc-1 ((x <dc-a>)) 'a)
+(define-method dc-1 (x) 'top)
+
+(test* "dispatch cache" '(a a top a)
+       (list (dc-1 (make <dc-a>)) (dc-1 (make <dc-b>)) (dc-1 1)
+             (apply dc-1 (list (make <dc-b>)))))
+(define-method dc-1 ((x <dc-b>)) (cons 'b (next-method)))
+(test* "dispatch cache (method added)" '(a (b . a) top (b . a))
+       (list (dc-1 (make <dc-a>)) (dc-1 (make <dc-b>)) (dc-1 1)
+             (apply dc-1 (list (make <dc-b>)))))
+(define-method dc-1 ((x <dc-b>)) 'bb)
+(test* "dispatch cache (method replaced)" '(a bb top)
+       (list (dc-1 (make <dc-a>)) (dc-1 (make <dc-b>)) (dc-1 1)))
+(delete-method! dc-1 (find (^m (equal? (slot-ref m 'specializers)
+                                       (list <dc-b>)))
+                           (slot-ref dc-1 'methods)))
+(test* "dispatch cache (method deleted)" '(a a top)
+       (list (dc-1 (make <dc-a>)) (dc-1 (make <dc-b>)) (dc-1 1)))
+
+;; Number of arguments is a part of the key.
+(define-method dc-2 ((x <dc-a>)) 1)
+(define-method dc-2 ((x <dc-a>) y) 2)
+(define-method dc-2 ((x <dc-a>) y . z) 'n)
+(test* "dispatch cache (arity)" '(1 2 n 1 2 n)
+       (let1 a (make <dc-a>)
+         (list (dc-2 a) (dc-2 a 0) (dc-2 a 0 0)
+               (apply dc-2 a '()) (apply dc-2 a 0 '()) (apply dc-2 a '(0 0)))))
+
+;; Many classes at the same call site.
+(test* "dispatch cache (megamorphic)" #t
+       (let ([cs (map (^_ (make <class> :name (gensym) :supers (list <dc-a>)))
+                      (iota 2000))])
+         (every (^c (eq? (dc-1 (make c)) 'a)) cs)))
+
+;; Class redefinition changes the applicable methods of the redefined
+;; class and its subclasses.
+(define-class <dc-c> () ())
+(define-class <dc-d> (<dc-b>) ())
+(define-method dc-3 ((x <dc-a>)) 'a)
+(define-method dc-3 ((x <dc-c>)) 'c)
+(define-method dc-3 (x) 'top)
+(test* "dispatch cache (before redefinition)" '(a a a)
+       (list (dc-3 (make <dc-a>)) (dc-3 (make <dc-b>)) (dc-3 (make <dc-d>))))
+(define-class <dc-b> (<dc-c>) ())
+(test* "dispatch cache (class redefined)" '(a c c)
+       (list (dc-3 (make <dc-a>)) (dc-3 (make <dc-b>)) (dc-3 (make <dc-d>))))
+(test* "dispatch cache (class redefined)" '(a top top)
+       (list (dc-1 (make <dc-a>)) (dc-1 (make <dc-b>)) (dc-1 (make <dc-d>))))
+
 
 ;;----------------------------------------------------------------
 (test-section "setter method definition")
@@ -364,6 +421,67 @@
            (ma-s m 'ei)
            (slot-ref m 'a))))
 
+;;----------------------------------------------------------------
+(test-section "slot accessor cache")
+
+;; slot-ref and slot-set! with a constant slot name cache the class
+;; and the accessor at each call site.  The same slot name maps to
+;; different slot numbers in different classes.
+(define-class <sc-1> () ((p :init-keyword :p) (q :init-keyword :q)))
+(define-class <sc-2> () ((q :init-keyword :q) (r) (p :init-keyword :p)))
+(define-class <sc-3> (<sc-1>)
+  ((q :allocation :virtual :slot-ref (^o 'virtual-q)
+      :slot-set! (^(o v) #f))))
+
+(define (sc-ref o) (list (slot-ref o 'p) (slot-ref o 'q)
+                         (slot-bound? o 'p) (slot-exists? o 'r)))
+
+(test* "slot accessor cache"
+       '((1 2 #t #f) (3 4 #t #t) (5 virtual-q #t #f) (1 2 #t #f))
+       (let ([a (make <sc-1> :p 1 :q 2)]
+             [b (make <sc-2> :p 3 :q 4)]
+             [c (make <sc-3> :p 5)])
+         (map sc-ref (list a b c a))))
+
+(test* "slot accessor cache (unbound)" '(#f #t)
+       (let1 o (make <sc-1> :q 0)
+         (list (slot-bound? o 'p)
+               (begin (slot-set! o 'p 'x) (slot-bound? o 'p)))))
+
+(test* "slot accessor cache (redefinition)" '(1 2 (1 2))
+       (let1 o (make <sc-1> :p 1 :q 2)
+         (sc-ref o)
+         (eval '(define-class <sc-1> () ((z :init-value 'z) (q) (p)))
+               (current-module))
+         (list (slot-ref o 'p) (slot-ref o 'q)
+               (map (cut slot-ref o <>) '(p q)))))
+
+(define (sc-set! o v) (slot-set! o 'p v) (slot-ref o 'p))
+
+(test* "slot accessor cache (slot-set!)" '(10 virtual-q 20 11 #t)
+       (let ([a (make <sc-1> :p 1 :q 2)]
+             [b (make <sc-2> :p 3 :q 4)])
+         (list (sc-set! a 10) (slot-ref (make <sc-3>) 'q)
+               (sc-set! b 20) (sc-set! a 11)
+               (equal? (map (cut slot-ref b <>) '(p q)) '(20 4)))))
+
+;; A call site that sees many classes gives up caching
+(define (make-sc-class n)               ; class with slot p after n slots
+  (make <class> :name '<sc-m> :supers (list <object>)
+        :slots `(,@(map (^k (list (string->symbol #"x~k"))) (iota n))
+                 (p :init-keyword :p))))
+
+(test* "slot accessor cache (many classes)" (map (cut * 2 <>) (iota 40))
+       (let1 objs (map (^i (make (make-sc-class (modulo i 20)) :p i))
+                       (iota 40))
+         (dolist [o objs] (slot-set! o 'p (* (slot-ref o 'p) 2)))
+         (map (^o (slot-ref o 'p)) objs)))
+
+(test* "slot accessor cache (code)" '(#t #t)
+       (let1 code ((with-module gauche.internal vm-code->list)
+                   (closure-code sc-ref))
+         (list (boolean (memq 'p code)) (boolean (memq 'q code)))))
+
 ;;----------------------------------------------------------------
 (test-section "class redefinition (part 1)")
 
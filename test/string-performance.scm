@@ -0,0 +1,55 @@
+;;;
+;;; Some performance test for indexed access to strings.
+;;;
+
+;; Indexed access to multibyte strings (string-ref, substring) used to
+;; scan the string from the beginning every time, making an indexed loop
+;; quadratic.  The sparse character index makes each access bounded.
+;; Run this on builds with different native encodings (e.g. utf-8 and
+;; euc-jp) to compare.  Single-byte strings are included as a baseline,
+;; which don't need the index.
+;;
+;;   gosh ./string-performance.scm [length ...]
+;;
+;; The default lengths are 1000 and 100000.
+
+(use gauche.time)
+
+(define (make-text n multibyte?)
+  (with-output-to-string
+    (^[] (dotimes [i n]
+           (write-char (if (and multibyte? (zero? (modulo i 3)))
+                         (integer->char (+ #x3042 (modulo i 80)))
+                         (integer->char (+ 97 (modulo i 26)))))))))
+
+(define (string-ref-loop s)
+  (let1 len (string-length s)
+    (let loop ([i 0] [n 0])
+      (if (= i len)
+        n
+        (loop (+ i 1)
+              (if (char=? (string-ref s i) #\a) (+ n 1) n))))))
+
+(define (substring-loop s)
+  (let1 len (string-length s)
+    (let loop ([i 0] [n 0])
+      (if (>= (+ i 10) len)
+        n
+        (loop (+ i 7) (+ n (string-length (substring s i (+ i 10)))))))))
+
+(define (run n)
+  (print #"encoding: ~(gauche-character-encoding), length: ~n")
+  (let ([sb (make-text n #f)]
+        [mb (make-text n (not (eq? (gauche-character-encoding) 'none)))])
+    (time-these/report
+     '(cpu 5)
+     `((string-ref/single-byte . ,(cut string-ref-loop sb))
+       (string-ref/multibyte   . ,(cut string-ref-loop mb))
+       (substring/single-byte  . ,(cut substring-loop sb))
+       (substring/multibyte    . ,(cut substring-loop mb))))))
+
+(define (main args)
+  (for-each run (if (null? (cdr args))
+                  '(1000 100000)
+                  (map x->integer (cdr args))))
+  0)
@@ -319,6 +319,86 @@
 (test* "string-split (bad limit)" (test-error)
        (string-split "--aa--bbb---c-c-" #/-+/ 'a))
 
+;;-------------------------------------------------------------------
+(test-section "large strings")
+
+;; Concatenating large strings may create a rope internally.  The result
+;; must be indistinguishable from the flat string.
+(let* ([piece (if (eq? (gauche-character-encoding) 'none)
+                "abcdefg"
+                "ab\u3042c\u3044de")]
+       [big (make-string 2000 #\z)]
+       [pieces (append-map (^i (if (zero? (modulo i 50))
+                                 (list big piece)
+                                 (list piece)))
+                           (iota 1000))]
+       [flat (with-output-to-string (cut for-each display pieces))]
+       [acc (fold (^[p acc] (string-append acc p)) "" pieces)]
+       [len (string-length flat)])
+  (test* "accumulated string-append" #t (equal? acc flat))
+  (test* "string-length" len (string-length acc))
+  (test* "string-size" (string-size flat) (string-size acc))
+  (test* "string-ref" #t
+         (every (^k (eqv? (string-ref acc k) (string-ref flat k)))
+                (list 0 1 2 3 (- len 1) 1000 5000 12345 (quotient len 2))))
+  (test* "substring" #t
+         (every (^[s e] (equal? (substring acc s e) (substring flat s e)))
+                (list 0 7 3000 0     2500 (- len 10))
+                (list 7 8 9000 len   40000 len)))
+  (test* "substring of substring" (substring flat 3010 3020)
+         (substring (substring acc 3000 9000) 10 20))
+  (test* "string-append of substrings"
+         (string-append (substring flat 0 4000) (substring flat 9000 20000))
+         (string-append (substring acc 0 4000) (substring acc 9000 20000)))
+  (test* "string-append (n-ary)"
+         (string-append flat "-" flat)
+         (string-append acc "-" acc))
+  (test* "string comparison" #t (and (string=? acc flat)
+                                     (string<? acc (string-append flat "a"))))
+  (test* "string-set!" (string-append (substring flat 0 2999) "Q"
+                                      (substring flat 3000 len))
+         (let1 s (string-copy acc)
+           (string-set! s 2999 #\Q)
+           s))
+  (test* "output" flat
+         (with-output-to-string (cut display acc)))
+  (test* "hash" (hash flat) (hash acc))
+  )
+
+;; Many appends of large pieces, each of which adds a node to the rope.
+;; It used to rebuild the whole rope every few dozen appends.
+(let* ([pieces (map (^i (make-string 600 (integer->char (+ 97 (modulo i 26)))))
+                    (iota 5000))]
+       [flat (with-output-to-string (cut for-each display pieces))]
+       [app (fold (^[p acc] (string-append acc p)) "" pieces)]
+       [pre (fold (^[p acc] (string-append p acc)) "" (reverse pieces))]
+       [ks '(0 599 600 1234567 2999999)])
+  (test* "many appends" #t (equal? app flat))
+  (test* "many prepends" #t (equal? pre flat))
+  (test* "many appends (string-ref)" (map (cut string-ref flat <>) ks)
+         (map (cut string-ref app <>) ks)))
+
+;; Indexed access to a long multibyte string uses a sparse index built
+;; at the first access.
+(let* ([chars (map (^i (if (zero? (modulo i 3))
+                         (integer->char (+ #x3042 (modulo i 80)))
+                         (integer->char (+ 97 (modulo i 26)))))
+                   (iota 3000))]
+       [chars (if (eq? (gauche-character-encoding) 'none)
+                (map (^c (if (> (char->integer c) 127) #\Z c)) chars)
+                chars)]
+       [str (list->string chars)]
+       [ks '(0 1 63 64 65 127 128 1000 2047 2999)])
+  (test* "string-ref (long string)" (map (cut list-ref chars <>) ks)
+         (map (cut string-ref str <>) ks))
+  (test* "substring (long string)"
+         (map (^k (list->string (take (drop chars k) (min 100 (- 3000 k)))))
+              ks)
+         (map (^k (substring str k (min (+ k 100) 3000))) ks))
+  (test* "string-pointer (long string)" (list-ref chars 2000)
+         (string-pointer-ref (make-string-pointer str 1000 1000)))
+  )
+
 ;;-------------------------------------------------------------------
 (test-section "incomplete strings")
 
@@ -91,6 +91,8 @@
 (do-tree-map (cut make-tree-map = <))
 (do-tree-map (cut make-tree-map (^[a b] (cond [(< a b) -1][(= a b) 0][else 1]))))
 (do-tree-map (cut make-tree-map))
+(do-tree-map (cut make-tree-map = < :type 'btree))
+(do-tree-map (cut make-tree-map :type 'btree))
 
 ;; Min, max, iterators
 (let ((empty (make-tree-map = <))
@@ -431,5 +433,189 @@
            (tree-map-pop-min! tree)
            (tree-map-num-entries tree))))
 
-(test-end)
+;;
+;; B+ tree core
+;;
 
+(test* "make-tree-map :type" (test-error)
+       (make-tree-map :type 'no-such-type))
+
+;; Run random operations on both cores and compare the results.
+;; The number of entries is large enough to split the root several times.
+(let ([rb (make-tree-map)]
+      [bt (make-tree-map :type 'btree)])
+  (define (both proc . args)
+    (let ([a (apply proc rb args)]
+          [b (apply proc bt args)])
+      (unless (equal? a b)
+        (errorf "~s mismatch on ~s: ~s vs ~s" proc args a b))
+      b))
+  (define (run n range)
+    (dotimes [i n]
+      (let1 k (modulo (* i 7919) range)
+        (case (modulo (* i 31) 7)
+          [(0 1 2) (both tree-map-put! k i)]
+          [(3 4)   (both tree-map-delete! k)]
+          [(5)     (both tree-map-floor k)]
+          [(6)     (both tree-map-successor k)])))
+    (%tree-map-check-consistency bt))
+  (test* "btree random ops (small)" #t (run 200 50))
+  (test* "btree random ops (large)" #t (run 20000 5000))
+  (test* "btree num-entries" (tree-map-num-entries rb)
+         (tree-map-num-entries bt))
+  (test* "btree ->alist" (tree-map->alist rb) (tree-map->alist bt))
+  (test* "btree fold-right" (tree-map-fold-right rb acons '())
+         (tree-map-fold-right bt acons '()))
+  (test* "btree copy" (tree-map->alist rb)
+         (let1 c (tree-map-copy bt)
+           (%tree-map-check-consistency c)
+           (tree-map->alist c)))
+  (test* "btree pop-min!/pop-max!" #t
+         (begin (dotimes [i 100]
+                  (both tree-map-pop-min!)
+                  (both tree-map-pop-max!))
+                (%tree-map-check-consistency bt)))
+  (test* "btree delete all" 0
+         (begin (for-each (cut tree-map-delete! bt <>) (tree-map-keys rb))
+                (%tree-map-check-consistency bt)
+                (tree-map-num-entries bt)))
+  )
+
+;; Iterating while modifying the tree.
+(let1 bt (make-tree-map :type 'btree)
+  (dotimes [i 1000] (tree-map-put! bt i i))
+  (test* "btree iteration with deletion" (iota 500 0 2)
+         (reverse
+          (tree-map-fold bt
+                         (^[k v s]
+                           (tree-map-delete! bt (+ k 1))
+                           (when (zero? (modulo k 4)) (tree-map-delete! bt k))
+                           (cons k s))
+                         '())))
+  (test* "btree iteration with deletion (rest)" (iota 250 2 4)
+         (tree-map-keys bt))
+  )
+
+;; Bulk operations.
+(define (test-bulk type)
+  (define (make-alist lo hi) (map (^k (cons k (* k k))) (iota (- hi lo) lo)))
+  (define (build alist) (alist->tree-map/sorted alist :type type))
+  (define (check tm) (and (%tree-map-check-consistency tm) (tree-map->alist tm)))
+
+  (test* #"alist->tree-map/sorted (~type)" (make-alist 0 1000)
+         (check (build (make-alist 0 1000))))
+  (test* #"alist->tree-map/sorted empty (~type)" '()
+         (check (build '())))
+  (test* #"alist->tree-map/sorted duplicates (~type)" '((1 . b) (2 . d))
+         (check (build '((1 . a) (1 . b) (2 . c) (2 . d)))))
+  (test* #"alist->tree-map/sorted unsorted (~type)" (test-error)
+         (build '((1 . a) (3 . b) (2 . c))))
+  (test* #"alist->tree-map/sorted then modify (~type)"
+         (append (make-alist 0 500) (make-alist 1000 1200))
+         (let1 tm (build (make-alist 0 1000))
+           (dotimes [i 500] (tree-map-delete! tm (+ i 500)))
+           (dotimes [i 200] (tree-map-put! tm (+ i 1000) (* (+ i 1000)
+                                                           (+ i 1000))))
+           (check tm)))
+
+  (test* #"tree-map-delete-range! small (~type)"
+         `(5 ,(append (make-alist 0 100) (make-alist 105 1000)))
+         (let* ([tm (build (make-alist 0 1000))]
+                [n (tree-map-delete-range! tm 100 105)])
+           (list n (check tm))))
+  (test* #"tree-map-delete-range! large (~type)"
+         `(800 ,(append (make-alist 0 100) (make-alist 900 1000)))
+         (let* ([tm (build (make-alist 0 1000))]
+                [n (tree-map-delete-range! tm 100 900)])
+           (list n (check tm))))
+  (test* #"tree-map-delete-range! outside (~type)"
+         `(0 0 ,(make-alist 0 10))
+         (let* ([tm (build (make-alist 0 10))]
+                [n1 (tree-map-delete-range! tm 20 30)]
+                [n2 (tree-map-delete-range! tm 5 5)])
+           (list n1 n2 (check tm))))
+
+  (test* #"tree-map-split! (~type)"
+         `(,(make-alist 0 300) ,(make-alist 300 1000))
+         (let* ([tm (build (make-alist 0 1000))]
+                [tm2 (tree-map-split! tm 300)])
+           (list (check tm) (check tm2))))
+  (test* #"tree-map-split! at edges (~type)"
+         `(() ,(make-alist 0 10) ())
+         (let* ([tm (build (make-alist 0 10))]
+                [tm2 (tree-map-split! tm 0)]
+                [tm3 (tree-map-split! tm2 100)])
+           (list (check tm) (check tm2) (check tm3))))
+  (test* #"tree-map-join! (~type)"
+         `(,(make-alist 0 1000) ())
+         (let* ([tm (build (make-alist 0 1000))]
+                [tm2 (tree-map-split! tm 456)])
+           (tree-map-join! tm tm2)
+           (list (check tm) (check tm2))))
+  (test* #"tree-map-join! overlap (~type)" (test-error)
+         (tree-map-join! (build (make-alist 0 10)) (build (make-alist 5 15))))
+  (test* #"tree-map-join! incompatible (~type)" (test-error)
+         (tree-map-join! (build (make-alist 0 10))
+                         (alist->tree-map (make-alist 10 20) = <)))
+  (test* #"tree-map-join! repeated append (~type)"
+         (make-alist 0 20000)
+         (let1 tm (build (make-alist 0 10000))
+           (do ([lo 10000 (+ lo 100)])
+               [(= lo 20000) (check tm)]
+             (tree-map-join! tm (build (make-alist lo (+ lo 100))))
+             (%tree-map-check-consistency tm))))
+  (test* #"tree-map-split!/join! repeated (~type)"
+         (map (^i (let1 k (modulo (* i 7919) 20001) (list k (- 20000 k))))
+              (iota 100))
+         (let1 tm (build (make-alist 0 20000))
+           (map (^i (let* ([tm2 (tree-map-split! tm (modulo (* i 7919) 20001))]
+                           [r (list (tree-map-num-entries tm)
+                                    (tree-map-num-entries tm2))])
+                      (%tree-map-check-consistency tm)
+                      (%tree-map-check-consistency tm2)
+                      (tree-map-join! tm tm2)
+                      (%tree-map-check-consistency tm)
+                      r))
+                (iota 100))))
+  (test* #"tree-map-split! into pieces and join! back (~type)"
+         (make-alist 0 20000)
+         (let* ([tm (build (make-alist 0 20000))]
+                [pieces (fold (^[k ps]
+                                (let1 p (tree-map-split! tm k)
+                                  (%tree-map-check-consistency tm)
+                                  (%tree-map-check-consistency p)
+                                  (cons p ps)))
+                              '() '(19990 19000 15000 5000 4990 1))])
+           ;; Joins small maps to large ones as well.
+           (check (fold (^[p acc]
+                          (tree-map-join! acc p)
+                          (%tree-map-check-consistency acc)
+                          acc)
+                        tm pieces))))
+
+  (test* #"tree-map-update-many! small (~type)"
+         '((0 . 1) (1 . 1) (2 . 5) (3 . 3))
+         (let1 tm (build '((0 . 0) (1 . 1) (2 . 2) (3 . 3)))
+           (dotimes [i 100] (tree-map-put! tm (+ i 100) i))
+           (tree-map-update-many! tm '(2 0 2 2) (cut + 1 <>))
+           (dotimes [i 100] (tree-map-delete! tm (+ i 100)))
+           (check tm)))
+  (test* #"tree-map-update-many! large (~type)"
+         (map (^k (cons k (if (even? k) (+ k 1) 1))) (iota 1000))
+         (let1 tm (build (map (^k (cons k k)) (iota 500 0 2)))
+           (tree-map-update-many! tm (reverse (iota 1000)) (cut + 1 <>) 0)
+           (check tm)))
+  (test* #"tree-map-update-many! no entry (~type)" '((0 . 0))
+         (let1 tm (build '((0 . 0)))
+           (guard (e [else (check tm)])
+             (tree-map-update-many! tm '(0 1) (cut + 1 <>)))))
+  (test* #"tree-map-update-many! error in proc (~type)" '((0 . 0) (1 . a))
+         (let1 tm (build '((0 . 0) (1 . a)))
+           (guard (e [else (check tm)])
+             (tree-map-update-many! tm '(0 1) (cut + 1 <>)))))
+  )
+
+(test-bulk 'rbtree)
+(test-bulk 'btree)
+
+(test-end)
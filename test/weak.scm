@@ -43,83 +43,144 @@
        (map (cut weak-vector-ref x <>) '(0 1 2 3 4)))
 
 
-; (test-section "weak hash table")
-
-; (define x (make-weak-hash-table 'eqv? 'value 'gone))
-
-; (test* "make-weak-hash-table (value-weak)" <weak-hash-table>
-;        (class-of x))
-
-; (test* "weak-hash-table-type" 'eqv? (weak-hash-table-type x))
-; (test* "weak-hash-table-weakness" 'value (weak-hash-table-weakness x))
-
-; (test* "weak-hash-table-get (nonexistent)" (test-error)
-;        (weak-hash-table-get x 123))
-; (test* "weak-hash-table-get (nonexistent)" 'foo
-;        (weak-hash-table-get x 123 'foo))
-
-; (test* "weak-hash-table-put!/get" '(1 2 3)
-;        (begin
-;          (weak-hash-table-put! x 123 (list 1 2 3))
-;          (weak-hash-table-get x 123)))
-; (test* "weak-hash-table-put!/get" '(4 5 6)
-;        (begin
-;          (weak-hash-table-put! x 456 (list 4 5 6))
-;          (weak-hash-table-get x 456)))
-
-; (clear-references)
-
-; (test* "weak-hash-table-get (after gc)" '(gone gone)
-;        (map (cut weak-hash-table-get x <>) '(123 456)))
-
-; (test* "weak-hash-table-keys & values" '((111 222 123 456)
-;                                          ((1 1 1) (2 2 2) gone gone))
-;        (let ((ones (list 1 1 1))
-;              (twos (list 2 2 2)))
-;          (weak-hash-table-put! x 111 ones)
-;          (weak-hash-table-put! x 222 twos)
-;          (list (weak-hash-table-keys x)
-;                (weak-hash-table-values x)))
-;        (lambda (expected got)
-;          (and (lset= equal? (car expected) (car got))
-;               (lset= equal? (cadr expected) (cadr got)))))
-         
-; (define x (make-weak-hash-table 'equal? 'key 'gone))
+(test-section "weak hash table")
+
+(define x (make-weak-hash-table 'eqv? 'value 'gone))
+
+(test* "make-weak-hash-table (value-weak)" <weak-hash-table>
+       (class-of x))
+
+(test* "weak-hash-table-type" 'eqv? (weak-hash-table-type x))
+(test* "weak-hash-table-weakness" 'value (weak-hash-table-weakness x))
+
+(test* "weak-hash-table-get (nonexistent)" (test-error)
+       (weak-hash-table-get x 123))
+(test* "weak-hash-table-get (nonexistent)" 'foo
+       (weak-hash-table-get x 123 'foo))
 
-; (test* "make-weak-hash-table (key-weak)" <weak-hash-table>
-;        (class-of x))
+(test* "weak-hash-table-put!/get" '(1 2 3)
+       (begin
+         (weak-hash-table-put! x 123 (list 1 2 3))
+         (weak-hash-table-get x 123)))
+(test* "weak-hash-table-put!/get" '(4 5 6)
+       (begin
+         (weak-hash-table-put! x 456 (list 4 5 6))
+         (weak-hash-table-get x 456)))
 
-; (test* "weak-hash-table-weakness" 'key (weak-hash-table-weakness x))
+(clear-references)
+
+(test* "weak-hash-table-get (after gc)" '(gone gone)
+       (map (cut weak-hash-table-get x <>) '(123 456)))
+
+(test* "weak-hash-table-keys & values" '((111 222 123 456)
+                                         ((1 1 1) (2 2 2) gone gone))
+       (let ((ones (list 1 1 1))
+             (twos (list 2 2 2)))
+         (weak-hash-table-put! x 111 ones)
+         (weak-hash-table-put! x 222 twos)
+         (list (weak-hash-table-keys x)
+               (weak-hash-table-values x)))
+       (lambda (expected got)
+         (and (lset= equal? (car expected) (car got))
+              (lset= equal? (cadr expected) (cadr got)))))
+         
+(define x (make-weak-hash-table 'equal? 'key 'gone))
 
-; (test* "weak-hash-table-get (nonexistent)" (test-error)
-;        (weak-hash-table-get x (list 1 2 3)))
-; (test* "weak-hash-table-get (nonexistent)" 'foo
-;        (weak-hash-table-get x (list 1 2 3) 'foo))
+(test* "make-weak-hash-table (key-weak)" <weak-hash-table>
+       (class-of x))
 
+(test* "weak-hash-table-weakness" 'key (weak-hash-table-weakness x))
 
-; (define y (list 7 8 9))
+(test* "weak-hash-table-get (nonexistent)" (test-error)
+       (weak-hash-table-get x (list 1 2 3)))
+(test* "weak-hash-table-get (nonexistent)" 'foo
+       (weak-hash-table-get x (list 1 2 3) 'foo))
 
-; (test* "weak-hash-table-put!/get" 123
-;        (begin
-;          (weak-hash-table-put! x (list 1 2 3) 123)
-;          (weak-hash-table-get x '(1 2 3) 'huh?)))
-; (test* "weak-hash-table-put!/get" 456
-;        (begin
-;          (weak-hash-table-put! x (list 4 5 6) 456)
-;          (weak-hash-table-get x '(4 5 6) 'huh?)))
-; (test* "weak-hash-table-put!/get" 789
-;        (begin
-;          (weak-hash-table-put! x y 789)
-;          (weak-hash-table-get x '(7 8 9) 'huh?)))
 
-; (clear-references)
+(define y (list 7 8 9))
 
-; (test* "weak-hash-table-get (after gc)" '(foo foo 789)
-;        (map (cut weak-hash-table-get x <> 'foo) '((1 2 3) (4 5 6) (7 8 9))))
+(test* "weak-hash-table-put!/get" 123
+       (begin
+         (weak-hash-table-put! x (list 1 2 3) 123)
+         (weak-hash-table-get x '(1 2 3) 'huh?)))
+(test* "weak-hash-table-put!/get" 456
+       (begin
+         (weak-hash-table-put! x (list 4 5 6) 456)
+         (weak-hash-table-get x '(4 5 6) 'huh?)))
+(test* "weak-hash-table-put!/get" 789
+       (begin
+         (weak-hash-table-put! x y 789)
+         (weak-hash-table-get x '(7 8 9) 'huh?)))
+
+(clear-references)
 
-; (test* "weak-hash-table-keys&values" '(((7 8 9)) (789))
-;        (list (weak-hash-table-keys x)
-;              (weak-hash-table-values x)))
+(test* "weak-hash-table-get (after gc)" '(foo foo 789)
+       (map (cut weak-hash-table-get x <> 'foo) '((1 2 3) (4 5 6) (7 8 9))))
+
+(test* "weak-hash-table-keys&values" '(((7 8 9)) (789))
+       (list (weak-hash-table-keys x)
+             (weak-hash-table-values x)))
+
+;; Ephemeron semantics: a value that refers to its own key doesn't
+;; keep the entry alive, while a live key keeps its value alive.
+(define (ephemeron-test-fill! tab wv live-key)
+  (let1 k (list 'dead)
+    (weak-hash-table-put! tab k (list 'value k))
+    (weak-vector-set! wv 0 (weak-hash-table-get tab k)))
+  (weak-hash-table-put! tab live-key (list 'value live-key))
+  (weak-vector-set! wv 1 (weak-hash-table-get tab live-key)))
+
+(let ([tab (make-weak-hash-table 'eq?)]
+      [wv  (make-weak-vector 2)]
+      [live-key (list 'live)])
+  (ephemeron-test-fill! tab wv live-key)
+  (clear-references)
+  (test* "ephemeron (value refers to dead key)" #f
+         (weak-vector-ref wv 0))
+  (test* "ephemeron (value of live key)" `(value ,live-key)
+         (weak-vector-ref wv 1))
+  (test* "ephemeron (keys)" `(,live-key)
+         (weak-hash-table-keys tab)))
+
+(test-section "weak hash table cleanup")
+
+;; Entries whose keys are gone are removed a little by little by
+;; modifying operations.
+(define (cleanup-test-fill! tab n)
+  (dotimes [i n] (weak-hash-table-put! tab (list i) i)))
+
+(let1 tab (make-weak-hash-table 'eq?)
+  (cleanup-test-fill! tab 1000)
+  (clear-references)
+  (dotimes [i 2000]
+    (weak-hash-table-put! tab i i)
+    (weak-hash-table-delete! tab i))
+  (test* "stale entries swept" #t
+         (< (weak-hash-table-num-entries tab) 100)))
+
+(test-section "weak hash table as dictionary")
+
+(use gauche.dictionary)
+
+(let ([tab (make-weak-hash-table 'equal? 'value)]
+      [a (list 'a)]
+      [b (list 'b)])
+  (dict-put! tab "a" a)
+  (dict-put! tab "b" b)
+  (test* "dict-get" a (dict-get tab "a"))
+  (test* "dict-get (fallback)" 'none (dict-get tab "c" 'none))
+  (test* "dict-exists?" '(#t #f) (list (dict-exists? tab "b")
+                                       (dict-exists? tab "c")))
+  (test* "dict->alist" `(("a" . ,a) ("b" . ,b))
+         (sort (dict->alist tab) (^[x y] (string<? (car x) (car y)))))
+  (test* "dict-delete!" '(#f ("b"))
+         (begin (dict-delete! tab "a")
+                (list (dict-exists? tab "a") (dict-keys tab))))
+  (test* "weak-hash-table-copy" '(("b") ("b" "c"))
+         (let1 tab2 (weak-hash-table-copy tab)
+           (weak-hash-table-put! tab2 "c" b)
+           (list (dict-keys tab)
+                 (sort (dict-keys tab2))))))
 
 (test-end)
 